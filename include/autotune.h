@@ -0,0 +1,83 @@
+/******************************************************************************
+ * Per-machine autotuning of solve_spectrum(). The fastest way to get every
+ * eigenvalue and k eigenvectors depends on n, k, the machine and the backends
+ * compiled in: a full solve costs the same for any k, eigenvalues by slicing
+ * plus inverse iteration for just the k vectors grows with k, and slicing may
+ * or may not gain from more threads at a given size. A rank-one update of a
+ * full solve is timed too, for solve_spectrum_update() to weigh against the
+ * plan.
+ *
+ * Calibration times each of these on a few grid sizes. Predictions
+ * interpolate the times between those sizes as power laws of n and
+ * extrapolate beyond them with the nearest one. The measurements are saved
+ * as a small text file in the spectrum store directory and reused until the
+ * CPU count or the backends compiled in change.
+******************************************************************************/
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <stdio.h>
+#include "solver.h"
+
+// Grid sizes timed by calibration
+#define TUNE_SIZES 4
+#define TUNE_MAX_BACKENDS 4
+#define TUNE_MAX_PARTIAL 32
+
+extern const int tune_sizes[TUNE_SIZES];
+
+// Seconds of one solve at each of tune_sizes
+typedef struct TuneFull
+{
+    const SolverBackend *backend;
+    double seconds[TUNE_SIZES];
+} TuneFull;
+
+typedef struct TunePartial
+{
+    const SolverBackend *backend;
+    int threads;
+    double values[TUNE_SIZES]; // every eigenvalue
+    double vector[TUNE_SIZES]; // each eigenvector on top of that
+} TunePartial;
+
+typedef struct TuneProfile
+{
+    int cpus;
+    int num_full;
+    TuneFull full[TUNE_MAX_BACKENDS];
+    int num_partial;
+    TunePartial partial[TUNE_MAX_PARTIAL];
+    double update[TUNE_SIZES]; // one rank-one update of a full solve (see rankupdate.h)
+} TuneProfile;
+
+// Times every backend and thread count on this machine. Takes a second or
+// two. Writes a line per measurement to log unless it is NULL.
+TuneProfile *autotune_calibrate(FILE *log);
+
+// Returns NULL if the file is missing, unreadable or stale
+TuneProfile *autotune_load(const char *path);
+
+// Returns 0 if the file can't be written
+int autotune_save(const TuneProfile *profile, const char *path);
+
+// Sets plan to the predicted fastest way to solve for n and k, with its
+// predictions filled in, and returns its predicted time in seconds
+double autotune_predict(const TuneProfile *profile, int n, int k, SolvePlan *plan);
+
+// Makes solve_spectrum() follow the predictions of profile. NULL goes back to
+// full solves on solver_backend(). The profile must outlive its use.
+void autotune_install(const TuneProfile *profile);
+
+// SolvePlanner that autotune_install() sets up
+void autotune_plan(int n, int k, SolvePlan *plan);
+
+// Loads the profile saved for this machine, calibrating and saving one first
+// if there is none or recalibrate is set, and installs it. If it can't be
+// saved, the next run calibrates again.
+TuneProfile *autotune_startup(int recalibrate, FILE *log);
+
+// Measured times and the plans predicted for a few typical requests
+void autotune_report(const TuneProfile *profile, FILE *out);
+
+#endif
@@ -0,0 +1,72 @@
+/******************************************************************************
+ * Continuation of eigenstates while a parameter of the potential is varied.
+ *
+ * Between close steps, the states of the last step are good predictors of
+ * the new ones. Each is refined by Rayleigh quotient iteration with the new
+ * Hamiltonian: a shifted tridiagonal solve per iteration, O(n), converging
+ * cubically in two or three. A Sturm count then confirms the state index
+ * each one reached, and a cold solve is left to take over otherwise.
+ *
+ * Independently of how a step was solved, a LevelTracker matches its states
+ * to those of the step before by overlap |<psi_a|psi_b>|, so a level keeps
+ * its label, and its color, through avoided crossings where the ordering
+ * by energy swaps, and records E(parameter) of every label for plotting.
+******************************************************************************/
+#ifndef CONTINUATION_H
+#define CONTINUATION_H
+
+#include "solver.h"
+#include "workspace.h"
+
+// Steps of E(parameter) a LevelTracker keeps, oldest dropped first
+#define TRACK_HISTORY 512
+
+// Least overlap for a state to continue a level of the step before. Smaller
+// ones start a new level.
+#define TRACK_MIN_OVERLAP 0.3
+
+// Refines the k unit vectors m long at vectors + j*m, predictors of states
+// first..first+k-1 of the tridiagonal matrix (d, e), into its eigenvectors
+// in place, with the eigenvalues to w. Vectors keep the sign of their
+// predictors. Progress counts states through ctl (optional). Returns 1 when
+// done, 0 if cancelled and -1 if a predictor led to another state than its
+// own, in which case w and vectors are left in an unspecified state. Scratch
+// comes from arena (optional, see workspace.h).
+int continue_eigenpairs(const double *d, const double *e, int m, int first, int k, double *w, double *vectors,
+    SolveControl *ctl, Arena *arena);
+
+typedef struct LevelTracker
+{
+    int n;
+    int first; // state window of the last step, k = 0 before the first one
+    int k;
+    double *vectors; // k unit vectors of the last step, n-1 long each
+    int *labels; // level label of each state of the last step, k entries
+    int next_label; // first label not used yet
+    double *overlaps; // workspace, k x k
+    int *matched; // workspace, k
+    // E(parameter), TRACK_HISTORY steps in a ring starting at oldest
+    double *parameters;
+    double *energies; // k per step, by state index
+    int *history_labels; // k per step, the labels of those energies
+    int steps; // held in the ring
+    int oldest;
+} LevelTracker;
+
+LevelTracker *init_tracker(int n);
+
+void free_tracker(LevelTracker *tracker);
+
+// Forgets every level, e.g. when the potential changed by other means
+void tracker_reset(LevelTracker *tracker);
+
+// Labels the displayed states of epkg, which needs their eigenvectors, by
+// overlap with those of the last step, and records their energies at
+// parameter. A different window of states starts over.
+void track_levels(LevelTracker *tracker, const EigenPackage *epkg, double parameter);
+
+// Ring slot of the s-th oldest step held, for s < tracker->steps. Its
+// energies and labels start at k * slot.
+int tracker_slot(const LevelTracker *tracker, int s);
+
+#endif
@@ -0,0 +1,38 @@
+/******************************************************************************
+ * Streaming export of eigenvectors for grids too large to hold many of them.
+ * The energies of the wanted states come from spectrum slicing, then each
+ * vector is found on its own by inverse iteration and written to the output
+ * file as soon as it is done, so memory stays at a few vectors however many
+ * states are exported.
+ *
+ * The file is a header followed by the count energies and then count
+ * vectors of the n-1 interior values, each at a fixed offset. The header
+ * records how many vectors are safely on disk, and is only written once
+ * the data it vouches for is synced. An interrupted export picks up from
+ * there when it is run again with the same potential and states, and one
+ * interrupted before its first header starts over.
+******************************************************************************/
+#ifndef EIGENEXPORT_H
+#define EIGENEXPORT_H
+
+#include "raylib.h"
+#include "solver.h"
+
+// Earlier vectors each new one is kept orthogonal to
+#define EXPORT_HISTORY 16
+
+// Bytes written between checkpoints, each of which syncs the file
+#define EXPORT_CHECKPOINT_BYTES ((size_t) 64 << 20)
+
+// Streams the unit eigenvectors of states first..first+count-1 to path,
+// resuming an earlier export of the same states there. Progress counts
+// vectors on disk through ctl (optional), and cancelling checkpoints and
+// stops. Returns how many vectors are on disk, which is count when finished,
+// or -1 on I/O errors or if path holds an export of something else.
+int export_eigenvectors(const char *path, Vector2 *potential, int n, int first, int count, SolveControl *ctl);
+
+// Reads back the energy and vector of the i-th exported state, counting
+// from first. Returns 0 if the file is unreadable or it is not written yet.
+int read_exported_vector(const char *path, int i, double *energy, double *vector);
+
+#endif
@@ -0,0 +1,46 @@
+/******************************************************************************
+ * User-typed potentials. An expression such as
+ *
+ *     a*exp(-(x-c)^2/w) + if(x < 0.3, 0.5, 0) ; a = 0.8 ; c = 0.5 ; w = 0.01
+ *
+ * is compiled once to a compact stack bytecode and then evaluated a whole
+ * block of grid points per instruction, so the inner loops are plain array
+ * arithmetic the compiler vectorizes.
+ *
+ * Syntax: numbers, `x`, `pi`, + - * / ^, comparisons (< > <= >= == !=, which
+ * give 1 or 0), parentheses, the functions exp log sqrt abs sin cos tan tanh
+ * min max and if(cond, then, else). Any other name is a parameter. Parameters
+ * default to 1 and can be given values after the expression with `; name = v`.
+******************************************************************************/
+#ifndef EXPR_H
+#define EXPR_H
+
+#include <stddef.h>
+#include "raylib.h"
+
+typedef struct Expr Expr;
+
+// Returns NULL on a syntax error and writes a message to err
+Expr *expr_compile(const char *src, char *err, int errlen);
+
+void expr_free(Expr *expr);
+
+int expr_num_params(const Expr *expr);
+
+const char *expr_param_name(const Expr *expr, int i);
+
+double expr_get_param(const Expr *expr, int i);
+
+void expr_set_param(Expr *expr, int i, double value);
+
+// Index of the named parameter, or -1
+int expr_find_param(const Expr *expr, const char *name);
+
+// out[i] = V(x[i]) for i < n. Safe to call from several threads at once
+void expr_eval(const Expr *expr, const double *x, double *out, size_t n);
+
+// Re-evaluates the potential in place: points[i] = (domain[i], V(domain[i]))
+// for the n+1 points of a grid
+void expr_apply(const Expr *expr, double *domain, Vector2 *points, int n);
+
+#endif
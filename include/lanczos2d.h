@@ -0,0 +1,55 @@
+/******************************************************************************
+ * 2D solver. The unit square is split into n intervals per side and the
+ * wavefunction vanishes on the boundary, so the (n-1)^2 interior points are
+ * the unknowns. The Hamiltonian is the 5-point stencil
+ *
+ *     H psi = -(1/2) laplacian(psi) + POTENTIAL_SCALE * V psi
+ *
+ * in the same units as the 1D solver. It is never stored: the lowest k states
+ * come from a thick-restart Lanczos iteration that only applies the stencil,
+ * with the vector work split across threads.
+ *
+ * Potentials are (n+1)*(n+1) row-major grids that include the boundary, so
+ * value [i*(n+1) + j] sits at (x, y) = (j/n, i/n).
+******************************************************************************/
+#ifndef LANCZOS2D_H
+#define LANCZOS2D_H
+
+#include "solver.h"
+
+typedef struct Spectrum2D
+{
+    int n; // intervals per side
+    int k; // number of states
+    double *evalues; // k, ascending
+    double *evectors; // k vectors of (n-1)^2 unit-norm interior values
+    int solved; // evectors hold a finished solve, usable as a warm start
+    double *potential; // the potential that solve was for
+    double cut; // estimate of the energy just above the solved states
+    int iterations; // stencil applications of the last solve on this grid
+    int restarts;
+} Spectrum2D;
+
+Spectrum2D *init_spectrum2d(int n, int k);
+
+void free_spectrum2d(Spectrum2D *spec);
+
+// out = H in over the interior points
+void apply_hamiltonian2d(const double *potential, int n, const double *in, double *out);
+
+// Lowest spec->k states of the potential. When spec already holds a solve
+// its vectors seed the iteration, so small edits to the potential converge
+// in a fraction of the work. Otherwise grids of 128 intervals and up are
+// seeded from the states of a grid half as fine. Progress counts converged states. Returns 1 when
+// done and 0 if cancelled, in which case spec is left as it was.
+int solve_spectrum2d(const double *potential, Spectrum2D *spec, SolveControl *ctl);
+
+// Bilinear interpolation of a full (from_n+1)^2 grid onto a (to_n+1)^2 grid
+// over the same square
+void resample2d(const double *from, int from_n, double *to, int to_n);
+
+// |psi|^2 of state `state` on the full (n+1)^2 grid, zero on the boundary,
+// normalized so it sums to 1 over the grid
+void density2d(const Spectrum2D *spec, int state, double *out);
+
+#endif
@@ -0,0 +1,105 @@
+/******************************************************************************
+ * LiveSolver owns a background thread that re-solves the spectrum whenever a
+ * new potential is requested. Results are double buffered: the solver thread
+ * writes into `back` and swaps it with `front` once a solve completes, so the
+ * GUI always has a finished EigenPackage to draw. A newer request cancels the
+ * solve that is in flight.
+ *
+ * Meanwhile each request gets an instant first-order preview (see perturb.h)
+ * built from the states in front, for the GUI to draw until the solve of
+ * that request is published.
+ *
+ * With continuation on, each request is first continued from the states in
+ * front (see continuation.h), which is O(nk) when the potential moved a
+ * little, and only solved afresh when that fails.
+******************************************************************************/
+#ifndef LIVESOLVER_H
+#define LIVESOLVER_H
+
+#include <pthread.h>
+#include "raylib.h"
+#include "solver.h"
+#include "spectrumcache.h"
+#include "spectrumstore.h"
+
+// Memory budget of the spectrum cache used by the solver thread
+#define LIVE_CACHE_BYTES ((size_t) 64 << 20)
+
+// Rank-one updates chained onto one full solve before solving afresh, so
+// rounding errors don't pile up over a long painting session
+#define LIVE_MAX_UPDATES 32
+
+typedef struct LiveSolver
+{
+    pthread_t thread;
+    pthread_mutex_t lock; // guards everything below, including reading front
+    pthread_cond_t wake;
+
+    EigenPackage *front; // last published solve. Only read while holding lock
+    EigenPackage *back; // workspace of the solver thread
+    EigenPackage *preview; // first-order estimate of the newest request, written by the requesting thread
+    unsigned long preview_of; // request the preview is for, 0 if there is none
+    EigenPackage *preview_from; // copy of front the preview is worked out from
+    Vector2 *preview_before; // copy of front_potential to go with it
+
+    Vector2 *request_potential; // snapshot of the newest request
+    Vector2 *work_potential; // copy the solver thread is working on
+    Vector2 *front_potential; // potential of the solve in front
+    int front_updates; // updates front is away from a full solve, -1 if it can't be updated
+    int n;
+    int request_k;
+    int request_first; // lowest state index of the request, 0 for the ground state
+    int continuation; // continue requests from front before solving them afresh
+
+    unsigned long requested; // number of requests made
+    unsigned long published; // request number currently held in front
+    int pending; // a request is waiting to be picked up
+    int busy; // the solver thread is inside solve_spectrum()
+    int quit;
+    double requested_at; // monotonic time of the newest request
+    double started; // monotonic time the current solve began, in seconds
+    double last_solve_seconds; // duration of the last published solve
+    int last_from_cache; // 1 if the last publish came from cache, 2 from store
+    int last_continued; // 1 if the last publish was continued from the one before
+
+    SpectrumCache *cache; // spectra of recently solved potentials
+    SpectrumStore *store; // spectra shared across runs. NULL if unavailable
+
+    SolveControl control;
+} LiveSolver;
+
+// Starts the solver thread. Runs once during initialization
+LiveSolver *init_livesolver(int n, int k, double *domain);
+
+// Queues a solve of `potential` (copied, n+1 points) for k eigenfunctions.
+// Any solve already running for an older request is cancelled. Requests,
+// and so the previews they make, belong to one thread, such as the GUI.
+void livesolver_request(LiveSolver *solver, Vector2 *potential, int k);
+
+// Like livesolver_request() for states first..first+k-1 only. Any first > 0
+// goes through solve_spectrum_window() and skips the cache and store, which
+// hold whole spectra.
+void livesolver_request_window(LiveSolver *solver, Vector2 *potential, int first, int k);
+
+// Turns continuation of later requests from the published states on or off
+void livesolver_set_continuation(LiveSolver *solver, int on);
+
+// The preview to draw instead of front, or NULL once the solve it stands in
+// for was published. Only call and use while holding solver->lock.
+EigenPackage *livesolver_preview(LiveSolver *solver);
+
+// Returns non-zero while a request is queued or being solved
+int livesolver_busy(LiveSolver *solver);
+
+// Request number of the solve currently in front, so callers can tell when
+// a new one was published
+unsigned long livesolver_published(LiveSolver *solver);
+
+// Fraction in [0, 1] of the running solve that is done. Writes a linear
+// estimate of the remaining seconds to eta, or -1 when there is none yet.
+double livesolver_progress(LiveSolver *solver, double *eta);
+
+// Stops the thread and frees both packages
+void free_livesolver(LiveSolver *solver);
+
+#endif
@@ -0,0 +1,67 @@
+/******************************************************************************
+ * LiveThermal keeps the thermal density (see thermal.h) of the potential
+ * being painted on its own thread, so the draw loop never waits on the
+ * eigenvalue and eigenvector solves behind it. Results are double buffered
+ * like LiveSolver: the thread sums rho into `back` and swaps it with `front`
+ * once an update completes, so the GUI always has a finished density to
+ * draw.
+ *
+ * A request for a new potential cancels the update in flight, whose solves
+ * are of no use for it. A request for a new temperature only waits its
+ * turn: the update in flight may be solving the very states it needs.
+******************************************************************************/
+#ifndef LIVETHERMAL_H
+#define LIVETHERMAL_H
+
+#include <pthread.h>
+#include "raylib.h"
+#include "solver.h"
+#include "thermal.h"
+
+typedef struct LiveThermal
+{
+    pthread_t thread;
+    pthread_mutex_t lock; // guards everything below, including reading front
+    pthread_cond_t wake;
+
+    ThermalDensity *thermal; // workspace of the thread
+    Vector2 *front; // n+1 points of the last published rho. Only read while holding lock
+    Vector2 *back; // rho of the update being published next
+    double kT; // of front, -1 before the first publish
+    int used; // states summed into front
+    double tail; // share of the weight left out of front
+
+    Vector2 *request_potential; // snapshot of the newest request
+    Vector2 *work_potential; // copy the thread is working on
+    double request_kT;
+    double tolerance;
+    int n;
+
+    unsigned long requested; // number of requests made
+    unsigned long published; // request number currently held in front
+    int pending; // a request is waiting to be picked up
+    int busy; // the thread is inside thermal_update()
+    int quit;
+
+    SolveControl control;
+} LiveThermal;
+
+// Starts the thread. Runs the first time thermal mode is turned on
+LiveThermal *init_livethermal(int n, double *domain, double tolerance);
+
+// Queues an update of rho for `potential` (copied, n+1 points) at kT. Does
+// nothing if it is the newest request already, so it can be called every
+// frame.
+void livethermal_request(LiveThermal *thermal, Vector2 *potential, double kT);
+
+// Returns non-zero while a request is queued or being worked on
+int livethermal_busy(LiveThermal *thermal);
+
+// Request number of the rho currently in front, so callers can tell when a
+// new one was published
+unsigned long livethermal_published(LiveThermal *thermal);
+
+// Stops the thread and frees everything
+void free_livethermal(LiveThermal *thermal);
+
+#endif
@@ -0,0 +1,86 @@
+/******************************************************************************
+ * 2D mode. The potential is an (n+1)*(n+1) grid over the unit square that is
+ * painted with the mouse, and |psi|^2 of one of its lowest states is drawn as
+ * a heatmap beside it.
+ *
+ * Solving works like LiveSolver: a background thread runs
+ * solve_spectrum2d() on a snapshot of the newest request, a newer request
+ * cancels the solve in flight, and finished results are double buffered so
+ * the GUI only ever reads a complete one. Each solve is warm started from
+ * the previous result, which is what makes repainting cheap. The first solve
+ * has nothing to start from and is seeded from coarser grids instead, which
+ * still takes seconds at 512x512, so the grid starts at MODE2D_N and goes
+ * to MODE2D_FINE_N on demand.
+******************************************************************************/
+#ifndef MODE2D_H
+#define MODE2D_H
+
+#include <pthread.h>
+#include "raylib.h"
+#include "solver.h"
+#include "lanczos2d.h"
+
+#define MODE2D_N 128
+#define MODE2D_FINE_N 512
+#define MODE2D_K 10
+
+typedef struct Mode2D
+{
+    int n;
+    int k;
+    double *potential; // what the user paints, (n+1)^2
+    int state; // state drawn in the heatmap
+    unsigned char dirty; // painted since the last request
+    double last_stroke_time;
+    double last_request_time;
+
+    Texture2D potential_texture;
+    Texture2D density_texture;
+    Color *pixels; // (n+1)^2 upload buffer
+    double *density; // (n+1)^2 workspace
+    unsigned char potential_stale; // potential_texture needs an upload
+    unsigned long drawn; // published request shown in density_texture
+    int drawn_state;
+
+    // Solver thread, guarded by lock
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    double *request; // snapshot of the newest request
+    Spectrum2D *front; // last published solve. Only read while holding lock
+    Spectrum2D *back; // workspace of the solver thread, and its warm start
+    unsigned long requested;
+    unsigned long published;
+    int pending;
+    int busy;
+    int quit;
+    double last_solve_seconds;
+    SolveControl control;
+} Mode2D;
+
+// Starts the solver thread on a harmonic well and queues its first solve.
+// Needs the window, for the textures.
+Mode2D *init_mode2d(int n, int k);
+
+void free_mode2d(Mode2D *mode);
+
+// Replaces mode with one on an n*n grid holding the painted potential
+// resampled onto it, and queues its solve. mode is freed.
+Mode2D *regrid_mode2d(Mode2D *mode, int n);
+
+// Queues a solve of the current potential, cancelling any older one
+void mode2d_request(Mode2D *mode);
+
+// Adds amount * exp(-r^2 / radius^2) around (x, y) in unit-square coordinates
+void mode2d_paint(Mode2D *mode, double x, double y, double radius, double amount);
+
+// Mouse and keyboard handling for one frame
+void update_mode2d(Mode2D *mode);
+
+void draw_mode2d(Mode2D *mode);
+
+// 1 when the next frame would look like the last one: nothing painted is
+// waiting to be solved, no solve is running and the newest result is drawn
+int mode2d_settled(Mode2D *mode);
+
+#endif
@@ -0,0 +1,40 @@
+/******************************************************************************
+ * Eigenvectors of a symmetric tridiagonal matrix by Multiple Relatively
+ * Robust Representations (Dhillon and Parlett). Each vector comes from one
+ * twisted factorization, at the cost of O(n), and is orthogonal to the others
+ * to working precision without any Gram-Schmidt:
+ *
+ *   - T - sigma I = LDL^T with sigma just below the spectrum is positive
+ *     definite, so its factors determine every eigenvalue to high relative
+ *     accuracy. Eigenvalues are refined against LDL^T by bisection on its
+ *     own negative pivot counts, far enough to tell clusters apart.
+ *   - An eigenvalue whose gap to its neighbours is large relative to its
+ *     distance from sigma gets its vector straight from a twisted
+ *     factorization of LDL^T - lambda I, with lambda polished by Rayleigh
+ *     quotient iteration on the same factorization.
+ *   - Eigenvalues clustered closer than that get a new representation
+ *     L'D'L'^T = LDL^T - sigma' I with sigma' at the edge of the cluster.
+ *     Against it their relative gaps are large, and the same steps repeat.
+ *
+ * Groups separated at the top are independent, so they are split across
+ * threads. Clusters too tight to split within a few levels, which only
+ * happen for gaps near the rounding of the matrix, fall back to inverse
+ * iteration orthogonalized within the cluster.
+ *
+ * Matrices use the tqli() layout described in tridiag.h.
+******************************************************************************/
+#ifndef MRRR_H
+#define MRRR_H
+
+#include "solver.h"
+#include "workspace.h"
+
+// Eigenpairs il..iu (0-based, ascending, inclusive): values to w and unit
+// vectors n long at vectors + (j-il)*n. threads <= 0 uses every online CPU.
+// Progress counts finished vectors through ctl (optional); returns 0 if
+// cancelled. Costs O(n) per eigenpair. Scratch comes from work (optional,
+// see workspace.h).
+int mrrr_eigenpairs(const double *d, const double *e, int n, int il, int iu, double *w, double *vectors,
+    int threads, SolveControl *ctl, Workspace *work);
+
+#endif
@@ -0,0 +1,67 @@
+/******************************************************************************
+ * Optional hardware performance counters for the stages of a solve and for
+ * the render pass. On Linux, perf_event_open() counts cycles, instructions,
+ * cache misses and branch misses of the calling thread in user space. A
+ * counter the kernel or the hardware refuses (perf_event_paranoid, virtual
+ * machines, other systems) is reported as unavailable and the rest still
+ * work, down to wall-clock time alone.
+ *
+ * A PerfProfile accumulates per stage. Code that takes one treats NULL as
+ * "not profiling", like an optional SolveControl.
+******************************************************************************/
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <stdio.h>
+
+typedef enum PerfStage
+{
+    STAGE_ASSEMBLE, // filling the tridiagonal Hamiltonian
+    STAGE_IDENTITY, // resetting z to the identity
+    STAGE_TQLI, // QL iterations with eigenvectors, or the whole solve of another backend
+    STAGE_SORT, // sorting eigenpairs, or reordering those of another backend
+    STAGE_OBSERVABLES, // normalized |psi|^2 and observables of the displayed states
+    STAGE_EIGENVALUES, // eigenvalues-only solves
+    STAGE_VECTORS, // eigenvectors of the wanted states only
+    STAGE_UPDATE, // rank-one updates of the previous solve
+    STAGE_RENDER, // one frame of the GUI
+    STAGE_COUNT
+} PerfStage;
+
+typedef enum PerfEvent
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_EVENTS
+} PerfEvent;
+
+typedef struct PerfProfile
+{
+    int fds[PERF_EVENTS]; // -1 where the counter is unavailable
+    double value[PERF_EVENTS]; // readings at the last perf_begin()
+    double started;
+    double counts[STAGE_COUNT][PERF_EVENTS];
+    double seconds[STAGE_COUNT];
+    long runs[STAGE_COUNT];
+} PerfProfile;
+
+// Opens whichever counters are available for the calling thread. Only that
+// thread may use the profile.
+PerfProfile *init_perfprofile();
+
+void free_perfprofile(PerfProfile *profile);
+
+// Non-zero if the counter could be opened
+int perf_available(const PerfProfile *profile, PerfEvent event);
+
+// Brackets one run of a stage. Stages don't nest.
+void perf_begin(PerfProfile *profile);
+void perf_end(PerfProfile *profile, PerfStage stage);
+
+// Table of the stages that ran: time, IPC and misses per grid point, with
+// points the size of the grid they ran on
+void perf_report(const PerfProfile *profile, FILE *out, long points);
+
+#endif
@@ -0,0 +1,35 @@
+/******************************************************************************
+ * First-order perturbation theory for a change dV of the potential, from a
+ * solve of the old one. Used to show a preview the moment a new solve is
+ * queued, until the solve itself is published.
+ *
+ * For each solved state psi_j with energy E_j of the old Hamiltonian H:
+ *
+ *   - the energy shifts by <psi_j|dV|psi_j>
+ *   - the state gains psi_j' = -(H - E_j)^+ (dV - <psi_j|dV|psi_j>) psi_j,
+ *     the reduced resolvent applied to the perturbation. That is one
+ *     tridiagonal solve at E_j with psi_j projected out afterwards, so the
+ *     sum over all the other states of the textbook formula comes for O(n)
+ *     instead of needing every eigenvector.
+ *
+ * First order breaks down between states closer than the coupling dV gives
+ * them, such as the doublets of a double well, so each correction is capped
+ * at PERTURB_MAX_CORRECTION times the norm of the state.
+******************************************************************************/
+#ifndef PERTURB_H
+#define PERTURB_H
+
+#include "solver.h"
+
+#define PERTURB_MAX_CORRECTION 0.5
+
+// Fills preview like solve_spectrum() would for the potential `after`, from
+// the states of from, a solve of `before` (both n+1 points): the energies of
+// the displayed states to evalues, with first and num_evalues as in from,
+// and their densities to efunctions. Leaves preview without eigenvectors
+// (z_columns = 0). Scratch comes from the workspace of preview, so repeated
+// previews at one size stay off the heap. Returns 0, doing nothing, if from
+// holds no eigenvectors of its displayed states.
+int perturb_preview(const EigenPackage *from, Vector2 *before, Vector2 *after, int n, EigenPackage *preview);
+
+#endif
@@ -0,0 +1,92 @@
+/******************************************************************************
+ * Native potential plugins. A plugin is a shared object that exports a
+ * PotentialPlugin descriptor named `potential_plugin`:
+ *
+ *     #include "plugin.h"
+ *
+ *     static void eval(const double *x, double *out, size_t n, const double *p)
+ *     { ... out[i] = V(x[i]) using p[0], p[1], ... }
+ *
+ *     const PotentialPlugin potential_plugin = {
+ *         .abi = POTENTIAL_PLUGIN_ABI, .name = "my well", .eval = eval,
+ *         .num_params = 1, .params = {{"depth", 0.5, 0.0, 2.0}},
+ *     };
+ *
+ * and is built with `cc -shared -fPIC -Iinclude -Ilib/raylib/src`. The loader
+ * dlopen()s a private copy of the file, so the original can be rebuilt while
+ * it is loaded; reload_plugin_if_changed() picks the new build up.
+******************************************************************************/
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+#include <time.h>
+#include "potential.h"
+
+// Bumped whenever PotentialPlugin changes layout
+#define POTENTIAL_PLUGIN_ABI 1
+#define PLUGIN_MAX_PARAMS 8
+#define PLUGIN_PATH_LEN 512
+// Room for the messages written by load_plugin() and reload_plugin_if_changed()
+#define PLUGIN_ERROR_LEN 128
+
+typedef struct PluginParam
+{
+    const char *name;
+    double value; // default
+    double min;
+    double max;
+} PluginParam;
+
+typedef struct PotentialPlugin
+{
+    int abi;
+    const char *name;
+    PotentialBatchFn eval; // called with the current parameter values
+    int num_params;
+    PluginParam params[PLUGIN_MAX_PARAMS];
+} PotentialPlugin;
+
+// What a build of the plugin file looked like, to notice rebuilds
+typedef struct PluginFile
+{
+    struct timespec mtime;
+    long long size;
+    unsigned long long inode;
+} PluginFile;
+
+typedef struct Plugin
+{
+    char path[PLUGIN_PATH_LEN];
+    void *handle;
+    const PotentialPlugin *desc;
+    double params[PLUGIN_MAX_PARAMS];
+    int generation; // bumped by every successful reload
+
+    PluginFile loaded; // the build last tried
+    PluginFile seen; // the file at the previous poll
+} Plugin;
+
+// Returns NULL and writes a message to err if the file can't be loaded or
+// doesn't export a valid descriptor
+Plugin *load_plugin(const char *path, char *err, int errlen);
+
+void free_plugin(Plugin *plugin);
+
+// Reloads the plugin once its file has changed since the last attempt and
+// then stayed the same for one call, so a build still being written is not
+// picked up half way. Parameters keep their values when the new build still
+// has them. Returns 1 after a
+// reload, 0 if nothing changed and -1 if the new build failed to load, in
+// which case the old one stays in use and err says why.
+int reload_plugin_if_changed(Plugin *plugin, char *err, int errlen);
+
+// Index of the named parameter, or -1
+int plugin_find_param(const Plugin *plugin, const char *name);
+
+// Sets a parameter, clamped to the range the plugin declares (if min < max)
+void plugin_set_param(Plugin *plugin, int i, double value);
+
+// points[i] = (domain[i], V(domain[i])) for the n+1 points of a grid
+void plugin_fill(const Plugin *plugin, const double *domain, int n, Vector2 *points);
+
+#endif
@@ -4,6 +4,9 @@
 #ifndef POTENTIAL_H
 #define POTENTIAL_H
 
+#include <stddef.h>
+#include "raylib.h"
+
 double constant(double x);
 double linear(double x);
 double quadratic(double x);
@@ -11,4 +14,42 @@ double step(double x);
 double gaussian(double x);
 double sinusodial(double x);
 
+typedef double (*PotentialFn)(double);
+
+// Looks up one of the functions above by name. Returns NULL if unknown
+PotentialFn find_potential(const char *name);
+
+/******************************************************************************
+*  Batch forms: out[i] = V(x[i]) for i < n, one array at a time. params holds
+*  the coefficients listed with each function, or NULL for the values the
+*  scalar versions above use. out may alias x.
+******************************************************************************/
+typedef void (*PotentialBatchFn)(const double *x, double *out, size_t n, const double *params);
+
+// 0
+void constant_batch(const double *x, double *out, size_t n, const double *params);
+// slope * x                                  {slope} = {1}
+void linear_batch(const double *x, double *out, size_t n, const double *params);
+// a * (x - c)^2                              {a, c} = {4, 0.5}
+void quadratic_batch(const double *x, double *out, size_t n, const double *params);
+// height for x < edge, else 0                {height, edge} = {0.5, 0.3}
+void step_batch(const double *x, double *out, size_t n, const double *params);
+// height * exp(-(x - c)^2 / width)           {height, c, width} = {100, 0.75, 0.001}
+void gaussian_batch(const double *x, double *out, size_t n, const double *params);
+// amplitude * sin(frequency * x) + offset    {amplitude, frequency, offset} = {1000, 25, 0.5}
+void sinusodial_batch(const double *x, double *out, size_t n, const double *params);
+
+PotentialBatchFn find_potential_batch(const char *name);
+
+// Evaluates f over the n+1 points of a grid in place:
+// points[i] = (domain[i], f(domain[i]))
+void fill_potential(const double *domain, int n, PotentialBatchFn f, const double *params, Vector2 *points);
+
+// Like apply_potential but with a batch function. The caller frees the result
+Vector2 *apply_potential_batch(const double *domain, int n, PotentialBatchFn f, const double *params);
+
+// Separable 2D potential V(x, y) = f(x) + f(y) on the unit square, as the
+// (n+1)*(n+1) row-major grid the 2D solver takes
+void fill_potential2d(int n, PotentialBatchFn f, const double *params, double *grid);
+
 #endif
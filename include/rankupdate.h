@@ -0,0 +1,42 @@
+/******************************************************************************
+ * Low-rank updates of a full eigendecomposition, as in the merge step of
+ * divide and conquer. Painting changes a contiguous block of r diagonal
+ * entries of the Hamiltonian, which is r rank-one updates rho e_i e_i^T. In
+ * the eigenbasis Q of the old matrix each one is
+ *
+ *   Q^T (A + rho e_i e_i^T) Q = L + rho u u^T,  u = row i of Q
+ *
+ * whose eigenvalues are the roots of the secular equation
+ *
+ *   f(mu) = 1 + rho sum_j u_j^2 / (lambda_j - mu) = 0,
+ *
+ * one between each pair of old eigenvalues. Components of u that are
+ * negligible, and pairs of old eigenvalues too close to separate, deflate:
+ * their eigenpairs carry over unchanged. The rest get vectors from the
+ * roots by the Gu-Eisenstat formula, which keeps them orthogonal, and are
+ * rotated into Q with one matrix product.
+ *
+ * Each rank-one update costs O(m^2) for the roots and up to 2 m^3 flops,
+ * fewer the more deflates, for the product. That beats a fresh tqli() while
+ * r stays well below the cost ratio of the two (see rank_update_pays()).
+******************************************************************************/
+#ifndef RANKUPDATE_H
+#define RANKUPDATE_H
+
+#include "solver.h"
+#include "workspace.h"
+
+// Turns the eigendecomposition of a symmetric m x m matrix A, ascending
+// eigenvalues w and eigenvector j in column j of z (tqli() layout), into
+// that of A + diag(delta) where delta[i] changes row first+i for i < r, in
+// place. Progress counts rank-one updates through ctl (optional). The
+// O(m^2) scratch comes from arena (optional, see workspace.h). Returns 0 if
+// cancelled, in which case w and z are left in an unspecified state.
+int rank_update_diagonal(double *w, double **z, int m, int first, int r, const double *delta, SolveControl *ctl,
+    Arena *arena);
+
+// Whether r rank-one updates of an m x m decomposition are expected to beat
+// solving it again from scratch
+int rank_update_pays(int m, int r);
+
+#endif
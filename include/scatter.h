@@ -0,0 +1,29 @@
+/******************************************************************************
+ * Open-boundary scattering. Instead of the closed box of the eigensolver, the
+ * grid is joined at both ends to leads that continue forever at the
+ * potential of the end points, and a wave comes in from the left. The
+ * transmission T(E) and reflection R(E) are found with the same
+ * finite-difference Hamiltonian as the box, by running its three-term
+ * recurrence
+ *
+ *     psi_{j-1} = 2 (1 + h^2 (U_j - E)) psi_j - psi_{j+1},  U = POTENTIAL_SCALE V
+ *
+ * from a purely outgoing wave on the right to the left lead, where it splits
+ * into incoming and reflected waves. That is O(n) per energy. Sweeps batch
+ * energies into SIMD lanes and split them across threads.
+******************************************************************************/
+#ifndef SCATTER_H
+#define SCATTER_H
+
+#include "raylib.h"
+#include "solver.h"
+
+// Transmission, and reflection if it is not NULL, at count energies for a
+// potential with n+1 points. Energies outside the band of either lead carry
+// no current there and get T = R = 0. threads <= 0 uses every online CPU.
+// Progress counts finished energies through ctl (optional); returns 0 if
+// cancelled, leaving the rest of the output unwritten.
+int transmission_sweep(Vector2 *potential, int n, const double *energies, int count,
+    double *transmission, double *reflection, int threads, SolveControl *ctl);
+
+#endif
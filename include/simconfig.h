@@ -5,6 +5,22 @@
 #define SIMCONFIG_H
 
 #include "raylib.h"
+#include "expr.h"
+#include "plugin.h"
+#include "livethermal.h"
+#include "continuation.h"
+
+// Longest potential expression that can be typed in
+#define EXPR_TEXT_LEN 256
+
+// Energies the T(E) plot samples between 0 and the top of the vertical axis
+#define TRANSMISSION_POINTS 4096
+// Energies of a T(E) sweep done per painted frame
+#define TRANSMISSION_CHUNK 512
+
+// Steps of a continuation sweep from one end of a plugin parameter's range
+// to the other
+#define CONTINUATION_STEPS 200
 
 // Simulation-level data. Changeable throughout program execution
 typedef struct SimConfig
@@ -13,6 +29,18 @@ typedef struct SimConfig
     unsigned char zoom_mode;
     unsigned char paused;
     unsigned char num_eigenfunctions;
+    int first_state; // index of the lowest state solved for, 0 for the ground state
+    unsigned char show_overlay; // instrumentation text in the bottom-left corner
+    unsigned char show_levels; // draw the energy-level ladder next to the plot
+    unsigned char live_mode; // re-solve in the background while painting
+    unsigned char live_dirty; // potential was painted since the last live request
+    unsigned char show_2d; // the 2D mode replaces the 1D plot
+    unsigned char show_transmission; // plot T(E) of the open-boundary problem
+    unsigned char show_observables; // table of <x>, uncertainties etc. of the solved states
+    unsigned char show_thermal; // draw the thermal density instead of the eigenstates
+    unsigned char continuation; // continue solves from the last one and track levels
+    double last_stroke_time;
+    double last_request_time;
     double dt;
     double t;
     double arrow_side_length;
@@ -24,6 +52,37 @@ typedef struct SimConfig
 
     Vector2 *potential;
     double *domain;
+
+    double *energies; // TRANSMISSION_POINTS sample energies of the T(E) sweep
+    double *transmission; // T at each of them from the last finished sweep
+    double *sweeping; // T of the sweep in progress
+    int transmission_done; // energies of the sweep in progress done, TRANSMISSION_POINTS if there is none
+    unsigned char transmission_ready; // transmission holds a finished sweep
+    Vector2 *swept_potential; // the potential of the last sweep started
+    double swept_top; // energy at the top of the axis when it was started, 0 if never
+
+    LiveThermal *thermal; // started the first time thermal mode is turned on
+    unsigned long thermal_shown; // request of the thermal density drawn last
+    double temperature; // kT as a share of the energy at the top of the vertical axis
+    unsigned char thermal_slider_active; // the temperature slider is being dragged
+
+    LevelTracker *tracker; // levels of the solves published in continuation mode
+    unsigned long tracked_published; // last solve given to the tracker
+    int animated_param; // plugin parameter swept in continuation mode, the last one dragged
+    int sweep_direction; // +1 or -1, the way the sweep is going
+    unsigned long sweep_request; // request of the last sweep step, 0 if none
+    double sweep_value; // parameter value of that request
+
+    Expr *expr; // last applied user expression, NULL if none
+    unsigned char editing_expr; // the V(x) text box has keyboard focus
+    char expr_text[EXPR_TEXT_LEN];
+    char expr_error[128];
+
+    Plugin *plugin; // native potential plugin, NULL if none was loaded
+    char plugin_error[sizeof("reload failed: ") + PLUGIN_ERROR_LEN]; // why the last reload failed
+    int active_slider; // parameter slider being dragged, -1 if none
+    unsigned char plugin_dirty; // plugin potential changed since the last request
+    double last_plugin_poll;
 } SimConfig;
 
 // Runs once at program initialization
@@ -0,0 +1,37 @@
+/******************************************************************************
+ * Spectrum slicing: many eigenvalues of a symmetric tridiagonal matrix at
+ * once, in parallel. The wanted index range is split into contiguous slices,
+ * one per thread, and each thread narrows down the eigenvalues of its slice
+ * independently:
+ *
+ *   - intervals holding several eigenvalues are multisected, i.e. split at
+ *     several shifts per pass, until every eigenvalue has its own interval
+ *   - an isolated eigenvalue is then found by Newton's method on
+ *     det(T - xI), safeguarded by the Sturm count at every iterate. The
+ *     first step comes from the shift that isolated it, and once the steps
+ *     converge quadratically the last one is taken without a pass to
+ *     confirm it, which leaves about 4.7 passes per eigenvalue.
+ *
+ * Each pass is O(n), so all n eigenvalues take O(n^2) work between the
+ * threads.
+ *
+ * Shifts are evaluated a batch at a time, with one lane of the Sturm
+ * recurrence per shift, so the compiler can run the lanes in SIMD registers
+ * and the matrix is read once per batch instead of once per shift.
+ *
+ * Matrices use the tqli() layout described in tridiag.h.
+******************************************************************************/
+#ifndef SLICE_H
+#define SLICE_H
+
+#include "solver.h"
+#include "workspace.h"
+
+// Eigenvalues il..iu (0-based, ascending, inclusive) into out, which must
+// hold iu-il+1 values. threads <= 0 uses every online CPU. Progress counts
+// finished eigenvalues through ctl (optional); returns 0 if cancelled.
+// Scratch comes from work (optional, see workspace.h).
+int slice_eigenvalues(const double *d, const double *e, int n, int il, int iu, double *out,
+    int threads, SolveControl *ctl, Workspace *work);
+
+#endif
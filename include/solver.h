@@ -4,34 +4,150 @@
  *
  * Spectrum solver method, tqli(), is taken from "Numerical Reciples in C". It
  * finds the spectrum of a symmetrical tridiagonal matrix.
+ *
+ * The solves go through a SolverBackend. The in-tree one uses tqli() for
+ * whole spectra and the slicing and MRRR eigenvectors of slice.h/mrrr.h for
+ * parts of it. Builds with HAVE_LAPACK add one that calls dstevr() from
+ * the system LAPACK, to use an optimized library where there is one and to
+ * compare against.
 ******************************************************************************/
 
 #ifndef SOLVER_H
 #define SOLVER_H
 
+#include <stddef.h>
+#include <stdatomic.h>
 #include "raylib.h"
+#include "workspace.h"
+
+// Potentials are drawn in units where the top of the vertical axis is 1. The
+// Hamiltonian multiplies them by this so energies are E = POTENTIAL_SCALE * V
+#define POTENTIAL_SCALE 2000.0
+
+// Points in the finite-difference stencil of the kinetic term. Part of the
+// identity of a solve, e.g. for caching spectra
+#define HAMILTONIAN_STENCIL 3
+
+// Transition dipoles <i|x|j> are kept between this many leading displayed
+// states, which bounds their O(n k^2) cost
+#define DIPOLE_STATES 32
+
+// Expectation values of one normalized state, with hbar = m = 1 as in the
+// Hamiltonian and energies in the units of evalues
+typedef struct Observables
+{
+    double x; // <x>
+    double x2; // <x^2>
+    double p2; // <p^2>, twice the kinetic energy
+    double v; // <V>, so that the energy is p2 / 2 + v
+    double dx; // sqrt(<x^2> - <x>^2)
+    double dp; // sqrt(<p^2>), since <p> = 0 for real states
+} Observables;
 
 // Contains information about the solving for eigenvalues/eigenvectors
 typedef struct EigenPackage
 {
     double *evalues; // diagonal value in the tridiagonal matrix
+    int num_evalues; // leading entries of evalues that are valid
+    int first; // index of the state in evalues[0] and efunctions[0]
     Vector2 **efunctions; // packaged representation of eigenvectors that is displayable
     int num_efunctions; // Number of eigenfunctions to display.
     int n; // discretization
     int displayable; // State variable to know when the solver is done running
     double *subdiagonal; // the subdiagonal of the matrix
     double **z; // Out-parameter for the spectrum solver. Contains all eigenvectors
+    int z_columns; // Leading columns of z that hold valid eigenvectors
+    Observables *observables; // of the displayed states, capacity entries
+    int num_observables; // leading displayed states with valid observables, 0 for none
+    double *dipoles; // <i|x|j> of the first min(num_observables, DIPOLE_STATES) states, DIPOLE_STATES wide
+    int capacity; // Number of rows allocated in efunctions. Only grows between solves
+    struct evalue *order; // Workspace for sorting the eigenpairs, length n-1
+    double *scratch; // Workspace row used when permuting z, length n-1
+    double *sums; // Workspace of the observables, sized by capacity
+    double *diagonal; // Workspace of the partial and continued paths, length n-1
+    double *values; // Workspace eigenvalues of the wanted states, capacity entries
+    double *vectors; // Workspace eigenvectors of the wanted states, capacity columns of n-1
+    Workspace *work; // Scratch of the kernels, kept across changes of n
 } EigenPackage;
 
+// Entry used when sorting eigenvalues while remembering their original column
+struct evalue
+{
+    double value;
+    int index;
+};
+
+// Shared between a running solve and the thread that requested it
+typedef struct SolveControl
+{
+    atomic_int cancel; // set to non-zero to abandon the solve at the next sweep
+    atomic_int progress; // eigenvalues converged so far
+    atomic_int total; // eigenvalues the running solve will produce
+} SolveControl;
+
 // Interal struct that is passed into the pthread for parallelization
 struct SolverPkg
 {
     Vector2 *potential;
     double n;
-    unsigned char num_eigenfunctions;
+    int num_eigenfunctions;
     EigenPackage *epkg;
+    SolveControl *control; // optional. NULL means the solve cannot be cancelled
+    struct PerfProfile *profile; // optional per-stage counters, see perfcounters.h
+    int keep_vectors; // optional. 1 solves every eigenvector even on a partial plan, see plan_keeps_vectors()
 };
 
+// One way of solving the Hamiltonian. Matrices use the tqli() layout (see
+// tridiag.h) and have m = n-1 rows for a potential with n+1 points.
+typedef struct SolverBackend
+{
+    const char *name;
+    // Fills the diagonal d and subdiagonal e of the Hamiltonian
+    void (*assemble)(Vector2 *potential, int n, double *d, double *e);
+    // Every eigenpair of the matrix held in epkg->evalues and epkg->subdiagonal:
+    // ascending eigenvalues to epkg->evalues, eigenvector j to column j of
+    // epkg->z. Destroys the subdiagonal. Records its stages in profile
+    // (optional) and returns 0 if cancelled through ctl.
+    int (*solve_all)(EigenPackage *epkg, int m, SolveControl *ctl, struct PerfProfile *profile);
+    // Eigenpairs il..iu (0-based, ascending, inclusive): values to w and unit
+    // vectors m long at vectors + (j-il)*m. Progress counts vectors; returns 0
+    // if cancelled. threads works as in slice_eigenvalues() where the backend
+    // has a use for it. Scratch comes from work (optional, see workspace.h).
+    int (*solve_range)(const double *d, const double *e, int m, int il, int iu, double *w, double *vectors,
+        int threads, SolveControl *ctl, Workspace *work);
+    // All m eigenvalues, ascending, to w. Returns 0 if cancelled.
+    int (*eigenvalues_only)(const double *d, const double *e, int m, double *w, int threads, SolveControl *ctl,
+        Workspace *work);
+} SolverBackend;
+
+extern const SolverBackend tqli_backend;
+#ifdef HAVE_LAPACK
+extern const SolverBackend lapack_backend;
+#endif
+
+// The backends compiled in, in-tree one first, NULL-terminated
+extern const SolverBackend *const solver_backends[];
+
+// How solve_spectrum() answers one request
+typedef struct SolvePlan
+{
+    const SolverBackend *backend;
+    // 0: every eigenpair with solve_all(). 1: every eigenvalue with
+    // eigenvalues_only(), then solve_range() for just the k wanted vectors.
+    int partial;
+    int threads; // of the partial path, as in slice_eigenvalues()
+    // Predicted seconds of this plan, of the fastest full solve and of one
+    // rank-one update of a full decomposition (see rankupdate.h). 0 when the
+    // planner makes no predictions.
+    double seconds;
+    double full_seconds;
+    double update_seconds;
+} SolvePlan;
+
+// Fills in the plan for a potential with n+1 points and k eigenfunctions.
+// The plan comes in set to a full solve on solver_backend().
+typedef void (*SolvePlanner)(int n, int k, SolvePlan *plan);
+
 
 // Called at the beginning of the run. New eigenpackages overwrite the one initialized here.
 EigenPackage *init_eigenpackage(int num_evalues, int n, double *domain);
@@ -39,6 +155,50 @@ EigenPackage *init_eigenpackage(int num_evalues, int n, double *domain);
 // Called at the end
 void free_eigenpackage(EigenPackage *pkg);
 
+// Zeroes the cancel flag and progress counters
+void init_solvecontrol(SolveControl *ctl);
+
+// Makes sure pkg has workspaces for discretization n and k eigenfunctions.
+// Only allocates when n changes or k exceeds what was previously reserved.
+void reserve_eigenpackage(EigenPackage *pkg, int n, int k);
+
+// Backend the next solves will use, tqli_backend unless another was selected
+const SolverBackend *solver_backend();
+
+// Switches every later solve to the named backend. A solve already running
+// finishes on the one it started with. Returns 0 if no such backend was
+// compiled in.
+int solver_select_backend(const char *name);
+
+// Lets planner choose the plan of every later solve_spectrum(), e.g.
+// autotune_plan(). NULL, the default, always solves fully on solver_backend().
+void solver_set_planner(SolvePlanner planner);
+
+// The plan solve_spectrum() would follow right now for n and k
+SolvePlan solver_plan(int n, int k);
+
+// Whether r rank-one updates of a full decomposition with m rows are expected
+// to beat solving for k eigenfunctions on plan. Goes by the predictions of
+// the plan when it has them, else only updates instead of a full tqli() solve
+// (see rank_update_pays()).
+int plan_prefers_update(const SolvePlan *plan, int m, int k, int r);
+
+// Whether a solve for k eigenfunctions on a partial plan should keep all m
+// eigenvectors anyway, because the full solve costs less extra than it saves
+// if the next `updates` requests are strokes of r rows that can then be
+// updated instead of solved on plan. Needs the predictions of the plan.
+int plan_keeps_vectors(const SolvePlan *plan, int m, int k, int r, int updates);
+
+// malloc() for the modules of the 1D solver (this file, tridiag.h, slice.h,
+// mrrr.h, rankupdate.h, perturb.h, thermal.h, continuation.h and the LAPACK
+// backend). Counts towards solver_alloc_count() and exits with a message
+// naming who when the heap is exhausted.
+void *solver_alloc(size_t size, const char *who);
+
+// Number of heap allocations the solver has made so far. Used by the tests
+// to check that repeated solves at the same size do not touch the heap.
+long solver_alloc_count();
+
 // Create nxn identity matrix
 double **create_identity(int n);
 
@@ -54,14 +214,69 @@ Vector2* apply_potential(double *domain, int n, double (*f) (double));
 // Function from Numerical Recipes in C
 void tqli(double *d, double *e, double **z, int n);
 
+// tqli() that polls ctl between QL sweeps and publishes the number of
+// deflated eigenvalues through ctl->progress. Returns 1 when finished and 0 if
+// the solve was cancelled, in which case d, e and z hold partial results.
+// Pass z == NULL to compute eigenvalues only, which is O(n^2) instead of O(n^3).
+int tqli_ctl(double *d, double *e, double **z, int n, SolveControl *ctl);
+
+// Fills the n-1 interior diagonal (d) and subdiagonal (e) entries of the
+// finite-difference Hamiltonian for a potential with n+1 points
+void assemble_hamiltonian(Vector2 *potential, int n, double *d, double *e);
+
+// Index window of the states with energies in [emin, emax) from Sturm counts,
+// without solving. Writes the index of the first state at or above emin to
+// *first and returns how many are below emax.
+int spectrum_window(Vector2 *potential, int n, double emin, double emax, int *first);
+
+// States first..first+k-1 only, by the backend's solve_range(), in O(n k)
+// for the in-tree one instead of the O(n^3) of solve_spectrum(). Fills epkg
+// like solve_spectrum() except that evalues holds just those k energies.
+// Publishes progress through ctl. Returns 1 when done, 0 if cancelled, with
+// epkg left as it was, and -1 without solving unless 0 <= first and
+// first+k <= n-1.
+int solve_spectrum_window(Vector2 *potential, int n, int first, int k, EigenPackage *epkg, SolveControl *ctl);
+
+// solve_spectrum() for pkg->potential starting from previous, a solve with
+// every eigenvector (z_columns = n-1) of the potential `before`. When only a
+// block of a few rows of the Hamiltonian differs and plan_prefers_update()
+// over the plan solve_spectrum() would follow, previous is brought up to
+// date by rank-one updates (see rankupdate.h) into pkg->epkg, which may be
+// previous itself. Their scratch comes from the workspace of pkg->epkg, so
+// repeated updates at one size stay off the heap. Returns 1 when
+// updated, 0 if cancelled through pkg->control (pkg->epkg is then left
+// without eigenvectors) and -1, having done nothing, when an update would
+// not pay off or previous doesn't qualify.
+int solve_spectrum_update(struct SolverPkg *pkg, Vector2 *before, const EigenPackage *previous);
+
+// States first..first+k-1 of potential, continued from previous, a solve of
+// a nearby potential holding their eigenvectors (see continuation.h). Fills
+// epkg like solve_spectrum_window(). Returns 1 when done, 0 if cancelled
+// through ctl and -1, leaving epkg without eigenvectors, when previous does
+// not hold those states or did not lead to all of them.
+int solve_spectrum_continued(Vector2 *potential, int n, int first, int k, const EigenPackage *previous,
+    EigenPackage *epkg, SolveControl *ctl);
+
+// Eigenvalues-only fast path. Writes all n-1 eigenvalues in ascending order to
+// evalues without forming any eigenvectors, slicing the spectrum across all
+// CPUs (see slice.h). Returns 0 if cancelled through ctl.
+int solve_eigenvalues(Vector2 *potential, int n, double *evalues, SolveControl *ctl);
+
 void free_square_matrix(double **z, int n);
 
-// pthread function that takes in a SolverPkg and does operations in-place
+// pthread function that takes in a SolverPkg and does operations in-place.
+// Returns (void *) 1 on success and NULL if the solve was cancelled. All n-1
+// eigenvalues are always found; the planner decides whether z gets every
+// eigenvector or only the first num_eigenfunctions (see z_columns).
 void *solve_spectrum(void *);
 
 // Sorts the eigenvalues and eigenvectors correspondingly. Needed to extract the least eigenvalues/vectors
+// Sorting is done in place and evectors is returned.
 double **sort_e_vectors(double *evalues, double **evectors, int N);
 
+// Same as sort_e_vectors but uses caller-provided workspaces of length N-1
+void sort_e_vectors_ws(double *evalues, double **evectors, int N, struct evalue *order, double *scratch);
+
 int min(int a, int b);
 
 int max(int a, int b);
@@ -0,0 +1,48 @@
+/******************************************************************************
+ * In-memory LRU cache of solved spectra. Entries are keyed by a hash of the
+ * grid, the potential samples, the stencil, the number of eigenfunctions and
+ * the backend and path that solve_spectrum() would take, so toggling back to
+ * a potential that was already solved skips the solve.
+ * The cache is bounded by the bytes its entries hold.
+******************************************************************************/
+#ifndef SPECTRUMCACHE_H
+#define SPECTRUMCACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "raylib.h"
+#include "solver.h"
+
+struct CacheEntry;
+
+typedef struct SpectrumCache
+{
+    pthread_mutex_t lock;
+    struct hashmap *map; // key -> CacheEntry
+    struct CacheEntry *head; // most recently used
+    struct CacheEntry *tail; // next to be evicted
+    size_t bytes; // held by all entries. Only read while holding lock
+    size_t max_bytes;
+    atomic_long hits;
+    atomic_long misses;
+} SpectrumCache;
+
+SpectrumCache *init_spectrumcache(size_t max_bytes);
+
+void free_spectrumcache(SpectrumCache *cache);
+
+// Hash of everything that determines the result of solve_spectrum(),
+// including the plan solver_plan() picks for n and k
+uint64_t spectrum_key(Vector2 *potential, int n, int k);
+
+// On a hit, copies the cached spectrum into out (evalues, efunctions and the
+// first k columns of z) and returns 1. Returns 0 on a miss.
+int spectrumcache_get(SpectrumCache *cache, uint64_t key, int n, int k, EigenPackage *out);
+
+// Stores the first k eigenpairs of a solved package, evicting the least
+// recently used entries to stay within max_bytes
+void spectrumcache_put(SpectrumCache *cache, uint64_t key, EigenPackage *pkg);
+
+#endif
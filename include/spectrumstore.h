@@ -0,0 +1,72 @@
+/******************************************************************************
+ * Persistent, content-addressed store of solved spectra shared by every
+ * process on the machine. Each spectrum is one file named after its
+ * spectrum_key() in the store directory, laid out so it can be mmap'ed and
+ * copied straight into an EigenPackage.
+ *
+ * An append-only `index` file records the size and last use of every entry.
+ * The `lock` file holds a running estimate of the bytes in the store; once it
+ * passes max_bytes, or the index grows past STORE_INDEX_BYTES, the index is
+ * compacted and the least recently used files are evicted down to three
+ * quarters of max_bytes. Hits are remembered in memory and written to the
+ * index in batches. All access is serialized between processes with flock()
+ * on the `lock` file, and between the threads of one process with a mutex:
+ * lookups take a shared lock, inserts and eviction an exclusive one. Data
+ * files are written to a temporary name and renamed into place; temporaries
+ * left behind by crashed writers are removed when the store is opened.
+******************************************************************************/
+#ifndef SPECTRUMSTORE_H
+#define SPECTRUMSTORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "solver.h"
+
+// Default size limit of the store directory
+#define SPECTRUM_STORE_BYTES ((size_t) 1 << 30)
+
+// The index is compacted once it is larger than this
+#define STORE_INDEX_BYTES (64 * 1024)
+
+// Hits remembered before they are written to the index
+#define STORE_PENDING_HITS 64
+
+// Temporary files older than this many seconds belong to crashed writers
+#define STORE_TMP_AGE 3600
+
+struct index_entry;
+
+typedef struct SpectrumStore
+{
+    char *dir;
+    int lock_fd;
+    size_t max_bytes;
+    pthread_mutex_t lock; // flock() does not separate the threads of a process
+    struct index_entry *pending; // hits not yet in the index
+    int num_pending;
+    atomic_long hits;
+    atomic_long misses;
+} SpectrumStore;
+
+// Opens (creating if needed) the store in dir. With dir == NULL uses
+// $SCHRODINGER_STORE, else $XDG_CACHE_HOME/schrodingersim, else
+// ~/.cache/schrodingersim. Returns NULL if the directory is unusable.
+SpectrumStore *open_spectrumstore(const char *dir, size_t max_bytes);
+
+// Writes the default store directory to dir, creating it if needed. Other
+// per-machine files live there too. Returns 0 if there is none usable.
+int spectrumstore_default_dir(char *dir, size_t size);
+
+// Writes the remembered hits to the index and closes the store
+void close_spectrumstore(SpectrumStore *store);
+
+// Copies a stored spectrum into out and returns 1, or returns 0 on a miss
+int spectrumstore_get(SpectrumStore *store, uint64_t key, int n, int k, EigenPackage *out);
+
+// Writes the first k eigenpairs of pkg, then evicts the least recently used
+// files while the store is over its limit. Returns 0 on I/O errors.
+int spectrumstore_put(SpectrumStore *store, uint64_t key, EigenPackage *pkg);
+
+#endif
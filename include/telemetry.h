@@ -0,0 +1,42 @@
+/******************************************************************************
+ * Always-on performance telemetry. Each metric is an HDR-style histogram of
+ * durations: buckets are exact below 256 ns and then split every power of
+ * two into 128 equal steps, so any percentile is within 1% of the true value
+ * from nanoseconds to hours in a fixed 39 KB per metric. Recording is a few
+ * atomic adds and safe from any thread.
+ *
+ * Snapshots are written as a Prometheus text file (one summary per metric)
+ * and as JSON, for comparing builds.
+******************************************************************************/
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+typedef enum Metric
+{
+    METRIC_FRAME, // between frames drawn back to back
+    METRIC_QUEUE_WAIT, // a 1D solve request waiting for the solver thread
+    METRIC_SOLVE, // the solver thread working on a request that got published
+    METRIC_LATENCY, // request to publish of a 1D solve, e.g. click to result
+    METRIC_SOLVE2D, // the 2D solver thread working on a request that got published
+    METRIC_COUNT
+} Metric;
+
+void telemetry_record(Metric metric, double seconds);
+
+long telemetry_count(Metric metric);
+
+// Duration at or below which a fraction p of the recorded ones are, in
+// seconds. 0 if nothing was recorded.
+double telemetry_percentile(Metric metric, double p);
+
+// Forgets everything recorded so far
+void telemetry_reset();
+
+// Writes snapshots of every metric. Returns 0 if the file can't be written.
+int telemetry_write_prometheus(const char *path);
+int telemetry_write_json(const char *path);
+
+// Writes <prefix>.prom and <prefix>.json. Returns 0 if either failed.
+int telemetry_dump(const char *prefix);
+
+#endif
@@ -0,0 +1,64 @@
+/******************************************************************************
+ * Finite-temperature density of a potential in thermal equilibrium,
+ *
+ *   rho(x) = sum_j exp(-E_j / kT) |psi_j(x)|^2 / Z.
+ *
+ * All energies come from the eigenvalues-only path, O(n^2), and decide how
+ * many of the lowest states carry all but a tolerance of the Boltzmann
+ * weight. Only those get eigenvectors, through solve_spectrum_window(), and
+ * their densities are kept. A new temperature is then a reweighting of the
+ * kept densities, O(n) per state, and only solves the states it needs
+ * beyond them. A new potential starts over.
+******************************************************************************/
+#ifndef THERMAL_H
+#define THERMAL_H
+
+#include "raylib.h"
+#include "solver.h"
+
+// Share of the Boltzmann weight the states left out of rho may carry
+#define THERMAL_TOLERANCE 1e-4
+
+// Most states whose densities are kept, which bounds memory to this many
+// rows of n+1 doubles. Temperatures that need more leave a larger tail.
+#define THERMAL_MAX_STATES 1024
+
+typedef struct ThermalDensity
+{
+    int n;
+    int stride; // n+1 rounded up to whole tiles, the length of each density row
+    Vector2 *potential; // what evalues and densities are for
+    int have_potential; // 0 until the first update
+    double *evalues; // all n-1 energies, ascending
+    double *weights; // Boltzmann weights relative to the ground state, n-1
+    double *densities; // solved rows of normalized |psi|^2, stride apart
+    int solved; // lowest states held in densities
+    int capacity; // rows allocated in densities
+    EigenPackage *window; // workspace of the eigenvector solves
+    double *sum; // accumulator of rho, stride long
+    Vector2 *rho; // n+1 points of the thermal density at kT
+    double kT; // temperature of rho in the units of the energies, -1 if none yet
+    double tolerance; // the one rho was made with
+    int used; // states summed into rho
+    double tail; // share of the weight of the states left out of rho
+} ThermalDensity;
+
+ThermalDensity *init_thermal(int n, double *domain);
+
+void free_thermal(ThermalDensity *thermal);
+
+// Writes exp(-(E_j - E_0) / kT) for each of the m ascending evalues to
+// weights and returns the fewest leading states whose weight leaves at most
+// tolerance of the total to the rest. kT <= 0 is the ground state alone.
+// The share left out goes to *tail when it is not NULL.
+int thermal_states_needed(const double *evalues, int m, double kT, double tolerance, double *weights,
+    double *tail);
+
+// Brings thermal->rho up to date for potential (n+1 points) at kT, solving
+// eigenvectors only for states that are needed and not held yet. Returns
+// the number of states summed, or 0 if cancelled through ctl (optional), in
+// which case rho is left as it was and the next update picks up from the
+// states solved so far.
+int thermal_update(ThermalDensity *thermal, Vector2 *potential, double kT, double tolerance, SolveControl *ctl);
+
+#endif
@@ -0,0 +1,52 @@
+/******************************************************************************
+ * Tools for symmetric tridiagonal matrices that work on part of the spectrum:
+ * Sturm sequence counts, Gershgorin bounds, bisection for any subset of the
+ * eigenvalues and inverse iteration for their eigenvectors.
+ *
+ * Matrices use the same layout as tqli(): `d` is the n-length diagonal and
+ * `e[i]` couples rows i and i+1 (e[n-1] is ignored). Functions that need
+ * scratch take it from an optional Arena (see workspace.h), or from the heap
+ * when given NULL.
+******************************************************************************/
+#ifndef TRIDIAG_H
+#define TRIDIAG_H
+
+#include "workspace.h"
+
+// Number of eigenvalues strictly less than x
+int sturm_count(const double *d, const double *e, int n, double x);
+
+// Interval [*lo, *hi] that contains the whole spectrum
+void gershgorin_bounds(const double *d, const double *e, int n, double *lo, double *hi);
+
+// Eigenvalues il..iu (0-based, ascending, inclusive) by bisection. out must
+// hold iu-il+1 values. Costs O(n) per bisection step and per eigenvalue.
+void bisect_eigenvalues(const double *d, const double *e, int n, int il, int iu, double *out);
+
+// Indices [*il, *iu] of the eigenvalues in [lo, hi). Returns how many there
+// are; when none, *il is where the first one above lo would be.
+int eigenvalue_window(const double *d, const double *e, int n, double lo, double hi, int *il, int *iu);
+
+// Unit eigenvector for evalues[j] of a list of ascending eigenvalues, e.g.
+// from bisect_eigenvalues(), by inverse iteration with a shifted
+// factorization. Vectors are n long at vectors + i*n, and those for i < j must
+// already be there: the new one is kept orthogonal to the ones whose
+// eigenvalues are within a small fraction of the spectrum's width. Costs O(n)
+// plus O(n) per such close vector.
+void inverse_iteration(const double *d, const double *e, int n, const double *evalues, int j, double *vectors,
+    Arena *arena);
+
+// inverse_iteration() in bounded memory, for streaming vectors out one at a
+// time: the vector goes to x, and only the latest `slots` earlier vectors are
+// kept, vector i at history + (i % slots)*n. The new one is kept orthogonal to
+// the close ones among those, which are the ones it could mix with most.
+void inverse_iteration_history(const double *d, const double *e, int n, const double *evalues, int j,
+    const double *history, int slots, double *x, Arena *arena);
+
+// Solves (T - shift I) y = x in place, by elimination with row interchanges.
+// Pivots below the rounding of T are raised to it, so a shift at an
+// eigenvalue gives a large but finite multiple of its eigenvector on top of
+// the rest of the solution.
+void shifted_solve(const double *d, const double *e, int n, double shift, double *x, Arena *arena);
+
+#endif
@@ -0,0 +1,20 @@
+/******************************************************************************
+ * Array-at-a-time elementary functions. Each is a straight-line polynomial
+ * with arithmetic range reduction and no per-element branches or libm calls,
+ * so the loops vectorize. Accuracy is a few ulp for the arguments potentials
+ * use (|x| < 708 for exp, |x| < 1e5 for sin and cos).
+ *
+ * out may alias x.
+******************************************************************************/
+#ifndef VECMATH_H
+#define VECMATH_H
+
+#include <stddef.h>
+
+void vexp(const double *x, double *out, size_t n);
+
+void vsin(const double *x, double *out, size_t n);
+
+void vcos(const double *x, double *out, size_t n);
+
+#endif
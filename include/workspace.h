@@ -0,0 +1,99 @@
+/******************************************************************************
+ * Scratch memory of the solver kernels, reused from one solve to the next so
+ * that repeated solves of the same size stay off the heap.
+ *
+ * An Arena hands out blocks from one buffer and takes them back to a mark,
+ * like a stack, so nested calls each give back what they took. A request the
+ * buffer has no room for comes from the heap instead. When the arena is
+ * emptied and it had to go to the heap, its buffer is regrown to the most it
+ * held at once, so the next solve like it fits.
+ *
+ * A Workspace holds one arena per thread of the parallel kernels: task t of
+ * slice_eigenvalues() or mrrr_eigenpairs() only touches arena t, and arena 0
+ * belongs to the calling thread. It also keeps the threads those tasks run
+ * on, started the first time they are needed, so repeated solves don't
+ * create threads (and map their stacks) every time. Kernels that take an
+ * optional Workspace treat NULL as "use a temporary one". A Workspace is
+ * used by one solve at a time.
+******************************************************************************/
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+// Threads a Workspace has arenas for
+#define WORKSPACE_THREADS 64
+
+struct ArenaSpill;
+
+typedef struct Arena
+{
+    char *block;
+    size_t size; // of block
+    size_t used; // leading bytes of block handed out
+    size_t spilled; // bytes handed out from the heap
+    size_t peak; // most of used + spilled since the arena was last empty
+    struct ArenaSpill *spills; // heap blocks handed out, newest first
+} Arena;
+
+// What arena_release() rewinds to
+typedef struct ArenaMark
+{
+    size_t used;
+    size_t spilled;
+    struct ArenaSpill *spills;
+} ArenaMark;
+
+struct Workspace;
+
+// Thread t of a Workspace, which runs task t
+typedef struct WorkspaceThread
+{
+    pthread_t thread;
+    struct Workspace *work;
+    int index;
+    unsigned long seen; // last job it looked at
+} WorkspaceThread;
+
+typedef struct Workspace
+{
+    Arena arenas[WORKSPACE_THREADS];
+
+    pthread_mutex_t lock; // guards everything below
+    pthread_cond_t start; // a job was posted, or quit
+    pthread_cond_t done; // the last task of the job finished
+    WorkspaceThread threads[WORKSPACE_THREADS]; // 1..num_threads are running
+    int num_threads;
+    unsigned long job; // number of jobs posted
+    void *(*run)(void *); // the task runner of the job...
+    char *tasks; // ...its tasks, stride bytes apart...
+    size_t stride;
+    int count; // ...and how many there are
+    int remaining; // tasks still running on the threads
+    int quit;
+} Workspace;
+
+// Starts with empty arenas, so only the first solves allocate
+Workspace *init_workspace();
+
+// Accepts NULL
+void free_workspace(Workspace *work);
+
+// Arena of task t
+Arena *workspace_arena(Workspace *work, int t);
+
+ArenaMark arena_mark(const Arena *arena);
+
+// size bytes aligned for any type, valid until released
+void *arena_take(Arena *arena, size_t size);
+
+// Gives back everything taken since mark
+void arena_release(Arena *arena, ArenaMark mark);
+
+// Calls run(tasks + t*stride) for each task t < count: task 0 on the calling
+// thread and the others on threads of work, starting any it doesn't have
+// yet. Returns once every task has. count is at most WORKSPACE_THREADS.
+void workspace_run(Workspace *work, void *(*run)(void *), void *tasks, size_t stride, int count);
+
+#endif
@@ -0,0 +1,37 @@
+/******************************************************************************
+ * Example potential plugin: a quartic double well with a tilt,
+ *
+ *     V(x) = depth * ((x - c)^2 / w^2 - 1)^2 + tilt * (x - c)
+ *
+ * Build with `make plugins` and load with `bin/quantum bin/plugins/doublewell.so`
+ * or `bin/spectrum --plugin bin/plugins/doublewell.so`. Rebuilding while it is
+ * loaded swaps the new version in.
+******************************************************************************/
+#include "plugin.h"
+
+static void doublewell(const double *x, double *out, size_t n, const double *params)
+{
+    double depth = params[0];
+    double c = params[1];
+    double inv_w2 = 1.0 / (params[2] * params[2]);
+    double tilt = params[3];
+    for (size_t i = 0; i < n; i++)
+    {
+        double u = x[i] - c;
+        double s = u * u * inv_w2 - 1.0;
+        out[i] = depth * s * s + tilt * u;
+    }
+}
+
+const PotentialPlugin potential_plugin = {
+    .abi = POTENTIAL_PLUGIN_ABI,
+    .name = "double well",
+    .eval = doublewell,
+    .num_params = 4,
+    .params = {
+        {"depth", 0.5, 0.0, 2.0},
+        {"centre", 0.5, 0.2, 0.8},
+        {"width", 0.2, 0.05, 0.4},
+        {"tilt", 0.0, -1.0, 1.0},
+    },
+};
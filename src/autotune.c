@@ -0,0 +1,388 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include "autotune.h"
+#include "rankupdate.h"
+#include "spectrumstore.h"
+
+// Bumped whenever a solve path changes enough to invalidate old timings
+#define TUNE_MAGIC "schrodinger-autotune 3"
+// Eigenvectors timed per size for the partial path
+#define TUNE_VECTORS 16
+// Each measurement is the best of at least this many runs, and of more
+// while they add up to less than TUNE_MIN_SECONDS
+#define TUNE_RUNS 3
+#define TUNE_MIN_SECONDS 0.02
+
+const int tune_sizes[TUNE_SIZES] = {64, 128, 256, 512};
+
+// Read by the solver threads through autotune_plan()
+static _Atomic(const TuneProfile *) installed = NULL;
+
+static double monotonic_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *tune_malloc(size_t size)
+{
+    void *p = malloc(size);
+    if (p == NULL)
+    {
+        fprintf(stderr, "autotune: malloc failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+static int online_cpus()
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus < 1 ? 1 : (int) cpus;
+}
+
+static double calibration_potential(double x)
+{
+    return 4*(x-0.5)*(x-0.5);
+}
+
+// Matrix of one size and the workspaces to solve it repeatedly
+typedef struct TuneCase
+{
+    int m;
+    double *d;
+    double *e;
+    double *w;
+    double *vectors;
+    EigenPackage *epkg;
+} TuneCase;
+
+static void init_tunecase(TuneCase *c, const SolverBackend *backend, int n)
+{
+    double *domain = create_domain(0, 1, n);
+    Vector2 *potential = apply_potential(domain, n, &calibration_potential);
+    c->m = n-1;
+    c->d = tune_malloc(sizeof(double)*c->m);
+    c->e = tune_malloc(sizeof(double)*c->m);
+    c->w = tune_malloc(sizeof(double)*c->m);
+    c->vectors = tune_malloc(sizeof(double)*c->m*TUNE_VECTORS);
+    c->epkg = init_eigenpackage(1, n, domain);
+    backend->assemble(potential, n, c->d, c->e);
+    free(potential);
+    free(domain);
+}
+
+static void free_tunecase(TuneCase *c)
+{
+    free(c->d);
+    free(c->e);
+    free(c->w);
+    free(c->vectors);
+    free_eigenpackage(c->epkg);
+}
+
+enum { TIME_FULL, TIME_VALUES, TIME_VECTORS, TIME_UPDATE };
+
+static double time_once(const SolverBackend *backend, TuneCase *c, int what, int threads)
+{
+    if (what == TIME_FULL)
+    {
+        // solve_all works in place, so it gets a fresh copy every time
+        memcpy(c->epkg->evalues, c->d, sizeof(double)*c->m);
+        memcpy(c->epkg->subdiagonal, c->e, sizeof(double)*c->m);
+    }
+    // a stroke of the brush on one row, applied to what the last full solve left
+    double delta = 0.1 * c->d[c->m/2];
+    double start = monotonic_seconds();
+    if (what == TIME_FULL)
+        backend->solve_all(c->epkg, c->m, NULL, NULL);
+    else if (what == TIME_VALUES)
+        backend->eigenvalues_only(c->d, c->e, c->m, c->w, threads, NULL, c->epkg->work);
+    else if (what == TIME_VECTORS)
+        backend->solve_range(c->d, c->e, c->m, 0, TUNE_VECTORS-1, c->w, c->vectors, threads, NULL, c->epkg->work);
+    else
+        rank_update_diagonal(c->epkg->evalues, c->epkg->z, c->m, c->m/2, 1, &delta, NULL,
+            workspace_arena(c->epkg->work, 0));
+    return monotonic_seconds() - start;
+}
+
+static double time_best(const SolverBackend *backend, TuneCase *c, int what, int threads)
+{
+    double best = HUGE_VAL, total = 0;
+    for(int run = 0; run < TUNE_RUNS || total < TUNE_MIN_SECONDS; run++)
+    {
+        double t = time_once(backend, c, what, threads);
+        best = fmin(best, t);
+        total += t;
+    }
+    // power laws need positive times
+    return fmax(best, 1e-9);
+}
+
+TuneProfile *autotune_calibrate(FILE *log)
+{
+    TuneProfile *profile = tune_malloc(sizeof(TuneProfile));
+    memset(profile, 0, sizeof(TuneProfile));
+    profile->cpus = online_cpus();
+
+    // 1, 2, 4, ... and every CPU
+    int thread_counts[TUNE_MAX_PARTIAL];
+    int num_threads = 0;
+    for(int t = 1; t < profile->cpus && num_threads < TUNE_MAX_PARTIAL-1; t *= 2)
+        thread_counts[num_threads++] = t;
+    thread_counts[num_threads++] = profile->cpus;
+
+    for(int b = 0; solver_backends[b] != NULL && b < TUNE_MAX_BACKENDS; b++)
+    {
+        const SolverBackend *backend = solver_backends[b];
+        TuneFull *full = &profile->full[profile->num_full++];
+        full->backend = backend;
+        int first_partial = profile->num_partial;
+        for(int t = 0; t < num_threads && profile->num_partial < TUNE_MAX_PARTIAL; t++)
+        {
+            TunePartial *partial = &profile->partial[profile->num_partial++];
+            partial->backend = backend;
+            partial->threads = thread_counts[t];
+        }
+
+        for(int s = 0; s < TUNE_SIZES; s++)
+        {
+            TuneCase c;
+            init_tunecase(&c, backend, tune_sizes[s]);
+            full->seconds[s] = time_best(backend, &c, TIME_FULL, 0);
+            if (log != NULL)
+                fprintf(log, "# %s n=%d full %.3g s\n", backend->name, tune_sizes[s], full->seconds[s]);
+            // an update costs the same whichever backend solved what it starts from
+            if (b == 0)
+            {
+                profile->update[s] = time_best(backend, &c, TIME_UPDATE, 0);
+                if (log != NULL)
+                    fprintf(log, "# n=%d rank-one update %.3g s\n", tune_sizes[s], profile->update[s]);
+            }
+            for(int p = first_partial; p < profile->num_partial; p++)
+            {
+                TunePartial *partial = &profile->partial[p];
+                partial->values[s] = time_best(backend, &c, TIME_VALUES, partial->threads);
+                partial->vector[s] = time_best(backend, &c, TIME_VECTORS, partial->threads) / TUNE_VECTORS;
+                if (log != NULL)
+                    fprintf(log, "# %s n=%d threads=%d eigenvalues %.3g s, %.3g s per vector\n", backend->name,
+                        tune_sizes[s], partial->threads, partial->values[s], partial->vector[s]);
+            }
+            free_tunecase(&c);
+        }
+    }
+    return profile;
+}
+
+static const SolverBackend *find_backend(const char *name)
+{
+    for(int b = 0; solver_backends[b] != NULL; b++)
+        if (strcmp(solver_backends[b]->name, name) == 0)
+            return solver_backends[b];
+    return NULL;
+}
+
+int autotune_save(const TuneProfile *profile, const char *path)
+{
+    // written aside and renamed so other processes never read half a file
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%ld", path, (long) getpid());
+    FILE *out = fopen(tmp, "w");
+    if (out == NULL)
+        return 0;
+
+    fprintf(out, "%s\ncpus %d\nsizes", TUNE_MAGIC, profile->cpus);
+    for(int s = 0; s < TUNE_SIZES; s++)
+        fprintf(out, " %d", tune_sizes[s]);
+    fprintf(out, "\nupdate");
+    for(int s = 0; s < TUNE_SIZES; s++)
+        fprintf(out, " %.6g", profile->update[s]);
+    fprintf(out, "\n");
+    for(int f = 0; f < profile->num_full; f++)
+    {
+        fprintf(out, "full %s", profile->full[f].backend->name);
+        for(int s = 0; s < TUNE_SIZES; s++)
+            fprintf(out, " %.6g", profile->full[f].seconds[s]);
+        fprintf(out, "\n");
+    }
+    for(int p = 0; p < profile->num_partial; p++)
+    {
+        const TunePartial *partial = &profile->partial[p];
+        fprintf(out, "partial %s %d", partial->backend->name, partial->threads);
+        for(int s = 0; s < TUNE_SIZES; s++)
+            fprintf(out, " %.6g %.6g", partial->values[s], partial->vector[s]);
+        fprintf(out, "\n");
+    }
+
+    int ok = fclose(out) == 0 && rename(tmp, path) == 0;
+    if (!ok)
+        unlink(tmp);
+    return ok;
+}
+
+TuneProfile *autotune_load(const char *path)
+{
+    FILE *in = fopen(path, "r");
+    if (in == NULL)
+        return NULL;
+
+    TuneProfile *profile = tune_malloc(sizeof(TuneProfile));
+    memset(profile, 0, sizeof(TuneProfile));
+    char line[1024];
+    int ok = fgets(line, sizeof(line), in) != NULL && strcmp(line, TUNE_MAGIC "\n") == 0
+        && fscanf(in, "cpus %d sizes", &profile->cpus) == 1 && profile->cpus == online_cpus();
+    for(int s = 0; ok && s < TUNE_SIZES; s++)
+    {
+        int size;
+        ok = fscanf(in, "%d", &size) == 1 && size == tune_sizes[s];
+    }
+    char kind[16], name[64];
+    ok = ok && fscanf(in, "%15s", kind) == 1 && strcmp(kind, "update") == 0;
+    for(int s = 0; ok && s < TUNE_SIZES; s++)
+        ok = fscanf(in, "%lf", &profile->update[s]) == 1 && profile->update[s] > 0;
+
+    while (ok && fscanf(in, "%15s %63s", kind, name) == 2)
+    {
+        const SolverBackend *backend = find_backend(name);
+        // a backend that is no longer compiled in just drops out
+        if (strcmp(kind, "full") == 0 && profile->num_full < TUNE_MAX_BACKENDS)
+        {
+            TuneFull *full = &profile->full[profile->num_full];
+            for(int s = 0; ok && s < TUNE_SIZES; s++)
+                ok = fscanf(in, "%lf", &full->seconds[s]) == 1 && full->seconds[s] > 0;
+            full->backend = backend;
+            profile->num_full += backend != NULL;
+        }
+        else if (strcmp(kind, "partial") == 0 && profile->num_partial < TUNE_MAX_PARTIAL)
+        {
+            TunePartial *partial = &profile->partial[profile->num_partial];
+            ok = fscanf(in, "%d", &partial->threads) == 1;
+            for(int s = 0; ok && s < TUNE_SIZES; s++)
+                ok = fscanf(in, "%lf %lf", &partial->values[s], &partial->vector[s]) == 2
+                    && partial->values[s] > 0 && partial->vector[s] > 0;
+            partial->backend = backend;
+            profile->num_partial += backend != NULL;
+        }
+        else
+            ok = 0;
+    }
+    fclose(in);
+
+    // stale if a backend compiled in now was never timed
+    for(int b = 0; ok && solver_backends[b] != NULL; b++)
+    {
+        int timed = 0;
+        for(int f = 0; f < profile->num_full; f++)
+            timed |= profile->full[f].backend == solver_backends[b];
+        ok = timed;
+    }
+    if (!ok)
+    {
+        free(profile);
+        return NULL;
+    }
+    return profile;
+}
+
+// Time at n from times at tune_sizes: a power law through the two sizes
+// around n, or through the two nearest ones outside the range
+static double interpolate(const double *seconds, int n)
+{
+    int s = 0;
+    while (s < TUNE_SIZES-2 && n > tune_sizes[s+1])
+        s++;
+    double x = log(n), x0 = log(tune_sizes[s]), x1 = log(tune_sizes[s+1]);
+    double y0 = log(seconds[s]), y1 = log(seconds[s+1]);
+    return exp(y0 + (y1 - y0) * (x - x0) / (x1 - x0));
+}
+
+double autotune_predict(const TuneProfile *profile, int n, int k, SolvePlan *plan)
+{
+    double best = HUGE_VAL;
+    double full_seconds;
+    for(int f = 0; f < profile->num_full; f++)
+    {
+        double t = interpolate(profile->full[f].seconds, n);
+        if (t < best)
+        {
+            best = t;
+            *plan = (SolvePlan) { .backend=profile->full[f].backend, .partial=0, .threads=0 };
+        }
+    }
+    full_seconds = best;
+    // the partial path only pays off when it leaves out some vectors
+    for(int p = 0; p < profile->num_partial && k < n-1; p++)
+    {
+        const TunePartial *partial = &profile->partial[p];
+        double t = interpolate(partial->values, n) + k * interpolate(partial->vector, n);
+        if (t < best)
+        {
+            best = t;
+            *plan = (SolvePlan) { .backend=partial->backend, .partial=1, .threads=partial->threads };
+        }
+    }
+    plan->seconds = best;
+    plan->full_seconds = full_seconds;
+    plan->update_seconds = interpolate(profile->update, n);
+    return best;
+}
+
+void autotune_plan(int n, int k, SolvePlan *plan)
+{
+    const TuneProfile *profile = atomic_load(&installed);
+    if (profile != NULL && profile->num_full > 0)
+        autotune_predict(profile, n, k, plan);
+}
+
+void autotune_install(const TuneProfile *profile)
+{
+    atomic_store(&installed, profile);
+    solver_set_planner(profile != NULL ? &autotune_plan : NULL);
+}
+
+TuneProfile *autotune_startup(int recalibrate, FILE *log)
+{
+    char path[4096];
+    int have_path = spectrumstore_default_dir(path, sizeof(path) - 16);
+    if (have_path)
+        strcat(path, "/autotune");
+
+    TuneProfile *profile = (have_path && !recalibrate) ? autotune_load(path) : NULL;
+    if (profile == NULL)
+    {
+        if (log != NULL)
+            fprintf(log, "# calibrating the solver for this machine\n");
+        profile = autotune_calibrate(log);
+        if (have_path)
+            autotune_save(profile, path);
+    }
+    autotune_install(profile);
+    return profile;
+}
+
+void autotune_report(const TuneProfile *profile, FILE *out)
+{
+    static const int ns[] = {100, 500, 2000, 10000};
+    static const int ks[] = {1, 10, 50, 500};
+    fprintf(out, "# %d cpus\n# %6s %5s %-8s %-8s %8s %12s\n", profile->cpus, "n", "k", "backend", "path",
+        "threads", "predicted s");
+    for(size_t i = 0; i < sizeof(ns) / sizeof(ns[0]); i++)
+    {
+        for(size_t j = 0; j < sizeof(ks) / sizeof(ks[0]); j++)
+        {
+            if (ks[j] >= ns[i] - 1)
+                continue;
+            SolvePlan plan;
+            double t = autotune_predict(profile, ns[i], ks[j], &plan);
+            fprintf(out, "  %6d %5d %-8s %-8s %8d %12.3g\n", ns[i], ks[j], plan.backend->name,
+                plan.partial ? "partial" : "full", plan.threads, t);
+        }
+    }
+}
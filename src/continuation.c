@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "continuation.h"
+#include "tridiag.h"
+
+// Rayleigh quotient iterations a predictor gets to converge
+#define CONTINUE_MAX_RQI 8
+// Residual, relative to the spread of the spectrum, of a converged state
+#define CONTINUE_RESIDUAL 1e-12
+
+static void *continuation_malloc(size_t size)
+{
+    return solver_alloc(size, "continuation");
+}
+
+// x^T T x for a unit vector x
+static double rayleigh_quotient(const double *d, const double *e, int m, const double *x)
+{
+    double sum = 0;
+    for(int i = 0; i < m; i++)
+        sum += d[i] * x[i] * x[i];
+    for(int i = 0; i < m-1; i++)
+        sum += 2 * e[i] * x[i] * x[i+1];
+    return sum;
+}
+
+// |T x - sigma x|
+static double residual_norm(const double *d, const double *e, int m, const double *x, double sigma)
+{
+    double sum = 0;
+    for(int i = 0; i < m; i++)
+    {
+        double r = (d[i] - sigma) * x[i];
+        if (i > 0)
+            r += e[i-1] * x[i-1];
+        if (i < m-1)
+            r += e[i] * x[i+1];
+        sum += r * r;
+    }
+    return sqrt(sum);
+}
+
+static double dot(const double *a, const double *b, int m)
+{
+    double sum = 0;
+    for(int i = 0; i < m; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+int continue_eigenpairs(const double *d, const double *e, int m, int first, int k, double *w, double *vectors,
+    SolveControl *ctl, Arena *arena)
+{
+    if (ctl != NULL)
+    {
+        atomic_store_explicit(&ctl->total, k, memory_order_relaxed);
+        atomic_store_explicit(&ctl->progress, 0, memory_order_relaxed);
+    }
+    double lo, hi;
+    gershgorin_bounds(d, e, m, &lo, &hi);
+    double target = CONTINUE_RESIDUAL * (hi - lo);
+    ArenaMark mark = (arena != NULL) ? arena_mark(arena) : (ArenaMark) { 0, 0, NULL };
+    double *predictor = (arena != NULL) ? arena_take(arena, sizeof(double)*m) : continuation_malloc(sizeof(double)*m);
+    int status = 1;
+
+    for(int j = 0; j < k && status == 1; j++)
+    {
+        if (ctl != NULL && atomic_load_explicit(&ctl->cancel, memory_order_relaxed))
+        {
+            status = 0;
+            break;
+        }
+        double *x = vectors + (size_t) j*m;
+        double norm = sqrt(dot(x, x, m));
+        for(int i = 0; i < m; i++)
+            x[i] /= norm;
+        memcpy(predictor, x, sizeof(double)*m);
+
+        double sigma = rayleigh_quotient(d, e, m, x);
+        double residual = residual_norm(d, e, m, x, sigma);
+        for(int it = 0; it < CONTINUE_MAX_RQI && residual > target; it++)
+        {
+            shifted_solve(d, e, m, sigma, x, arena);
+            // keep clear of the states found already, e.g. the other half of a doublet
+            for(int i = 0; i < j; i++)
+            {
+                const double *found = vectors + (size_t) i*m;
+                double along = dot(found, x, m);
+                for(int l = 0; l < m; l++)
+                    x[l] -= along * found[l];
+            }
+            norm = sqrt(dot(x, x, m));
+            for(int i = 0; i < m; i++)
+                x[i] /= norm;
+            sigma = rayleigh_quotient(d, e, m, x);
+            residual = residual_norm(d, e, m, x, sigma);
+        }
+
+        // The residual bounds the distance to the nearest eigenvalue, so the
+        // counts around sigma say which state the iteration ended on. Counts
+        // are only exact to the rounding of T, far below the target.
+        double radius = target;
+        if (residual > target || sturm_count(d, e, m, sigma - radius) > first + j
+            || sturm_count(d, e, m, sigma + radius) <= first + j)
+        {
+            status = -1;
+            break;
+        }
+        if (dot(x, predictor, m) < 0)
+        {
+            for(int i = 0; i < m; i++)
+                x[i] = -x[i];
+        }
+        w[j] = sigma;
+        if (ctl != NULL)
+            atomic_store_explicit(&ctl->progress, j+1, memory_order_relaxed);
+    }
+
+    if (arena != NULL)
+        arena_release(arena, mark);
+    else
+        free(predictor);
+    return status;
+}
+
+LevelTracker *init_tracker(int n)
+{
+    LevelTracker *tracker = continuation_malloc(sizeof(LevelTracker));
+    tracker->n = n;
+    tracker->first = 0;
+    tracker->k = 0;
+    tracker->vectors = NULL;
+    tracker->labels = NULL;
+    tracker->next_label = 0;
+    tracker->overlaps = NULL;
+    tracker->matched = NULL;
+    tracker->parameters = continuation_malloc(sizeof(double)*TRACK_HISTORY);
+    tracker->energies = NULL;
+    tracker->history_labels = NULL;
+    tracker->steps = 0;
+    tracker->oldest = 0;
+    return tracker;
+}
+
+static void free_levels(LevelTracker *tracker)
+{
+    free(tracker->vectors);
+    free(tracker->labels);
+    free(tracker->overlaps);
+    free(tracker->matched);
+    free(tracker->energies);
+    free(tracker->history_labels);
+}
+
+void free_tracker(LevelTracker *tracker)
+{
+    free_levels(tracker);
+    free(tracker->parameters);
+    free(tracker);
+}
+
+void tracker_reset(LevelTracker *tracker)
+{
+    tracker->k = 0;
+    tracker->steps = 0;
+    tracker->oldest = 0;
+}
+
+int tracker_slot(const LevelTracker *tracker, int s)
+{
+    return (tracker->oldest + s) % TRACK_HISTORY;
+}
+
+// Sizes the arrays for k states and labels them in order of energy
+static void restart_levels(LevelTracker *tracker, int first, int k)
+{
+    int m = tracker->n - 1;
+    if (k != tracker->k)
+    {
+        free_levels(tracker);
+        tracker->vectors = continuation_malloc(sizeof(double)*m*k);
+        tracker->labels = continuation_malloc(sizeof(int)*k);
+        tracker->overlaps = continuation_malloc(sizeof(double)*k*k);
+        tracker->matched = continuation_malloc(sizeof(int)*k);
+        tracker->energies = continuation_malloc(sizeof(double)*TRACK_HISTORY*k);
+        tracker->history_labels = continuation_malloc(sizeof(int)*TRACK_HISTORY*k);
+    }
+    tracker->first = first;
+    tracker->k = k;
+    for(int j = 0; j < k; j++)
+        tracker->labels[j] = j;
+    tracker->next_label = k;
+    tracker->steps = 0;
+    tracker->oldest = 0;
+}
+
+// New labels from the largest overlaps first, so the clearest matches are
+// never taken by a weaker one
+static void match_levels(LevelTracker *tracker, const EigenPackage *epkg)
+{
+    int m = tracker->n - 1;
+    int k = tracker->k;
+    double *overlaps = tracker->overlaps;
+    memset(overlaps, 0, sizeof(double)*k*k);
+    for(int i = 0; i < m; i++)
+    {
+        const double *row = epkg->z[i];
+        for(int a = 0; a < k; a++)
+        {
+            double old = tracker->vectors[(size_t) a*m + i];
+            for(int b = 0; b < k; b++)
+                overlaps[a*k + b] += old * row[b];
+        }
+    }
+    for(int b = 0; b < k; b++)
+        tracker->matched[b] = -1;
+
+    for(int pass = 0; pass < k; pass++)
+    {
+        int best_a = -1, best_b = -1;
+        double best = TRACK_MIN_OVERLAP;
+        for(int a = 0; a < k; a++)
+        {
+            for(int b = 0; b < k; b++)
+            {
+                if (fabs(overlaps[a*k + b]) >= best)
+                {
+                    best = fabs(overlaps[a*k + b]);
+                    best_a = a;
+                    best_b = b;
+                }
+            }
+        }
+        if (best_a < 0)
+            break;
+        tracker->matched[best_b] = tracker->labels[best_a];
+        // neither state of the pair can be matched again
+        for(int l = 0; l < k; l++)
+        {
+            overlaps[best_a*k + l] = 0;
+            overlaps[l*k + best_b] = 0;
+        }
+    }
+
+    for(int b = 0; b < k; b++)
+        tracker->labels[b] = (tracker->matched[b] >= 0) ? tracker->matched[b] : tracker->next_label++;
+}
+
+void track_levels(LevelTracker *tracker, const EigenPackage *epkg, double parameter)
+{
+    int m = tracker->n - 1;
+    int k = epkg->num_efunctions;
+    if (epkg->n != tracker->n || k <= 0 || epkg->z_columns < k)
+        return;
+
+    if (k != tracker->k || epkg->first != tracker->first || tracker->steps == 0)
+        restart_levels(tracker, epkg->first, k);
+    else
+        match_levels(tracker, epkg);
+
+    for(int i = 0; i < m; i++)
+        for(int j = 0; j < k; j++)
+            tracker->vectors[(size_t) j*m + i] = epkg->z[i][j];
+
+    int slot;
+    if (tracker->steps < TRACK_HISTORY)
+        slot = tracker_slot(tracker, tracker->steps++);
+    else
+    {
+        slot = tracker->oldest;
+        tracker->oldest = (tracker->oldest + 1) % TRACK_HISTORY;
+    }
+    tracker->parameters[slot] = parameter;
+    for(int j = 0; j < k; j++)
+    {
+        tracker->energies[slot*k + j] = epkg->evalues[j];
+        tracker->history_labels[slot*k + j] = tracker->labels[j];
+    }
+}
@@ -0,0 +1,204 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "eigenexport.h"
+#include "spectrumcache.h"
+#include "tridiag.h"
+#include "slice.h"
+
+#define EXPORT_MAGIC "SEXPT01"
+
+// Start of every export file. count energies follow it, then count vectors
+// of n-1 values.
+struct export_header
+{
+    char magic[8];
+    uint64_t key; // spectrum_key() of the potential with k = 0
+    int32_t n;
+    int32_t first;
+    int32_t count;
+    int32_t stencil;
+    double potential_scale;
+    int64_t done; // leading vectors that are synced to disk
+};
+
+static off_t vector_offset(int n, int count, int i)
+{
+    return sizeof(struct export_header) + sizeof(double)*(off_t) count
+        + sizeof(double)*(off_t) (n-1) * i;
+}
+
+static int pwrite_all(int fd, const void *buf, size_t len, off_t offset)
+{
+    const char *p = buf;
+    while (len > 0)
+    {
+        ssize_t written = pwrite(fd, p, len, offset);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+        p += written;
+        len -= written;
+        offset += written;
+    }
+    return 1;
+}
+
+static int pread_all(int fd, void *buf, size_t len, off_t offset)
+{
+    char *p = buf;
+    while (len > 0)
+    {
+        ssize_t got = pread(fd, p, len, offset);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return 0;
+        p += got;
+        len -= got;
+        offset += got;
+    }
+    return 1;
+}
+
+// Everything written so far reaches the disk before the header says so
+static int checkpoint(int fd, struct export_header *header, int done)
+{
+    if (fdatasync(fd) != 0)
+        return 0;
+    header->done = done;
+    return pwrite_all(fd, header, sizeof(*header), 0) && fdatasync(fd) == 0;
+}
+
+int export_eigenvectors(const char *path, Vector2 *potential, int n, int first, int count, SolveControl *ctl)
+{
+    int m = n-1;
+    if (first < 0 || count < 1 || first + count > m)
+        return -1;
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return -1;
+
+    double *d = malloc(sizeof(double)*m);
+    double *e = malloc(sizeof(double)*m);
+    double *evalues = malloc(sizeof(double)*count);
+    double *history = malloc(sizeof(double)*m*EXPORT_HISTORY);
+    double *x = malloc(sizeof(double)*m);
+    if (d == NULL || e == NULL || evalues == NULL || history == NULL || x == NULL)
+    {
+        fprintf(stderr, "export_eigenvectors: malloc failed\n");
+        exit(1);
+    }
+    assemble_hamiltonian(potential, n, d, e);
+
+    struct export_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EXPORT_MAGIC, 8);
+    header.key = spectrum_key(potential, n, 0);
+    header.n = n;
+    header.first = first;
+    header.count = count;
+    header.stencil = HAMILTONIAN_STENCIL;
+    header.potential_scale = POTENTIAL_SCALE;
+
+    if (ctl != NULL)
+    {
+        atomic_store_explicit(&ctl->total, count, memory_order_relaxed);
+        atomic_store_explicit(&ctl->progress, 0, memory_order_relaxed);
+    }
+
+    // Resume a matching export, or start over in an empty file. The header
+    // goes in last, so a file whose header was never written is an export
+    // that stopped before its energies reached the disk, and starts over too.
+    static const char unwritten[8] = { 0 };
+    int done = -1;
+    int started = 1; // the file has a header
+    struct export_header found;
+    int have_header = pread_all(fd, &found, sizeof(found), 0);
+    if (have_header && memcmp(found.magic, unwritten, 8) != 0)
+    {
+        int64_t saved = found.done;
+        found.done = header.done;
+        if (memcmp(&found, &header, sizeof(header)) == 0
+            && pread_all(fd, evalues, sizeof(double)*count, sizeof(header)))
+        {
+            done = saved;
+            header.done = saved;
+        }
+    }
+    else if (have_header || lseek(fd, 0, SEEK_END) == 0)
+    {
+        if (!slice_eigenvalues(d, e, m, first, first + count - 1, evalues, 0, ctl, NULL))
+        {
+            started = 0; // cancelled before anything was written
+            done = 0;
+        }
+        else if (pwrite_all(fd, evalues, sizeof(double)*count, sizeof(header))
+            && ftruncate(fd, vector_offset(n, count, count)) == 0
+            && checkpoint(fd, &header, 0))
+            done = 0;
+    }
+
+    // The vectors the next ones must stay orthogonal to
+    int ok = done >= 0;
+    for(int j = (done > EXPORT_HISTORY) ? done - EXPORT_HISTORY : 0; ok && j < done; j++)
+        ok = pread_all(fd, history + (size_t) (j % EXPORT_HISTORY) * m, sizeof(double)*m,
+            vector_offset(n, count, j));
+
+    size_t unsynced = 0;
+    if (ok && ctl != NULL)
+        atomic_store_explicit(&ctl->progress, done, memory_order_relaxed);
+    while (ok && started && done < count)
+    {
+        if (ctl != NULL && atomic_load_explicit(&ctl->cancel, memory_order_relaxed))
+            break;
+
+        inverse_iteration_history(d, e, m, evalues, done, history, EXPORT_HISTORY, x, NULL);
+        memcpy(history + (size_t) (done % EXPORT_HISTORY) * m, x, sizeof(double)*m);
+        ok = pwrite_all(fd, x, sizeof(double)*m, vector_offset(n, count, done));
+        done++;
+        unsynced += sizeof(double)*m;
+
+        if (ok && unsynced >= EXPORT_CHECKPOINT_BYTES)
+        {
+            ok = checkpoint(fd, &header, done);
+            unsynced = 0;
+        }
+        if (ctl != NULL)
+            atomic_store_explicit(&ctl->progress, done, memory_order_relaxed);
+    }
+    if (ok && started && done > header.done)
+        ok = checkpoint(fd, &header, done);
+
+    ok = (close(fd) == 0) && ok;
+    free(x);
+    free(history);
+    free(evalues);
+    free(e);
+    free(d);
+    return ok ? done : -1;
+}
+
+int read_exported_vector(const char *path, int i, double *energy, double *vector)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct export_header header;
+    int ok = pread_all(fd, &header, sizeof(header), 0)
+        && memcmp(header.magic, EXPORT_MAGIC, 8) == 0
+        && i >= 0 && i < header.done
+        && pread_all(fd, energy, sizeof(double), sizeof(header) + sizeof(double)*(off_t) i)
+        && pread_all(fd, vector, sizeof(double)*(header.n-1), vector_offset(header.n, header.count, i));
+    close(fd);
+    return ok;
+}
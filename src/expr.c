@@ -0,0 +1,534 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "expr.h"
+#include "vecmath.h"
+
+#define EXPR_PI 3.14159265358979323846
+
+// Points evaluated per instruction
+#define EXPR_BLOCK 256
+// Deepest operand stack an expression may need
+#define EXPR_MAX_DEPTH 16
+
+enum
+{
+    OP_CONST, OP_X, OP_PARAM,
+    // unary
+    OP_NEG, OP_EXP, OP_LOG, OP_SQRT, OP_ABS, OP_SIN, OP_COS, OP_TAN, OP_TANH,
+    OP_POWI, // a^arg for a small non-negative integer arg
+    // binary
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POW, OP_MIN, OP_MAX,
+    OP_LT, OP_GT, OP_LE, OP_GE, OP_EQ, OP_NE,
+    // ternary
+    OP_IF
+};
+
+struct ExprInstr
+{
+    unsigned char op;
+    unsigned short arg; // index into consts or params
+};
+
+struct Expr
+{
+    struct ExprInstr *code;
+    int len;
+    int cap;
+    double *consts;
+    int num_consts;
+    char **param_names;
+    double *params;
+    int num_params;
+};
+
+// Recursive descent parser state
+struct Parser
+{
+    const char *p;
+    Expr *expr;
+    int depth; // operand stack depth after the code emitted so far
+    char *err;
+    int errlen;
+    int failed;
+};
+
+static const struct { const char *name; int op; int arity; } FUNCTIONS[] = {
+    {"exp", OP_EXP, 1}, {"log", OP_LOG, 1}, {"sqrt", OP_SQRT, 1}, {"abs", OP_ABS, 1},
+    {"sin", OP_SIN, 1}, {"cos", OP_COS, 1}, {"tan", OP_TAN, 1}, {"tanh", OP_TANH, 1},
+    {"min", OP_MIN, 2}, {"max", OP_MAX, 2}, {"if", OP_IF, 3},
+};
+
+static int op_arity(int op)
+{
+    if (op <= OP_PARAM)
+        return 0;
+    if (op <= OP_POWI)
+        return 1;
+    if (op <= OP_NE)
+        return 2;
+    return 3;
+}
+
+// Raises every lane to a small integer power by repeated squaring
+static void powi_lanes(double *restrict a, int power, int m)
+{
+    double result[EXPR_BLOCK];
+    for (int i=0;i<m;i++)
+        result[i] = 1.0;
+    while (power > 0)
+    {
+        if (power & 1)
+            for (int i=0;i<m;i++) result[i] *= a[i];
+        power >>= 1;
+        if (power > 0)
+            for (int i=0;i<m;i++) a[i] *= a[i];
+    }
+    memcpy(a, result, sizeof(double)*m);
+}
+
+// Applies op lane by lane. The result replaces a
+static void run_op(int op, int arg, double *restrict a, const double *restrict b, const double *restrict c, int m)
+{
+    int i;
+    switch (op)
+    {
+    case OP_POWI: powi_lanes(a, arg, m); break;
+    case OP_NEG:  for (i=0;i<m;i++) a[i] = -a[i]; break;
+    case OP_EXP:  vexp(a, a, m); break;
+    case OP_LOG:  for (i=0;i<m;i++) a[i] = log(a[i]); break;
+    case OP_SQRT: for (i=0;i<m;i++) a[i] = sqrt(a[i]); break;
+    case OP_ABS:  for (i=0;i<m;i++) a[i] = fabs(a[i]); break;
+    case OP_SIN:  vsin(a, a, m); break;
+    case OP_COS:  vcos(a, a, m); break;
+    case OP_TAN:  for (i=0;i<m;i++) a[i] = tan(a[i]); break;
+    case OP_TANH: for (i=0;i<m;i++) a[i] = tanh(a[i]); break;
+    case OP_ADD:  for (i=0;i<m;i++) a[i] += b[i]; break;
+    case OP_SUB:  for (i=0;i<m;i++) a[i] -= b[i]; break;
+    case OP_MUL:  for (i=0;i<m;i++) a[i] *= b[i]; break;
+    case OP_DIV:  for (i=0;i<m;i++) a[i] /= b[i]; break;
+    case OP_POW:  for (i=0;i<m;i++) a[i] = pow(a[i], b[i]); break;
+    case OP_MIN:  for (i=0;i<m;i++) a[i] = a[i] < b[i] ? a[i] : b[i]; break;
+    case OP_MAX:  for (i=0;i<m;i++) a[i] = a[i] > b[i] ? a[i] : b[i]; break;
+    case OP_LT:   for (i=0;i<m;i++) a[i] = a[i] < b[i]; break;
+    case OP_GT:   for (i=0;i<m;i++) a[i] = a[i] > b[i]; break;
+    case OP_LE:   for (i=0;i<m;i++) a[i] = a[i] <= b[i]; break;
+    case OP_GE:   for (i=0;i<m;i++) a[i] = a[i] >= b[i]; break;
+    case OP_EQ:   for (i=0;i<m;i++) a[i] = a[i] == b[i]; break;
+    case OP_NE:   for (i=0;i<m;i++) a[i] = a[i] != b[i]; break;
+    // a holds the condition
+    case OP_IF:   for (i=0;i<m;i++) a[i] = a[i] != 0 ? b[i] : c[i]; break;
+    }
+}
+
+static void parse_error(struct Parser *ps, const char *msg)
+{
+    if (ps->failed)
+        return;
+    ps->failed = 1;
+    snprintf(ps->err, ps->errlen, "%s near \"%.12s\"", msg, ps->p);
+}
+
+static void emit(struct Parser *ps, int op, int arg)
+{
+    Expr *expr = ps->expr;
+    int arity = op_arity(op);
+
+    // Fold operations whose operands are all constants
+    // x^2 and friends become multiplications instead of calls to pow()
+    if (op == OP_POW && expr->len >= 2 && expr->code[expr->len-1].op == OP_CONST)
+    {
+        double power = expr->consts[expr->code[expr->len-1].arg];
+        if (power >= 0 && power <= 64 && power == (int) power && expr->code[expr->len-2].op != OP_CONST)
+        {
+            expr->len--;
+            ps->depth--;
+            op = OP_POWI;
+            arg = (int) power;
+            arity = 1;
+        }
+    }
+
+    if (arity > 0 && expr->len >= arity)
+    {
+        int folded = 1;
+        for(int j = expr->len - arity; j < expr->len; j++)
+            folded = folded && expr->code[j].op == OP_CONST;
+        if (folded)
+        {
+            double v[3];
+            for(int j = 0; j < arity; j++)
+                v[j] = expr->consts[expr->code[expr->len - arity + j].arg];
+            run_op(op, arg, &v[0], &v[1], &v[2], 1);
+            // reuse the first operand's constant slot
+            int slot = expr->code[expr->len - arity].arg;
+            expr->consts[slot] = v[0];
+            expr->len -= arity - 1;
+            ps->depth -= arity - 1;
+            return;
+        }
+    }
+
+    if (expr->len == expr->cap)
+    {
+        expr->cap *= 2;
+        expr->code = realloc(expr->code, sizeof(struct ExprInstr)*expr->cap);
+    }
+    expr->code[expr->len++] = (struct ExprInstr) { .op=op, .arg=arg };
+
+    ps->depth += (arity == 0) ? 1 : 1 - arity;
+    if (ps->depth > EXPR_MAX_DEPTH)
+        parse_error(ps, "expression too deeply nested");
+}
+
+static void emit_const(struct Parser *ps, double value)
+{
+    Expr *expr = ps->expr;
+    expr->consts = realloc(expr->consts, sizeof(double)*(expr->num_consts+1));
+    expr->consts[expr->num_consts] = value;
+    emit(ps, OP_CONST, expr->num_consts++);
+}
+
+static int add_param(Expr *expr, const char *name, int len)
+{
+    for(int i = 0; i < expr->num_params; i++)
+        if ((int) strlen(expr->param_names[i]) == len && strncmp(expr->param_names[i], name, len) == 0)
+            return i;
+
+    expr->param_names = realloc(expr->param_names, sizeof(char*)*(expr->num_params+1));
+    expr->params = realloc(expr->params, sizeof(double)*(expr->num_params+1));
+    expr->param_names[expr->num_params] = malloc(len+1);
+    memcpy(expr->param_names[expr->num_params], name, len);
+    expr->param_names[expr->num_params][len] = '\0';
+    expr->params[expr->num_params] = 1.0;
+    return expr->num_params++;
+}
+
+static void skip_space(struct Parser *ps)
+{
+    while (isspace((unsigned char) *ps->p))
+        ps->p++;
+}
+
+static int accept(struct Parser *ps, const char *token)
+{
+    skip_space(ps);
+    size_t len = strlen(token);
+    if (strncmp(ps->p, token, len) != 0)
+        return 0;
+    ps->p += len;
+    return 1;
+}
+
+static void parse_expression(struct Parser *ps);
+
+static void parse_primary(struct Parser *ps)
+{
+    skip_space(ps);
+    if (ps->failed)
+        return;
+
+    if (isdigit((unsigned char) *ps->p) || *ps->p == '.')
+    {
+        char *end;
+        double value = strtod(ps->p, &end);
+        if (end == ps->p)
+        {
+            parse_error(ps, "bad number");
+            return;
+        }
+        ps->p = end;
+        emit_const(ps, value);
+    }
+    else if (isalpha((unsigned char) *ps->p) || *ps->p == '_')
+    {
+        const char *name = ps->p;
+        while (isalnum((unsigned char) *ps->p) || *ps->p == '_')
+            ps->p++;
+        int len = ps->p - name;
+
+        skip_space(ps);
+        if (*ps->p == '(')
+        {
+            int i;
+            int count = sizeof(FUNCTIONS) / sizeof(FUNCTIONS[0]);
+            for(i = 0; i < count; i++)
+                if ((int) strlen(FUNCTIONS[i].name) == len && strncmp(FUNCTIONS[i].name, name, len) == 0)
+                    break;
+            if (i == count)
+            {
+                ps->p = name;
+                parse_error(ps, "unknown function");
+                return;
+            }
+            ps->p++;
+            for(int j = 0; j < FUNCTIONS[i].arity; j++)
+            {
+                if (j > 0 && !accept(ps, ","))
+                {
+                    parse_error(ps, "expected ','");
+                    return;
+                }
+                parse_expression(ps);
+            }
+            if (!accept(ps, ")"))
+            {
+                parse_error(ps, "expected ')'");
+                return;
+            }
+            emit(ps, FUNCTIONS[i].op, 0);
+        }
+        else if (len == 1 && name[0] == 'x')
+            emit(ps, OP_X, 0);
+        else if (len == 2 && strncmp(name, "pi", 2) == 0)
+            emit_const(ps, EXPR_PI);
+        else
+            emit(ps, OP_PARAM, add_param(ps->expr, name, len));
+    }
+    else if (accept(ps, "("))
+    {
+        parse_expression(ps);
+        if (!accept(ps, ")"))
+            parse_error(ps, "expected ')'");
+    }
+    else
+        parse_error(ps, "expected a value");
+}
+
+static void parse_unary(struct Parser *ps);
+
+static void parse_power(struct Parser *ps)
+{
+    parse_primary(ps);
+    // right associative, and binds tighter than unary minus on its left
+    if (accept(ps, "^"))
+    {
+        parse_unary(ps);
+        emit(ps, OP_POW, 0);
+    }
+}
+
+static void parse_unary(struct Parser *ps)
+{
+    if (accept(ps, "-"))
+    {
+        parse_unary(ps);
+        emit(ps, OP_NEG, 0);
+    }
+    else
+    {
+        accept(ps, "+");
+        parse_power(ps);
+    }
+}
+
+static void parse_term(struct Parser *ps)
+{
+    parse_unary(ps);
+    while (!ps->failed)
+    {
+        if (accept(ps, "*"))
+        {
+            parse_unary(ps);
+            emit(ps, OP_MUL, 0);
+        }
+        else if (accept(ps, "/"))
+        {
+            parse_unary(ps);
+            emit(ps, OP_DIV, 0);
+        }
+        else
+            break;
+    }
+}
+
+static void parse_additive(struct Parser *ps)
+{
+    parse_term(ps);
+    while (!ps->failed)
+    {
+        if (accept(ps, "+"))
+        {
+            parse_term(ps);
+            emit(ps, OP_ADD, 0);
+        }
+        else if (accept(ps, "-"))
+        {
+            parse_term(ps);
+            emit(ps, OP_SUB, 0);
+        }
+        else
+            break;
+    }
+}
+
+static void parse_expression(struct Parser *ps)
+{
+    // two character operators first so "<=" is not read as "<"
+    static const struct { const char *token; int op; } COMPARISONS[] = {
+        {"<=", OP_LE}, {">=", OP_GE}, {"==", OP_EQ}, {"!=", OP_NE}, {"<", OP_LT}, {">", OP_GT},
+    };
+
+    parse_additive(ps);
+    for(int i = 0; i < (int) (sizeof(COMPARISONS) / sizeof(COMPARISONS[0])); i++)
+    {
+        if (accept(ps, COMPARISONS[i].token))
+        {
+            parse_additive(ps);
+            emit(ps, COMPARISONS[i].op, 0);
+            break;
+        }
+    }
+}
+
+// `; name = value` clauses after the expression
+static void parse_assignments(struct Parser *ps)
+{
+    while (!ps->failed && accept(ps, ";"))
+    {
+        skip_space(ps);
+        if (*ps->p == '\0')
+            break;
+        const char *name = ps->p;
+        while (isalnum((unsigned char) *ps->p) || *ps->p == '_')
+            ps->p++;
+        int len = ps->p - name;
+        if (len == 0 || !accept(ps, "="))
+        {
+            parse_error(ps, "expected 'name = value'");
+            return;
+        }
+        skip_space(ps);
+        char *end;
+        double value = strtod(ps->p, &end);
+        if (end == ps->p)
+        {
+            parse_error(ps, "bad number");
+            return;
+        }
+        ps->p = end;
+        int i = add_param(ps->expr, name, len);
+        ps->expr->params[i] = value;
+    }
+}
+
+Expr *expr_compile(const char *src, char *err, int errlen)
+{
+    Expr *expr = malloc(sizeof(Expr));
+    expr->cap = 16;
+    expr->len = 0;
+    expr->code = malloc(sizeof(struct ExprInstr)*expr->cap);
+    expr->consts = NULL;
+    expr->num_consts = 0;
+    expr->param_names = NULL;
+    expr->params = NULL;
+    expr->num_params = 0;
+
+    struct Parser ps = { .p=src, .expr=expr, .depth=0, .err=err, .errlen=errlen, .failed=0 };
+    parse_expression(&ps);
+    parse_assignments(&ps);
+    skip_space(&ps);
+    if (!ps.failed && *ps.p != '\0')
+        parse_error(&ps, "unexpected input");
+
+    if (ps.failed)
+    {
+        expr_free(expr);
+        return NULL;
+    }
+    return expr;
+}
+
+void expr_free(Expr *expr)
+{
+    for(int i = 0; i < expr->num_params; i++)
+        free(expr->param_names[i]);
+    free(expr->param_names);
+    free(expr->params);
+    free(expr->consts);
+    free(expr->code);
+    free(expr);
+}
+
+int expr_num_params(const Expr *expr)
+{
+    return expr->num_params;
+}
+
+const char *expr_param_name(const Expr *expr, int i)
+{
+    return expr->param_names[i];
+}
+
+double expr_get_param(const Expr *expr, int i)
+{
+    return expr->params[i];
+}
+
+void expr_set_param(Expr *expr, int i, double value)
+{
+    expr->params[i] = value;
+}
+
+int expr_find_param(const Expr *expr, const char *name)
+{
+    for(int i = 0; i < expr->num_params; i++)
+        if (strcmp(expr->param_names[i], name) == 0)
+            return i;
+    return -1;
+}
+
+void expr_eval(const Expr *expr, const double *x, double *out, size_t n)
+{
+    double stack[EXPR_MAX_DEPTH][EXPR_BLOCK];
+
+    for(size_t base = 0; base < n; base += EXPR_BLOCK)
+    {
+        int m = (n - base < EXPR_BLOCK) ? (int) (n - base) : EXPR_BLOCK;
+        int sp = 0;
+
+        for(int pc = 0; pc < expr->len; pc++)
+        {
+            struct ExprInstr instr = expr->code[pc];
+            double value;
+            switch (instr.op)
+            {
+            case OP_CONST:
+            case OP_PARAM:
+                value = (instr.op == OP_CONST) ? expr->consts[instr.arg] : expr->params[instr.arg];
+                for(int i = 0; i < m; i++)
+                    stack[sp][i] = value;
+                sp++;
+                break;
+            case OP_X:
+                memcpy(stack[sp++], x + base, sizeof(double)*m);
+                break;
+            default:
+            {
+                int arity = op_arity(instr.op);
+                sp -= arity - 1;
+                double *a = stack[sp-1];
+                run_op(instr.op, instr.arg, a, arity > 1 ? stack[sp] : NULL, arity > 2 ? stack[sp+1] : NULL, m);
+            }
+            }
+        }
+        memcpy(out + base, stack[0], sizeof(double)*m);
+    }
+}
+
+void expr_apply(const Expr *expr, double *domain, Vector2 *points, int n)
+{
+    double values[EXPR_BLOCK];
+    for(int base = 0; base <= n; base += EXPR_BLOCK)
+    {
+        int m = (n + 1 - base < EXPR_BLOCK) ? n + 1 - base : EXPR_BLOCK;
+        expr_eval(expr, domain + base, values, m);
+        for(int i = 0; i < m; i++)
+        {
+            points[base + i].x = domain[base + i];
+            points[base + i].y = values[i];
+        }
+    }
+}
@@ -0,0 +1,1051 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "lanczos2d.h"
+
+#define LANCZOS_MAX_THREADS 16
+// Rows of the grid per thread below which extra threads cost more than they save
+#define LANCZOS_MIN_ROWS 16
+// Vector entries handled together so the Gram-Schmidt passes stay in cache
+#define LANCZOS_CHUNK 2048
+// A state is converged when ||H x - rho x|| is below this times ||H||
+#define LANCZOS_TOL 1e-8
+#define LANCZOS_MAX_RESTARTS 2000
+#define LANCZOS_MAX_DEGREE 200
+// Cold solves on grids at least this fine start from the states of a grid
+// with half as many intervals per side
+#define LANCZOS_COARSE_N 128
+// Energies on the finer grid sit a little higher, so the cut taken over
+// from the coarse one moves up by this share of its distance from the ground
+// state
+#define LANCZOS_COARSE_MARGIN 0.1
+
+// Work every thread does in one parallel step, over its own block of rows
+enum
+{
+    PHASE_OPERATOR, // out = alpha H in + beta in + gamma prev, optionally dots with out
+    PHASE_DOT, // partial dots of v_0..v_j with w, then |w|^2
+    PHASE_UPDATE_DOT, // w -= sum coef_i v_i, then partial dots with w
+    PHASE_UPDATE_NORM, // w -= sum coef_i v_i, then partial |w|^2
+    PHASE_SCALE, // w *= scale
+    PHASE_START, // w = random, plus the warm start vectors if any
+    PHASE_ROTATE, // v_i = sum_j v_j Y[j][i] for i < keep
+    PHASE_RAYLEIGH, // partial v_i . H v_i for i < k
+    PHASE_RESIDUAL, // partial |H v_i - coef_i v_i|^2 for i < k
+    PHASE_QUIT
+};
+
+// pthread_barrier_t is missing on macOS
+typedef struct Barrier
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int count;
+    int waiting;
+    int generation;
+} Barrier;
+
+typedef struct Lanczos Lanczos;
+
+typedef struct LanczosTask
+{
+    Lanczos *lz;
+    int t;
+    pthread_t thread;
+    double *row; // one row of scratch
+} LanczosTask;
+
+struct Lanczos
+{
+    int side; // interior points per side, n-1
+    int size; // side^2 unknowns
+    int m; // basis vectors kept before a restart
+    int k;
+    int nthreads;
+    LanczosTask tasks[LANCZOS_MAX_THREADS];
+    Barrier start;
+    Barrier finish;
+
+    double *diag; // diagonal of H
+    double off; // the four neighbour couplings
+    double *zeros; // a row of zeros
+
+    double **v; // m+1 basis vectors
+    double *scratch[2]; // Chebyshev recurrence
+    double *w; // vector the current phase works on
+    double *coef; // m+1
+    double *partial; // nthreads rows of m+1 partial sums
+    double *ritz; // m*m Ritz vectors of T, column i is vector i
+    double *rotate_tmp; // per thread, keep * side
+
+    const double *warm; // k vectors seeding the start vector, or NULL
+    uint64_t seed;
+
+    int phase;
+    int j; // vectors v_0..v_j take part in the phase
+    int keep; // vectors produced by PHASE_ROTATE
+    double scale;
+
+    // PHASE_OPERATOR
+    const double *in;
+    const double *prev;
+    double *out;
+    double alpha;
+    double beta;
+    double gamma;
+    int with_dots;
+
+    // Chebyshev filter: -T_d mapped so [cut, upper] lands in [-1, 1]
+    int degree; // 0 applies H itself
+    double centre;
+    double half_width;
+};
+
+static void init_barrier(Barrier *b, int count)
+{
+    pthread_mutex_init(&b->lock, NULL);
+    pthread_cond_init(&b->cond, NULL);
+    b->count = count;
+    b->waiting = 0;
+    b->generation = 0;
+}
+
+static void free_barrier(Barrier *b)
+{
+    pthread_mutex_destroy(&b->lock);
+    pthread_cond_destroy(&b->cond);
+}
+
+static void barrier_wait(Barrier *b)
+{
+    pthread_mutex_lock(&b->lock);
+    int generation = b->generation;
+    if (++b->waiting == b->count)
+    {
+        b->generation++;
+        b->waiting = 0;
+        pthread_cond_broadcast(&b->cond);
+    }
+    else
+    {
+        while (generation == b->generation)
+            pthread_cond_wait(&b->cond, &b->lock);
+    }
+    pthread_mutex_unlock(&b->lock);
+}
+
+static int thread_count(int side)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = (cpus < 1) ? 1 : (int) cpus;
+    if (threads > LANCZOS_MAX_THREADS)
+        threads = LANCZOS_MAX_THREADS;
+    if (threads > side / LANCZOS_MIN_ROWS)
+        threads = side / LANCZOS_MIN_ROWS;
+    return (threads < 1) ? 1 : threads;
+}
+
+static uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// One row of out = alpha H x + beta x + gamma prev, where H is diag plus off
+// times the four neighbours. zeros stands in for rows outside the grid and
+// for a missing prev.
+static void operator_row(const double *diag, double off, int side, const double *zeros,
+    const double *x, const double *prev, int r, double alpha, double beta, double gamma,
+    double *restrict out)
+{
+    size_t base = (size_t) r * side;
+    const double *row = x + base;
+    const double *up = (r > 0) ? row - side : zeros;
+    const double *down = (r < side-1) ? row + side : zeros;
+    const double *p = (prev != NULL) ? prev + base : zeros;
+    const double *d = diag + base;
+    double coupling = alpha * off;
+
+    if (side == 1)
+    {
+        out[0] = (alpha*d[0] + beta) * row[0] + gamma * p[0];
+        return;
+    }
+    out[0] = (alpha*d[0] + beta) * row[0] + coupling * (row[1] + up[0] + down[0]) + gamma * p[0];
+    for (int c = 1; c < side-1; c++)
+        out[c] = (alpha*d[c] + beta) * row[c]
+            + coupling * (row[c-1] + row[c+1] + up[c] + down[c]) + gamma * p[c];
+    int c = side - 1;
+    out[c] = (alpha*d[c] + beta) * row[c] + coupling * (row[c-1] + up[c] + down[c]) + gamma * p[c];
+}
+
+static void build_diagonal(const double *potential, int n, double *diag)
+{
+    int side = n - 1;
+    double dl = 1.0 / n;
+    for (int r = 0; r < side; r++)
+        for (int c = 0; c < side; c++)
+            diag[(size_t) r * side + c] = 2.0 / (dl*dl)
+                + POTENTIAL_SCALE * potential[(size_t) (r+1) * (n+1) + c + 1];
+}
+
+void apply_hamiltonian2d(const double *potential, int n, const double *in, double *out)
+{
+    int side = n - 1;
+    double *diag = malloc(sizeof(double) * side * side);
+    double *zeros = calloc(side, sizeof(double));
+    build_diagonal(potential, n, diag);
+    for (int r = 0; r < side; r++)
+        operator_row(diag, -0.5 * n * n, side, zeros, in, NULL, r, 1, 0, 0, out + (size_t) r * side);
+    free(zeros);
+    free(diag);
+}
+
+// Partial dots of v_0..v_j with w, and |w|^2 after them in sums[j+1]
+static void dots(Lanczos *lz, const double *w, double *sums, size_t lo, size_t hi)
+{
+    for (int i = 0; i <= lz->j + 1; i++)
+        sums[i] = 0;
+    for (size_t base = lo; base < hi; base += LANCZOS_CHUNK)
+    {
+        size_t end = (base + LANCZOS_CHUNK < hi) ? base + LANCZOS_CHUNK : hi;
+        for (int i = 0; i <= lz->j; i++)
+        {
+            const double *v = lz->v[i];
+            double s = 0;
+            for (size_t p = base; p < end; p++)
+                s += v[p] * w[p];
+            sums[i] += s;
+        }
+        double s = 0;
+        for (size_t p = base; p < end; p++)
+            s += w[p] * w[p];
+        sums[lz->j + 1] += s;
+    }
+}
+
+// w -= sum coef_i v_i, then either dots with v_0..v_j or |w|^2 into sums
+static void subtract(Lanczos *lz, double *w, double *sums, size_t lo, size_t hi, int norm_only)
+{
+    int count = norm_only ? 1 : lz->j + 1;
+    for (int i = 0; i < count; i++)
+        sums[i] = 0;
+    for (size_t base = lo; base < hi; base += LANCZOS_CHUNK)
+    {
+        size_t end = (base + LANCZOS_CHUNK < hi) ? base + LANCZOS_CHUNK : hi;
+        for (int i = 0; i <= lz->j; i++)
+        {
+            const double *v = lz->v[i];
+            double c = lz->coef[i];
+            for (size_t p = base; p < end; p++)
+                w[p] -= c * v[p];
+        }
+        if (norm_only)
+        {
+            double s = 0;
+            for (size_t p = base; p < end; p++)
+                s += w[p] * w[p];
+            sums[0] += s;
+            continue;
+        }
+        for (int i = 0; i <= lz->j; i++)
+        {
+            const double *v = lz->v[i];
+            double s = 0;
+            for (size_t p = base; p < end; p++)
+                s += v[p] * w[p];
+            sums[i] += s;
+        }
+    }
+}
+
+static void run_task(LanczosTask *task)
+{
+    Lanczos *lz = task->lz;
+    int side = lz->side;
+    int row_lo = (int) ((long) side * task->t / lz->nthreads);
+    int row_hi = (int) ((long) side * (task->t + 1) / lz->nthreads);
+    size_t lo = (size_t) row_lo * side;
+    size_t hi = (size_t) row_hi * side;
+    double *sums = lz->partial + (size_t) task->t * (lz->m + 1);
+    double *w = lz->w;
+
+    switch (lz->phase)
+    {
+    case PHASE_OPERATOR:
+        for (int r = row_lo; r < row_hi; r++)
+            operator_row(lz->diag, lz->off, side, lz->zeros, lz->in, lz->prev, r,
+                lz->alpha, lz->beta, lz->gamma, lz->out + (size_t) r * side);
+        if (lz->with_dots)
+            dots(lz, w, sums, lo, hi);
+        break;
+    case PHASE_DOT:
+        dots(lz, w, sums, lo, hi);
+        break;
+    case PHASE_UPDATE_DOT:
+        subtract(lz, w, sums, lo, hi, 0);
+        break;
+    case PHASE_UPDATE_NORM:
+        subtract(lz, w, sums, lo, hi, 1);
+        break;
+    case PHASE_SCALE:
+        for (size_t p = lo; p < hi; p++)
+            w[p] *= lz->scale;
+        break;
+    case PHASE_START:
+        for (size_t p = lo; p < hi; p++)
+        {
+            double u = (splitmix64(lz->seed ^ p) >> 11) * (1.0 / 9007199254740992.0);
+            w[p] = u - 0.5;
+        }
+        if (lz->warm != NULL)
+        {
+            // mostly the previous states, with a little noise so the basis
+            // still reaches states an edit may have brought down
+            for (size_t p = lo; p < hi; p++)
+                w[p] *= 1e-3 / sqrt((double) lz->size);
+            for (int s = 0; s < lz->k; s++)
+            {
+                const double *prev = lz->warm + (size_t) s * lz->size;
+                for (size_t p = lo; p < hi; p++)
+                    w[p] += prev[p];
+            }
+        }
+        break;
+    case PHASE_ROTATE:
+    {
+        // one row at a time through a small buffer, so the basis is
+        // rotated in place
+        double *tmp = lz->rotate_tmp + (size_t) task->t * lz->keep * side;
+        for (int r = row_lo; r < row_hi; r++)
+        {
+            size_t base = (size_t) r * side;
+            memset(tmp, 0, sizeof(double) * lz->keep * side);
+            for (int j = 0; j < lz->m; j++)
+            {
+                const double *v = lz->v[j] + base;
+                for (int i = 0; i < lz->keep; i++)
+                {
+                    double y = lz->ritz[(size_t) j * lz->m + i];
+                    double *out = tmp + (size_t) i * side;
+                    for (int c = 0; c < side; c++)
+                        out[c] += y * v[c];
+                }
+            }
+            for (int i = 0; i < lz->keep; i++)
+                memcpy(lz->v[i] + base, tmp + (size_t) i * side, sizeof(double) * side);
+        }
+        break;
+    }
+    case PHASE_RAYLEIGH:
+    case PHASE_RESIDUAL:
+        // H v_i a row at a time, never stored
+        for (int i = 0; i < lz->k; i++)
+        {
+            double s = 0;
+            for (int r = row_lo; r < row_hi; r++)
+            {
+                const double *v = lz->v[i] + (size_t) r * side;
+                operator_row(lz->diag, lz->off, side, lz->zeros, lz->v[i], NULL, r, 1, 0, 0, task->row);
+                if (lz->phase == PHASE_RAYLEIGH)
+                {
+                    for (int c = 0; c < side; c++)
+                        s += v[c] * task->row[c];
+                }
+                else
+                {
+                    for (int c = 0; c < side; c++)
+                    {
+                        double d = task->row[c] - lz->coef[i] * v[c];
+                        s += d * d;
+                    }
+                }
+            }
+            sums[i] = s;
+        }
+        break;
+    }
+}
+
+static void *lanczos_worker(void *arg)
+{
+    LanczosTask *task = arg;
+    Lanczos *lz = task->lz;
+    while (1)
+    {
+        barrier_wait(&lz->start);
+        if (lz->phase == PHASE_QUIT)
+            break;
+        run_task(task);
+        barrier_wait(&lz->finish);
+    }
+    return NULL;
+}
+
+// Runs one phase over all rows on the pool and adds up the first `count`
+// partial sums into lz->coef
+static void run_phase(Lanczos *lz, int phase, int count)
+{
+    lz->phase = phase;
+    if (lz->nthreads > 1)
+        barrier_wait(&lz->start);
+    if (phase == PHASE_QUIT)
+        return;
+    run_task(&lz->tasks[0]);
+    if (lz->nthreads > 1)
+        barrier_wait(&lz->finish);
+
+    for (int i = 0; i < count; i++)
+    {
+        double s = 0;
+        for (int t = 0; t < lz->nthreads; t++)
+            s += lz->partial[(size_t) t * (lz->m + 1) + i];
+        lz->coef[i] = s;
+    }
+}
+
+// w = op(v_j) into lz->w, with the dots of v_0..v_j and w in coef. op is H
+// for degree 0 and the Chebyshev filter otherwise.
+static void apply_operator(Lanczos *lz)
+{
+    const double *x = lz->v[lz->j];
+    if (lz->degree == 0)
+    {
+        lz->in = x;
+        lz->prev = NULL;
+        lz->out = lz->w;
+        lz->alpha = 1;
+        lz->beta = 0;
+        lz->with_dots = 1;
+        run_phase(lz, PHASE_OPERATOR, lz->j + 2);
+        return;
+    }
+
+    // y_1 = (H - c) x / e and y_{i+1} = 2 (H - c) y_i / e - y_{i-1}. The
+    // last step lands in w and flips the sign for even degrees, so the
+    // wanted states become the most negative values of the operator.
+    int d = lz->degree;
+    double sign = (d % 2 == 0) ? -1.0 : 1.0;
+    double *buffers[3];
+    buffers[(d - 1) % 3] = lz->w;
+    buffers[d % 3] = lz->scratch[0];
+    buffers[(d + 1) % 3] = lz->scratch[1];
+
+    const double *prev = NULL;
+    const double *cur = x;
+    for (int i = 1; i <= d; i++)
+    {
+        double s = (i == d) ? sign : 1.0;
+        double two = (i == 1) ? 1.0 : 2.0;
+        lz->in = cur;
+        lz->prev = prev;
+        lz->out = buffers[(i - 1) % 3];
+        lz->alpha = s * two / lz->half_width;
+        lz->beta = -s * two * lz->centre / lz->half_width;
+        lz->gamma = -s;
+        lz->with_dots = (i == d);
+        run_phase(lz, PHASE_OPERATOR, (i == d) ? lz->j + 2 : 0);
+        prev = cur;
+        cur = lz->out;
+    }
+}
+
+// Orthogonalizes lz->w against v_0..v_j, leaves it normalized and returns
+// the norm it had. On entry coef holds the dots of v_0..v_j with w followed
+// by |w|^2; on return proj holds the total projections. Classical
+// Gram-Schmidt, with a second pass only when the first one removed most of w
+// and so lost precision to cancellation.
+static double orthonormalize(Lanczos *lz, double *proj)
+{
+    double before = lz->coef[lz->j + 1];
+    double after = before;
+    for (int i = 0; i <= lz->j; i++)
+    {
+        proj[i] = lz->coef[i];
+        after -= proj[i] * proj[i];
+    }
+    if (after < 0.5 * before)
+    {
+        run_phase(lz, PHASE_UPDATE_DOT, lz->j + 1);
+        for (int i = 0; i <= lz->j; i++)
+            proj[i] += lz->coef[i];
+    }
+    run_phase(lz, PHASE_UPDATE_NORM, 1);
+
+    double norm = sqrt(lz->coef[0]);
+    if (norm > 0)
+    {
+        lz->scale = 1.0 / norm;
+        run_phase(lz, PHASE_SCALE, 0);
+    }
+    return norm;
+}
+
+// Cyclic Jacobi on the m x m symmetric matrix a (destroyed). Eigenvalues come
+// out ascending in theta with the matching vectors in the columns of y.
+static void dense_eigen(double *a, int m, double *theta, double *y)
+{
+    for (int i = 0; i < m; i++)
+        for (int j = 0; j < m; j++)
+            y[i*m + j] = (i == j);
+
+    for (int sweep = 0; sweep < 100; sweep++)
+    {
+        double off = 0, total = 0;
+        for (int i = 0; i < m; i++)
+            for (int j = 0; j < m; j++)
+            {
+                total += a[i*m + j] * a[i*m + j];
+                if (i != j)
+                    off += a[i*m + j] * a[i*m + j];
+            }
+        if (off <= 1e-30 * total)
+            break;
+
+        for (int p = 0; p < m-1; p++)
+        {
+            for (int q = p+1; q < m; q++)
+            {
+                double apq = a[p*m + q];
+                if (apq == 0)
+                    continue;
+                double tau = (a[q*m + q] - a[p*m + p]) / (2 * apq);
+                double t = (tau >= 0 ? 1.0 : -1.0) / (fabs(tau) + sqrt(1 + tau*tau));
+                double c = 1 / sqrt(1 + t*t);
+                double s = t * c;
+
+                for (int k = 0; k < m; k++)
+                {
+                    double akp = a[k*m + p], akq = a[k*m + q];
+                    a[k*m + p] = c*akp - s*akq;
+                    a[k*m + q] = s*akp + c*akq;
+                }
+                for (int k = 0; k < m; k++)
+                {
+                    double apk = a[p*m + k], aqk = a[q*m + k];
+                    a[p*m + k] = c*apk - s*aqk;
+                    a[q*m + k] = s*apk + c*aqk;
+                }
+                for (int k = 0; k < m; k++)
+                {
+                    double ykp = y[k*m + p], ykq = y[k*m + q];
+                    y[k*m + p] = c*ykp - s*ykq;
+                    y[k*m + q] = s*ykp + c*ykq;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < m; i++)
+        theta[i] = a[i*m + i];
+    // selection sort, swapping vector columns along with the values
+    for (int i = 0; i < m-1; i++)
+    {
+        int lowest = i;
+        for (int j = i+1; j < m; j++)
+            if (theta[j] < theta[lowest])
+                lowest = j;
+        if (lowest == i)
+            continue;
+        double t = theta[i];
+        theta[i] = theta[lowest];
+        theta[lowest] = t;
+        for (int k = 0; k < m; k++)
+        {
+            t = y[k*m + i];
+            y[k*m + i] = y[k*m + lowest];
+            y[k*m + lowest] = t;
+        }
+    }
+}
+
+Spectrum2D *init_spectrum2d(int n, int k)
+{
+    Spectrum2D *spec = malloc(sizeof(Spectrum2D));
+    spec->n = n;
+    spec->k = k;
+    spec->evalues = calloc(k, sizeof(double));
+    spec->evectors = calloc((size_t) k * (n-1) * (n-1), sizeof(double));
+    spec->potential = calloc((size_t) (n+1) * (n+1), sizeof(double));
+    if (spec->evalues == NULL || spec->evectors == NULL || spec->potential == NULL)
+    {
+        fprintf(stderr, "init_spectrum2d: calloc failed\n");
+        exit(1);
+    }
+    spec->solved = 0;
+    spec->iterations = 0;
+    spec->restarts = 0;
+    return spec;
+}
+
+void free_spectrum2d(Spectrum2D *spec)
+{
+    free(spec->evalues);
+    free(spec->evectors);
+    free(spec->potential);
+    free(spec);
+}
+
+static int cancelled(SolveControl *ctl)
+{
+    return ctl != NULL && atomic_load_explicit(&ctl->cancel, memory_order_relaxed);
+}
+
+// Extends the basis from v_start to v_m, filling columns start..m-1 of the
+// projected matrix t. Returns the norm of the last residual, or -1 if the
+// solve was cancelled.
+static double lanczos_steps(Lanczos *lz, double *t, int start, double *proj, SolveControl *ctl)
+{
+    int m = lz->m;
+    double beta = 0;
+    for (int j = start; j < m; j++)
+    {
+        if (cancelled(ctl))
+            return -1;
+
+        lz->j = j;
+        lz->w = lz->v[j+1];
+        apply_operator(lz);
+        beta = orthonormalize(lz, proj);
+        for (int i = 0; i <= j; i++)
+        {
+            t[i*m + j] = proj[i];
+            t[j*m + i] = proj[i];
+        }
+
+        if (beta < 1e-12 * (fabs(t[j*m + j]) + 1) && j < m-1)
+        {
+            // invariant subspace: carry on from a fresh direction that t
+            // does not couple to
+            lz->seed = splitmix64(lz->seed);
+            lz->warm = NULL;
+            run_phase(lz, PHASE_START, 0);
+            run_phase(lz, PHASE_DOT, j + 2);
+            orthonormalize(lz, proj);
+            beta = 0;
+        }
+    }
+    return beta;
+}
+
+// i-th smallest eigenvalue of -laplacian/2 on the grid,
+// (2 - cos(p pi / n) - cos(q pi / n)) / dl^2 for p, q = 1 .. n-1
+static double laplacian_eigenvalue(int n, int i)
+{
+    int side = n - 1;
+    int count = 0;
+    int limit = (i + 1 < side) ? i + 1 : side;
+    double *values = malloc(sizeof(double) * limit * limit);
+    for (int p = 1; p <= limit; p++)
+        for (int q = 1; q <= limit; q++)
+            values[count++] = (double) n * n * (2 - cos(p * M_PI / n) - cos(q * M_PI / n));
+    // the i+1 smallest of these are the i+1 smallest overall
+    for (int a = 0; a <= i && a < count; a++)
+        for (int b = a+1; b < count; b++)
+            if (values[b] < values[a])
+            {
+                double t = values[a];
+                values[a] = values[b];
+                values[b] = t;
+            }
+    double value = values[(i < count) ? i : count - 1];
+    free(values);
+    return value;
+}
+
+// Filter degree for states below cut when the spectrum spans [lowest, upper].
+// Chebyshev polynomials resolve relative gaps of about 1/degree^2.
+static int filter_degree(double lowest, double cut, double upper)
+{
+    if (cut <= lowest || cut >= upper)
+        return 0;
+    double degree = 3 * sqrt((upper - cut) / (cut - lowest));
+    if (degree < 2)
+        return 0;
+    return (degree > LANCZOS_MAX_DEGREE) ? LANCZOS_MAX_DEGREE : (int) degree;
+}
+
+// Replaces the basis with the normalized sum of the lowest k Ritz vectors of
+// the last pass, in v_0
+static void restart_from_sum(Lanczos *lz, double *proj)
+{
+    int m = lz->m;
+    for (int j = 0; j < m; j++)
+    {
+        double sum = 0;
+        for (int i = 0; i < lz->k; i++)
+            sum += lz->ritz[j*m + i];
+        lz->ritz[j*m] = sum;
+    }
+    lz->keep = 1;
+    run_phase(lz, PHASE_ROTATE, 0);
+    lz->w = lz->v[0];
+    lz->j = -1;
+    run_phase(lz, PHASE_DOT, 1);
+    orthonormalize(lz, proj);
+}
+
+static void set_filter(Lanczos *lz, double lowest, double cut, double upper)
+{
+    lz->degree = filter_degree(lowest, cut, upper);
+    lz->centre = 0.5 * (cut + upper);
+    lz->half_width = 0.5 * (upper - cut);
+}
+
+// Energy of a filtered Ritz value theta < -1, which is an upper bound on the
+// energy of the matching state
+static double unfilter(const Lanczos *lz, double theta)
+{
+    return lz->centre - lz->half_width * cosh(acosh(-theta) / lz->degree);
+}
+
+void resample2d(const double *from, int from_n, double *to, int to_n)
+{
+    for (int i = 0; i <= to_n; i++)
+    {
+        double y = (double) i * from_n / to_n;
+        int r = (y < from_n) ? (int) y : from_n - 1;
+        double fy = y - r;
+        for (int j = 0; j <= to_n; j++)
+        {
+            double x = (double) j * from_n / to_n;
+            int c = (x < from_n) ? (int) x : from_n - 1;
+            double fx = x - c;
+            const double *below = from + (size_t) r * (from_n+1) + c;
+            const double *above = below + from_n + 1;
+            to[(size_t) i * (to_n+1) + j] = (1-fy) * ((1-fx) * below[0] + fx * below[1])
+                + fy * ((1-fx) * above[0] + fx * above[1]);
+        }
+    }
+}
+
+// Fills spec, which holds no solve yet, with the states of the potential on
+// a grid with half as many intervals per side (itself seeded the same way
+// while it is fine enough) interpolated back, as if they were a previous
+// solve. Returns 0 if cancelled, leaving spec as it was.
+static int seed_from_coarse(const double *potential, Spectrum2D *spec, SolveControl *ctl)
+{
+    int n = spec->n;
+    int side = n - 1;
+    int coarse_n = n / 2;
+    int coarse_side = coarse_n - 1;
+    Spectrum2D *coarse = init_spectrum2d(coarse_n, spec->k);
+    double *grid = malloc(sizeof(double) * (coarse_n+1) * (coarse_n+1));
+    double *fine = malloc(sizeof(double) * (n+1) * (n+1));
+    if (grid == NULL || fine == NULL)
+    {
+        fprintf(stderr, "solve_spectrum2d: malloc failed\n");
+        exit(1);
+    }
+    resample2d(potential, n, grid, coarse_n);
+    int done = solve_spectrum2d(grid, coarse, ctl);
+    if (done)
+    {
+        memset(grid, 0, sizeof(double) * (coarse_n+1) * (coarse_n+1));
+        for (int s = 0; s < spec->k; s++)
+        {
+            const double *psi = coarse->evectors + (size_t) s * coarse_side * coarse_side;
+            for (int r = 0; r < coarse_side; r++)
+                memcpy(grid + (size_t) (r+1) * (coarse_n+1) + 1, psi + (size_t) r * coarse_side,
+                    sizeof(double) * coarse_side);
+            resample2d(grid, coarse_n, fine, n);
+
+            double *out = spec->evectors + (size_t) s * side * side;
+            double norm = 0;
+            for (int r = 0; r < side; r++)
+                for (int c = 0; c < side; c++)
+                {
+                    double value = fine[(size_t) (r+1) * (n+1) + c + 1];
+                    out[(size_t) r * side + c] = value;
+                    norm += value * value;
+                }
+            for (size_t p = 0; p < (size_t) side * side; p++)
+                out[p] /= sqrt(norm);
+        }
+        memcpy(spec->evalues, coarse->evalues, sizeof(double) * spec->k);
+        memcpy(spec->potential, potential, sizeof(double) * (n+1) * (n+1));
+        spec->cut = coarse->cut + LANCZOS_COARSE_MARGIN * (coarse->cut - coarse->evalues[0]);
+        spec->solved = 1;
+    }
+    free(fine);
+    free(grid);
+    free_spectrum2d(coarse);
+    return done;
+}
+
+int solve_spectrum2d(const double *potential, Spectrum2D *spec, SolveControl *ctl)
+{
+    int n = spec->n;
+    int k = spec->k;
+    if (!spec->solved && n >= LANCZOS_COARSE_N && !seed_from_coarse(potential, spec, ctl))
+        return 0;
+    Lanczos lz;
+    lz.side = n - 1;
+    lz.size = lz.side * lz.side;
+    lz.k = k;
+    // A short basis: past a dozen extra vectors the Gram-Schmidt work grows
+    // faster than the restarts it saves
+    lz.m = k + 12;
+    if (lz.m > lz.size - 1)
+        lz.m = lz.size - 1;
+    lz.nthreads = thread_count(lz.side);
+    lz.off = -0.5 * n * n;
+    lz.warm = spec->solved ? spec->evectors : NULL;
+    lz.seed = 0x5eed;
+    lz.degree = 0;
+    int m = lz.m;
+    int keep = k + (m - k) / 2;
+
+    lz.diag = malloc(sizeof(double) * lz.size);
+    lz.zeros = calloc(lz.side, sizeof(double));
+    lz.v = malloc(sizeof(double *) * (m + 1));
+    for (int i = 0; i <= m; i++)
+        lz.v[i] = malloc(sizeof(double) * lz.size);
+    lz.scratch[0] = malloc(sizeof(double) * lz.size);
+    lz.scratch[1] = malloc(sizeof(double) * lz.size);
+    lz.coef = malloc(sizeof(double) * (m + 1));
+    lz.partial = malloc(sizeof(double) * lz.nthreads * (m + 1));
+    lz.ritz = malloc(sizeof(double) * m * m);
+    lz.rotate_tmp = malloc(sizeof(double) * lz.nthreads * keep * lz.side);
+    double *t = calloc(m * m, sizeof(double));
+    double *a = malloc(sizeof(double) * m * m);
+    double *theta = malloc(sizeof(double) * m);
+    double *proj = malloc(sizeof(double) * (m + 1));
+    double *rho = malloc(sizeof(double) * k);
+    if (lz.v[m] == NULL || lz.scratch[1] == NULL || lz.rotate_tmp == NULL || proj == NULL)
+    {
+        fprintf(stderr, "solve_spectrum2d: malloc failed\n");
+        exit(1);
+    }
+    build_diagonal(potential, n, lz.diag);
+
+    // Gershgorin bound on the top of the spectrum
+    double upper = 0;
+    for (int p = 0; p < lz.size; p++)
+        upper = fmax(upper, lz.diag[p]);
+    upper += 4 * fabs(lz.off);
+
+    init_barrier(&lz.start, lz.nthreads);
+    init_barrier(&lz.finish, lz.nthreads);
+    for (int i = 0; i < lz.nthreads; i++)
+    {
+        lz.tasks[i].lz = &lz;
+        lz.tasks[i].t = i;
+        lz.tasks[i].row = malloc(sizeof(double) * lz.side);
+        if (i > 0 && pthread_create(&lz.tasks[i].thread, NULL, lanczos_worker, &lz.tasks[i]) != 0)
+        {
+            fprintf(stderr, "solve_spectrum2d: pthread_create failed\n");
+            exit(1);
+        }
+    }
+
+    if (ctl != NULL)
+    {
+        atomic_store_explicit(&ctl->total, k, memory_order_relaxed);
+        atomic_store_explicit(&ctl->progress, 0, memory_order_relaxed);
+    }
+
+    int done = 0;
+    int iterations = 0;
+    int restarts = 0;
+
+    // Weyl's inequality bounds eigenvalue i by that of the empty box plus
+    // the range of the potential
+    double vmin = potential[0], vmax = potential[0];
+    for (size_t p = 0; p < (size_t) (n+1)*(n+1); p++)
+    {
+        vmin = fmin(vmin, potential[p]);
+        vmax = fmax(vmax, potential[p]);
+    }
+    double lowest = laplacian_eigenvalue(n, 0) + POTENTIAL_SCALE * vmin;
+    double cut = laplacian_eigenvalue(n, keep) + POTENTIAL_SCALE * vmax;
+
+    lz.w = lz.v[0];
+    lz.j = -1;
+    run_phase(&lz, PHASE_START, 0);
+    run_phase(&lz, PHASE_DOT, 1);
+    orthonormalize(&lz, proj);
+
+    if (spec->solved)
+    {
+        // No eigenvalue rises by more than the potential did
+        double raise = 0;
+        for (size_t p = 0; p < (size_t) (n+1)*(n+1); p++)
+            raise = fmax(raise, potential[p] - spec->potential[p]);
+        cut = fmin(cut, spec->cut + POTENTIAL_SCALE * raise);
+    }
+    else
+    {
+        // One pass with H itself: by interlacing Ritz value `keep` is above
+        // the true one, and the lowest Ritz vectors make a better start
+        if (lanczos_steps(&lz, t, 0, proj, ctl) < 0)
+            goto out;
+        iterations += m;
+        memcpy(a, t, sizeof(double) * m * m);
+        dense_eigen(a, m, theta, lz.ritz);
+        cut = fmin(cut, theta[keep]);
+        restart_from_sum(&lz, proj);
+    }
+    set_filter(&lz, lowest, cut, upper);
+
+    memset(t, 0, sizeof(double) * m * m);
+    int start = 0;
+    int verified = 0;
+    for (restarts = 0; restarts < LANCZOS_MAX_RESTARTS; restarts++)
+    {
+        if (lanczos_steps(&lz, t, start, proj, ctl) < 0)
+            goto out;
+        iterations += (m - start) * (lz.degree > 0 ? lz.degree : 1);
+        memcpy(a, t, sizeof(double) * m * m);
+        dense_eigen(a, m, theta, lz.ritz);
+
+        // The Weyl bound is loose for deep wells and tall barriers, and
+        // can leave no filter at all. Once a pass shows the wanted states
+        // end far below the cut, a sharper filter started afresh from them
+        // wins back more than the pass cost.
+        double ends = cut;
+        if (lz.degree == 0)
+            ends = theta[keep];
+        else if (theta[keep] < -1)
+            ends = unfilter(&lz, theta[keep]);
+        if (ends < 0.5 * cut)
+        {
+            cut = ends;
+            set_filter(&lz, lowest, cut, upper);
+            restart_from_sum(&lz, proj);
+            memset(t, 0, sizeof(double) * m * m);
+            start = 0;
+            verified = 0;
+            continue;
+        }
+
+        // Thick restart: keep the lowest Ritz vectors and continue from the
+        // residual direction v_m. t becomes diagonal plus the couplings the
+        // next pass computes.
+        lz.keep = keep;
+        run_phase(&lz, PHASE_ROTATE, 0);
+        double *residual = lz.v[m];
+        lz.v[m] = lz.v[keep];
+        lz.v[keep] = residual;
+        memset(t, 0, sizeof(double) * m * m);
+        for (int i = 0; i < keep; i++)
+            t[i*m + i] = theta[i];
+        start = keep;
+
+        // Converged when the Ritz vectors are eigenvectors of H itself
+        run_phase(&lz, PHASE_RAYLEIGH, k);
+        memcpy(rho, lz.coef, sizeof(double) * k);
+        run_phase(&lz, PHASE_RESIDUAL, k);
+        iterations += 2*k;
+        int converged = 0;
+        for (int i = 0; i < k; i++)
+        {
+            if (sqrt(fmax(lz.coef[i], 0)) <= LANCZOS_TOL * upper)
+                converged++;
+        }
+        if (ctl != NULL)
+            atomic_store_explicit(&ctl->progress, converged, memory_order_relaxed);
+        if (converged < k)
+            continue;
+        if (verified)
+        {
+            done = 1;
+            break;
+        }
+
+        // A single start vector has no component along the second copy of a
+        // degenerate state (symmetric wells have many), so Lanczos can
+        // converge with such a state missing. Carrying on from a random
+        // direction orthogonal to the kept vectors brings any missed state
+        // in; the result stands once it converges again.
+        verified = 1;
+        lz.seed = splitmix64(lz.seed);
+        lz.warm = NULL;
+        lz.w = lz.v[keep];
+        lz.j = keep - 1;
+        run_phase(&lz, PHASE_START, 0);
+        run_phase(&lz, PHASE_DOT, keep + 1);
+        orthonormalize(&lz, proj);
+    }
+    if (!done)
+        fprintf(stderr, "solve_spectrum2d: no convergence after %d restarts\n", LANCZOS_MAX_RESTARTS);
+
+    // Energies are the Rayleigh quotients, ordered with their vectors
+    for (int i = 0; i < k; i++)
+    {
+        int lowest = i;
+        for (int j = i+1; j < k; j++)
+            if (rho[j] < rho[lowest])
+                lowest = j;
+        double r = rho[i];
+        rho[i] = rho[lowest];
+        rho[lowest] = r;
+        double *v = lz.v[i];
+        lz.v[i] = lz.v[lowest];
+        lz.v[lowest] = v;
+    }
+    // Ritz value `keep` mapped back through the filter estimates where the
+    // wanted states end for the next warm solve
+    spec->cut = cut;
+    if (lz.degree == 0)
+        spec->cut = theta[keep];
+    else if (theta[keep] < -1)
+        spec->cut = unfilter(&lz, theta[keep]);
+    memcpy(spec->potential, potential, sizeof(double) * (n+1) * (n+1));
+    memcpy(spec->evalues, rho, sizeof(double) * k);
+    for (int i = 0; i < k; i++)
+        memcpy(spec->evectors + (size_t) i * lz.size, lz.v[i], sizeof(double) * lz.size);
+    spec->solved = 1;
+    done = 1;
+
+out:
+    spec->iterations = iterations;
+    spec->restarts = restarts;
+    run_phase(&lz, PHASE_QUIT, 0);
+    for (int i = 0; i < lz.nthreads; i++)
+    {
+        if (i > 0)
+            pthread_join(lz.tasks[i].thread, NULL);
+        free(lz.tasks[i].row);
+    }
+    free_barrier(&lz.start);
+    free_barrier(&lz.finish);
+    for (int i = 0; i <= m; i++)
+        free(lz.v[i]);
+    free(lz.v);
+    free(lz.scratch[0]);
+    free(lz.scratch[1]);
+    free(lz.diag);
+    free(lz.zeros);
+    free(lz.coef);
+    free(lz.partial);
+    free(lz.ritz);
+    free(lz.rotate_tmp);
+    free(t);
+    free(a);
+    free(theta);
+    free(proj);
+    free(rho);
+    return done;
+}
+
+void density2d(const Spectrum2D *spec, int state, double *out)
+{
+    int n = spec->n;
+    int side = n - 1;
+    const double *psi = spec->evectors + (size_t) state * side * side;
+    memset(out, 0, sizeof(double) * (n+1) * (n+1));
+    for (int r = 0; r < side; r++)
+        for (int c = 0; c < side; c++)
+        {
+            double p = psi[(size_t) r * side + c];
+            out[(size_t) (r+1) * (n+1) + c + 1] = p * p;
+        }
+}
@@ -0,0 +1,135 @@
+// SolverBackend on the system LAPACK, compiled in with HAVE_LAPACK (make
+// LAPACK=1). dstevr() uses the MRRR algorithm of dstemr() when it can, which
+// costs O(m) per eigenpair instead of the O(m^2) of QL iterations.
+#ifdef HAVE_LAPACK
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "solver.h"
+#include "perfcounters.h"
+
+void dstevr_(const char *jobz, const char *range, const int *n, double *d, double *e, const double *vl,
+    const double *vu, const int *il, const int *iu, const double *abstol, int *m, double *w, double *z,
+    const int *ldz, int *isuppz, double *work, const int *lwork, int *iwork, const int *liwork, int *info);
+
+// Eigenpairs il..iu (0-based) of (d, e), or only their values when z is NULL.
+// LAPACK overwrites its inputs, so it gets copies, taken from arena with its
+// workspace. Returns the number found.
+static int run_dstevr(const double *d, const double *e, int m, int il, int iu, double *w, double *z,
+    Arena *arena)
+{
+    ArenaMark mark = arena_mark(arena);
+    double *dc = arena_take(arena, sizeof(double)*m);
+    double *ec = arena_take(arena, sizeof(double)*m);
+    memcpy(dc, d, sizeof(double)*m);
+    memcpy(ec, e, sizeof(double)*m);
+
+    int lwork = 20*m, liwork = 10*m;
+    double *work = arena_take(arena, sizeof(double)*lwork);
+    int *iwork = arena_take(arena, sizeof(int)*liwork);
+    int *isuppz = arena_take(arena, sizeof(int)*2*(iu-il+1));
+
+    const char *range = (il == 0 && iu == m-1) ? "A" : "I";
+    int il1 = il+1, iu1 = iu+1, found = 0, info = 0, ldz = m;
+    double unused = 0, abstol = 0;
+    dstevr_(z != NULL ? "V" : "N", range, &m, dc, ec, &unused, &unused, &il1, &iu1, &abstol, &found, w,
+        z != NULL ? z : &unused, &ldz, isuppz, work, &lwork, iwork, &liwork, &info);
+    if (info != 0)
+    {
+        fprintf(stderr, "lapack_backend: dstevr failed with info %d\n", info);
+        exit(1);
+    }
+
+    arena_release(arena, mark);
+    return found;
+}
+
+// The library call can't be interrupted, so cancellation is only noticed
+// before it starts and progress jumps from 0 to done
+static int cancelled(SolveControl *ctl)
+{
+    return ctl != NULL && atomic_load_explicit(&ctl->cancel, memory_order_relaxed);
+}
+
+static void finished(SolveControl *ctl, int count)
+{
+    if (ctl != NULL)
+        atomic_store_explicit(&ctl->progress, count, memory_order_relaxed);
+}
+
+static int lapack_solve_all(EigenPackage *epkg, int m, SolveControl *ctl, PerfProfile *profile)
+{
+    if (ctl != NULL)
+    {
+        atomic_store_explicit(&ctl->total, m, memory_order_relaxed);
+        atomic_store_explicit(&ctl->progress, 0, memory_order_relaxed);
+    }
+    if (cancelled(ctl))
+        return 0;
+
+    if (profile != NULL)
+        perf_begin(profile);
+    // column-major, so eigenvector j is contiguous at vectors + j*m
+    Arena *arena = workspace_arena(epkg->work, 0);
+    ArenaMark mark = arena_mark(arena);
+    double *vectors = arena_take(arena, sizeof(double)*m*m);
+    run_dstevr(epkg->evalues, epkg->subdiagonal, m, 0, m-1, epkg->evalues, vectors, arena);
+    if (profile != NULL)
+        perf_end(profile, STAGE_TQLI);
+
+    if (profile != NULL)
+        perf_begin(profile);
+    for(int i = 0; i < m; i++)
+    {
+        double *row = epkg->z[i];
+        for(int j = 0; j < m; j++)
+            row[j] = vectors[(size_t) j*m + i];
+    }
+    arena_release(arena, mark);
+    if (profile != NULL)
+        perf_end(profile, STAGE_SORT);
+
+    finished(ctl, m);
+    return 1;
+}
+
+static int lapack_solve_range(const double *d, const double *e, int m, int il, int iu, double *w, double *vectors,
+    int threads, SolveControl *ctl, Workspace *work)
+{
+    if (cancelled(ctl))
+        return 0;
+    Workspace *temporary = (work == NULL) ? init_workspace() : NULL;
+    run_dstevr(d, e, m, il, iu, w, vectors, workspace_arena(temporary != NULL ? temporary : work, 0));
+    free_workspace(temporary);
+    finished(ctl, iu-il+1);
+    return 1;
+}
+
+static int lapack_eigenvalues_only(const double *d, const double *e, int m, double *w, int threads, SolveControl *ctl,
+    Workspace *work)
+{
+    if (ctl != NULL)
+    {
+        atomic_store_explicit(&ctl->total, m, memory_order_relaxed);
+        atomic_store_explicit(&ctl->progress, 0, memory_order_relaxed);
+    }
+    if (cancelled(ctl))
+        return 0;
+    Workspace *temporary = (work == NULL) ? init_workspace() : NULL;
+    run_dstevr(d, e, m, 0, m-1, w, NULL, workspace_arena(temporary != NULL ? temporary : work, 0));
+    free_workspace(temporary);
+    finished(ctl, m);
+    return 1;
+}
+
+const SolverBackend lapack_backend = {
+    .name = "lapack",
+    .assemble = assemble_hamiltonian,
+    .solve_all = lapack_solve_all,
+    .solve_range = lapack_solve_range,
+    .eigenvalues_only = lapack_eigenvalues_only
+};
+
+#endif
@@ -0,0 +1,321 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "livesolver.h"
+#include "telemetry.h"
+#include "perturb.h"
+
+static double monotonic_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Rows of the Hamiltonian the request being worked on changed from the one
+// in front, as one block: a brush stroke. 0 if the grid moved.
+static int stroke_rows(const LiveSolver *solver)
+{
+    int lo = solver->n, hi = -1;
+    for(int i = 0; i <= solver->n; i++)
+    {
+        if (solver->work_potential[i].x != solver->front_potential[i].x)
+            return 0;
+        if (solver->work_potential[i].y != solver->front_potential[i].y)
+        {
+            lo = min(lo, i);
+            hi = i;
+        }
+    }
+    return max(hi - lo + 1, 0);
+}
+
+static void *livesolver_main(void *arg)
+{
+    LiveSolver *solver = (LiveSolver*) arg;
+    struct SolverPkg solverpkg;
+
+    pthread_mutex_lock(&solver->lock);
+    while (!solver->quit)
+    {
+        while (!solver->quit && !solver->pending)
+            pthread_cond_wait(&solver->wake, &solver->lock);
+        if (solver->quit)
+            break;
+
+        // Take a private copy so the GUI can keep painting the request buffer
+        memcpy(solver->work_potential, solver->request_potential, sizeof(Vector2)*(solver->n+1));
+        unsigned long generation = solver->requested;
+        solverpkg.potential = solver->work_potential;
+        solverpkg.n = solver->n;
+        solverpkg.num_eigenfunctions = solver->request_k;
+        solverpkg.epkg = solver->back;
+        solverpkg.control = &solver->control;
+        solverpkg.profile = NULL;
+        solverpkg.keep_vectors = 0;
+        int first = solver->request_first;
+        int continuation = solver->continuation && solver->published > 0;
+        solver->pending = 0;
+        solver->busy = 1;
+        solver->started = monotonic_seconds();
+        double asked = solver->requested_at;
+        telemetry_record(METRIC_QUEUE_WAIT, solver->started - asked);
+        atomic_store(&solver->control.cancel, 0);
+        atomic_store(&solver->control.progress, 0);
+        pthread_mutex_unlock(&solver->lock);
+
+        // Toggling back to a potential that was solved before is a lookup
+        uint64_t key = spectrum_key(solverpkg.potential, solver->n, solverpkg.num_eigenfunctions);
+        int from_cache = first == 0
+            && spectrumcache_get(solver->cache, key, solver->n, solverpkg.num_eigenfunctions, solver->back);
+        if (!from_cache && first == 0 && solver->store != NULL
+            && spectrumstore_get(solver->store, key, solver->n, solverpkg.num_eigenfunctions, solver->back))
+        {
+            from_cache = 2;
+            spectrumcache_put(solver->cache, key, solver->back);
+        }
+
+        void *done = (void *) 1;
+        int solved = 0;
+        int updated = -1;
+        int continued = -1;
+        // Only this thread swaps front and writes front_potential and
+        // front_updates, so from here on it reads them without the lock.
+        // A continued solve holds just the k states, so it isn't cached.
+        if (continuation && !from_cache
+            && (continued = solve_spectrum_continued(solverpkg.potential, solver->n, first,
+                solverpkg.num_eigenfunctions, solver->front, solver->back, &solver->control)) >= 0)
+        {
+            if (!continued)
+                done = NULL;
+        }
+        else if (first > 0)
+        {
+            if (solve_spectrum_window(solverpkg.potential, solver->n, first,
+                    solverpkg.num_eigenfunctions, solver->back, &solver->control) != 1)
+                done = NULL;
+        }
+        else if (!from_cache)
+        {
+            // A brush stroke that changed only a few rows updates front instead.
+            // One that can't be updated solves every eigenvector, even where
+            // the plan would only solve k, when that pays off over the
+            // strokes likely to follow.
+            if (solver->front_updates >= 0 && solver->front_updates < LIVE_MAX_UPDATES)
+                updated = solve_spectrum_update(&solverpkg, solver->front_potential, solver->front);
+            if (updated < 0)
+            {
+                SolvePlan plan = solver_plan(solver->n, solverpkg.num_eigenfunctions);
+                int rows = (solver->published > 0 && solver->front->first == 0) ? stroke_rows(solver) : 0;
+                solverpkg.keep_vectors = plan_keeps_vectors(&plan, solver->n-1, solverpkg.num_eigenfunctions, rows,
+                    LIVE_MAX_UPDATES);
+                done = solve_spectrum(&solverpkg);
+            }
+            else
+                done = updated ? (void *) 1 : NULL;
+            solved = done != NULL;
+            if (solved)
+                spectrumcache_put(solver->cache, key, solver->back);
+        }
+
+        pthread_mutex_lock(&solver->lock);
+        solver->busy = 0;
+        if (done != NULL)
+        {
+            double now = monotonic_seconds();
+            solver->last_solve_seconds = now - solver->started;
+            telemetry_record(METRIC_SOLVE, solver->last_solve_seconds);
+            telemetry_record(METRIC_LATENCY, now - asked);
+            solver->last_from_cache = from_cache;
+            solver->last_continued = continued > 0;
+            EigenPackage *tmp = solver->front;
+            solver->front = solver->back;
+            solver->back = tmp;
+            solver->published = generation;
+            memcpy(solver->front_potential, solver->work_potential, sizeof(Vector2)*(solver->n+1));
+            if (first > 0 || solver->front->z_columns != solver->n-1)
+                solver->front_updates = -1;
+            else
+                solver->front_updates = (updated > 0) ? solver->front_updates + 1 : 0;
+        }
+
+        if (solved && solver->store != NULL)
+        {
+            // Writing after publishing keeps disk I/O out of the latency.
+            EigenPackage *published = solver->front;
+            pthread_mutex_unlock(&solver->lock);
+            spectrumstore_put(solver->store, key, published);
+            pthread_mutex_lock(&solver->lock);
+        }
+    }
+    pthread_mutex_unlock(&solver->lock);
+    return NULL;
+}
+
+LiveSolver *init_livesolver(int n, int k, double *domain)
+{
+    LiveSolver *solver = malloc(sizeof(LiveSolver));
+    solver->n = n;
+    solver->request_k = k;
+    solver->request_first = 0;
+    solver->continuation = 0;
+    solver->front = init_eigenpackage(k, n, domain);
+    solver->back = init_eigenpackage(k, n, domain);
+    solver->preview = init_eigenpackage(k, n, domain);
+    solver->preview_of = 0;
+    solver->preview_from = init_eigenpackage(k, n, domain);
+    solver->preview_before = malloc(sizeof(Vector2)*(n+1));
+    solver->request_potential = malloc(sizeof(Vector2)*(n+1));
+    solver->work_potential = malloc(sizeof(Vector2)*(n+1));
+    solver->front_potential = malloc(sizeof(Vector2)*(n+1));
+    solver->front_updates = -1;
+    solver->requested = 0;
+    solver->published = 0;
+    solver->pending = 0;
+    solver->busy = 0;
+    solver->quit = 0;
+    solver->requested_at = 0;
+    solver->started = 0;
+    solver->last_solve_seconds = 0;
+    solver->last_from_cache = 0;
+    solver->last_continued = 0;
+    solver->cache = init_spectrumcache(LIVE_CACHE_BYTES);
+    solver->store = open_spectrumstore(NULL, SPECTRUM_STORE_BYTES);
+    init_solvecontrol(&solver->control);
+
+    pthread_mutex_init(&solver->lock, NULL);
+    pthread_cond_init(&solver->wake, NULL);
+    pthread_create(&solver->thread, NULL, &livesolver_main, (void *) solver);
+    return solver;
+}
+
+void livesolver_request(LiveSolver *solver, Vector2 *potential, int k)
+{
+    livesolver_request_window(solver, potential, 0, k);
+}
+
+// Copies what perturb_preview() reads of front: the energies of the
+// displayed states and their eigenvectors
+static void snapshot_front(EigenPackage *snapshot, const EigenPackage *front)
+{
+    int k = front->num_efunctions;
+    int columns = min(k, front->z_columns);
+    reserve_eigenpackage(snapshot, front->n, k);
+    snapshot->num_evalues = min(k, front->num_evalues);
+    memcpy(snapshot->evalues, front->evalues, sizeof(double)*snapshot->num_evalues);
+    for(int i = 0; i < front->n-1; i++)
+        memcpy(snapshot->z[i], front->z[i], sizeof(double)*columns);
+    snapshot->z_columns = columns;
+    snapshot->num_efunctions = k;
+    snapshot->first = front->first;
+}
+
+void livesolver_request_window(LiveSolver *solver, Vector2 *potential, int first, int k)
+{
+    pthread_mutex_lock(&solver->lock);
+    memcpy(solver->request_potential, potential, sizeof(Vector2)*(solver->n+1));
+    solver->request_first = min(max(first, 0), solver->n-2);
+    solver->request_k = min(k, solver->n-1 - solver->request_first);
+    solver->requested++;
+    solver->requested_at = monotonic_seconds();
+    solver->pending = 1;
+
+    unsigned long request = solver->requested;
+
+    // the solve in flight is now obsolete
+    atomic_store(&solver->control.cancel, 1);
+    pthread_cond_signal(&solver->wake);
+
+    // Good enough to draw right away when the request is for the states in
+    // front of a potential that moved a little. It is worked out on a copy
+    // of front, so the solver thread can publish meanwhile.
+    solver->preview_of = 0;
+    int preview = solver->published > 0 && solver->front->first == solver->request_first;
+    if (preview)
+    {
+        snapshot_front(solver->preview_from, solver->front);
+        memcpy(solver->preview_before, solver->front_potential, sizeof(Vector2)*(solver->n+1));
+    }
+    pthread_mutex_unlock(&solver->lock);
+
+    if (preview && perturb_preview(solver->preview_from, solver->preview_before, potential, solver->n,
+            solver->preview))
+    {
+        pthread_mutex_lock(&solver->lock);
+        solver->preview_of = request;
+        pthread_mutex_unlock(&solver->lock);
+    }
+}
+
+void livesolver_set_continuation(LiveSolver *solver, int on)
+{
+    pthread_mutex_lock(&solver->lock);
+    solver->continuation = on;
+    pthread_mutex_unlock(&solver->lock);
+}
+
+EigenPackage *livesolver_preview(LiveSolver *solver)
+{
+    return (solver->preview_of > solver->published) ? solver->preview : NULL;
+}
+
+int livesolver_busy(LiveSolver *solver)
+{
+    pthread_mutex_lock(&solver->lock);
+    int busy = solver->pending || solver->busy;
+    pthread_mutex_unlock(&solver->lock);
+    return busy;
+}
+
+unsigned long livesolver_published(LiveSolver *solver)
+{
+    pthread_mutex_lock(&solver->lock);
+    unsigned long published = solver->published;
+    pthread_mutex_unlock(&solver->lock);
+    return published;
+}
+
+double livesolver_progress(LiveSolver *solver, double *eta)
+{
+    pthread_mutex_lock(&solver->lock);
+    double started = solver->started;
+    int busy = solver->busy;
+    pthread_mutex_unlock(&solver->lock);
+
+    int done = atomic_load(&solver->control.progress);
+    int total = atomic_load(&solver->control.total);
+    *eta = -1;
+    if (!busy || total <= 0)
+        return 0.0;
+
+    double fraction = done / (double) total;
+    if (done > 0)
+        *eta = (monotonic_seconds() - started) * (1.0 - fraction) / fraction;
+    return fraction;
+}
+
+void free_livesolver(LiveSolver *solver)
+{
+    pthread_mutex_lock(&solver->lock);
+    solver->quit = 1;
+    atomic_store(&solver->control.cancel, 1);
+    pthread_cond_signal(&solver->wake);
+    pthread_mutex_unlock(&solver->lock);
+    pthread_join(solver->thread, NULL);
+
+    pthread_mutex_destroy(&solver->lock);
+    pthread_cond_destroy(&solver->wake);
+    free_eigenpackage(solver->front);
+    free_eigenpackage(solver->back);
+    free_eigenpackage(solver->preview);
+    free_eigenpackage(solver->preview_from);
+    free(solver->preview_before);
+    free_spectrumcache(solver->cache);
+    if (solver->store != NULL)
+        close_spectrumstore(solver->store);
+    free(solver->request_potential);
+    free(solver->work_potential);
+    free(solver->front_potential);
+    free(solver);
+}
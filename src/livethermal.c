@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <string.h>
+#include "livethermal.h"
+
+static void *livethermal_main(void *arg)
+{
+    LiveThermal *thermal = (LiveThermal*) arg;
+    int n = thermal->n;
+
+    pthread_mutex_lock(&thermal->lock);
+    while (!thermal->quit)
+    {
+        while (!thermal->quit && !thermal->pending)
+            pthread_cond_wait(&thermal->wake, &thermal->lock);
+        if (thermal->quit)
+            break;
+
+        // Take a private copy so the GUI can keep painting the request buffer
+        memcpy(thermal->work_potential, thermal->request_potential, sizeof(Vector2)*(n+1));
+        double kT = thermal->request_kT;
+        unsigned long generation = thermal->requested;
+        thermal->pending = 0;
+        thermal->busy = 1;
+        atomic_store(&thermal->control.cancel, 0);
+        pthread_mutex_unlock(&thermal->lock);
+
+        ThermalDensity *density = thermal->thermal;
+        int used = thermal_update(density, thermal->work_potential, kT, thermal->tolerance, &thermal->control);
+        if (used > 0)
+            memcpy(thermal->back, density->rho, sizeof(Vector2)*(n+1));
+
+        pthread_mutex_lock(&thermal->lock);
+        thermal->busy = 0;
+        if (used > 0)
+        {
+            Vector2 *tmp = thermal->front;
+            thermal->front = thermal->back;
+            thermal->back = tmp;
+            thermal->kT = density->kT;
+            thermal->used = density->used;
+            thermal->tail = density->tail;
+            thermal->published = generation;
+        }
+    }
+    pthread_mutex_unlock(&thermal->lock);
+    return NULL;
+}
+
+LiveThermal *init_livethermal(int n, double *domain, double tolerance)
+{
+    LiveThermal *thermal = malloc(sizeof(LiveThermal));
+    thermal->n = n;
+    thermal->tolerance = tolerance;
+    thermal->thermal = init_thermal(n, domain);
+    thermal->front = malloc(sizeof(Vector2)*(n+1));
+    thermal->back = malloc(sizeof(Vector2)*(n+1));
+    memcpy(thermal->front, thermal->thermal->rho, sizeof(Vector2)*(n+1));
+    thermal->kT = -1;
+    thermal->used = 0;
+    thermal->tail = 0;
+    thermal->request_potential = malloc(sizeof(Vector2)*(n+1));
+    thermal->work_potential = malloc(sizeof(Vector2)*(n+1));
+    thermal->request_kT = -1;
+    thermal->requested = 0;
+    thermal->published = 0;
+    thermal->pending = 0;
+    thermal->busy = 0;
+    thermal->quit = 0;
+    init_solvecontrol(&thermal->control);
+
+    pthread_mutex_init(&thermal->lock, NULL);
+    pthread_cond_init(&thermal->wake, NULL);
+    pthread_create(&thermal->thread, NULL, &livethermal_main, (void *) thermal);
+    return thermal;
+}
+
+void livethermal_request(LiveThermal *thermal, Vector2 *potential, double kT)
+{
+    int n = thermal->n;
+    pthread_mutex_lock(&thermal->lock);
+    int moved = thermal->requested == 0
+        || memcmp(potential, thermal->request_potential, sizeof(Vector2)*(n+1)) != 0;
+    if (moved || kT != thermal->request_kT)
+    {
+        memcpy(thermal->request_potential, potential, sizeof(Vector2)*(n+1));
+        thermal->request_kT = kT;
+        thermal->requested++;
+        thermal->pending = 1;
+        // the states being solved in flight are of no use for a new potential
+        if (moved)
+            atomic_store(&thermal->control.cancel, 1);
+        pthread_cond_signal(&thermal->wake);
+    }
+    pthread_mutex_unlock(&thermal->lock);
+}
+
+int livethermal_busy(LiveThermal *thermal)
+{
+    pthread_mutex_lock(&thermal->lock);
+    int busy = thermal->pending || thermal->busy;
+    pthread_mutex_unlock(&thermal->lock);
+    return busy;
+}
+
+unsigned long livethermal_published(LiveThermal *thermal)
+{
+    pthread_mutex_lock(&thermal->lock);
+    unsigned long published = thermal->published;
+    pthread_mutex_unlock(&thermal->lock);
+    return published;
+}
+
+void free_livethermal(LiveThermal *thermal)
+{
+    pthread_mutex_lock(&thermal->lock);
+    thermal->quit = 1;
+    atomic_store(&thermal->control.cancel, 1);
+    pthread_cond_signal(&thermal->wake);
+    pthread_mutex_unlock(&thermal->lock);
+    pthread_join(thermal->thread, NULL);
+
+    pthread_mutex_destroy(&thermal->lock);
+    pthread_cond_destroy(&thermal->wake);
+    free_thermal(thermal->thermal);
+    free(thermal->front);
+    free(thermal->back);
+    free(thermal->request_potential);
+    free(thermal->work_potential);
+    free(thermal);
+}
@@ -0,0 +1,365 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "mode2d.h"
+#include "potential.h"
+#include "telemetry.h"
+
+// A stroke is solved once the brush has rested this long. Unlike 1D there is
+// no maximum wait: a solve takes longer than the wait would be, so requests
+// during a stroke would only cancel each other.
+#define MODE2D_DEBOUNCE 0.15
+// Brush radius in unit-square coordinates, and height painted per second
+#define MODE2D_BRUSH 0.04
+#define MODE2D_PAINT_RATE 0.5
+
+#define PANEL_SIZE 430
+#define PANEL_TOP 130
+#define PANEL_GAP 40
+
+static double monotonic_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void copy_spectrum2d(Spectrum2D *to, const Spectrum2D *from)
+{
+    size_t side = from->n - 1;
+    memcpy(to->evalues, from->evalues, sizeof(double) * from->k);
+    memcpy(to->evectors, from->evectors, sizeof(double) * from->k * side * side);
+    memcpy(to->potential, from->potential, sizeof(double) * (from->n+1) * (from->n+1));
+    to->solved = from->solved;
+    to->cut = from->cut;
+    to->iterations = from->iterations;
+    to->restarts = from->restarts;
+}
+
+static void *mode2d_main(void *arg)
+{
+    Mode2D *mode = (Mode2D*) arg;
+    size_t grid = (size_t) (mode->n+1) * (mode->n+1);
+    double *work = malloc(sizeof(double) * grid);
+
+    pthread_mutex_lock(&mode->lock);
+    while (!mode->quit)
+    {
+        while (!mode->quit && !mode->pending)
+            pthread_cond_wait(&mode->wake, &mode->lock);
+        if (mode->quit)
+            break;
+
+        memcpy(work, mode->request, sizeof(double) * grid);
+        unsigned long generation = mode->requested;
+        mode->pending = 0;
+        mode->busy = 1;
+        atomic_store(&mode->control.cancel, 0);
+        atomic_store(&mode->control.progress, 0);
+        pthread_mutex_unlock(&mode->lock);
+
+        double started = monotonic_seconds();
+        int done = solve_spectrum2d(work, mode->back, &mode->control);
+
+        pthread_mutex_lock(&mode->lock);
+        mode->busy = 0;
+        if (done)
+        {
+            mode->last_solve_seconds = monotonic_seconds() - started;
+            telemetry_record(METRIC_SOLVE2D, mode->last_solve_seconds);
+            Spectrum2D *tmp = mode->front;
+            mode->front = mode->back;
+            mode->back = tmp;
+            mode->published = generation;
+
+            // The next solve warm starts from this one, copied outside the
+            // lock since front changes hands nowhere else.
+            pthread_mutex_unlock(&mode->lock);
+            copy_spectrum2d(mode->back, mode->front);
+            pthread_mutex_lock(&mode->lock);
+        }
+    }
+    pthread_mutex_unlock(&mode->lock);
+    free(work);
+    return NULL;
+}
+
+static Texture2D blank_texture(int size)
+{
+    Image image = GenImageColor(size, size, BLACK);
+    Texture2D texture = LoadTextureFromImage(image);
+    UnloadImage(image);
+    return texture;
+}
+
+Mode2D *init_mode2d(int n, int k)
+{
+    Mode2D *mode = malloc(sizeof(Mode2D));
+    size_t grid = (size_t) (n+1) * (n+1);
+    mode->n = n;
+    mode->k = k;
+    mode->potential = malloc(sizeof(double) * grid);
+    mode->request = malloc(sizeof(double) * grid);
+    mode->density = malloc(sizeof(double) * grid);
+    mode->pixels = malloc(sizeof(Color) * grid);
+    if (mode->potential == NULL || mode->request == NULL || mode->density == NULL || mode->pixels == NULL)
+    {
+        fprintf(stderr, "init_mode2d: malloc failed\n");
+        exit(1);
+    }
+    fill_potential2d(n, &quadratic_batch, NULL, mode->potential);
+
+    mode->state = 0;
+    mode->dirty = 0;
+    mode->last_stroke_time = 0;
+    mode->last_request_time = 0;
+    mode->potential_texture = blank_texture(n+1);
+    mode->density_texture = blank_texture(n+1);
+    mode->potential_stale = 1;
+    mode->drawn = 0;
+    mode->drawn_state = -1;
+
+    mode->front = init_spectrum2d(n, k);
+    mode->back = init_spectrum2d(n, k);
+    mode->requested = 0;
+    mode->published = 0;
+    mode->pending = 0;
+    mode->busy = 0;
+    mode->quit = 0;
+    mode->last_solve_seconds = 0;
+    init_solvecontrol(&mode->control);
+
+    pthread_mutex_init(&mode->lock, NULL);
+    pthread_cond_init(&mode->wake, NULL);
+    pthread_create(&mode->thread, NULL, &mode2d_main, (void *) mode);
+    mode2d_request(mode);
+    return mode;
+}
+
+void free_mode2d(Mode2D *mode)
+{
+    pthread_mutex_lock(&mode->lock);
+    mode->quit = 1;
+    atomic_store(&mode->control.cancel, 1);
+    pthread_cond_signal(&mode->wake);
+    pthread_mutex_unlock(&mode->lock);
+    pthread_join(mode->thread, NULL);
+
+    pthread_mutex_destroy(&mode->lock);
+    pthread_cond_destroy(&mode->wake);
+    UnloadTexture(mode->potential_texture);
+    UnloadTexture(mode->density_texture);
+    free_spectrum2d(mode->front);
+    free_spectrum2d(mode->back);
+    free(mode->potential);
+    free(mode->request);
+    free(mode->density);
+    free(mode->pixels);
+    free(mode);
+}
+
+Mode2D *regrid_mode2d(Mode2D *mode, int n)
+{
+    // The harmonic well the new mode starts on is cancelled by the request
+    // for the painted one before it gets anywhere
+    Mode2D *regridded = init_mode2d(n, mode->k);
+    resample2d(mode->potential, mode->n, regridded->potential, n);
+    regridded->state = mode->state;
+    regridded->potential_stale = 1;
+    mode2d_request(regridded);
+    free_mode2d(mode);
+    return regridded;
+}
+
+void mode2d_request(Mode2D *mode)
+{
+    pthread_mutex_lock(&mode->lock);
+    memcpy(mode->request, mode->potential, sizeof(double) * (mode->n+1) * (mode->n+1));
+    mode->requested++;
+    mode->pending = 1;
+    // the solve in flight is now obsolete
+    atomic_store(&mode->control.cancel, 1);
+    pthread_cond_signal(&mode->wake);
+    pthread_mutex_unlock(&mode->lock);
+}
+
+void mode2d_paint(Mode2D *mode, double x, double y, double radius, double amount)
+{
+    int n = mode->n;
+    int reach = (int) ceil(3 * radius * n);
+    int ci = (int) round(y * n);
+    int cj = (int) round(x * n);
+    for (int i = (ci - reach < 0 ? 0 : ci - reach); i <= n && i <= ci + reach; i++)
+        for (int j = (cj - reach < 0 ? 0 : cj - reach); j <= n && j <= cj + reach; j++)
+        {
+            double dx = j / (double) n - x;
+            double dy = i / (double) n - y;
+            mode->potential[(size_t) i*(n+1) + j] += amount * exp(-(dx*dx + dy*dy) / (radius*radius));
+        }
+    mode->potential_stale = 1;
+}
+
+static Rectangle potential_panel()
+{
+    return (Rectangle) {PANEL_GAP, PANEL_TOP, PANEL_SIZE, PANEL_SIZE};
+}
+
+static Rectangle density_panel()
+{
+    return (Rectangle) {2*PANEL_GAP + PANEL_SIZE, PANEL_TOP, PANEL_SIZE, PANEL_SIZE};
+}
+
+void update_mode2d(Mode2D *mode)
+{
+    if (IsKeyPressed(KEY_RIGHT) && mode->state < mode->k - 1)
+        mode->state++;
+    if (IsKeyPressed(KEY_LEFT) && mode->state > 0)
+        mode->state--;
+    if (IsKeyPressed(KEY_R))
+    {
+        fill_potential2d(mode->n, &quadratic_batch, NULL, mode->potential);
+        mode->potential_stale = 1;
+        mode->dirty = 1;
+    }
+
+    // Left drag raises the potential under the brush, right drag lowers it
+    Vector2 mouse = GetMousePosition();
+    Rectangle panel = potential_panel();
+    int left = IsMouseButtonDown(MOUSE_BUTTON_LEFT);
+    int right = IsMouseButtonDown(MOUSE_BUTTON_RIGHT);
+    if (CheckCollisionPointRec(mouse, panel))
+    {
+        SetMouseCursor(MOUSE_CURSOR_CROSSHAIR);
+        if (left || right)
+        {
+            double x = (mouse.x - panel.x) / panel.width;
+            double y = 1.0 - (mouse.y - panel.y) / panel.height;
+            double amount = MODE2D_PAINT_RATE * GetFrameTime();
+            mode2d_paint(mode, x, y, MODE2D_BRUSH, left ? amount : -amount);
+            mode->dirty = 1;
+            mode->last_stroke_time = GetTime();
+        }
+    }
+    else
+        SetMouseCursor(MOUSE_CURSOR_ARROW);
+
+    if (mode->dirty && !left && !right && GetTime() - mode->last_stroke_time > MODE2D_DEBOUNCE)
+    {
+        mode2d_request(mode);
+        mode->dirty = 0;
+        mode->last_request_time = GetTime();
+    }
+}
+
+int mode2d_settled(Mode2D *mode)
+{
+    pthread_mutex_lock(&mode->lock);
+    int settled = !mode->dirty && !mode->pending && !mode->busy && !mode->potential_stale
+        && (mode->published == 0 || mode->drawn == mode->published);
+    pthread_mutex_unlock(&mode->lock);
+    return settled;
+}
+
+// Black through purple and orange to pale yellow for t in [0, 1]
+static Color heat_color(double t)
+{
+    static const unsigned char stops[5][3] = {
+        {0, 0, 4}, {81, 18, 124}, {183, 55, 121}, {252, 137, 97}, {252, 253, 191}
+    };
+    t = (t < 0) ? 0 : (t > 1) ? 1 : t;
+    double s = t * 4;
+    int i = (s >= 4) ? 3 : (int) s;
+    double f = s - i;
+    return (Color) {
+        (unsigned char) (stops[i][0] + f * (stops[i+1][0] - stops[i][0])),
+        (unsigned char) (stops[i][1] + f * (stops[i+1][1] - stops[i][1])),
+        (unsigned char) (stops[i][2] + f * (stops[i+1][2] - stops[i][2])),
+        255
+    };
+}
+
+// Grid row i is y = i/n, drawn bottom up so the panels read like the 1D plot
+static void upload_grid(Mode2D *mode, Texture2D texture, const double *values, int heat)
+{
+    int n = mode->n;
+    size_t grid = (size_t) (n+1) * (n+1);
+    double lo = values[0], hi = values[0];
+    for (size_t p = 0; p < grid; p++)
+    {
+        lo = fmin(lo, values[p]);
+        hi = fmax(hi, values[p]);
+    }
+    if (heat)
+        lo = 0;
+    double range = (hi > lo) ? hi - lo : 1.0;
+
+    for (int i = 0; i <= n; i++)
+        for (int j = 0; j <= n; j++)
+        {
+            double t = (values[(size_t) i*(n+1) + j] - lo) / range;
+            unsigned char g = (unsigned char) (255 * t);
+            mode->pixels[(size_t) (n-i)*(n+1) + j] = heat ? heat_color(t) : (Color) {g, g, g, 255};
+        }
+    UpdateTexture(texture, mode->pixels);
+}
+
+static void draw_panel(Texture2D texture, Rectangle panel)
+{
+    Rectangle source = {0, 0, texture.width, texture.height};
+    DrawTexturePro(texture, source, panel, (Vector2) {0, 0}, 0, WHITE);
+    DrawRectangleLinesEx(panel, 1, DARKGRAY);
+}
+
+void draw_mode2d(Mode2D *mode)
+{
+    if (mode->potential_stale)
+    {
+        upload_grid(mode, mode->potential_texture, mode->potential, 0);
+        mode->potential_stale = 0;
+    }
+
+    pthread_mutex_lock(&mode->lock);
+    Spectrum2D *spec = mode->front;
+    int solved = mode->published > 0;
+    int busy = mode->pending || mode->busy;
+    double energy = spec->evalues[mode->state];
+    double solve_ms = 1000 * mode->last_solve_seconds;
+    if (solved && (mode->drawn != mode->published || mode->drawn_state != mode->state))
+    {
+        density2d(spec, mode->state, mode->density);
+        mode->drawn = mode->published;
+        mode->drawn_state = mode->state;
+        pthread_mutex_unlock(&mode->lock);
+        upload_grid(mode, mode->density_texture, mode->density, 1);
+    }
+    else
+        pthread_mutex_unlock(&mode->lock);
+
+    Rectangle left = potential_panel();
+    Rectangle right = density_panel();
+    draw_panel(mode->potential_texture, left);
+    if (solved)
+        draw_panel(mode->density_texture, right);
+    else
+        DrawRectangleLinesEx(right, 1, DARKGRAY);
+
+    DrawText(TextFormat("2D mode, %dx%d grid (Tab for 1D)", mode->n, mode->n), PANEL_GAP, 30, 20, DARKGRAY);
+    DrawText(TextFormat("Left/right drag paints the potential up/down, R resets it, arrow keys pick the state, G for %dx%d",
+        (mode->n == MODE2D_N) ? MODE2D_FINE_N : MODE2D_N, (mode->n == MODE2D_N) ? MODE2D_FINE_N : MODE2D_N),
+        PANEL_GAP, 60, 14, DARKGRAY);
+    DrawText("V(x, y)", left.x, left.y - 22, 16, DARKGRAY);
+    if (solved)
+        DrawText(TextFormat("|psi_%d|^2   E = %.4f   (solved in %.0f ms)", mode->state, energy, solve_ms),
+            right.x, right.y - 22, 16, DARKGRAY);
+
+    if (busy)
+    {
+        int done = atomic_load(&mode->control.progress);
+        int total = atomic_load(&mode->control.total);
+        DrawText(TextFormat("Solving... %d/%d states converged", done, total > 0 ? total : mode->k),
+            PANEL_GAP, left.y + left.height + 16, 16, DARKGRAY);
+    }
+}
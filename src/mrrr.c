@@ -0,0 +1,651 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include "mrrr.h"
+#include "slice.h"
+#include "tridiag.h"
+
+// Same pivot floor as sturm_count()
+#define PIVMIN (DBL_MIN / DBL_EPSILON)
+// Neighbours closer than this fraction of their distance from the shift are
+// treated as a cluster
+#define MRRR_MIN_RELGAP 1e-3
+// Representations stacked on one cluster before giving up on splitting it
+#define MRRR_MAX_DEPTH 8
+// Bisection only needs to tell clusters apart; Rayleigh quotient iteration
+// on the twisted factorization takes singletons the rest of the way
+#define MRRR_BISECT_RTOL 1.5e-8
+#define MRRR_MAX_RQI 10
+// Counts bisection runs side by side, so their divisions overlap
+#define MRRR_LANES 8
+// A child representation is trusted while its pivots stay below this many
+// widths of the spectrum
+#define MRRR_MAX_GROWTH 8.0
+// Unwanted neighbours looked at on each side to find the gaps of the end ones
+#define MRRR_MAX_EXTEND 64
+#define MRRR_MAX_THREADS WORKSPACE_THREADS
+// Vectors per thread below which extra threads cost more than they save
+#define MRRR_MIN_PER_THREAD 16
+
+// LDL^T = T - shift I, with L unit lower bidiagonal
+typedef struct Representation
+{
+    double shift;
+    double *D;
+    double *L; // L[i] couples rows i and i+1
+    double *LD; // L[i] D[i]
+    double *LLD; // L[i]^2 D[i]
+} Representation;
+
+typedef struct Mrrr
+{
+    const double *d;
+    const double *e;
+    int n;
+    double spdiam; // width of the spectrum
+    int il; // wanted eigenpairs
+    int iu;
+    double *w;
+    double *vectors;
+    SolveControl *ctl;
+    atomic_int cancelled;
+} Mrrr;
+
+// Workspace of the twisted factorization
+typedef struct Twist
+{
+    double *lplus;
+    double *uminus;
+    double *s;
+    double *p;
+} Twist;
+
+typedef struct MrrrTask
+{
+    Mrrr *m;
+    const Representation *root;
+    // root-relative eigenvalues and their brackets, for eigenvalue j at [j - base]
+    double *tau;
+    double *lo;
+    double *hi;
+    int base;
+    // refine: eigenvalues first..last. vectors: groups first..last of groups
+    int refine;
+    int first;
+    int last;
+    const int *groups; // start and end of each group, in pairs
+    Arena *arena; // this task's scratch
+} MrrrTask;
+
+// Storage lasts until arena is released past it
+static void init_representation(Representation *r, int n, Arena *arena)
+{
+    double *block = arena_take(arena, sizeof(double) * 4 * n);
+    r->D = block;
+    r->L = block + n;
+    r->LD = block + 2*n;
+    r->LLD = block + 3*n;
+}
+
+static void finish_representation(Representation *r, int n)
+{
+    r->L[n-1] = 0;
+    for(int i = 0; i < n; i++)
+    {
+        r->LD[i] = r->L[i] * r->D[i];
+        r->LLD[i] = r->L[i] * r->LD[i];
+    }
+}
+
+// Bracket width at which bisection stops
+static double tolerance(const Mrrr *m, double lo, double hi)
+{
+    return MRRR_BISECT_RTOL * fmax(fabs(lo), fabs(hi)) + DBL_EPSILON * DBL_EPSILON * m->spdiam;
+}
+
+// Eigenvalues of r below tau: negative pivots of LDL^T - tau I = L+ D+ L+^T
+// by the stationary qd transform
+static int representation_count(const Representation *r, int n, double tau)
+{
+    int count = 0;
+    double s = -tau;
+    for(int i = 0; i < n; i++)
+    {
+        double dplus = r->D[i] + s;
+        if (fabs(dplus) < PIVMIN)
+            dplus = -PIVMIN;
+        count += dplus < 0;
+        s = r->LLD[i] * s / dplus - tau;
+    }
+    return count;
+}
+
+// representation_count() at num shifts x, MRRR_LANES at a time
+static void representation_counts(const Representation *r, int n, const double *x, int *counts, int num)
+{
+    for(int b = 0; b < num; b += MRRR_LANES)
+    {
+        double tau[MRRR_LANES];
+        double s[MRRR_LANES];
+        int c[MRRR_LANES];
+        for(int l = 0; l < MRRR_LANES; l++)
+        {
+            tau[l] = x[(b+l < num) ? b+l : num-1];
+            s[l] = -tau[l];
+            c[l] = 0;
+        }
+        for(int i = 0; i < n; i++)
+        {
+            double D = r->D[i];
+            double LLD = r->LLD[i];
+            for(int l = 0; l < MRRR_LANES; l++)
+            {
+                double dplus = D + s[l];
+                dplus = (fabs(dplus) < PIVMIN) ? -PIVMIN : dplus;
+                c[l] += dplus < 0;
+                s[l] = LLD * s[l] / dplus - tau[l];
+            }
+        }
+        for(int l = 0; l < MRRR_LANES && b+l < num; l++)
+            counts[b+l] = c[l];
+    }
+}
+
+// Narrows [lo[j], hi[j]] around eigenvalue first+j of r for j < count,
+// widening it first if rounding left the eigenvalue outside, and puts its
+// midpoint in tau[j]. All the brackets move together in passes of
+// representation_counts(); when fewer of them than MRRR_LANES are left, each
+// is cut at several points per pass instead of halved.
+static void representation_bisect(const Mrrr *m, const Representation *r, int first, int count,
+    double *tau, double *lo, double *hi, Arena *arena)
+{
+    int size = 2*count + MRRR_LANES;
+    ArenaMark mark = arena_mark(arena);
+    double *x = arena_take(arena, sizeof(double) * (size + 2*count));
+    double *step = x + size;
+    int *counts = arena_take(arena, sizeof(int) * (size + 2*count));
+    int *pending = counts + size; // 2j for lo[j], 2j+1 for hi[j]
+
+    int num = 2 * count;
+    for(int k = 0; k < num; k++)
+    {
+        int j = k / 2;
+        step[k] = fmax(hi[j] - lo[j], tolerance(m, lo[j], hi[j]));
+        pending[k] = k;
+    }
+    while (num > 0)
+    {
+        for(int k = 0; k < num; k++)
+            x[k] = (pending[k] % 2) ? hi[pending[k] / 2] : lo[pending[k] / 2];
+        representation_counts(r, m->n, x, counts, num);
+        int next = 0;
+        for(int k = 0; k < num; k++)
+        {
+            int end = pending[k];
+            int j = end / 2;
+            if (end % 2 == 0 && counts[k] > first+j)
+                lo[j] -= step[end];
+            else if (end % 2 == 1 && counts[k] <= first+j)
+                hi[j] += step[end];
+            else
+                continue;
+            step[end] *= 2;
+            pending[next++] = end;
+        }
+        num = next;
+    }
+
+    num = 0;
+    for(int j = 0; j < count; j++)
+    {
+        if (hi[j] - lo[j] > tolerance(m, lo[j], hi[j]))
+            pending[num++] = j;
+    }
+    for(int iter = 0; iter < 256 && num > 0; iter++)
+    {
+        int cuts = (num < MRRR_LANES) ? MRRR_LANES / num : 1;
+        for(int k = 0; k < num; k++)
+        {
+            int j = pending[k];
+            for(int c = 0; c < cuts; c++)
+                x[k*cuts + c] = lo[j] + (hi[j] - lo[j]) * (c+1) / (cuts+1);
+        }
+        representation_counts(r, m->n, x, counts, num * cuts);
+        int next = 0;
+        for(int k = 0; k < num; k++)
+        {
+            int j = pending[k];
+            double newlo = lo[j];
+            double newhi = hi[j];
+            for(int c = cuts-1; c >= 0; c--)
+            {
+                if (counts[k*cuts + c] > first+j)
+                    newhi = x[k*cuts + c];
+            }
+            for(int c = 0; c < cuts; c++)
+            {
+                if (counts[k*cuts + c] <= first+j && x[k*cuts + c] < newhi)
+                    newlo = x[k*cuts + c];
+            }
+            if (newlo <= lo[j] && newhi >= hi[j])
+                continue; // rounding left nothing to cut
+            lo[j] = newlo;
+            hi[j] = newhi;
+            if (hi[j] - lo[j] > tolerance(m, lo[j], hi[j]))
+                pending[next++] = j;
+        }
+        num = next;
+    }
+    for(int j = 0; j < count; j++)
+        tau[j] = 0.5 * (lo[j] + hi[j]);
+    arena_release(arena, mark);
+}
+
+// child = r - shift I, by the stationary qd transform. Returns the largest
+// pivot, which measures how much relative accuracy the child may have lost.
+static double shift_representation(const Representation *r, int n, double shift, Representation *child)
+{
+    double s = -shift;
+    double growth = 0;
+    for(int i = 0; i < n; i++)
+    {
+        double dplus = r->D[i] + s;
+        if (fabs(dplus) < PIVMIN)
+            dplus = -PIVMIN;
+        child->D[i] = dplus;
+        child->L[i] = (i < n-1) ? r->LD[i] / dplus : 0;
+        s = r->LLD[i] * s / dplus - shift;
+        growth = fmax(growth, fabs(dplus));
+    }
+    finish_representation(child, n);
+    child->shift = r->shift + shift;
+    return isfinite(growth) ? growth : HUGE_VAL;
+}
+
+// Unit eigenvector of r for its eigenvalue near tau. LDL^T - tau I is
+// factored from the top (L+ D+ L+^T) and from the bottom (U- D- U-^T); the two
+// meet at the twist index where the pivot gamma of the combined factorization
+// is smallest, and there the vector is found by two recurrences without any
+// division by a small pivot. Returns the Rayleigh quotient correction to tau,
+// and the norm of the residual (LDL^T - tau I) z to *residual.
+static double twisted_vector(const Representation *r, int n, double tau, Twist *t, double *z, double *residual)
+{
+    double s = -tau;
+    for(int i = 0; i < n; i++)
+    {
+        t->s[i] = s;
+        if (i == n-1)
+            break;
+        double dplus = r->D[i] + s;
+        if (fabs(dplus) < PIVMIN)
+            dplus = -PIVMIN;
+        t->lplus[i] = r->LD[i] / dplus;
+        s = t->lplus[i] * r->L[i] * s - tau;
+    }
+
+    double p = r->D[n-1] - tau;
+    t->p[n-1] = p;
+    for(int i = n-2; i >= 0; i--)
+    {
+        double dminus = r->LLD[i] + p;
+        if (fabs(dminus) < PIVMIN)
+            dminus = -PIVMIN;
+        double ratio = r->D[i] / dminus;
+        t->uminus[i] = r->L[i] * ratio;
+        p = p * ratio - tau;
+        t->p[i] = p;
+    }
+
+    int twist = 0;
+    double smallest = HUGE_VAL;
+    for(int i = 0; i < n; i++)
+    {
+        double gamma = fabs(t->s[i] + t->p[i] + tau);
+        if (gamma < smallest)
+        {
+            smallest = gamma;
+            twist = i;
+        }
+    }
+
+    z[twist] = 1;
+    double norm = 1;
+    for(int i = twist-1; i >= 0; i--)
+    {
+        z[i] = -t->lplus[i] * z[i+1];
+        norm += z[i] * z[i];
+    }
+    for(int i = twist; i < n-1; i++)
+    {
+        z[i+1] = -t->uminus[i] * z[i];
+        norm += z[i+1] * z[i+1];
+    }
+    double correction = smallest / norm;
+    correction = (t->s[twist] + t->p[twist] + tau < 0) ? -correction : correction;
+    *residual = smallest / sqrt(norm);
+    norm = 1.0 / sqrt(norm);
+    for(int i = 0; i < n; i++)
+        z[i] *= norm;
+    return correction;
+}
+
+// Vector of eigenvalue j of r, a singleton bracketed by [lo, hi], refined by
+// Rayleigh quotient iteration until the residual is small against the gap to
+// the neighbours, which separated() puts at no less than MRRR_MIN_RELGAP |tau|,
+// or until rounding stops the corrections from shrinking. Returns the
+// eigenvalue relative to r.
+static double singleton_vector(const Mrrr *m, const Representation *r, int j, double tau, double lo, double hi,
+    Twist *t, double *z)
+{
+    double target = 4 * log2(m->n + 1) * DBL_EPSILON * MRRR_MIN_RELGAP;
+    double previous = HUGE_VAL;
+    for(int iter = 0; iter < MRRR_MAX_RQI; iter++)
+    {
+        double residual;
+        double correction = twisted_vector(r, m->n, tau, t, z, &residual);
+        if (residual <= target * fabs(tau) || fabs(correction) <= 4 * DBL_EPSILON * fabs(tau)
+            || fabs(correction) >= 0.5 * previous)
+            break;
+        previous = fabs(correction);
+        double next = tau + correction;
+        if (!(next > lo && next < hi))
+        {
+            // left the bracket: bisect once and try again from there
+            if (representation_count(r, m->n, tau) > j)
+                hi = tau;
+            else
+                lo = tau;
+            next = 0.5 * (lo + hi);
+        }
+        tau = next;
+    }
+    return tau;
+}
+
+// Whether eigenvalues j and j+1 can get their vectors separately
+static int separated(const double *tau, const double *lo, const double *hi, int j)
+{
+    return lo[j+1] > hi[j] && tau[j+1] - tau[j] >= MRRR_MIN_RELGAP * fmax(fabs(tau[j]), fabs(tau[j+1]));
+}
+
+static void vector_done(Mrrr *m)
+{
+    if (m->ctl != NULL)
+        atomic_fetch_add_explicit(&m->ctl->progress, 1, memory_order_relaxed);
+}
+
+// Eigenvalues a..b that no representation could pull apart: inverse
+// iteration on T, orthogonalized within the cluster
+static void solve_tight_cluster(Mrrr *m, const Representation *rep, int a, int b, const double *tau,
+    Arena *arena)
+{
+    int n = m->n;
+    int count = b - a + 1;
+    ArenaMark mark = arena_mark(arena);
+    double *evalues = arena_take(arena, sizeof(double) * count);
+    double *block = arena_take(arena, sizeof(double) * count * n);
+    for(int j = 0; j < count; j++)
+        evalues[j] = rep->shift + tau[j];
+    for(int j = 0; j < count; j++)
+    {
+        inverse_iteration(m->d, m->e, n, evalues, j, block, arena);
+        if (a+j >= m->il && a+j <= m->iu)
+        {
+            m->w[a+j - m->il] = evalues[j];
+            memcpy(m->vectors + (size_t) (a+j - m->il) * n, block + (size_t) j * n, sizeof(double) * n);
+            vector_done(m);
+        }
+    }
+    arena_release(arena, mark);
+}
+
+// Vectors of the wanted eigenvalues among a..b, which rep resolves to tau,
+// lo and hi (at [j - a]) and which are separated from all the others
+static void solve_group(Mrrr *m, Twist *twist, const Representation *rep, int a, int b,
+    const double *tau, const double *lo, const double *hi, int depth, Arena *arena)
+{
+    int n = m->n;
+    if (b < m->il || a > m->iu)
+        return;
+    if (m->ctl != NULL && atomic_load_explicit(&m->ctl->cancel, memory_order_relaxed))
+    {
+        atomic_store(&m->cancelled, 1);
+        return;
+    }
+    if (a == b)
+    {
+        double refined = singleton_vector(m, rep, a, tau[0], lo[0], hi[0], twist,
+            m->vectors + (size_t) (a - m->il) * n);
+        m->w[a - m->il] = rep->shift + refined;
+        vector_done(m);
+        return;
+    }
+    if (depth >= MRRR_MAX_DEPTH)
+    {
+        solve_tight_cluster(m, rep, a, b, tau, arena);
+        return;
+    }
+
+    // Shift to just beyond one end of the cluster, past the uncertainty of
+    // its end value, where the cluster's relative gaps are large. Prefer the
+    // end whose representation keeps smaller pivots.
+    int count = b - a + 1;
+    double left = lo[0] - fmax(hi[0] - lo[0], tolerance(m, lo[0], hi[0]));
+    double right = hi[count-1] + fmax(hi[count-1] - lo[count-1], tolerance(m, lo[count-1], hi[count-1]));
+    ArenaMark mark = arena_mark(arena);
+    Representation child;
+    init_representation(&child, n, arena);
+    double shift = left;
+    double growth = shift_representation(rep, n, left, &child);
+    if (!(growth <= MRRR_MAX_GROWTH * m->spdiam))
+    {
+        Representation other;
+        init_representation(&other, n, arena);
+        if (shift_representation(rep, n, right, &other) < growth)
+        {
+            child = other;
+            shift = right;
+        }
+    }
+
+    double *ctau = arena_take(arena, sizeof(double) * 3 * count);
+    double *clo = ctau + count;
+    double *chi = ctau + 2*count;
+    for(int j = 0; j < count; j++)
+    {
+        clo[j] = lo[j] - shift;
+        chi[j] = hi[j] - shift;
+    }
+    representation_bisect(m, &child, a, count, ctau, clo, chi, arena);
+
+    int start = 0;
+    for(int j = 0; j < count; j++)
+    {
+        if (j == count-1 || separated(ctau, clo, chi, j))
+        {
+            solve_group(m, twist, &child, a+start, a+j, ctau+start, clo+start, chi+start, depth+1, arena);
+            start = j+1;
+        }
+    }
+    arena_release(arena, mark);
+}
+
+static void *mrrr_run(void *arg)
+{
+    MrrrTask *task = arg;
+    Mrrr *m = task->m;
+    if (task->refine)
+    {
+        int at = task->first - task->base;
+        representation_bisect(m, task->root, task->first, task->last - task->first + 1,
+            task->tau + at, task->lo + at, task->hi + at, task->arena);
+        return NULL;
+    }
+
+    int n = m->n;
+    Twist twist;
+    ArenaMark mark = arena_mark(task->arena);
+    double *work = arena_take(task->arena, sizeof(double) * 4 * n);
+    twist.lplus = work;
+    twist.uminus = work + n;
+    twist.s = work + 2*n;
+    twist.p = work + 3*n;
+    for(int g = task->first; g <= task->last && !atomic_load(&m->cancelled); g++)
+    {
+        int a = task->groups[2*g];
+        int b = task->groups[2*g + 1];
+        int at = a - task->base;
+        solve_group(m, &twist, task->root, a, b, task->tau + at, task->lo + at, task->hi + at, 0, task->arena);
+    }
+    arena_release(task->arena, mark);
+    return NULL;
+}
+
+// Eigenvalue j of T relative to the root, bracketed from an estimate
+static void refine_one(const Mrrr *m, const Representation *root, int j, double *tau, double *lo, double *hi,
+    Arena *arena)
+{
+    double lambda;
+    bisect_eigenvalues(m->d, m->e, m->n, j, j, &lambda);
+    double width = tolerance(m, lambda, lambda) + 8 * DBL_EPSILON * m->spdiam;
+    *lo = lambda - width - root->shift;
+    *hi = lambda + width - root->shift;
+    representation_bisect(m, root, j, 1, tau, lo, hi, arena);
+}
+
+int mrrr_eigenpairs(const double *d, const double *e, int n, int il, int iu, double *w, double *vectors,
+    int threads, SolveControl *ctl, Workspace *work)
+{
+    int count = iu - il + 1;
+    if (threads <= 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus < 1) ? 1 : (int) cpus;
+    }
+    if (threads > MRRR_MAX_THREADS)
+        threads = MRRR_MAX_THREADS;
+    if (threads > count / MRRR_MIN_PER_THREAD)
+        threads = count / MRRR_MIN_PER_THREAD;
+    if (threads < 1)
+        threads = 1;
+
+    Workspace *temporary = (work == NULL) ? init_workspace() : NULL;
+    if (temporary != NULL)
+        work = temporary;
+    Arena *arena = workspace_arena(work, 0);
+    ArenaMark mark = arena_mark(arena);
+
+    Mrrr m = { .d = d, .e = e, .n = n, .il = il, .iu = iu, .w = w, .vectors = vectors, .ctl = ctl };
+    atomic_init(&m.cancelled, 0);
+    if (ctl != NULL)
+    {
+        atomic_store_explicit(&ctl->total, count, memory_order_relaxed);
+        atomic_store_explicit(&ctl->progress, 0, memory_order_relaxed);
+    }
+    double glo, ghi;
+    gershgorin_bounds(d, e, n, &glo, &ghi);
+    m.spdiam = ghi - glo;
+
+    // Root: T - sigma I with sigma just below the lowest eigenvalue, moved
+    // further down until every pivot is positive
+    Representation root;
+    init_representation(&root, n, arena);
+    double lowest;
+    bisect_eigenvalues(d, e, n, 0, 0, &lowest);
+    double delta = fmax(1e-3 * fabs(lowest), 8 * DBL_EPSILON * m.spdiam) + PIVMIN;
+    for(int positive = 0; !positive; delta *= 2)
+    {
+        root.shift = lowest - delta;
+        root.D[0] = d[0] - root.shift;
+        positive = root.D[0] > 0;
+        for(int i = 0; i < n-1 && positive; i++)
+        {
+            root.L[i] = e[i] / root.D[i];
+            root.D[i+1] = d[i+1] - root.shift - root.L[i] * e[i];
+            positive = root.D[i+1] > 0;
+        }
+    }
+    finish_representation(&root, n);
+
+    // The wanted eigenvalues, then their neighbours outwards until each end
+    // is separated from the rest
+    int span = count + 2 * MRRR_MAX_EXTEND;
+    int base = il - MRRR_MAX_EXTEND;
+    double *tau = arena_take(arena, sizeof(double) * 3 * span);
+    double *lo = tau + span;
+    double *hi = tau + 2*span;
+    double *lambda = w;
+    slice_eigenvalues(d, e, n, il, iu, lambda, threads, NULL, work);
+    for(int j = il; j <= iu; j++)
+    {
+        // Sturm counts on T are only good to about the rounding of its width
+        double width = tolerance(&m, lambda[j-il], lambda[j-il]) + 8 * DBL_EPSILON * m.spdiam;
+        lo[j - base] = lambda[j-il] - width - root.shift;
+        hi[j - base] = lambda[j-il] + width - root.shift;
+    }
+    MrrrTask tasks[MRRR_MAX_THREADS];
+    for(int t = 0; t < threads; t++)
+    {
+        tasks[t] = (MrrrTask) {
+            .m = &m, .root = &root, .tau = tau, .lo = lo, .hi = hi, .base = base, .refine = 1,
+            .first = il + (int) ((long) count * t / threads),
+            .last = il + (int) ((long) count * (t + 1) / threads) - 1,
+            .arena = workspace_arena(work, t)
+        };
+    }
+    workspace_run(work, mrrr_run, tasks, sizeof(MrrrTask), threads);
+
+    int wl = il;
+    while (wl > 0 && wl > il - MRRR_MAX_EXTEND)
+    {
+        wl--;
+        refine_one(&m, &root, wl, &tau[wl - base], &lo[wl - base], &hi[wl - base], arena);
+        if (separated(tau + (wl - base), lo + (wl - base), hi + (wl - base), 0))
+            break;
+    }
+    int wu = iu;
+    while (wu < n-1 && wu < iu + MRRR_MAX_EXTEND)
+    {
+        wu++;
+        refine_one(&m, &root, wu, &tau[wu - base], &lo[wu - base], &hi[wu - base], arena);
+        if (separated(tau + (wu-1 - base), lo + (wu-1 - base), hi + (wu-1 - base), 0))
+            break;
+    }
+    // Groups of eigenvalues that are separated from each other at the root
+    int *groups = arena_take(arena, sizeof(int) * 2 * (wu - wl + 1));
+    int num_groups = 0;
+    int start = wl;
+    for(int j = wl; j <= wu; j++)
+    {
+        if (j == wu || separated(tau + (j - base), lo + (j - base), hi + (j - base), 0))
+        {
+            groups[2*num_groups] = start;
+            groups[2*num_groups + 1] = j;
+            num_groups++;
+            start = j+1;
+        }
+    }
+
+    if (threads > num_groups)
+        threads = num_groups;
+    for(int t = 0; t < threads; t++)
+    {
+        tasks[t] = (MrrrTask) {
+            .m = &m, .root = &root, .tau = tau, .lo = lo, .hi = hi, .base = base, .refine = 0,
+            .first = (int) ((long) num_groups * t / threads),
+            .last = (int) ((long) num_groups * (t + 1) / threads) - 1,
+            .groups = groups, .arena = workspace_arena(work, t)
+        };
+    }
+    workspace_run(work, mrrr_run, tasks, sizeof(MrrrTask), threads);
+
+    int cancelled = atomic_load(&m.cancelled);
+    arena_release(arena, mark);
+    free_workspace(temporary);
+    return !cancelled;
+}
@@ -0,0 +1,152 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "perfcounters.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static const char *stage_names[STAGE_COUNT] = {
+    "assemble", "identity", "tqli", "sort", "observables", "eigenvalues", "vectors", "update", "render"
+};
+
+static double monotonic_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#ifdef __linux__
+static int open_counter(PerfEvent event)
+{
+    static const uint64_t configs[PERF_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = configs[event];
+    // user space only, which perf_event_paranoid = 2 still allows
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // threads started later count too, once they are joined
+    attr.inherit = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // counting starts right away, and stages read differences
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Count so far, scaled up if the kernel had to multiplex the counter
+static double read_counter(int fd)
+{
+    uint64_t data[3]; // value, time enabled, time running
+    if (read(fd, data, sizeof(data)) != sizeof(data) || data[2] == 0)
+        return 0;
+    return (double) data[0] * data[1] / data[2];
+}
+#endif
+
+PerfProfile *init_perfprofile()
+{
+    PerfProfile *profile = calloc(1, sizeof(PerfProfile));
+    if (profile == NULL)
+    {
+        fprintf(stderr, "init_perfprofile: malloc failed\n");
+        exit(1);
+    }
+    for (int i = 0; i < PERF_EVENTS; i++)
+    {
+#ifdef __linux__
+        profile->fds[i] = open_counter(i);
+#else
+        profile->fds[i] = -1;
+#endif
+    }
+    return profile;
+}
+
+void free_perfprofile(PerfProfile *profile)
+{
+    for (int i = 0; i < PERF_EVENTS; i++)
+    {
+        if (profile->fds[i] >= 0)
+            close(profile->fds[i]);
+    }
+    free(profile);
+}
+
+int perf_available(const PerfProfile *profile, PerfEvent event)
+{
+    return profile->fds[event] >= 0;
+}
+
+void perf_begin(PerfProfile *profile)
+{
+#ifdef __linux__
+    for (int i = 0; i < PERF_EVENTS; i++)
+    {
+        if (profile->fds[i] >= 0)
+            profile->value[i] = read_counter(profile->fds[i]);
+    }
+#endif
+    profile->started = monotonic_seconds();
+}
+
+void perf_end(PerfProfile *profile, PerfStage stage)
+{
+    profile->seconds[stage] += monotonic_seconds() - profile->started;
+    profile->runs[stage]++;
+#ifdef __linux__
+    for (int i = 0; i < PERF_EVENTS; i++)
+    {
+        if (profile->fds[i] >= 0)
+            profile->counts[stage][i] += read_counter(profile->fds[i]) - profile->value[i];
+    }
+#endif
+}
+
+void perf_report(const PerfProfile *profile, FILE *out, long points)
+{
+    int cycles = perf_available(profile, PERF_CYCLES);
+    int instructions = perf_available(profile, PERF_INSTRUCTIONS);
+    int cache = perf_available(profile, PERF_CACHE_MISSES);
+    int branch = perf_available(profile, PERF_BRANCH_MISSES);
+    if (!cycles && !instructions && !cache && !branch)
+        fprintf(out, "# hardware counters unavailable (see /proc/sys/kernel/perf_event_paranoid), wall time only\n");
+
+    fprintf(out, "# %-11s %6s %12s %8s %16s %17s\n",
+        "stage", "runs", "ms/run", "IPC", "cache miss/point", "branch miss/point");
+    for (int s = 0; s < STAGE_COUNT; s++)
+    {
+        long runs = profile->runs[s];
+        if (runs == 0)
+            continue;
+        const double *c = profile->counts[s];
+        double per_point = 1.0 / ((double) runs * (points > 0 ? points : 1));
+
+        char ipc[32] = "n/a";
+        char cache_text[32] = "n/a";
+        char branch_text[32] = "n/a";
+        if (cycles && instructions && c[PERF_CYCLES] > 0)
+            snprintf(ipc, sizeof(ipc), "%.2f", c[PERF_INSTRUCTIONS] / c[PERF_CYCLES]);
+        if (cache)
+            snprintf(cache_text, sizeof(cache_text), "%.3g", c[PERF_CACHE_MISSES] * per_point);
+        if (branch)
+            snprintf(branch_text, sizeof(branch_text), "%.3g", c[PERF_BRANCH_MISSES] * per_point);
+
+        fprintf(out, "  %-11s %6ld %12.3f %8s %16s %17s\n", stage_names[s], runs,
+            1000 * profile->seconds[s] / runs, ipc, cache_text, branch_text);
+    }
+}
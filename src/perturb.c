@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "perturb.h"
+#include "tridiag.h"
+#include "workspace.h"
+
+int perturb_preview(const EigenPackage *from, Vector2 *before, Vector2 *after, int n, EigenPackage *preview)
+{
+    int m = n-1;
+    int k = from->num_efunctions;
+    if (from->n != n || k <= 0 || from->z_columns < k || from->num_evalues < k)
+        return 0;
+
+    reserve_eigenpackage(preview, n, k);
+    Arena *arena = workspace_arena(preview->work, 0);
+    ArenaMark mark = arena_mark(arena);
+    double *d = arena_take(arena, sizeof(double)*m);
+    double *e = arena_take(arena, sizeof(double)*m);
+    double *dv = arena_take(arena, sizeof(double)*m);
+    double *psi = arena_take(arena, sizeof(double)*m);
+    double *x = arena_take(arena, sizeof(double)*m);
+    solver_backend()->assemble(before, n, d, e);
+    for(int i = 0; i < m; i++)
+        dv[i] = POTENTIAL_SCALE * (after[i+1].y - before[i+1].y);
+
+    double dl = after[1].x - after[0].x;
+    for(int j = 0; j < k; j++)
+    {
+        double shift = 0;
+        for(int i = 0; i < m; i++)
+        {
+            psi[i] = from->z[i][j];
+            shift += dv[i] * psi[i] * psi[i];
+        }
+        double energy = from->evalues[j];
+        preview->evalues[j] = energy + shift;
+
+        for(int i = 0; i < m; i++)
+            x[i] = -(dv[i] - shift) * psi[i];
+        shifted_solve(d, e, m, energy, x, arena);
+        // The solve blows up along psi itself, which first order leaves out
+        double along = 0;
+        for(int i = 0; i < m; i++)
+            along += psi[i] * x[i];
+        double norm = 0;
+        for(int i = 0; i < m; i++)
+        {
+            x[i] -= along * psi[i];
+            norm += x[i] * x[i];
+        }
+        norm = sqrt(norm);
+        double scale = (norm > PERTURB_MAX_CORRECTION) ? PERTURB_MAX_CORRECTION / norm : 1.0;
+
+        // Normalized density of psi + x, as solve_spectrum() finds it
+        Vector2 *wavefunction = preview->efunctions[j];
+        double area = 0;
+        for(int i = 0; i < m; i++)
+        {
+            double v = psi[i] + scale * x[i];
+            x[i] = v;
+            area += v * v;
+        }
+        double inv = 1.0 / (area * dl);
+        wavefunction[0] = (Vector2) { after[0].x, 0.0 };
+        wavefunction[n] = (Vector2) { after[n].x, 0.0 };
+        for(int i = 1; i < n; i++)
+            wavefunction[i] = (Vector2) { after[i].x, x[i-1] * x[i-1] * inv };
+    }
+
+    preview->num_evalues = k;
+    preview->first = from->first;
+    preview->num_efunctions = k;
+    preview->z_columns = 0;
+    preview->num_observables = 0;
+    preview->displayable = 1;
+    arena_release(arena, mark);
+    return 1;
+}
@@ -0,0 +1,199 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include "plugin.h"
+
+// Every load gets a distinct copy name so dlopen() never hands back the
+// previous build from its own cache of open objects
+static int copy_counter = 0;
+
+static int file_identity(const char *path, PluginFile *file)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return 0;
+    file->mtime = st.st_mtim;
+    file->size = st.st_size;
+    file->inode = st.st_ino;
+    return 1;
+}
+
+static int same_file(const PluginFile *a, const PluginFile *b)
+{
+    return a->mtime.tv_sec == b->mtime.tv_sec && a->mtime.tv_nsec == b->mtime.tv_nsec
+        && a->size == b->size && a->inode == b->inode;
+}
+
+static int copy_file(const char *from, int to_fd)
+{
+    int in = open(from, O_RDONLY);
+    if (in < 0)
+        return 0;
+
+    char buf[1 << 16];
+    ssize_t got;
+    while ((got = read(in, buf, sizeof(buf))) > 0)
+    {
+        if (write(to_fd, buf, got) != got)
+        {
+            close(in);
+            return 0;
+        }
+    }
+    close(in);
+    return got == 0;
+}
+
+// dlopen()s a private copy of path. The copy is unlinked straight away; the
+// mapping keeps it alive until dlclose().
+static void *open_copy(const char *path, const PotentialPlugin **desc, char *err, int errlen)
+{
+    const char *tmpdir = getenv("TMPDIR");
+    char copy[PLUGIN_PATH_LEN];
+    snprintf(copy, sizeof(copy), "%s/schrodinger-plugin-%d-%d-XXXXXX",
+        tmpdir ? tmpdir : "/tmp", (int) getpid(), copy_counter++);
+
+    int fd = mkstemp(copy);
+    if (fd < 0)
+    {
+        snprintf(err, errlen, "can't create a copy of %s", path);
+        return NULL;
+    }
+    int copied = copy_file(path, fd);
+    close(fd);
+    if (!copied)
+    {
+        unlink(copy);
+        snprintf(err, errlen, "can't read %s", path);
+        return NULL;
+    }
+
+    void *handle = dlopen(copy, RTLD_NOW | RTLD_LOCAL);
+    unlink(copy);
+    if (handle == NULL)
+    {
+        // dlerror() names the private copy, which means nothing to the user
+        const char *why = strrchr(dlerror(), ':');
+        snprintf(err, errlen, "can't load %s%s", path, why ? why : "");
+        return NULL;
+    }
+
+    const PotentialPlugin *found = dlsym(handle, "potential_plugin");
+    if (found == NULL)
+        snprintf(err, errlen, "%s does not export potential_plugin", path);
+    else if (found->abi != POTENTIAL_PLUGIN_ABI)
+        snprintf(err, errlen, "%s was built for plugin ABI %d, expected %d",
+            path, found->abi, POTENTIAL_PLUGIN_ABI);
+    else if (found->eval == NULL || found->num_params < 0 || found->num_params > PLUGIN_MAX_PARAMS)
+        snprintf(err, errlen, "%s has an invalid descriptor", path);
+    else
+    {
+        *desc = found;
+        return handle;
+    }
+    dlclose(handle);
+    return NULL;
+}
+
+Plugin *load_plugin(const char *path, char *err, int errlen)
+{
+    if (strlen(path) >= PLUGIN_PATH_LEN)
+    {
+        snprintf(err, errlen, "plugin path too long");
+        return NULL;
+    }
+
+    Plugin *plugin = calloc(1, sizeof(Plugin));
+    strcpy(plugin->path, path);
+    if (!file_identity(path, &plugin->loaded))
+    {
+        snprintf(err, errlen, "can't open %s", path);
+        free(plugin);
+        return NULL;
+    }
+
+    plugin->handle = open_copy(path, &plugin->desc, err, errlen);
+    if (plugin->handle == NULL)
+    {
+        free(plugin);
+        return NULL;
+    }
+    plugin->seen = plugin->loaded;
+    for(int i = 0; i < plugin->desc->num_params; i++)
+        plugin->params[i] = plugin->desc->params[i].value;
+    return plugin;
+}
+
+void free_plugin(Plugin *plugin)
+{
+    dlclose(plugin->handle);
+    free(plugin);
+}
+
+int reload_plugin_if_changed(Plugin *plugin, char *err, int errlen)
+{
+    PluginFile now;
+    if (!file_identity(plugin->path, &now))
+        return 0; // mid-rebuild; try again on the next poll
+
+    int settled = same_file(&now, &plugin->seen);
+    plugin->seen = now;
+    if (same_file(&now, &plugin->loaded) || !settled)
+        return 0;
+
+    // Remember the attempt either way so a broken build is reported once
+    plugin->loaded = now;
+
+    const PotentialPlugin *desc;
+    void *handle = open_copy(plugin->path, &desc, err, errlen);
+    if (handle == NULL)
+        return -1;
+
+    double params[PLUGIN_MAX_PARAMS];
+    for(int i = 0; i < desc->num_params; i++)
+    {
+        int old = plugin_find_param(plugin, desc->params[i].name);
+        params[i] = (old >= 0) ? plugin->params[old] : desc->params[i].value;
+    }
+
+    dlclose(plugin->handle);
+    plugin->handle = handle;
+    plugin->desc = desc;
+    for(int i = 0; i < desc->num_params; i++)
+        plugin_set_param(plugin, i, params[i]);
+    plugin->generation++;
+    return 1;
+}
+
+int plugin_find_param(const Plugin *plugin, const char *name)
+{
+    for(int i = 0; i < plugin->desc->num_params; i++)
+    {
+        if (strcmp(plugin->desc->params[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+void plugin_set_param(Plugin *plugin, int i, double value)
+{
+    const PluginParam *param = &plugin->desc->params[i];
+    if (param->min < param->max)
+    {
+        if (value < param->min)
+            value = param->min;
+        if (value > param->max)
+            value = param->max;
+    }
+    plugin->params[i] = value;
+}
+
+void plugin_fill(const Plugin *plugin, const double *domain, int n, Vector2 *points)
+{
+    fill_potential(domain, n, plugin->desc->eval, plugin->params, points);
+}
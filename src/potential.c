@@ -1,5 +1,13 @@
 #include <potential.h>
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vecmath.h"
+#include "solver.h"
+
+// Grid points are evaluated this many at a time through a stack buffer
+#define POTENTIAL_BLOCK 256
 
 double constant(double x)
 {
@@ -32,3 +40,130 @@ double sinusodial(double x)
 {
     return 1000* sin(25*x) + 0.5;
 }
+
+PotentialFn find_potential(const char *name)
+{
+    static const struct { const char *name; PotentialFn f; } table[] = {
+        {"constant", &constant},
+        {"linear", &linear},
+        {"quadratic", &quadratic},
+        {"step", &step},
+        {"gaussian", &gaussian},
+        {"sinusodial", &sinusodial},
+    };
+    for(int i = 0; i < (int) (sizeof(table) / sizeof(table[0])); i++)
+    {
+        if (strcmp(table[i].name, name) == 0)
+            return table[i].f;
+    }
+    return NULL;
+}
+
+void constant_batch(const double *x, double *out, size_t n, const double *params)
+{
+    memset(out, 0, sizeof(double)*n);
+}
+
+void linear_batch(const double *x, double *out, size_t n, const double *params)
+{
+    double slope = params ? params[0] : 1.0;
+    for (size_t i = 0; i < n; i++)
+        out[i] = slope * x[i];
+}
+
+void quadratic_batch(const double *x, double *out, size_t n, const double *params)
+{
+    double a = params ? params[0] : 4.0;
+    double c = params ? params[1] : 0.5;
+    for (size_t i = 0; i < n; i++)
+        out[i] = a * (x[i] - c) * (x[i] - c);
+}
+
+void step_batch(const double *x, double *out, size_t n, const double *params)
+{
+    double height = params ? params[0] : 0.5;
+    double edge = params ? params[1] : 0.3;
+    for (size_t i = 0; i < n; i++)
+        out[i] = height * (double) (x[i] < edge);
+}
+
+void gaussian_batch(const double *x, double *out, size_t n, const double *params)
+{
+    double height = params ? params[0] : 100.0;
+    double c = params ? params[1] : 0.75;
+    double inv_width = 1.0 / (params ? params[2] : 0.001);
+    for (size_t i = 0; i < n; i++)
+        out[i] = -(x[i] - c) * (x[i] - c) * inv_width;
+    vexp(out, out, n);
+    for (size_t i = 0; i < n; i++)
+        out[i] *= height;
+}
+
+void sinusodial_batch(const double *x, double *out, size_t n, const double *params)
+{
+    double amplitude = params ? params[0] : 1000.0;
+    double frequency = params ? params[1] : 25.0;
+    double offset = params ? params[2] : 0.5;
+    for (size_t i = 0; i < n; i++)
+        out[i] = frequency * x[i];
+    vsin(out, out, n);
+    for (size_t i = 0; i < n; i++)
+        out[i] = amplitude * out[i] + offset;
+}
+
+PotentialBatchFn find_potential_batch(const char *name)
+{
+    static const struct { const char *name; PotentialBatchFn f; } table[] = {
+        {"constant", &constant_batch},
+        {"linear", &linear_batch},
+        {"quadratic", &quadratic_batch},
+        {"step", &step_batch},
+        {"gaussian", &gaussian_batch},
+        {"sinusodial", &sinusodial_batch},
+    };
+    for(int i = 0; i < (int) (sizeof(table) / sizeof(table[0])); i++)
+    {
+        if (strcmp(table[i].name, name) == 0)
+            return table[i].f;
+    }
+    return NULL;
+}
+
+void fill_potential(const double *domain, int n, PotentialBatchFn f, const double *params, Vector2 *points)
+{
+    double values[POTENTIAL_BLOCK];
+    for(int base = 0; base <= n; base += POTENTIAL_BLOCK)
+    {
+        int m = (n + 1 - base < POTENTIAL_BLOCK) ? n + 1 - base : POTENTIAL_BLOCK;
+        f(domain + base, values, m, params);
+        for(int i = 0; i < m; i++)
+        {
+            points[base + i].x = domain[base + i];
+            points[base + i].y = values[i];
+        }
+    }
+}
+
+Vector2 *apply_potential_batch(const double *domain, int n, PotentialBatchFn f, const double *params)
+{
+    Vector2 *points = malloc(sizeof(Vector2)*(n+1));
+    if (points == NULL)
+    {
+        fprintf(stderr, "apply_potential_batch: malloc failed\n");
+        exit(1);
+    }
+    fill_potential(domain, n, f, params, points);
+    return points;
+}
+
+void fill_potential2d(int n, PotentialBatchFn f, const double *params, double *grid)
+{
+    // f(x) and f(y) share the one axis
+    double *axis = create_domain(0, 1, n);
+    f(axis, axis, n+1, params);
+
+    for(int i = 0; i <= n; i++)
+        for(int j = 0; j <= n; j++)
+            grid[(size_t) i*(n+1) + j] = axis[i] + axis[j];
+    free(axis);
+}
@@ -4,6 +4,8 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 #include <complex.h>
 #include <pthread.h>
 
@@ -14,12 +16,38 @@
 #include "guiconfig.h"
 #include "simconfig.h"
 #include "solver.h"
+#include "livesolver.h"
+#include "livethermal.h"
 #include "potential.h"
+#include "plugin.h"
+#include "mode2d.h"
+#include "scatter.h"
+#include "continuation.h"
+#include "telemetry.h"
+#include "perfcounters.h"
+#include "autotune.h"
 
 const int N = 500; // LENGTH. NUM POINTS WILL BE 501
 const Vector2 ORIGIN = {0.0, 0.0};
 const int NUM_COMPUTE_EVECTORS = 50; // 
 
+// Live mode waits for the brush to rest this long before re-solving...
+const double LIVE_DEBOUNCE = 0.03;
+// ...but never lets a continuous stroke go unsolved for longer than this
+const double LIVE_MAX_WAIT = 0.12;
+// How often a loaded plugin's file is checked for a rebuild
+const double PLUGIN_POLL_INTERVAL = 0.5;
+
+// Frame rate cap while something is changing, and while the window is in the
+// background. A static scene is not redrawn at all: the loop only wakes up
+// to look for input this often...
+const int ACTIVE_FPS = 60;
+const int UNFOCUSED_FPS = 15;
+const double IDLE_POLL = 1.0 / 30;
+const double UNFOCUSED_IDLE_POLL = 1.0 / 8;
+// ...and repaints this often anyway, in case the window system lost the image
+const double IDLE_REDRAW_INTERVAL = 1.0;
+
 const Color GUI_COLOR = (Color) {112, 128, 144, 150};
 const Color UNSELECTED_COLOR = (Color) {229, 228, 226, 255};
 const Color SELECTED_COLOR = (Color) {128, 128, 128, 255};
@@ -34,16 +62,23 @@ typedef struct WaveFunction
     double complex *points;
 } WaveFunction;
 
-// Draws points.width and height are the lengths of the horizontal and vertical axes respectively
-void display_points(Vector2 *points, int n, Color color, int width, int height) 
+// Value that display_points() maps to the top of the vertical axis
+double plot_scale(Vector2 *points, int n)
 {
-    Vector2 *scaled_points = malloc(sizeof(Vector2)*n);
     double max_val = 1.0;
     for (int i=0;i<n;i++)
     {
         if (points[i].y > max_val)
             max_val = points[i].y;
     }
+    return max_val;
+}
+
+// Draws points.width and height are the lengths of the horizontal and vertical axes respectively
+void display_points(Vector2 *points, int n, Color color, float thickness, int width, int height) 
+{
+    Vector2 *scaled_points = malloc(sizeof(Vector2)*n);
+    double max_val = plot_scale(points, n);
 
     for (int i=0;i<n;i++)
     {
@@ -53,11 +88,161 @@ void display_points(Vector2 *points, int n, Color color, int width, int height)
 
     for (int i=0; i<n-1; i++) 
     {
-        DrawLineEx(scaled_points[i], scaled_points[i+1], 2.5, color);
+        DrawLineEx(scaled_points[i], scaled_points[i+1], thickness, color);
     }
     free(scaled_points);
 }
 
+// Draws sorted energy levels as a ladder to the right of the plot, in the same
+// units as the potential. One line per distinct row, so thousands stay cheap.
+// alpha fades the whole ladder, 1 for opaque. labels, when not NULL, give
+// the colors of the first num_colored levels instead of their index.
+void display_levels(double *evalues, int count, int num_colored, const int *labels, double max_val, float alpha,
+    int width, int height)
+{
+    float left = width + 40;
+    float right = left + 60;
+    int last_row = -1;
+
+    for (int i=0;i<count;i++)
+    {
+        double level = evalues[i] / POTENTIAL_SCALE / max_val;
+        if (level > 1.0)
+            break; // the rest are above the vertical axis
+        int row = (int) (level * height);
+        if (row == last_row && i >= num_colored)
+            continue;
+        last_row = row;
+
+        Color color = DARKGRAY;
+        if (i < num_colored)
+            color = EIG_COLORS[((labels != NULL) ? labels[i] : i) % 6];
+        DrawLineV((Vector2) {left, -level * height}, (Vector2) {right, -level * height}, Fade(color, alpha));
+    }
+}
+
+// Starts a sweep of T(E) on a snapshot of the potential if it or the energy
+// at the top of the axis changed since the last one started
+void start_transmission(SimConfig *config)
+{
+    int points = config->n + 1;
+    double top = plot_scale(config->potential, points) * POTENTIAL_SCALE;
+    if (top == config->swept_top
+        && memcmp(config->potential, config->swept_potential, sizeof(Vector2)*points) == 0)
+        return;
+
+    for (int i=0;i<TRANSMISSION_POINTS;i++)
+        config->energies[i] = top * (i + 0.5) / TRANSMISSION_POINTS;
+    memcpy(config->swept_potential, config->potential, sizeof(Vector2)*points);
+    config->swept_top = top;
+    config->transmission_done = 0;
+}
+
+// Sweeps TRANSMISSION_CHUNK energies of T(E) per painted frame, so a sweep
+// never holds up drawing, and publishes the sweep once it is whole. While
+// painting, the plot lags the brush by a sweep of TRANSMISSION_POINTS /
+// TRANSMISSION_CHUNK frames.
+void update_transmission(SimConfig *config)
+{
+    if (config->transmission_done == TRANSMISSION_POINTS)
+        start_transmission(config);
+    int done = config->transmission_done;
+    int count = min(TRANSMISSION_CHUNK, TRANSMISSION_POINTS - done);
+    if (count == 0)
+        return;
+
+    transmission_sweep(config->swept_potential, config->n, config->energies + done, count,
+        config->sweeping + done, NULL, 0, NULL);
+    config->transmission_done += count;
+    if (config->transmission_done == TRANSMISSION_POINTS)
+    {
+        double *finished = config->sweeping;
+        config->sweeping = config->transmission;
+        config->transmission = finished;
+        config->transmission_ready = 1;
+        // strokes made during the sweep start the next one right away
+        start_transmission(config);
+    }
+}
+
+// Asks the thermal worker for the density of the current potential and
+// temperature. Only copies the potential, so painting never waits on the
+// solves behind it.
+void update_thermal(SimConfig *config)
+{
+    if (config->thermal == NULL)
+        config->thermal = init_livethermal(config->n, config->domain, THERMAL_TOLERANCE);
+    double top = plot_scale(config->potential, config->n + 1) * POTENTIAL_SCALE;
+    livethermal_request(config->thermal, config->potential, config->temperature * top);
+}
+
+// Draws T(E) sideways to the right of the level ladder. Energy runs up the
+// same scale as the potential, and T = 1 is 150 units to the right.
+void display_transmission(double *transmission, int count, int width, int height)
+{
+    float left = width + 120;
+    float right = left + 150;
+    DrawLineV((Vector2) {left, 0}, (Vector2) {left, -height}, DARKGRAY);
+    DrawLineV((Vector2) {right, 0}, (Vector2) {right, -height}, LIGHTGRAY);
+    DrawText("T(E)", left, -height - 24, 16, DARKGRAY);
+
+    Vector2 last = {left + transmission[0] * (right - left), -0.5f * height / count};
+    for (int i=1;i<count;i++)
+    {
+        Vector2 point = {left + transmission[i] * (right - left), -(i + 0.5f) * height / count};
+        DrawLineV(last, point, DARKBLUE);
+        last = point;
+    }
+}
+
+// Draws the E(parameter) curves of the tracked levels to the right of the
+// T(E) plot, on the same energy scale as the potential. Steps are joined
+// where a level, and so its color, carries on.
+void display_level_curves(const LevelTracker *tracker, const char *name, double max_val, int width, int height)
+{
+    float left = width + 300;
+    float right = left + 200;
+    DrawLineV((Vector2) {left, 0}, (Vector2) {left, -height}, DARKGRAY);
+    DrawText(TextFormat("E(%s)", name), left, -height - 24, 16, DARKGRAY);
+    if (tracker->steps < 2)
+        return;
+
+    double lo = tracker->parameters[tracker_slot(tracker, 0)];
+    double hi = lo;
+    for (int s=1;s<tracker->steps;s++)
+    {
+        double parameter = tracker->parameters[tracker_slot(tracker, s)];
+        lo = fmin(lo, parameter);
+        hi = fmax(hi, parameter);
+    }
+    if (hi <= lo)
+        return;
+
+    int k = tracker->k;
+    double scale = height / (POTENTIAL_SCALE * max_val);
+    for (int s=1;s<tracker->steps;s++)
+    {
+        int before = tracker_slot(tracker, s-1);
+        int now = tracker_slot(tracker, s);
+        float x0 = left + (tracker->parameters[before] - lo) / (hi - lo) * (right - left);
+        float x1 = left + (tracker->parameters[now] - lo) / (hi - lo) * (right - left);
+        for (int j=0;j<k;j++)
+        {
+            int label = tracker->history_labels[now*k + j];
+            for (int i=0;i<k;i++)
+            {
+                if (tracker->history_labels[before*k + i] != label)
+                    continue;
+                Vector2 from = {x0, -tracker->energies[before*k + i] * scale};
+                Vector2 to = {x1, -tracker->energies[now*k + j] * scale};
+                if (from.y >= -height && to.y >= -height)
+                    DrawLineV(from, to, EIG_COLORS[label%6]);
+                break;
+            }
+        }
+    }
+}
+
 // Draws all information from a GuiConfig
 void draw_gui(GuiConfig *config, int num_eigenvalues)
 {
@@ -196,6 +381,402 @@ void draw_gui(GuiConfig *config, int num_eigenvalues)
     );
 }
 
+// Draws a bar under the gui showing how far the running solve is
+void draw_progress(GuiConfig *config, double fraction, double eta)
+{
+    Rectangle bar = {
+        config->gui_background.x,
+        config->gui_background.y + config->gui_height + 32,
+        config->gui_background.width / 3,
+        12
+    };
+    Rectangle fill = bar;
+    fill.width *= fraction;
+
+    DrawRectangleRec(bar, UNSELECTED_COLOR);
+    DrawRectangleRec(fill, SELECTED_COLOR);
+    DrawRectangleLinesEx(bar, 1, DARKGRAY);
+
+    if (eta >= 0)
+        DrawText(TextFormat("Solving %.0f%%  ETA %.1fs", 100*fraction, eta),
+            bar.x + bar.width + 10, bar.y - 2, 14, DARKGRAY);
+    else
+        DrawText("Solving...", bar.x + bar.width + 10, bar.y - 2, 14, DARKGRAY);
+}
+
+// Instrumentation overlay with frame rate, solve timings and cache counters.
+// The rate counts frames actually drawn, which drops to about 1 when idle.
+void draw_overlay(LiveSolver *live, double frame_rate)
+{
+    pthread_mutex_lock(&live->lock);
+    double solve_ms = 1000 * live->last_solve_seconds;
+    int from_cache = live->last_from_cache;
+    int continued = live->last_continued;
+    pthread_mutex_unlock(&live->lock);
+    // the solver thread fills the cache without holding live->lock
+    pthread_mutex_lock(&live->cache->lock);
+    size_t cache_bytes = live->cache->bytes;
+    pthread_mutex_unlock(&live->cache->lock);
+
+    const char *source = "";
+    if (from_cache == 1)
+        source = " (cached)";
+    else if (from_cache == 2)
+        source = " (from disk)";
+    else if (continued)
+        source = " (continued)";
+
+    int x = 10;
+    int y = GetScreenHeight() - 88;
+    DrawText(TextFormat("%.0f frames/s drawn", frame_rate), x, y, 14, DARKGRAY);
+    DrawText(TextFormat("last solve %.1f ms%s", solve_ms, source),
+        x, y + 18, 14, DARKGRAY);
+    DrawText(TextFormat("cache %ld hits / %ld misses, %.1f MB",
+            atomic_load(&live->cache->hits), atomic_load(&live->cache->misses),
+            cache_bytes / (1024.0 * 1024.0)),
+        x, y + 36, 14, DARKGRAY);
+    if (live->store != NULL)
+        DrawText(TextFormat("store %ld hits / %ld misses",
+                atomic_load(&live->store->hits), atomic_load(&live->store->misses)),
+            x, y + 54, 14, DARKGRAY);
+}
+
+// Table of the observables of the published states in the top-right corner:
+// energy, <x>, the uncertainties and their product, <V>, and the dipole to the
+// next displayed state. Rows take the colors of the curves.
+void draw_observables(LiveSolver *live)
+{
+    enum { ROWS = 12 };
+    Observables rows[ROWS];
+    double energies[ROWS];
+    double dipoles[ROWS];
+    pthread_mutex_lock(&live->lock);
+    EigenPackage *epkg = live->front;
+    int count = min(epkg->num_observables, ROWS);
+    int first = epkg->first;
+    for (int j = 0; j < count; j++)
+    {
+        rows[j] = epkg->observables[j];
+        energies[j] = epkg->evalues[j];
+        dipoles[j] = (j+1 < min(epkg->num_observables, DIPOLE_STATES))
+            ? epkg->dipoles[j*DIPOLE_STATES + j+1] : NAN;
+    }
+    pthread_mutex_unlock(&live->lock);
+
+    // the default font is proportional, so every column gets its own x
+    static const char *headers[8] = { "state", "E", "<x>", "dx", "dp", "dx*dp", "<V>", "<j|x|j+1>" };
+    int width = 72;
+    int x = GetScreenWidth() - 8 * width;
+    int y = 10;
+    for (int c = 0; c < 8; c++)
+        DrawText(headers[c], x + c * width, y, 14, DARKGRAY);
+    for (int j = 0; j < count; j++)
+    {
+        const Observables *o = &rows[j];
+        double values[7] = { energies[j], o->x, o->dx, o->dp, o->dx * o->dp, o->v, dipoles[j] };
+        int row_y = y + 18 * (j+1);
+        DrawText(TextFormat("%d", first + j), x, row_y, 14, EIG_COLORS[j%6]);
+        for (int c = 0; c < 7; c++)
+        {
+            if (!isnan(values[c]))
+                DrawText(TextFormat("%.4g", values[c]), x + (c+1) * width, row_y, 14, EIG_COLORS[j%6]);
+        }
+    }
+}
+
+// Text box for typing V(x). Enter compiles the expression, replaces the
+// potential with it and queues a solve. Escape leaves the box.
+void edit_expression(SimConfig *config, LiveSolver *live)
+{
+    int len = strlen(config->expr_text);
+    int c;
+    while ((c = GetCharPressed()) != 0)
+    {
+        if (c >= 32 && c < 127 && len < EXPR_TEXT_LEN - 1)
+        {
+            config->expr_text[len++] = (char) c;
+            config->expr_text[len] = '\0';
+        }
+    }
+    if (IsKeyPressed(KEY_BACKSPACE) && len > 0)
+        config->expr_text[--len] = '\0';
+
+    if (IsKeyPressed(KEY_ESCAPE))
+    {
+        config->editing_expr = 0;
+        SetExitKey(KEY_ESCAPE);
+    }
+    else if (IsKeyPressed(KEY_ENTER))
+    {
+        Expr *expr = expr_compile(config->expr_text, config->expr_error, sizeof(config->expr_error));
+        if (expr != NULL)
+        {
+            if (config->expr != NULL)
+                expr_free(config->expr);
+            config->expr = expr;
+            config->expr_error[0] = '\0';
+            expr_apply(expr, config->domain, config->potential, config->n);
+
+            livesolver_request_window(live, config->potential, config->first_state, config->num_eigenfunctions);
+            config->live_dirty = 0;
+            config->last_request_time = GetTime();
+            config->editing_expr = 0;
+            SetExitKey(KEY_ESCAPE);
+        }
+    }
+}
+
+void draw_expression(GuiConfig *gui_config, SimConfig *config)
+{
+    int x = gui_config->gui_background.x;
+    int y = gui_config->gui_background.y + gui_config->gui_height + 54;
+    DrawText(TextFormat("V(x) = %s_", config->expr_text), x, y, 18, BLACK);
+    if (config->expr_error[0] != '\0')
+        DrawText(config->expr_error, x, y + 22, 14, MAROON);
+    else
+        DrawText("Enter to apply, Esc to cancel", x, y + 22, 14, DARKGRAY);
+}
+
+// Screen rectangle of the track of the i-th plugin parameter slider
+Rectangle slider_rect(GuiConfig *gui_config, int i)
+{
+    return (Rectangle) {
+        GetScreenWidth() - 240,
+        gui_config->gui_background.y + gui_config->gui_height + 40 + 36*i,
+        180,
+        8
+    };
+}
+
+// The temperature slider of thermal mode sits below those of a plugin
+Rectangle thermal_slider_rect(GuiConfig *gui_config, SimConfig *config)
+{
+    return slider_rect(gui_config, (config->plugin != NULL) ? config->plugin->desc->num_params + 1 : 0);
+}
+
+// Lets the temperature slider take the mouse. Returns 1 while the mouse is
+// over or dragging it. Only the weights change, so there is nothing to queue.
+int handle_thermal_slider(GuiConfig *gui_config, SimConfig *config, Vector2 mouse_point)
+{
+    Rectangle track = thermal_slider_rect(gui_config, config);
+    if (!IsMouseButtonDown(MOUSE_BUTTON_LEFT))
+        config->thermal_slider_active = 0;
+
+    if (!config->thermal_slider_active)
+    {
+        Rectangle hit = track;
+        hit.y -= 8;
+        hit.height += 16;
+        if (!CheckCollisionPointRec(mouse_point, hit))
+            return 0;
+        if (!IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
+            return 1;
+        config->thermal_slider_active = 1;
+    }
+    config->temperature = Clamp((mouse_point.x - track.x) / track.width, 0.0f, 1.0f);
+    return 1;
+}
+
+void draw_thermal_slider(GuiConfig *gui_config, SimConfig *config)
+{
+    Rectangle track = thermal_slider_rect(gui_config, config);
+    LiveThermal *thermal = config->thermal;
+    pthread_mutex_lock(&thermal->lock);
+    DrawText(TextFormat("kT = %.4g (%d states, %.1e of the weight left out)",
+            thermal->kT, thermal->used, thermal->tail),
+        track.x, track.y - 14, 12, DARKGRAY);
+    pthread_mutex_unlock(&thermal->lock);
+    Color knob = config->thermal_slider_active ? SELECTED_COLOR : GUI_COLOR;
+    DrawRectangleRec(track, UNSELECTED_COLOR);
+    DrawRectangleLinesEx(track, 1, DARKGRAY);
+    DrawCircleV((Vector2) {track.x + config->temperature * track.width, track.y + track.height / 2}, 7, knob);
+}
+
+// Lets the plugin parameter sliders take the mouse. Moving one re-evaluates
+// the potential and marks it for a debounced solve. Returns 1 while the mouse
+// is over or dragging a slider so the rest of the input handling skips it.
+int handle_sliders(GuiConfig *gui_config, SimConfig *config, Vector2 mouse_point)
+{
+    Plugin *plugin = config->plugin;
+    if (!IsMouseButtonDown(MOUSE_BUTTON_LEFT))
+        config->active_slider = -1;
+
+    if (config->active_slider < 0)
+    {
+        int hovered = -1;
+        for(int i = 0; i < plugin->desc->num_params; i++)
+        {
+            Rectangle hit = slider_rect(gui_config, i);
+            hit.y -= 8;
+            hit.height += 16;
+            if (plugin->desc->params[i].min < plugin->desc->params[i].max
+                && CheckCollisionPointRec(mouse_point, hit))
+                hovered = i;
+        }
+        if (hovered < 0)
+            return 0;
+        if (!IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
+            return 1;
+        config->active_slider = hovered;
+    }
+
+    int i = config->active_slider;
+    const PluginParam *param = &plugin->desc->params[i];
+    Rectangle track = slider_rect(gui_config, i);
+    double t = Clamp((mouse_point.x - track.x) / track.width, 0.0f, 1.0f);
+    double value = param->min + t * (param->max - param->min);
+    config->animated_param = i;
+    if (value != plugin->params[i])
+    {
+        plugin_set_param(plugin, i, value);
+        plugin_fill(plugin, config->domain, config->n, config->potential);
+        config->plugin_dirty = 1;
+        config->last_stroke_time = GetTime();
+    }
+    return 1;
+}
+
+void draw_sliders(GuiConfig *gui_config, SimConfig *config)
+{
+    Plugin *plugin = config->plugin;
+    Rectangle first = slider_rect(gui_config, 0);
+    DrawText(TextFormat("plugin: %s", plugin->desc->name), first.x, first.y - 30, 16, BLACK);
+
+    for(int i = 0; i < plugin->desc->num_params; i++)
+    {
+        const PluginParam *param = &plugin->desc->params[i];
+        Rectangle track = slider_rect(gui_config, i);
+        DrawText(TextFormat("%s = %.4g", param->name, plugin->params[i]),
+            track.x, track.y - 14, 12, DARKGRAY);
+        if (param->min >= param->max)
+            continue; // no range to slide over
+
+        double t = (plugin->params[i] - param->min) / (param->max - param->min);
+        Color knob = (i == config->active_slider) ? SELECTED_COLOR : GUI_COLOR;
+        DrawRectangleRec(track, UNSELECTED_COLOR);
+        DrawRectangleLinesEx(track, 1, DARKGRAY);
+        DrawCircleV((Vector2) {track.x + t * track.width, track.y + track.height / 2}, 7, knob);
+    }
+
+    if (config->plugin_error[0] != '\0')
+    {
+        Rectangle below = slider_rect(gui_config, plugin->desc->num_params);
+        int width = MeasureText(config->plugin_error, 12);
+        DrawText(config->plugin_error, GetScreenWidth() - 10 - width, below.y, 12, MAROON);
+    }
+}
+
+// Picks up a rebuilt plugin. A failed reload keeps the old build running.
+void poll_plugin(SimConfig *config)
+{
+    double now = GetTime();
+    if (now - config->last_plugin_poll < PLUGIN_POLL_INTERVAL)
+        return;
+    config->last_plugin_poll = now;
+
+    char err[PLUGIN_ERROR_LEN];
+    int status = reload_plugin_if_changed(config->plugin, err, sizeof(err));
+    if (status == 1)
+    {
+        config->plugin_error[0] = '\0';
+        plugin_fill(config->plugin, config->domain, config->n, config->potential);
+        config->plugin_dirty = 1;
+    }
+    else if (status == -1)
+        snprintf(config->plugin_error, sizeof(config->plugin_error), "reload failed: %s", err);
+}
+
+// Writes the telemetry histograms to $SCHRODINGER_TELEMETRY.prom/.json,
+// else telemetry.prom/.json in the working directory, and prints the render
+// pass counters
+void dump_telemetry(const PerfProfile *render, int n)
+{
+    perf_report(render, stdout, n);
+    const char *prefix = getenv("SCHRODINGER_TELEMETRY");
+    if (prefix == NULL || prefix[0] == '\0')
+        prefix = "telemetry";
+    if (telemetry_dump(prefix))
+        printf("telemetry written to %s.prom and %s.json\n", prefix, prefix);
+    else
+        fprintf(stderr, "could not write telemetry to %s.prom/.json\n", prefix);
+}
+
+// Any mouse or keyboard activity since the last poll. Leaves the character
+// queue alone for the expression box.
+int has_input()
+{
+    Vector2 delta = GetMouseDelta();
+    if (delta.x != 0 || delta.y != 0 || GetMouseWheelMove() != 0)
+        return 1;
+    for (int button=MOUSE_BUTTON_LEFT;button<=MOUSE_BUTTON_MIDDLE;button++)
+    {
+        if (IsMouseButtonDown(button) || IsMouseButtonReleased(button))
+            return 1;
+    }
+    return GetKeyPressed() != 0;
+}
+
+// The plugin parameter a continuation sweep moves, or -1 when there is no
+// sweep: outside continuation mode, without a plugin, or while a slider is held
+int swept_param(SimConfig *config)
+{
+    if (!config->continuation || config->plugin == NULL || config->active_slider >= 0)
+        return -1;
+    int i = config->animated_param;
+    if (i >= config->plugin->desc->num_params
+        || !(config->plugin->desc->params[i].min < config->plugin->desc->params[i].max))
+        return -1;
+    return i;
+}
+
+// Moves the swept parameter one step, bouncing off the ends of its range,
+// once the step before was published, and requests the solve of that step
+void sweep_parameter(SimConfig *config, LiveSolver *live)
+{
+    int i = swept_param(config);
+    if (i < 0 || livesolver_published(live) < config->sweep_request)
+        return;
+    Plugin *plugin = config->plugin;
+    const PluginParam *param = &plugin->desc->params[i];
+    double value = plugin->params[i] + config->sweep_direction * (param->max - param->min) / CONTINUATION_STEPS;
+    if (value > param->max || value < param->min)
+    {
+        config->sweep_direction = -config->sweep_direction;
+        value = Clamp(value, param->min, param->max);
+    }
+    plugin_set_param(plugin, i, value);
+    plugin_fill(plugin, config->domain, config->n, config->potential);
+    livesolver_request_window(live, config->potential, config->first_state, config->num_eigenfunctions);
+    pthread_mutex_lock(&live->lock);
+    config->sweep_request = live->requested;
+    pthread_mutex_unlock(&live->lock);
+    config->sweep_value = value;
+    config->plugin_dirty = 0;
+    config->last_request_time = GetTime();
+}
+
+// Whether the next frame could differ from the last one drawn, which is
+// shown_published's solve at last_frame. If not, the main loop sleeps.
+int needs_frame(SimConfig *config, LiveSolver *live, Mode2D *mode2d, unsigned long shown_published, double last_frame)
+{
+    double now = GetTime();
+    if (has_input() || config->editing_expr || now - last_frame > IDLE_REDRAW_INTERVAL)
+        return 1;
+    if (config->show_2d)
+        return !mode2d_settled(mode2d);
+    if (livesolver_busy(live) || livesolver_published(live) != shown_published || swept_param(config) >= 0)
+        return 1;
+    if (config->show_transmission && config->transmission_done < TRANSMISSION_POINTS)
+        return 1;
+    if (config->show_thermal && config->thermal != NULL && (livethermal_busy(config->thermal)
+            || livethermal_published(config->thermal) != config->thermal_shown))
+        return 1;
+    // a debounced request or a plugin check is due
+    if ((config->live_mode && config->live_dirty) || config->plugin_dirty)
+        return 1;
+    return config->plugin != NULL && now - config->last_plugin_poll >= PLUGIN_POLL_INTERVAL;
+}
+
 void clear_btn_selections(GuiConfig *config)
 {
     config->selected_cursor = 0;
@@ -206,8 +787,8 @@ void clear_btn_selections(GuiConfig *config)
 }
 
 
-// Program main entry point
-int main()
+// Program main entry point. An optional argument names a potential plugin.
+int main(int argc, char **argv)
 {
     // Initialization
     // These constants are set regardless of system
@@ -215,20 +796,99 @@ int main()
     const int screen_width = 1000;
     const int screen_height = 700;
 
+    // e.g. SCHRODINGER_BACKEND=lapack in builds with LAPACK=1. Otherwise each
+    // solve takes the path this machine's tuning profile predicts is fastest.
+    const char *backend = getenv("SCHRODINGER_BACKEND");
+    TuneProfile *tuning = NULL;
+    if (backend != NULL && backend[0] != '\0')
+    {
+        if (!solver_select_backend(backend))
+        {
+            fprintf(stderr, "backend %s is not compiled in\n", backend);
+            exit(1);
+        }
+    }
+    else
+        tuning = autotune_startup(0, stdout);
+
     InitWindow(screen_width, screen_height, "Schrodinger Sim");
 
     SimConfig *config = init_simconfig(N);
     GuiConfig *gui_config = init_guiconfig();
-    EigenPackage *epkg = init_eigenpackage(config->num_eigenfunctions, N, config->domain);
-    struct SolverPkg *solverpkg = malloc(sizeof(struct SolverPkg));
+    LiveSolver *live = init_livesolver(N, config->num_eigenfunctions, config->domain);
+    Mode2D *mode2d = NULL; // started the first time it is shown
 
-    pthread_t solver_thread_id;
+    if (argc > 1)
+    {
+        char err[PLUGIN_ERROR_LEN];
+        config->plugin = load_plugin(argv[1], err, sizeof(err));
+        if (config->plugin == NULL)
+        {
+            fprintf(stderr, "%s\n", err);
+            exit(1);
+        }
+        plugin_fill(config->plugin, config->domain, config->n, config->potential);
+        config->plugin_dirty = 1;
+    }
 
-    SetTargetFPS(60);
+    SetTargetFPS(ACTIVE_FPS);
+    int focused = 1;
+    unsigned long shown_published = 0; // solve in front when the last frame was drawn
+    double last_frame = -IDLE_REDRAW_INTERVAL; // the first frame is always drawn
+    int frames = 0; // drawn since rate_start
+    double rate_start = 0;
+    double frame_rate = 0;
+    int drew_last = 0; // the previous iteration drew a frame instead of idling
+    PerfProfile *render = init_perfprofile(); // CPU side of each frame, up to the buffer swap
 
     // Main game loop
     while (!WindowShouldClose())
     {
+        if (IsWindowFocused() != focused)
+        {
+            focused = !focused;
+            SetTargetFPS(focused ? ACTIVE_FPS : UNFOCUSED_FPS);
+        }
+        // Sleep through static scenes. EndDrawing() polls input otherwise.
+        if (!needs_frame(config, live, mode2d, shown_published, last_frame))
+        {
+            WaitTime(focused ? IDLE_POLL : UNFOCUSED_IDLE_POLL);
+            PollInputEvents();
+            drew_last = 0;
+            continue;
+        }
+        if (drew_last)
+            telemetry_record(METRIC_FRAME, GetTime() - last_frame);
+        drew_last = 1;
+        last_frame = GetTime();
+        frames++;
+        if (last_frame - rate_start >= 1.0)
+        {
+            frame_rate = frames / (last_frame - rate_start);
+            frames = 0;
+            rate_start = last_frame;
+        }
+
+        if (!config->editing_expr && IsKeyPressed(KEY_TAB))
+        {
+            config->show_2d = !config->show_2d;
+            if (config->show_2d && mode2d == NULL)
+                mode2d = init_mode2d(MODE2D_N, MODE2D_K);
+        }
+        if (config->show_2d)
+        {
+            if (IsKeyPressed(KEY_G))
+                mode2d = regrid_mode2d(mode2d, (mode2d->n == MODE2D_N) ? MODE2D_FINE_N : MODE2D_N);
+            update_mode2d(mode2d);
+            perf_begin(render);
+            BeginDrawing();
+            ClearBackground(RAYWHITE);
+            draw_mode2d(mode2d);
+            perf_end(render, STAGE_RENDER);
+            EndDrawing();
+            continue;
+        }
+
         Vector2 mouse_point = GetMousePosition();
 
         // right-click panning behavior
@@ -244,7 +904,11 @@ int main()
 
         // Check whether the cursor is hovering over a specific button and color it accordingly.
         // Further check if the button is actually clicked
-        if (CheckCollisionPointRec(mouse_point, gui_config->cursor_btn))
+        if (config->plugin != NULL && handle_sliders(gui_config, config, mouse_point))
+            SetMouseCursor(MOUSE_CURSOR_RESIZE_EW);
+        else if (config->show_thermal && handle_thermal_slider(gui_config, config, mouse_point))
+            SetMouseCursor(MOUSE_CURSOR_RESIZE_EW);
+        else if (CheckCollisionPointRec(mouse_point, gui_config->cursor_btn))
         {
             if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
             {
@@ -307,15 +971,12 @@ int main()
                 clear_btn_selections(gui_config);
                 gui_config->selected_evalue = 1; 
 
-                if (epkg->displayable)
+                // the solver thread copies the potential, so painting can continue meanwhile
+                if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
                 {
-                    epkg->displayable = 0;
-                    solverpkg->epkg = epkg;
-                    solverpkg->n = config->n;
-                    solverpkg->num_eigenfunctions = config->num_eigenfunctions;
-                    solverpkg->potential = config->potential;
-
-                    pthread_create(&solver_thread_id, NULL, &solve_spectrum, (void *)(solverpkg));
+                    livesolver_request_window(live, config->potential, config->first_state, config->num_eigenfunctions);
+                    config->live_dirty = 0;
+                    config->last_request_time = GetTime();
                 }
             }
             else
@@ -381,6 +1042,9 @@ int main()
 
                 for (int i=index_low; i <= index_high; i++)
                     config->potential[i].y = (start + (i-index_low) * diff);
+
+                config->live_dirty = 1;
+                config->last_stroke_time = GetTime();
             }
         }
         else
@@ -391,6 +1055,98 @@ int main()
                 SetMouseCursor(MOUSE_CURSOR_ARROW);
         }
 
+        // Keyboard shortcuts are off while typing an expression
+        if (config->editing_expr)
+            edit_expression(config, live);
+        else
+        {
+            if (IsKeyPressed(KEY_I))
+                config->show_overlay = !config->show_overlay;
+
+            if (IsKeyPressed(KEY_D))
+                dump_telemetry(render, config->n);
+
+            if (IsKeyPressed(KEY_E))
+                config->show_levels = !config->show_levels;
+
+            if (IsKeyPressed(KEY_T))
+                config->show_transmission = !config->show_transmission;
+
+            if (IsKeyPressed(KEY_O))
+                config->show_observables = !config->show_observables;
+
+            if (IsKeyPressed(KEY_K))
+                config->show_thermal = !config->show_thermal;
+
+            if (IsKeyPressed(KEY_C))
+            {
+                config->continuation = !config->continuation;
+                livesolver_set_continuation(live, config->continuation);
+                tracker_reset(config->tracker);
+                config->tracked_published = 0;
+                config->sweep_request = 0;
+            }
+
+            if (IsKeyPressed(KEY_L))
+            {
+                config->live_mode = !config->live_mode;
+                config->live_dirty = config->live_mode;
+            }
+
+            // Page through the spectrum a window at a time, or jump to the
+            // states around the energy under the cursor
+            int first = config->first_state;
+            if (IsKeyPressed(KEY_PAGE_UP))
+                first += max(config->num_eigenfunctions, 1);
+            if (IsKeyPressed(KEY_PAGE_DOWN))
+                first -= max(config->num_eigenfunctions, 1);
+            if (IsKeyPressed(KEY_G))
+            {
+                double energy = cursor_pos.y / config->vertical_axis
+                    * plot_scale(config->potential, N+1) * POTENTIAL_SCALE;
+                spectrum_window(config->potential, N, energy, energy, &first);
+                first -= config->num_eigenfunctions / 2;
+            }
+            first = min(max(first, 0), N-1 - max(config->num_eigenfunctions, 1));
+            if (first != config->first_state)
+            {
+                config->first_state = first;
+                livesolver_request_window(live, config->potential, config->first_state, config->num_eigenfunctions);
+                config->last_request_time = GetTime();
+            }
+
+            if (IsKeyPressed(KEY_V))
+            {
+                config->editing_expr = 1;
+                config->expr_error[0] = '\0';
+                // Escape should leave the text box, not the program
+                SetExitKey(KEY_NULL);
+                while (GetCharPressed() != 0)
+                    ; // drop the 'v' that opened the box
+            }
+        }
+
+        if (config->plugin != NULL)
+            poll_plugin(config);
+
+        sweep_parameter(config, live);
+
+        // Debounced background re-solve while painting or sliding plugin
+        // parameters. A newer request cancels whatever the solver thread is
+        // still working on.
+        if ((config->live_mode && config->live_dirty) || config->plugin_dirty)
+        {
+            double now = GetTime();
+            if (now - config->last_stroke_time > LIVE_DEBOUNCE
+                || now - config->last_request_time > LIVE_MAX_WAIT)
+            {
+                livesolver_request_window(live, config->potential, config->first_state, config->num_eigenfunctions);
+                config->live_dirty = 0;
+                config->plugin_dirty = 0;
+                config->last_request_time = now;
+            }
+        }
+
         float wheel = GetMouseWheelMove();
         if (wheel != 0)
         {
@@ -415,6 +1171,7 @@ int main()
 
         // Draw
         //----------------------------------------------------------------------------------
+        perf_begin(render);
         BeginDrawing();
         ClearBackground(RAYWHITE);
         BeginMode2D(config->camera);
@@ -425,12 +1182,73 @@ int main()
             rlRotatef(90, 1, 0, 0);
             // DrawGrid(100, 50.0);
             rlPopMatrix();
-        display_points(config->potential, N+1, BLACK, config->horizontal_axis, config->vertical_axis);
-        // displaying desired potential
-        if (epkg->displayable)
+        display_points(config->potential, N+1, BLACK, 2.5, config->horizontal_axis, config->vertical_axis);
+        // displaying the last published eigenfunctions, or while a solve runs
+        // the first-order preview of it, thinner and faded
+        pthread_mutex_lock(&live->lock);
+        shown_published = live->published;
+        if (config->continuation && live->published != config->tracked_published)
+        {
+            // A step of the sweep is at its own value, anything else at the
+            // slider's, or without a plugin at the number of the solve
+            double parameter = live->published;
+            if (config->plugin != NULL && config->animated_param < config->plugin->desc->num_params)
+                parameter = (live->published == config->sweep_request)
+                    ? config->sweep_value : config->plugin->params[config->animated_param];
+            track_levels(config->tracker, live->front, parameter);
+            config->tracked_published = live->published;
+        }
+        // Colors follow the tracked levels, which the preview shares with front
+        const int *labels = NULL;
+        if (config->continuation && config->tracker->steps > 0 && config->tracker->k == live->front->num_efunctions
+            && config->tracker->first == live->front->first)
+            labels = config->tracker->labels;
+        EigenPackage *epkg = live->front;
+        EigenPackage *preview = livesolver_preview(live);
+        float alpha = 1.0;
+        float thickness = 2.5;
+        if (preview != NULL)
+        {
+            epkg = preview;
+            alpha = 0.45;
+            thickness = 1.5;
+        }
+        if (epkg->displayable && !config->show_thermal)
         {
             for(int i=0;i<epkg->num_efunctions;i++)
-                display_points(epkg->efunctions[i], N, EIG_COLORS[i%6], config->horizontal_axis, config->vertical_axis);
+                display_points(epkg->efunctions[i], N, Fade(EIG_COLORS[((labels != NULL) ? labels[i] : i) % 6], alpha),
+                    thickness, config->horizontal_axis, config->vertical_axis);
+        }
+        if (config->show_levels && live->published > 0)
+        {
+            display_levels(epkg->evalues, epkg->num_evalues, epkg->num_efunctions, labels,
+                plot_scale(config->potential, N+1), alpha, config->horizontal_axis, config->vertical_axis);
+        }
+        pthread_mutex_unlock(&live->lock);
+        if (config->continuation)
+        {
+            const char *name = "step";
+            if (config->plugin != NULL && config->animated_param < config->plugin->desc->num_params)
+                name = config->plugin->desc->params[config->animated_param].name;
+            display_level_curves(config->tracker, name, plot_scale(config->potential, N+1),
+                config->horizontal_axis, config->vertical_axis);
+        }
+        if (config->show_thermal)
+        {
+            update_thermal(config);
+            LiveThermal *thermal = config->thermal;
+            pthread_mutex_lock(&thermal->lock);
+            if (thermal->published > 0)
+                display_points(thermal->front, N+1, MAROON, 3.0, config->horizontal_axis, config->vertical_axis);
+            config->thermal_shown = thermal->published;
+            pthread_mutex_unlock(&thermal->lock);
+        }
+        if (config->show_transmission)
+        {
+            update_transmission(config);
+            if (config->transmission_ready)
+                display_transmission(config->transmission, TRANSMISSION_POINTS,
+                    config->horizontal_axis, config->vertical_axis);
         }
 
         // display resizeable axes
@@ -484,14 +1302,65 @@ int main()
         EndMode2D();
 
         draw_gui(gui_config, config->num_eigenfunctions);
+
+        if (config->live_mode)
+        {
+            DrawText(
+                "Live solving (L to stop)",
+                gui_config->gui_background.x,
+                gui_config->gui_background.y + gui_config->gui_height + 10,
+                16,
+                DARKGRAY
+            );
+        }
+
+        if (config->first_state > 0)
+        {
+            DrawText(
+                TextFormat("States %d-%d (PgUp/PgDn to page, G for the cursor's energy)",
+                    config->first_state, config->first_state + config->num_eigenfunctions - 1),
+                gui_config->gui_background.x,
+                gui_config->gui_background.y + gui_config->gui_height + 52,
+                16,
+                DARKGRAY
+            );
+        }
+
+        if (config->editing_expr)
+            draw_expression(gui_config, config);
+
+        if (config->plugin != NULL)
+            draw_sliders(gui_config, config);
+
+        if (config->show_thermal && config->thermal != NULL)
+            draw_thermal_slider(gui_config, config);
+
+        if (config->show_overlay)
+            draw_overlay(live, frame_rate);
+
+        if (config->show_observables)
+            draw_observables(live);
+
+        if (livesolver_busy(live))
+        {
+            double eta;
+            double fraction = livesolver_progress(live, &eta);
+            draw_progress(gui_config, fraction, eta);
+        }
         
+        perf_end(render, STAGE_RENDER);
         EndDrawing();
     }
+    dump_telemetry(render, config->n);
+    free_perfprofile(render);
     // Deallocate memory. Ig it doesn't really matter here
-    free(solverpkg);
-    free_eigenpackage(epkg);
+    free_livesolver(live);
+    if (mode2d != NULL)
+        free_mode2d(mode2d);
     free_simconfig(config);
     free_guiconfig(gui_config);
+    autotune_install(NULL);
+    free(tuning);
     CloseWindow();
     return 0;
 }
@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include "rankupdate.h"
+
+// Iterations on one secular root before giving up on more accuracy
+#define SECULAR_MAX_ITER 64
+// Old columns summed over per pass of the product, so that slice of them
+// stays in cache while every tile of new columns goes by
+#define UPDATE_BLOCK 128
+// Tile of the product held in registers: rows of z by new columns. Rows of
+// the inner eigenvector matrix are padded to a multiple of the tile width: a
+// fixed trip count keeps the innermost loop vectorizable without runtime
+// checks.
+#define UPDATE_ROWS 8
+#define UPDATE_TILE 4
+
+// Workspaces of one rank-one update, all sized for m and taken from one arena
+typedef struct RankUpdate
+{
+    int m;
+    double *d; // old eigenvalues, ascending after a flip for rho < 0
+    double *u; // the update vector in the old eigenbasis
+    int *col; // column of z and entry of w behind d[j]
+    int *kept; // indices into d of the components that did not deflate
+    double *dk; // their eigenvalues and components
+    double *uk;
+    int *origin; // pole each secular root is measured from...
+    double *eta; // ...and its distance from there
+    double *zhat; // components recomputed from the roots
+    double *inner; // eigenvectors of the non-deflated part, kk rows of stride
+    double *old; // the kept columns of z, m x kk by rows
+    struct evalue *order;
+    double *scratch;
+} RankUpdate;
+
+static void init_rankupdate(RankUpdate *ru, int m, Arena *arena)
+{
+    ru->m = m;
+    ru->d = arena_take(arena, sizeof(double) * m);
+    ru->u = arena_take(arena, sizeof(double) * m);
+    ru->col = arena_take(arena, sizeof(int) * m);
+    ru->kept = arena_take(arena, sizeof(int) * m);
+    ru->dk = arena_take(arena, sizeof(double) * m);
+    ru->uk = arena_take(arena, sizeof(double) * m);
+    ru->origin = arena_take(arena, sizeof(int) * m);
+    ru->eta = arena_take(arena, sizeof(double) * m);
+    ru->zhat = arena_take(arena, sizeof(double) * m);
+    ru->inner = arena_take(arena, sizeof(double) * m * (m + UPDATE_TILE));
+    ru->old = arena_take(arena, sizeof(double) * m * m);
+    ru->order = arena_take(arena, sizeof(struct evalue) * m);
+    ru->scratch = arena_take(arena, sizeof(double) * m);
+}
+
+// Root i of 1 + rho sum_j uk_j^2 / (dk_j - mu) for rho > 0, which lies in
+// (dk[i], dk[i+1]), or above dk[kk-1] for the last one. It is kept as a
+// distance *eta from the nearer pole *origin, so that dk_j - mu can later be
+// formed without cancellation. Each step fits the sums over the poles left
+// and right of the root with one pole each, matching value and slope, and
+// solves the model exactly; steps that leave the bracket bisect instead.
+static void secular_root(const double *dk, const double *uk, int kk, double rho, int i, int *origin, double *eta)
+{
+    int o = i;
+    double a, b; // bracket of eta, f(a) < 0 < f(b)
+    if (i < kk-1)
+    {
+        double gap = dk[i+1] - dk[i];
+        double mid = 0.5 * gap;
+        double f = 1;
+        for(int j = 0; j < kk; j++)
+            f += rho * uk[j] * uk[j] / ((dk[j] - dk[i]) - mid);
+        if (f >= 0)
+        {
+            a = 0;
+            b = mid;
+        }
+        else
+        {
+            o = i+1;
+            a = -mid;
+            b = 0;
+        }
+    }
+    else
+    {
+        double norm = 0;
+        for(int j = 0; j < kk; j++)
+            norm += uk[j] * uk[j];
+        a = 0;
+        b = rho * norm * (1 + 4 * DBL_EPSILON) + DBL_MIN;
+    }
+
+    double x = 0.5 * (a + b);
+    for(int iter = 0; iter < SECULAR_MAX_ITER; iter++)
+    {
+        double psi = 0, dpsi = 0, phi = 0, dphi = 0;
+        for(int j = 0; j <= i; j++)
+        {
+            double t = uk[j] / ((dk[j] - dk[o]) - x);
+            psi += uk[j] * t;
+            dpsi += t * t;
+        }
+        for(int j = i+1; j < kk; j++)
+        {
+            double t = uk[j] / ((dk[j] - dk[o]) - x);
+            phi += uk[j] * t;
+            dphi += t * t;
+        }
+        double f = 1 + rho * (psi + phi);
+        double error = 8 * (1 + rho * (fabs(psi) + fabs(phi))) + fabs(x) * rho * (dpsi + dphi);
+        if (fabs(f) <= DBL_EPSILON * error)
+            break;
+        if (f < 0)
+            a = x;
+        else
+            b = x;
+        if (b - a <= 2 * DBL_EPSILON * fmax(fabs(a), fabs(b)))
+            break;
+
+        double left = (dk[i] - dk[o]) - x; // distances to the two nearest poles
+        double s1 = rho * dpsi * left * left;
+        double next;
+        if (i < kk-1)
+        {
+            double right = (dk[i+1] - dk[o]) - x;
+            double s2 = rho * dphi * right * right;
+            double c = f - s1 / left - s2 / right;
+            // c h^2 - B h + left right f = 0 for the step h
+            double B = c * (left + right) + s1 + s2;
+            double C = left * right * f;
+            double h;
+            if (c == 0)
+                h = C / B;
+            else
+            {
+                double disc = sqrt(fmax(B*B - 4*c*C, 0));
+                double q = 0.5 * (B + copysign(disc, B));
+                double h1 = q / c;
+                double h2 = (q != 0) ? C / q : h1;
+                h = (h1 > left && h1 < right) ? h1 : h2;
+            }
+            next = x + h;
+        }
+        else
+        {
+            double c = f - s1 / left;
+            next = (c > 0) ? x + left + s1 / c : 0.5 * (a + b);
+        }
+        x = (next > a && next < b) ? next : 0.5 * (a + b);
+    }
+    *origin = o;
+    *eta = x;
+}
+
+// Rotates columns p and q of z: p' = c p + s q, q' = c q - s p
+static void rotate_columns(double **z, int m, int p, int q, double c, double s)
+{
+    for(int r = 0; r < m; r++)
+    {
+        double x = z[r][p];
+        double y = z[r][q];
+        z[r][p] = c * x + s * y;
+        z[r][q] = c * y - s * x;
+    }
+}
+
+// Eigendecomposition of diag(w) + rho u u^T with u = row `row` of z
+static int rank_one(RankUpdate *ru, double *w, double **z, int row, double rho, SolveControl *ctl)
+{
+    int m = ru->m;
+    double *d = ru->d;
+    double *u = ru->u;
+    int *col = ru->col;
+
+    // rho < 0 is the negated problem: ascending -w reversed, rho > 0
+    int flip = rho < 0;
+    double norm = 0;
+    for(int j = 0; j < m; j++)
+    {
+        col[j] = flip ? m-1 - j : j;
+        d[j] = flip ? -w[col[j]] : w[col[j]];
+        u[j] = z[row][col[j]];
+        norm += u[j] * u[j];
+    }
+    norm = sqrt(norm);
+    for(int j = 0; j < m; j++)
+        u[j] /= norm;
+    rho = fabs(rho) * norm * norm;
+
+    // Deflation: negligible components keep their eigenpair, and of two
+    // close eigenvalues a rotation leaves only one coupled to u
+    double largest = fmax(fabs(d[0]), fabs(d[m-1]));
+    double tol = 8 * DBL_EPSILON * fmax(largest, rho);
+    int kk = 0;
+    for(int j = 0; j < m; j++)
+    {
+        if (rho * fabs(u[j]) <= tol)
+            continue;
+        if (kk > 0)
+        {
+            int p = ru->kept[kk-1];
+            double tau = hypot(u[p], u[j]);
+            double c = u[j] / tau;
+            double s = -u[p] / tau;
+            if (fabs((d[j] - d[p]) * c * s) <= tol)
+            {
+                rotate_columns(z, m, col[p], col[j], c, s);
+                double t = d[p] * c * c + d[j] * s * s;
+                d[j] = d[p] * s * s + d[j] * c * c;
+                d[p] = t;
+                u[j] = tau;
+                u[p] = 0;
+                ru->kept[kk-1] = j;
+                continue;
+            }
+        }
+        ru->kept[kk++] = j;
+    }
+
+    // Deflated pairs only moved, if they were rotated
+    for(int j = 0; j < m; j++)
+        w[col[j]] = flip ? -d[j] : d[j];
+    if (kk == 0)
+        return 1;
+
+    double *dk = ru->dk;
+    double *uk = ru->uk;
+    for(int j = 0; j < kk; j++)
+    {
+        dk[j] = d[ru->kept[j]];
+        uk[j] = u[ru->kept[j]];
+    }
+    for(int i = 0; i < kk; i++)
+        secular_root(dk, uk, kk, rho, i, &ru->origin[i], &ru->eta[i]);
+
+    // Gu-Eisenstat: the u for which the computed roots are exact, so the
+    // vectors built from it are orthogonal however close the roots are
+    double *zhat = ru->zhat;
+    for(int j = 0; j < kk; j++)
+        zhat[j] = ((dk[ru->origin[j]] - dk[j]) + ru->eta[j]) / rho;
+    for(int i = 0; i < kk; i++)
+    {
+        double base = dk[ru->origin[i]];
+        for(int j = 0; j < kk; j++)
+        {
+            if (j != i)
+                zhat[j] *= ((base - dk[j]) + ru->eta[i]) / (dk[i] - dk[j]);
+        }
+    }
+    for(int j = 0; j < kk; j++)
+        zhat[j] = copysign(sqrt(fabs(zhat[j])), uk[j]);
+
+    // Column i of inner: zhat_j / (dk_j - mu_i), normalized
+    double *inner = ru->inner;
+    size_t stride = (kk + UPDATE_TILE-1) / UPDATE_TILE * UPDATE_TILE;
+    for(int j = 0; j < kk; j++)
+        for(size_t i = kk; i < stride; i++)
+            inner[j*stride + i] = 0;
+    for(int i = 0; i < kk; i++)
+    {
+        double base = dk[ru->origin[i]];
+        double sum = 0;
+        for(int j = 0; j < kk; j++)
+        {
+            double v = zhat[j] / ((dk[j] - base) - ru->eta[i]);
+            inner[j*stride + i] = v;
+            sum += v * v;
+        }
+        sum = 1.0 / sqrt(sum);
+        for(int j = 0; j < kk; j++)
+            inner[j*stride + i] *= sum;
+        double mu = base + ru->eta[i];
+        w[col[ru->kept[i]]] = flip ? -mu : mu;
+    }
+
+    // New columns: the kept old ones times inner
+    double *old = ru->old;
+    for(int r = 0; r < m; r++)
+        for(int j = 0; j < kk; j++)
+            old[(size_t) r*kk + j] = z[r][col[ru->kept[j]]];
+    for(int jb = 0; jb < kk; jb += UPDATE_BLOCK)
+    {
+        if (ctl != NULL && atomic_load_explicit(&ctl->cancel, memory_order_relaxed))
+            return 0;
+        int depth = (kk - jb < UPDATE_BLOCK) ? kk - jb : UPDATE_BLOCK;
+        for(int cb = 0; cb < kk; cb += UPDATE_TILE)
+        {
+            int width = (kk - cb < UPDATE_TILE) ? kk - cb : UPDATE_TILE;
+            int *target = ru->kept + cb;
+            for(int r0 = 0; r0 < m; r0 += UPDATE_ROWS)
+            {
+                int rows = (m - r0 < UPDATE_ROWS) ? m - r0 : UPDATE_ROWS;
+                const double *g[UPDATE_ROWS];
+                double acc[UPDATE_ROWS][UPDATE_TILE] = {{0}};
+                for(int rr = 0; rr < UPDATE_ROWS; rr++)
+                {
+                    int r = r0 + ((rr < rows) ? rr : 0);
+                    g[rr] = old + (size_t) r*kk + jb;
+                    // z's kept columns already went to old, so they hold the
+                    // partial sums of the earlier blocks
+                    for(int c = 0; c < width && jb > 0; c++)
+                        acc[rr][c] = z[r][col[target[c]]];
+                }
+                for(int j = 0; j < depth; j++)
+                {
+                    const double *in = inner + (jb + j)*stride + cb;
+                    for(int rr = 0; rr < UPDATE_ROWS; rr++)
+                        for(int c = 0; c < UPDATE_TILE; c++)
+                            acc[rr][c] += g[rr][j] * in[c];
+                }
+                for(int rr = 0; rr < rows; rr++)
+                    for(int c = 0; c < width; c++)
+                        z[r0+rr][col[target[c]]] = acc[rr][c];
+            }
+        }
+    }
+    return 1;
+}
+
+int rank_update_diagonal(double *w, double **z, int m, int first, int r, const double *delta, SolveControl *ctl,
+    Arena *arena)
+{
+    if (ctl != NULL)
+    {
+        atomic_store_explicit(&ctl->total, r, memory_order_relaxed);
+        atomic_store_explicit(&ctl->progress, 0, memory_order_relaxed);
+    }
+    Workspace *temporary = (arena == NULL) ? init_workspace() : NULL;
+    if (temporary != NULL)
+        arena = workspace_arena(temporary, 0);
+    ArenaMark mark = arena_mark(arena);
+    RankUpdate ru;
+    init_rankupdate(&ru, m, arena);
+    int done = 1;
+    for(int i = 0; i < r && done; i++)
+    {
+        if (delta[i] != 0)
+        {
+            done = rank_one(&ru, w, z, first+i, delta[i], ctl);
+            // the next update wants ascending eigenvalues again
+            if (done)
+                sort_e_vectors_ws(w, z, m+1, ru.order, ru.scratch);
+        }
+        if (ctl != NULL)
+            atomic_fetch_add_explicit(&ctl->progress, 1, memory_order_relaxed);
+    }
+    arena_release(arena, mark);
+    free_workspace(temporary);
+    return done;
+}
+
+int rank_update_pays(int m, int r)
+{
+    // Timed against tqli(), one rank-one update costs about 1 / (1.5 log2(m/50))
+    // of a full solve: the product runs near peak while the QL sweeps stride
+    // across z. Leave a margin for updates that deflate little.
+    return r > 0 && m > 50 && r <= log2(m / 50.0);
+}
@@ -0,0 +1,218 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "scatter.h"
+
+// Energies run through the recurrence together, one per lane
+#define SCATTER_LANES 8
+#define SCATTER_MAX_THREADS 64
+// Grid points times energies per thread below which extra threads cost more
+// than they save
+#define SCATTER_MIN_WORK (1 << 18)
+// Under a barrier the wave grows every step. Every this many steps lanes
+// whose |psi|^2 passed SCATTER_BIG are scaled down by SCATTER_SHRINK^2, which
+// leaves room for growth of 1e6 per step before anything can overflow.
+#define SCATTER_STRIDE 16
+#define SCATTER_BIG 1e200
+#define SCATTER_SHRINK 1e-100
+
+typedef struct ScatterTask
+{
+    const double *a0; // 2 + 2 h^2 U_j, so the recurrence coefficient is a0[j] - 2 h^2 E
+    double h2; // 2 h^2
+    int n;
+    const double *energies;
+    int count;
+    double *transmission;
+    double *reflection;
+    SolveControl *ctl;
+    int cancelled;
+    pthread_t thread;
+} ScatterTask;
+
+// T and R at SCATTER_LANES energies
+static void scatter_lanes(const double *restrict a0, double h2, int n, const double *restrict energy,
+    double *restrict transmission, double *restrict reflection)
+{
+    double shift[SCATTER_LANES];
+    double cos_left[SCATTER_LANES];
+    double sin_left[SCATTER_LANES];
+    double sin_right[SCATTER_LANES];
+    double re[SCATTER_LANES]; // psi_j
+    double im[SCATTER_LANES];
+    double re_next[SCATTER_LANES]; // psi_{j+1}
+    double im_next[SCATTER_LANES];
+    double shrunk[SCATTER_LANES]; // times psi was scaled by SCATTER_SHRINK
+
+    // In a lead at U the plane waves exp(i theta j) have
+    // cos(theta) = 1 - h^2 (E - U), i.e. half the recurrence coefficient
+    for (int l = 0; l < SCATTER_LANES; l++)
+    {
+        shift[l] = h2 * energy[l];
+        double c_right = 0.5 * (a0[n] - shift[l]);
+        cos_left[l] = 0.5 * (a0[0] - shift[l]);
+        sin_left[l] = sqrt(fmax(0.0, 1.0 - cos_left[l] * cos_left[l]));
+        sin_right[l] = sqrt(fmax(0.0, 1.0 - c_right * c_right));
+
+        // Only the transmitted wave on the right, with unit amplitude at j = n
+        re[l] = 1.0;
+        im[l] = 0.0;
+        re_next[l] = c_right;
+        im_next[l] = sin_right[l];
+        shrunk[l] = 0;
+    }
+
+    for (int j = n; j >= 1; j -= SCATTER_STRIDE)
+    {
+        int stop = (j - SCATTER_STRIDE > 0) ? j - SCATTER_STRIDE : 0;
+        for (int i = j; i > stop; i--)
+        {
+            double a = a0[i];
+            for (int l = 0; l < SCATTER_LANES; l++)
+            {
+                double r = (a - shift[l]) * re[l] - re_next[l];
+                double m = (a - shift[l]) * im[l] - im_next[l];
+                re_next[l] = re[l];
+                im_next[l] = im[l];
+                re[l] = r;
+                im[l] = m;
+            }
+        }
+
+        for (int l = 0; l < SCATTER_LANES; l++)
+        {
+            double size = re[l] * re[l] + im[l] * im[l] + re_next[l] * re_next[l] + im_next[l] * im_next[l];
+            int big = size > SCATTER_BIG;
+            double factor = big ? SCATTER_SHRINK : 1.0;
+            re[l] *= factor;
+            im[l] *= factor;
+            re_next[l] *= factor;
+            im_next[l] *= factor;
+            shrunk[l] += big;
+        }
+    }
+
+    // Now re/im hold psi_0 and re_next/im_next psi_1. On the left
+    // psi_j = A exp(i theta j) + B exp(-i theta j), and matching j = 0, 1
+    // gives 2 i sin(theta) A = psi_1 - psi_0 exp(-i theta) =: N
+    for (int l = 0; l < SCATTER_LANES; l++)
+    {
+        double nre = re_next[l] - (re[l] * cos_left[l] + im[l] * sin_left[l]);
+        double nim = im_next[l] - (im[l] * cos_left[l] - re[l] * sin_left[l]);
+        double norm = nre * nre + nim * nim;
+        int open = sin_left[l] > 0 && sin_right[l] > 0 && norm > 0;
+
+        // Currents go as |amplitude|^2 sin(theta), so with a unit
+        // transmitted amplitude T = sin_r / (sin_l |A|^2)
+        double t = 4 * sin_left[l] * sin_right[l] / norm;
+        t *= pow(SCATTER_SHRINK * SCATTER_SHRINK, shrunk[l]);
+        transmission[l] = open ? t : 0;
+
+        if (reflection != NULL)
+        {
+            // A and B up to the same factor 2 i sin(theta)
+            double are = nre;
+            double aim = nim;
+            double bre = -2 * sin_left[l] * im[l] - are;
+            double bim = 2 * sin_left[l] * re[l] - aim;
+            reflection[l] = open ? (bre * bre + bim * bim) / norm : 0;
+        }
+    }
+}
+
+static void *scatter_run(void *arg)
+{
+    ScatterTask *task = arg;
+    double energy[SCATTER_LANES];
+    double t[SCATTER_LANES];
+    double r[SCATTER_LANES];
+
+    for (int b = 0; b < task->count; b += SCATTER_LANES)
+    {
+        if (task->ctl != NULL && atomic_load_explicit(&task->ctl->cancel, memory_order_relaxed))
+        {
+            task->cancelled = 1;
+            break;
+        }
+
+        int lanes = (task->count - b < SCATTER_LANES) ? task->count - b : SCATTER_LANES;
+        for (int l = 0; l < SCATTER_LANES; l++)
+            energy[l] = task->energies[b + ((l < lanes) ? l : lanes - 1)];
+        scatter_lanes(task->a0, task->h2, task->n, energy, t, (task->reflection != NULL) ? r : NULL);
+
+        for (int l = 0; l < lanes; l++)
+        {
+            task->transmission[b + l] = t[l];
+            if (task->reflection != NULL)
+                task->reflection[b + l] = r[l];
+        }
+        if (task->ctl != NULL)
+            atomic_fetch_add_explicit(&task->ctl->progress, lanes, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+int transmission_sweep(Vector2 *potential, int n, const double *energies, int count,
+    double *transmission, double *reflection, int threads, SolveControl *ctl)
+{
+    if (threads <= 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus < 1) ? 1 : (int) cpus;
+    }
+    if (threads > SCATTER_MAX_THREADS)
+        threads = SCATTER_MAX_THREADS;
+    if (threads > (long) count * n / SCATTER_MIN_WORK)
+        threads = (long) count * n / SCATTER_MIN_WORK;
+    if (threads < 1)
+        threads = 1;
+
+    double dl = potential[1].x - potential[0].x;
+    double h2 = 2 * dl * dl;
+    double *a0 = malloc(sizeof(double) * (n + 1));
+    if (a0 == NULL)
+    {
+        fprintf(stderr, "transmission_sweep: malloc failed\n");
+        exit(1);
+    }
+    for (int j = 0; j <= n; j++)
+        a0[j] = 2 + h2 * POTENTIAL_SCALE * potential[j].y;
+
+    if (ctl != NULL)
+    {
+        atomic_store_explicit(&ctl->total, count, memory_order_relaxed);
+        atomic_store_explicit(&ctl->progress, 0, memory_order_relaxed);
+    }
+
+    ScatterTask tasks[SCATTER_MAX_THREADS];
+    for (int t = 0; t < threads; t++)
+    {
+        int from = (int) ((long) count * t / threads);
+        int to = (int) ((long) count * (t + 1) / threads);
+        tasks[t] = (ScatterTask) {
+            .a0 = a0, .h2 = h2, .n = n,
+            .energies = energies + from, .count = to - from,
+            .transmission = transmission + from,
+            .reflection = (reflection != NULL) ? reflection + from : NULL,
+            .ctl = ctl, .cancelled = 0
+        };
+        if (t > 0 && pthread_create(&tasks[t].thread, NULL, scatter_run, &tasks[t]) != 0)
+        {
+            fprintf(stderr, "transmission_sweep: pthread_create failed\n");
+            exit(1);
+        }
+    }
+    scatter_run(&tasks[0]);
+
+    int cancelled = tasks[0].cancelled;
+    for (int t = 1; t < threads; t++)
+    {
+        pthread_join(tasks[t].thread, NULL);
+        cancelled |= tasks[t].cancelled;
+    }
+    free(a0);
+    return !cancelled;
+}
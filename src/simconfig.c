@@ -12,18 +12,67 @@ SimConfig *init_simconfig(int discretization)
     config->zoom_mode = 0;
     config->paused = 0;
     config->num_eigenfunctions = 3;
+    config->first_state = 0;
+    config->show_overlay = 0;
+    config->show_levels = 1;
+    config->live_mode = 0;
+    config->live_dirty = 0;
+    config->show_2d = 0;
+    config->show_transmission = 0;
+    config->show_observables = 0;
+    config->show_thermal = 0;
+    config->continuation = 0;
+    config->last_stroke_time = 0;
+    config->last_request_time = 0;
     config->horizontal_axis = GetScreenWidth();
     config->vertical_axis = GetScreenHeight();
     config->axis_thickness = 4.0;
     config->t = 0;
     config->n = discretization;
     config->domain = create_domain(0, 1, config->n); // domain has size n+1
-    config->potential = apply_potential(config->domain, config->n, &quadratic); // potential has size n+1
+    config->potential = apply_potential_batch(config->domain, config->n, &quadratic_batch, NULL); // potential has size n+1
+    config->energies = malloc(sizeof(double)*TRANSMISSION_POINTS);
+    config->transmission = malloc(sizeof(double)*TRANSMISSION_POINTS);
+    config->sweeping = malloc(sizeof(double)*TRANSMISSION_POINTS);
+    config->transmission_done = TRANSMISSION_POINTS;
+    config->transmission_ready = 0;
+    config->swept_potential = malloc(sizeof(Vector2)*(config->n+1));
+    config->swept_top = 0;
+    config->thermal = NULL;
+    config->thermal_shown = 0;
+    config->temperature = 0.05;
+    config->thermal_slider_active = 0;
+    config->tracker = init_tracker(config->n);
+    config->tracked_published = 0;
+    config->animated_param = 0;
+    config->sweep_direction = 1;
+    config->sweep_request = 0;
+    config->sweep_value = 0;
+    config->expr = NULL;
+    config->editing_expr = 0;
+    config->expr_text[0] = '\0';
+    config->expr_error[0] = '\0';
+    config->plugin = NULL;
+    config->plugin_error[0] = '\0';
+    config->active_slider = -1;
+    config->plugin_dirty = 0;
+    config->last_plugin_poll = 0;
     return config;
 }
 void free_simconfig(SimConfig *config)
 {
     free(config->domain);
     free(config->potential);
+    free(config->energies);
+    free(config->transmission);
+    free(config->sweeping);
+    free(config->swept_potential);
+    if (config->thermal != NULL)
+        free_livethermal(config->thermal);
+    free_tracker(config->tracker);
+    if (config->expr != NULL)
+        expr_free(config->expr);
+    if (config->plugin != NULL)
+        free_plugin(config->plugin);
     free(config);
 }
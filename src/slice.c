@@ -0,0 +1,365 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <unistd.h>
+#include "slice.h"
+#include "tridiag.h"
+
+// Shifts evaluated together. A fixed trip count keeps the lane loop
+// vectorizable without runtime checks.
+#define SLICE_LANES 16
+#define SLICE_MAX_THREADS WORKSPACE_THREADS
+// Eigenvalues per thread below which extra threads cost more than they save
+#define SLICE_MIN_PER_THREAD 64
+// Most shifts one interval gets in a pass when lanes would otherwise idle
+#define SLICE_MAX_SECTIONS 8
+// Newton steps on one eigenvalue before falling back to plain bisection
+#define SLICE_NEWTON_STEPS 12
+// A Newton step may stand in for the pass that would confirm it when the
+// rounding of the Sturm counts is within this many tolerances of the
+// eigenvalue
+#define SLICE_PREDICT_NOISE 64
+
+// Same pivot floor as sturm_count(), so counts agree with it
+#define PIVMIN (DBL_MIN / DBL_EPSILON)
+
+typedef struct SliceInterval
+{
+    double lo;
+    double hi;
+    int clo; // Sturm counts at lo and hi
+    int chi;
+    double x; // next shift, for an interval holding one eigenvalue
+    double step; // length of the Newton step that gave x, 0 if x was bisected
+    int steps;
+    double slope_lo; // d/dx log|det(T - xI)| at lo and hi, NaN if not evaluated
+    double slope_hi;
+} SliceInterval;
+
+typedef struct SliceTask
+{
+    const double *d; // diagonal, padded with a 0 at n
+    const double *e2; // squared couplings, padded with a 0 at n-1
+    int n;
+    double glo; // Gershgorin bounds
+    double ghi;
+    int il; // the slice of the whole range this task owns
+    int iu;
+    int base; // index of out[0]
+    double *out;
+    SolveControl *ctl;
+    Arena *arena; // this task's scratch
+    int cancelled;
+} SliceTask;
+
+// Sturm counts and d/dx log|det(T - xI)| at SLICE_LANES shifts. Alongside the
+// pivots q_i of T - xI = LDL^T runs their derivative: q_{i+1} = d_{i+1} - x -
+// e_i^2 / q_i gives q'_{i+1} = -1 + (e_i^2 / q_i) (q'_i / q_i), and the
+// log-derivative of det = prod q_i is the sum of q'_i / q_i. One division per
+// step serves both.
+static void sturm_lanes(const double *restrict d, const double *restrict e2, int n,
+    const double *restrict x, double *restrict count, double *restrict slope)
+{
+    double q[SLICE_LANES];
+    double dq[SLICE_LANES];
+    double c[SLICE_LANES];
+    double s[SLICE_LANES];
+    for (int l = 0; l < SLICE_LANES; l++)
+    {
+        q[l] = d[0] - x[l];
+        dq[l] = -1.0;
+        c[l] = 0;
+        s[l] = 0;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        double next = d[i+1];
+        double coupling = e2[i];
+        for (int l = 0; l < SLICE_LANES; l++)
+        {
+            // Written without comparisons that could trap, which would
+            // keep the compiler from turning them into lane-wise selects.
+            // Pivots are floored at PIVMIN in magnitude like sturm_count().
+            double size = fabs(q[l]);
+            size = (size > PIVMIN) ? size : PIVMIN;
+            double v = copysign(size, q[l]);
+            double inv = 1.0 / v;
+            c[l] += 0.5 - 0.5 * copysign(1.0, v);
+            double r = dq[l] * inv;
+            s[l] += r;
+            double t = coupling * inv;
+            q[l] = next - x[l] - t;
+            dq[l] = -1.0 + t * r;
+        }
+    }
+
+    for (int l = 0; l < SLICE_LANES; l++)
+    {
+        count[l] = c[l];
+        slope[l] = s[l];
+    }
+}
+
+static double tolerance(double lo, double hi)
+{
+    return 2 * DBL_EPSILON * fmax(fabs(lo), fabs(hi)) + PIVMIN;
+}
+
+// Writes every owned eigenvalue in [clo, chi) as value
+static int emit(SliceTask *task, int clo, int chi, double value)
+{
+    int from = (clo > task->il) ? clo : task->il;
+    int to = (chi - 1 < task->iu) ? chi - 1 : task->iu;
+    for (int j = from; j <= to; j++)
+        task->out[j - task->base] = value;
+    return (to >= from) ? to - from + 1 : 0;
+}
+
+static int owns_any(const SliceTask *task, int clo, int chi)
+{
+    return clo < chi && clo <= task->iu && chi - 1 >= task->il;
+}
+
+// An interval holding one eigenvalue. Its first shift is the Newton step from
+// the nearer end, where that end is a shift already evaluated, so the pass
+// that isolated the eigenvalue doubles as its first Newton step.
+static SliceInterval isolate(double lo, double hi, int clo, double slope_lo, double slope_hi)
+{
+    SliceInterval iv = {lo, hi, clo, clo + 1, 0.5 * (lo + hi), 0, 0, slope_lo, slope_hi};
+    // NaN slopes give NaN steps, which fail the comparisons
+    double from_lo = -1.0 / slope_lo;
+    double from_hi = 1.0 / slope_hi;
+    int lo_ok = from_lo > 0 && from_lo < hi - lo;
+    int hi_ok = from_hi > 0 && from_hi < hi - lo;
+    if (lo_ok && (!hi_ok || from_lo < from_hi))
+    {
+        iv.x = lo + from_lo;
+        iv.step = from_lo;
+    }
+    else if (hi_ok)
+    {
+        iv.x = hi - from_hi;
+        iv.step = from_hi;
+    }
+    return iv;
+}
+
+static void *slice_run(void *arg)
+{
+    SliceTask *task = arg;
+    int owned = task->iu - task->il + 1;
+    // intervals are disjoint and each holds an owned eigenvalue
+    ArenaMark mark = arena_mark(task->arena);
+    SliceInterval *cur = arena_take(task->arena, sizeof(SliceInterval) * owned);
+    SliceInterval *next = arena_take(task->arena, sizeof(SliceInterval) * owned);
+    int max_shifts = owned * SLICE_MAX_SECTIONS + SLICE_LANES;
+    double *shifts = arena_take(task->arena, sizeof(double) * max_shifts);
+    double *counts = arena_take(task->arena, sizeof(double) * max_shifts);
+    double *slopes = arena_take(task->arena, sizeof(double) * max_shifts);
+
+    // Sturm counts are exact for a matrix within about this of T
+    double noise = DBL_EPSILON * (task->ghi - task->glo);
+
+    cur[0] = (SliceInterval) {task->glo, task->ghi, 0, task->n, 0, 0, 0, NAN, NAN};
+    int ncur = 1;
+    while (ncur > 0)
+    {
+        if (task->ctl != NULL && atomic_load_explicit(&task->ctl->cancel, memory_order_relaxed))
+        {
+            task->cancelled = 1;
+            break;
+        }
+
+        // Isolated eigenvalues take one lane each. While there are few
+        // intervals, clusters are split at several shifts so no lane idles.
+        int multi = 0;
+        for (int i = 0; i < ncur; i++)
+            multi += cur[i].chi - cur[i].clo > 1;
+        int sections = 1;
+        if (multi > 0 && ncur < SLICE_LANES)
+        {
+            sections = (SLICE_LANES - (ncur - multi)) / multi;
+            sections = (sections < 1) ? 1 : (sections > SLICE_MAX_SECTIONS) ? SLICE_MAX_SECTIONS : sections;
+        }
+
+        int m = 0;
+        for (int i = 0; i < ncur; i++)
+        {
+            SliceInterval *iv = &cur[i];
+            if (iv->chi - iv->clo == 1)
+                shifts[m++] = iv->x;
+            else
+                for (int s = 1; s <= sections; s++)
+                    shifts[m++] = iv->lo + (iv->hi - iv->lo) * s / (sections + 1);
+        }
+        int padded = m;
+        while (padded % SLICE_LANES != 0)
+        {
+            shifts[padded] = shifts[m-1];
+            padded++;
+        }
+        for (int b = 0; b < padded; b += SLICE_LANES)
+            sturm_lanes(task->d, task->e2, task->n, shifts + b, counts + b, slopes + b);
+
+        int nnext = 0;
+        int finished = 0;
+        m = 0;
+        for (int i = 0; i < ncur; i++)
+        {
+            SliceInterval iv = cur[i];
+            if (iv.chi - iv.clo == 1)
+            {
+                double x = shifts[m];
+                int below = (int) counts[m] > iv.clo;
+                double slope = slopes[m];
+                m++;
+                if (below)
+                {
+                    iv.hi = x;
+                    iv.slope_hi = slope;
+                }
+                else
+                {
+                    iv.lo = x;
+                    iv.slope_lo = slope;
+                }
+
+                // Safeguarded Newton: accept a step that stays inside the
+                // bracket, else bisect. Once the steps converge quadratically
+                // the last one predicts the next, and a step whose successor
+                // would be below tolerance is as good as taking it.
+                double tol = tolerance(iv.lo, iv.hi);
+                double guess = x - 1.0 / slope;
+                double step = fabs(guess - x);
+                int inside = guess > iv.lo && guess < iv.hi;
+                int predicted = inside && step < 0.5 * iv.step && noise <= SLICE_PREDICT_NOISE * tol
+                    && step * step * step <= tol * iv.step * iv.step;
+                if (guess >= iv.lo && guess <= iv.hi && (step <= tol || predicted))
+                    finished += emit(task, iv.clo, iv.chi, guess);
+                else if (iv.hi - iv.lo <= tol)
+                    finished += emit(task, iv.clo, iv.chi, 0.5 * (iv.lo + iv.hi));
+                else
+                {
+                    iv.steps++;
+                    iv.x = 0.5 * (iv.lo + iv.hi);
+                    iv.step = 0;
+                    if (iv.steps < SLICE_NEWTON_STEPS && inside && step > noise)
+                    {
+                        iv.x = guess;
+                        iv.step = step;
+                    }
+                    else if (iv.steps < SLICE_NEWTON_STEPS && inside)
+                    {
+                        // The step is down in the rounding of the counts, so
+                        // it says no more than where the eigenvalue is to
+                        // within noise. Close the bracket just past it and
+                        // bisect the rest of the way.
+                        double past = guess + (below ? -2 : 2) * noise;
+                        if (past > iv.lo && past < iv.hi)
+                            iv.x = past;
+                        iv.steps = SLICE_NEWTON_STEPS;
+                    }
+                    next[nnext++] = iv;
+                }
+                continue;
+            }
+
+            // Multisection: keep the pieces that hold owned eigenvalues
+            double a = iv.lo;
+            int ca = iv.clo;
+            double slope_a = iv.slope_lo;
+            for (int s = 0; s <= sections; s++)
+            {
+                double b = (s < sections) ? shifts[m + s] : iv.hi;
+                int cb = (s < sections) ? (int) counts[m + s] : iv.chi;
+                double slope_b = (s < sections) ? slopes[m + s] : iv.slope_hi;
+                // rounding can't make counts decrease, but be safe
+                cb = (cb < ca) ? ca : (cb > iv.chi) ? iv.chi : cb;
+                if (owns_any(task, ca, cb))
+                {
+                    if (b - a <= tolerance(a, b))
+                        finished += emit(task, ca, cb, 0.5 * (a + b));
+                    else if (cb - ca == 1)
+                        next[nnext++] = isolate(a, b, ca, slope_a, slope_b);
+                    else
+                        next[nnext++] = (SliceInterval) {a, b, ca, cb, 0.5 * (a + b), 0, 0, slope_a, slope_b};
+                }
+                a = b;
+                ca = cb;
+                slope_a = slope_b;
+            }
+            m += sections;
+        }
+
+        if (task->ctl != NULL)
+            atomic_fetch_add_explicit(&task->ctl->progress, finished, memory_order_relaxed);
+        SliceInterval *tmp = cur;
+        cur = next;
+        next = tmp;
+        ncur = nnext;
+    }
+
+    arena_release(task->arena, mark);
+    return NULL;
+}
+
+int slice_eigenvalues(const double *d, const double *e, int n, int il, int iu, double *out,
+    int threads, SolveControl *ctl, Workspace *work)
+{
+    int count = iu - il + 1;
+    if (threads <= 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus < 1) ? 1 : (int) cpus;
+    }
+    if (threads > SLICE_MAX_THREADS)
+        threads = SLICE_MAX_THREADS;
+    if (threads > count / SLICE_MIN_PER_THREAD)
+        threads = count / SLICE_MIN_PER_THREAD;
+    if (threads < 1)
+        threads = 1;
+
+    Workspace *temporary = (work == NULL) ? init_workspace() : NULL;
+    if (temporary != NULL)
+        work = temporary;
+    Arena *arena = workspace_arena(work, 0);
+    ArenaMark mark = arena_mark(arena);
+    double *padded = arena_take(arena, sizeof(double) * (n + 1));
+    double *e2 = arena_take(arena, sizeof(double) * n);
+    memcpy(padded, d, sizeof(double) * n);
+    padded[n] = 0;
+    for (int i = 0; i < n-1; i++)
+        e2[i] = e[i] * e[i];
+    e2[n-1] = 0;
+
+    double glo, ghi;
+    gershgorin_bounds(d, e, n, &glo, &ghi);
+    if (ctl != NULL)
+    {
+        atomic_store_explicit(&ctl->total, count, memory_order_relaxed);
+        atomic_store_explicit(&ctl->progress, 0, memory_order_relaxed);
+    }
+
+    SliceTask tasks[SLICE_MAX_THREADS];
+    for (int t = 0; t < threads; t++)
+    {
+        tasks[t] = (SliceTask) {
+            .d = padded, .e2 = e2, .n = n, .glo = glo, .ghi = ghi,
+            .il = il + (int) ((long) count * t / threads),
+            .iu = il + (int) ((long) count * (t + 1) / threads) - 1,
+            .base = il, .out = out, .ctl = ctl, .arena = workspace_arena(work, t), .cancelled = 0
+        };
+    }
+    workspace_run(work, slice_run, tasks, sizeof(SliceTask), threads);
+
+    int cancelled = 0;
+    for (int t = 0; t < threads; t++)
+        cancelled |= tasks[t].cancelled;
+    arena_release(arena, mark);
+    free_workspace(temporary);
+    return !cancelled;
+}
@@ -1,11 +1,69 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <float.h>
 #include <math.h>
-#include "hashmap.h"
+#include <stdatomic.h>
 #include "solver.h"
+#include "tridiag.h"
+#include "slice.h"
+#include "mrrr.h"
+#include "rankupdate.h"
+#include "continuation.h"
+#include "perfcounters.h"
 #include "raylib.h"
 
+// Every allocation made by the solver modules goes through these so tests
+// can check that the steady-state solve path stays off the heap.
+static atomic_long alloc_count = 0;
+
+void *solver_alloc(size_t size, const char *who)
+{
+    atomic_fetch_add(&alloc_count, 1);
+    void *p = malloc(size);
+    if (p == NULL)
+    {
+        fprintf(stderr, "%s: malloc failed\n", who);
+        exit(1);
+    }
+    return p;
+}
+
+static void *solver_malloc(size_t size)
+{
+    return solver_alloc(size, "solver");
+}
+
+static void *solver_calloc(size_t num, size_t size)
+{
+    atomic_fetch_add(&alloc_count, 1);
+    void *p = calloc(num, size);
+    if (p == NULL)
+    {
+        fprintf(stderr, "solver: calloc failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+// States of the observables sweep are handled in tiles of this many, with
+// the sums padded to match, so the per-state loops have fixed trip counts
+#define OBSERVABLE_TILE 4
+
+// The observables workspace holds, per tile of states, a sum of each kind
+// below for every state of the tile, then two padded rows of z
+enum { SUM_NORM, SUM_X, SUM_X2, SUM_V, SUM_KINETIC, SUM_KINDS, SUM_COUNT = SUM_KINDS + 2 };
+
+static int padded_states(int k)
+{
+    return (k + OBSERVABLE_TILE-1) / OBSERVABLE_TILE * OBSERVABLE_TILE;
+}
+
+long solver_alloc_count()
+{
+    return atomic_load(&alloc_count);
+}
+
 // Matrix is assumed to be tridiagonal.
 // Algorithm from "Numerical Recipes in C"
 //
@@ -35,27 +93,32 @@ int max(int a, int b)
 
 EigenPackage *init_eigenpackage(int num_evalues, int n, double *domain)
 {
-    EigenPackage *pkg = malloc(sizeof(EigenPackage));
-    pkg->subdiagonal = calloc((n-1), sizeof(double));
-    pkg->evalues = calloc((n-1), sizeof(double));
+    EigenPackage *pkg = solver_malloc(sizeof(EigenPackage));
+    pkg->n = 0;
+    pkg->capacity = 0;
+    pkg->efunctions = NULL;
+    pkg->subdiagonal = NULL;
+    pkg->evalues = NULL;
+    pkg->z = NULL;
+    pkg->z_columns = 0;
+    pkg->order = NULL;
+    pkg->scratch = NULL;
+    pkg->observables = NULL;
+    pkg->sums = NULL;
+    pkg->diagonal = NULL;
+    pkg->values = NULL;
+    pkg->vectors = NULL;
+    pkg->work = init_workspace();
+    pkg->num_observables = 0;
+    pkg->dipoles = solver_calloc(DIPOLE_STATES*DIPOLE_STATES, sizeof(double));
+    pkg->num_evalues = 0;
+    pkg->first = 0;
+    reserve_eigenpackage(pkg, n, num_evalues);
     pkg->num_efunctions = num_evalues;
-    pkg->n = n;
-    pkg->z = create_identity(n-1);
-
-    pkg->efunctions = malloc(sizeof(Vector2*)*num_evalues);
 
     for(int j=0;j<num_evalues;j++)
     {
-        pkg->efunctions[j] = malloc(sizeof(Vector2)*(n+1));
-
-        // Applying the boundary conditions
-        pkg->efunctions[j][0].x = domain[0];
-        pkg->efunctions[j][0].y = 0.0;
-
-        pkg->efunctions[j][n].x = domain[n];
-        pkg->efunctions[j][n].y = 0.0;
-
-        for(int i=1;i<n-1;i++)
+        for(int i=0;i<=n;i++)
         {
             pkg->efunctions[j][i].x = domain[i];
             pkg->efunctions[j][i].y = 0.0; 
@@ -65,21 +128,96 @@ EigenPackage *init_eigenpackage(int num_evalues, int n, double *domain)
     return pkg;
 }
 
+void reserve_eigenpackage(EigenPackage *pkg, int n, int k)
+{
+    if (pkg->n != n)
+    {
+        // everything is sized by n, so start over
+        for(int i=0; i<pkg->capacity;i++)
+            free(pkg->efunctions[i]);
+        free(pkg->efunctions);
+        free(pkg->subdiagonal);
+        free(pkg->evalues);
+        free(pkg->order);
+        free(pkg->scratch);
+        free(pkg->observables);
+        free(pkg->sums);
+        free(pkg->diagonal);
+        free(pkg->values);
+        free(pkg->vectors);
+        if (pkg->z != NULL)
+            free_square_matrix(pkg->z, pkg->n-1);
+
+        pkg->n = n;
+        pkg->capacity = 0;
+        pkg->efunctions = NULL;
+        pkg->observables = NULL;
+        pkg->sums = NULL;
+        pkg->values = NULL;
+        pkg->vectors = NULL;
+        pkg->num_observables = 0;
+        pkg->subdiagonal = solver_calloc((n-1), sizeof(double));
+        pkg->diagonal = solver_malloc(sizeof(double)*(n-1));
+        pkg->evalues = solver_calloc((n-1), sizeof(double));
+        pkg->order = solver_malloc(sizeof(struct evalue)*(n-1));
+        pkg->scratch = solver_malloc(sizeof(double)*(n-1));
+        pkg->z = create_identity(n-1);
+        pkg->z_columns = 0;
+    }
+
+    if (k > pkg->capacity)
+    {
+        Vector2 **rows = solver_malloc(sizeof(Vector2*)*k);
+        for(int j=0;j<pkg->capacity;j++)
+            rows[j] = pkg->efunctions[j];
+        for(int j=pkg->capacity;j<k;j++)
+            rows[j] = solver_calloc(n+1, sizeof(Vector2));
+        free(pkg->efunctions);
+        pkg->efunctions = rows;
+        free(pkg->observables);
+        free(pkg->sums);
+        free(pkg->values);
+        free(pkg->vectors);
+        pkg->observables = solver_calloc(k, sizeof(Observables));
+        pkg->sums = solver_malloc(sizeof(double)*SUM_COUNT*padded_states(k));
+        pkg->values = solver_malloc(sizeof(double)*k);
+        pkg->vectors = solver_malloc(sizeof(double)*(n-1)*k);
+        pkg->num_observables = 0;
+        pkg->capacity = k;
+    }
+}
+
 void free_eigenpackage(EigenPackage *pkg)
 {
-    for(int i=0; i<pkg->num_efunctions;i++)
+    for(int i=0; i<pkg->capacity;i++)
         free(pkg->efunctions[i]);
     free(pkg->efunctions);
     free(pkg->subdiagonal);
     free(pkg->evalues);
+    free(pkg->order);
+    free(pkg->scratch);
+    free(pkg->observables);
+    free(pkg->sums);
+    free(pkg->diagonal);
+    free(pkg->values);
+    free(pkg->vectors);
+    free_workspace(pkg->work);
+    free(pkg->dipoles);
     free_square_matrix(pkg->z, pkg->n-1);
     free(pkg);
 }
 
+void init_solvecontrol(SolveControl *ctl)
+{
+    atomic_init(&ctl->cancel, 0);
+    atomic_init(&ctl->progress, 0);
+    atomic_init(&ctl->total, 0);
+}
+
 double *create_domain(int l_bound, int r_bound, int n)
 {
     double dl = (r_bound - l_bound) / ((double) n);
-    double *domain = malloc(sizeof(double)*(n+1));
+    double *domain = solver_malloc(sizeof(double)*(n+1));
     for(int i=0;i<=n;i++)
     {
          domain[i] = l_bound + i * dl; 
@@ -89,7 +227,7 @@ double *create_domain(int l_bound, int r_bound, int n)
 
 Vector2* apply_potential(double *domain, int n, double (*f) (double)) 
 {
-    Vector2 *points = malloc(sizeof(Vector2)*(n+1));
+    Vector2 *points = solver_malloc(sizeof(Vector2)*(n+1));
     for (int i=0;i<n+1;i++)
     {
         points[i].x = domain[i];
@@ -98,8 +236,13 @@ Vector2* apply_potential(double *domain, int n, double (*f) (double))
     return points;
 }
 
-// From "Numerical recipes in C"
 void tqli(double *d, double *e, double **z, int n)
+{
+    tqli_ctl(d, e, z, n, NULL);
+}
+
+// From "Numerical recipes in C"
+int tqli_ctl(double *d, double *e, double **z, int n, SolveControl *ctl)
 {
     // `diagonal`: n-length array representing the diagonal
     // `subdiagonal`: n-length array representing the subdiagonal. subdiagonal[n-1] is arbitrary
@@ -110,9 +253,18 @@ void tqli(double *d, double *e, double **z, int n)
 
     e[n-1] = 0.0;
 
+    if (ctl != NULL)
+    {
+        atomic_store_explicit(&ctl->total, n, memory_order_relaxed);
+        atomic_store_explicit(&ctl->progress, 0, memory_order_relaxed);
+    }
+
     for (l = 0; l < n; l++) {
         iter = 0;
         do {
+            // each sweep is O(n), so this keeps cancellation latency tiny
+            if (ctl != NULL && atomic_load_explicit(&ctl->cancel, memory_order_relaxed))
+                return 0;
             for (m = l; m < n - 1; m++) {
                 dd = fabs(d[m]) + fabs(d[m+1]);
                 if (fabs(e[m]) <= EPS * dd)
@@ -144,6 +296,9 @@ void tqli(double *d, double *e, double **z, int n)
                     r = (d[i] - g) * s + 2.0 * c * b;
                     d[i+1] = g + (p=s * r);
                     g = c * r - b;
+                    // eigenvalue-only solves skip the O(n) rotation of z
+                    if (z == NULL)
+                        continue;
                     for (k = 0; k < n; k++) {
                         f = z[k][i+1];
                         z[k][i+1] = s * z[k][i] + c * f;
@@ -156,7 +311,11 @@ void tqli(double *d, double *e, double **z, int n)
                 e[m] = 0.0;
             }
         } while(m != l);
+        // d[l] has converged
+        if (ctl != NULL)
+            atomic_store_explicit(&ctl->progress, l+1, memory_order_relaxed);
     }
+    return 1;
 }
 
 void show_2D(double **arr, int n)
@@ -174,7 +333,7 @@ void show_2D(double **arr, int n)
 double **create_identity(int n)
 {
     // creates nxn identity matrix
-    double **outer = malloc(sizeof(double*) * n);
+    double **outer = solver_malloc(sizeof(double*) * n);
     if (outer == NULL)
     {
         fprintf(stderr, "create_identity: malloc failed\n");
@@ -183,7 +342,7 @@ double **create_identity(int n)
 
     for(int i=0;i<n;i++)
     {
-        outer[i] = calloc(n, sizeof(double));
+        outer[i] = solver_calloc(n, sizeof(double));
         if (outer[i] == NULL)
         {
             fprintf(stderr, "create_identity: calloc failed\n");
@@ -194,101 +353,246 @@ double **create_identity(int n)
     return outer;
 }
 
-// Entry in the hashmap
-struct evalue
+int evalue_compare(const void *a, const void *b)
 {
-    double value;
-    int index;
-};
+    const struct evalue *ev1 = (const struct evalue*) a;
+    const struct evalue *ev2 = (const struct evalue*) b;
 
+    if (ev1->value < ev2->value)
+        return -1;
+    else if (ev1->value > ev2->value)
+        return 1;
+    // ties keep their original order so degenerate eigenvalues stay distinct
+    return ev1->index - ev2->index;
+}
 
-uint64_t evalue_hash(const void *item, uint64_t seed0, uint64_t seed1)
+void free_square_matrix(double **z, int n)
 {
-    struct evalue *ev = (struct evalue*) item;
-    return hashmap_sip(&(ev->value), 1, seed0, seed1);
+    for(int i = 0; i < n; i++)
+    {
+        free(z[i]);
+    }
+    free(z);
 }
 
+// Moves order[root] down the heap of the first count entries until its
+// children are no larger
+static void sift_down(struct evalue *order, int root, int count)
+{
+    struct evalue top = order[root];
+    for(int child = 2*root + 1; child < count; child = 2*root + 1)
+    {
+        if (child + 1 < count && evalue_compare(&order[child], &order[child+1]) < 0)
+            child++;
+        if (evalue_compare(&top, &order[child]) >= 0)
+            break;
+        order[root] = order[child];
+        root = child;
+    }
+    order[root] = top;
+}
 
-int evalue_compare(const void *a, const void *b, void *udata)
+// Heapsort by evalue_compare(). It works in place, where glibc's qsort()
+// mallocs a buffer for anything over a kilobyte or so, and the order is
+// total, so the result is the same as a stable sort's.
+static void sort_evalues(struct evalue *order, int count)
 {
-    struct evalue *ev1 = (struct evalue*) a;
-    struct evalue *ev2 = (struct evalue*) b;
+    for(int root = count/2 - 1; root >= 0; root--)
+        sift_down(order, root, count);
+    for(int last = count-1; last > 0; last--)
+    {
+        struct evalue top = order[0];
+        order[0] = order[last];
+        order[last] = top;
+        sift_down(order, 0, last);
+    }
+}
 
-    // possibly the other way.
-    if (ev1->value < ev2->value)
-        return -1;
-    else if (ev1->value > ev2->value)
-        return 1;
-    else
-        return 0;
+void sort_e_vectors_ws(double *evalues, double **evectors, int n, struct evalue *order, double *scratch)
+{
+    for(int i = 0; i < n-1; i++)
+    {
+        order[i].value = evalues[i];
+        order[i].index = i;
+    }
+
+    sort_evalues(order, n-1);
+
+    for(int i = 0; i < n-1; i++)
+        evalues[i] = order[i].value;
+
+    // permute the columns of each row through the scratch row
+    for(int j = 0; j < n-1; j++)
+    {
+        double *row = evectors[j];
+        for(int i = 0; i < n-1; i++)
+            scratch[i] = row[i];
+        for(int i = 0; i < n-1; i++)
+            row[i] = scratch[order[i].index];
+    }
 }
 
-int compare_doubles(const void *a, const void *b)
+double **sort_e_vectors(double *evalues, double **evectors, int n)
 {
-    double *num1 = (double*) a;
-    double *num2 = (double*) b;
+    struct evalue *order = solver_malloc(sizeof(struct evalue)*(n-1));
+    double *scratch = solver_malloc(sizeof(double)*(n-1));
 
-    if (*num1 < *num2) 
-        return -1;
-    else if (*num1 > *num2)
-        return 1;
-    else
-        return 0;
+    sort_e_vectors_ws(evalues, evectors, n, order, scratch);
+
+    free(order);
+    free(scratch);
+    return evectors;
 }
 
-void free_square_matrix(double **z, int n)
+void assemble_hamiltonian(Vector2 *potential, int n, double *d, double *e)
 {
-    for(int i = 0; i < n; i++)
+    double dl = potential[1].x - potential[0].x;
+
+    for(int i=0;i<n-1;i++)
     {
-        free(z[i]);
+        d[i] = 1.0 / (dl * dl) + POTENTIAL_SCALE*potential[i+1].y;
+        e[i] = -1.0 / (2 * dl * dl);
     }
-    free(z);
 }
 
-double **sort_e_vectors(double *evalues, double **evectors, int n)
+int solve_eigenvalues(Vector2 *potential, int n, double *evalues, SolveControl *ctl)
 {
-    struct hashmap *map = hashmap_new(sizeof(struct evalue), 0, 0, 0,
-                                &evalue_hash, &evalue_compare, NULL, NULL);
+    const SolverBackend *backend = solver_backend();
+    double *subdiagonal = solver_malloc(sizeof(double)*(n-1));
 
-    for(int i = 0; i < n-1; i++)
+    double *diagonal = solver_malloc(sizeof(double)*(n-1));
+
+    backend->assemble(potential, n, diagonal, subdiagonal);
+    int done = backend->eigenvalues_only(diagonal, subdiagonal, n-1, evalues, 0, ctl, NULL);
+
+    free(diagonal);
+    free(subdiagonal);
+    return done;
+}
+
+// Adds row i of z (zero-padded to pad states) to the sums of the observables.
+// previous is row i-1, for the kinetic energy by summation by parts.
+static void accumulate_row(const double *restrict row, const double *restrict previous, double x, double v,
+    int pad, double *restrict sums)
+{
+    for(int t=0;t<pad;t+=OBSERVABLE_TILE)
     {
-        hashmap_set(map, &(struct evalue) { .value=evalues[i], .index=i});
+        double *tile = sums + t*SUM_KINDS;
+        for(int l=0;l<OBSERVABLE_TILE;l++)
+        {
+            double a = row[t+l];
+            double a2 = a * a;
+            double difference = a - previous[t+l];
+            tile[SUM_NORM*OBSERVABLE_TILE + l] += a2;
+            tile[SUM_X*OBSERVABLE_TILE + l] += x * a2;
+            tile[SUM_X2*OBSERVABLE_TILE + l] += x * x * a2;
+            tile[SUM_V*OBSERVABLE_TILE + l] += v * a2;
+            tile[SUM_KINETIC*OBSERVABLE_TILE + l] += difference * difference;
+        }
     }
+}
 
-    
-    qsort(evalues, n-1, sizeof(double), &compare_doubles);
+// Adds x times the outer product of the first kd entries of row to dipoles
+static void accumulate_dipoles(const double *restrict row, double x, int kd, double *restrict dipoles)
+{
+    int pad = padded_states(kd);
+    for(int a=0;a<kd;a++)
+    {
+        double xa = x * row[a];
+        double *dipole = dipoles + a*DIPOLE_STATES;
+        for(int t=0;t<pad;t+=OBSERVABLE_TILE)
+            for(int l=0;l<OBSERVABLE_TILE;l++)
+                dipole[t+l] += xa * row[t+l];
+    }
+}
 
-    double **out = create_identity(n-1);
+// Fills efunctions[0..k-1] with the normalized probability densities of the
+// first k columns of z, and observables and dipoles with their expectation
+// values. A single sweep down the rows of z gathers every sum at once; each
+// row is copied into a zero-padded buffer so the loops over states run in
+// whole tiles and vectorize.
+static void extract_states(Vector2 *potential, int n, int k, EigenPackage *epkg)
+{
+    int pad = padded_states(k);
+    int kd = min(k, DIPOLE_STATES);
+    double dl = potential[1].x - potential[0].x;
+    double *row = epkg->sums + SUM_KINDS*pad;
+    double *previous = row + pad;
+    memset(epkg->sums, 0, sizeof(double)*SUM_COUNT*pad);
+    memset(epkg->dipoles, 0, sizeof(double)*DIPOLE_STATES*DIPOLE_STATES);
 
-    for(int i = 0; i < n-1; i++)
+    // Row n-1 is the zero boundary, for the last difference of the kinetic sum
+    for(int i=0;i<n;i++)
     {
-        struct evalue *eigv = (struct evalue*) (hashmap_get(map, &(struct evalue){ .value=evalues[i]}));
-        for(int j = 0; j < n-1; j++)
-            out[j][i] = evectors[j][eigv->index];
+        if (i < n-1)
+            memcpy(row, epkg->z[i], sizeof(double)*k);
+        else
+            memset(row, 0, sizeof(double)*k);
+        double x = potential[i+1].x;
+        double v = potential[i+1].y;
+        accumulate_row(row, previous, x, v, pad, epkg->sums);
+        accumulate_dipoles(row, x, kd, epkg->dipoles);
+        if (i < n-1)
+        {
+            for(int j=0;j<k;j++)
+                epkg->efunctions[j][i+1] = (Vector2) { x, row[j] * row[j] };
+        }
+        double *swap = previous;
+        previous = row;
+        row = swap;
     }
 
-    free_square_matrix(evectors, n-1);
-    hashmap_free(map);
-    return out;
+    double norm[DIPOLE_STATES];
+    for(int j=0;j<k;j++)
+    {
+        const double *tile = epkg->sums + (j - j%OBSERVABLE_TILE)*SUM_KINDS + j%OBSERVABLE_TILE;
+        double sum = tile[SUM_NORM*OBSERVABLE_TILE];
+        if (j < DIPOLE_STATES)
+            norm[j] = sum;
+
+        // normalize the probability density and apply the boundary conditions
+        Vector2 *wavefunction = epkg->efunctions[j];
+        double density = 1.0 / (sum * dl);
+        wavefunction[0] = (Vector2) { potential[0].x, 0.0 };
+        wavefunction[n] = (Vector2) { potential[n].x, 0.0 };
+        for(int i=1;i<n;i++)
+            wavefunction[i].y *= density;
+
+        Observables *o = &epkg->observables[j];
+        o->x = tile[SUM_X*OBSERVABLE_TILE] / sum;
+        o->x2 = tile[SUM_X2*OBSERVABLE_TILE] / sum;
+        o->p2 = tile[SUM_KINETIC*OBSERVABLE_TILE] / (sum * dl * dl);
+        o->v = POTENTIAL_SCALE * tile[SUM_V*OBSERVABLE_TILE] / sum;
+        o->dx = sqrt(fmax(o->x2 - o->x * o->x, 0.0));
+        o->dp = sqrt(o->p2);
+    }
+    for(int a=0;a<kd;a++)
+        for(int b=0;b<kd;b++)
+            epkg->dipoles[a*DIPOLE_STATES + b] /= sqrt(norm[a] * norm[b]);
+    epkg->num_observables = k;
 }
 
-void *solve_spectrum(void *pkg)
+// Profiling hooks that do nothing without a profile
+static void stage_begin(PerfProfile *profile)
 {
-    // performance isn't that vital for this function
-    
-    struct SolverPkg *solverpkg = (struct SolverPkg*) (pkg);
-    Vector2 *potential = solverpkg->potential;
-    int n = solverpkg->n;
-    int k = solverpkg->num_eigenfunctions;
-    EigenPackage *epkg = solverpkg->epkg;
+    if (profile != NULL)
+        perf_begin(profile);
+}
 
-    double dl = potential[1].x - potential[0].x;
+static void stage_end(PerfProfile *profile, PerfStage stage)
+{
+    if (profile != NULL)
+        perf_end(profile, stage);
+}
 
-    for(int i=0;i<n-1;i++)
+// The in-tree backend: tqli() for whole spectra, MRRR (see mrrr.h) for
+// parts of them
+static int tqli_solve_all(EigenPackage *epkg, int m, SolveControl *ctl, PerfProfile *profile)
+{
+    stage_begin(profile);
+    for(int i=0;i<m;i++)
     {
-        epkg->evalues[i] = 1.0 / (dl * dl) + 2000*potential[i+1].y;
-        epkg->subdiagonal[i] = -1.0 / (2 * dl * dl);
-        for (int j=0; j<n-1; j++)
+        for (int j=0; j<m; j++)
         {
             if (i == j)
                 epkg->z[i][j] = 1.0;
@@ -296,50 +600,343 @@ void *solve_spectrum(void *pkg)
                 epkg->z[i][j] = 0.0;
         }
     }
-    //tqli() is only exception to size input as pure
-    tqli(epkg->evalues, epkg->subdiagonal, epkg->z, epkg->n-1);
+    stage_end(profile, STAGE_IDENTITY);
 
-    epkg->z = sort_e_vectors(epkg->evalues, epkg->z, epkg->n);
+    stage_begin(profile);
+    int done = tqli_ctl(epkg->evalues, epkg->subdiagonal, epkg->z, m, ctl);
+    stage_end(profile, STAGE_TQLI);
+    if (!done)
+        return 0;
 
-    for (int i=0; i<epkg->num_efunctions; i++)
-        free(epkg->efunctions[i]);
+    stage_begin(profile);
+    sort_e_vectors_ws(epkg->evalues, epkg->z, m+1, epkg->order, epkg->scratch);
+    stage_end(profile, STAGE_SORT);
+    return 1;
+}
 
-    free(epkg->efunctions);
+static int tqli_solve_range(const double *d, const double *e, int m, int il, int iu, double *w, double *vectors,
+    int threads, SolveControl *ctl, Workspace *work)
+{
+    return mrrr_eigenpairs(d, e, m, il, iu, w, vectors, threads, ctl, work);
+}
 
-    // extract wavefunctions from z
-    Vector2 **wavefunctions = malloc(sizeof(Vector2*)*k); 
-    for(int j=0;j<k;j++)
-    {
-        wavefunctions[j] = malloc(sizeof(Vector2)*(n+1));
-        double area = 0;
+static int tqli_eigenvalues_only(const double *d, const double *e, int m, double *w, int threads, SolveControl *ctl,
+    Workspace *work)
+{
+    return slice_eigenvalues(d, e, m, 0, m-1, w, threads, ctl, work);
+}
 
-        // Applying the boundary conditions
-        wavefunctions[j][0].x = potential[0].x;
-        wavefunctions[j][0].y = 0.0;
+const SolverBackend tqli_backend = {
+    .name = "tqli",
+    .assemble = assemble_hamiltonian,
+    .solve_all = tqli_solve_all,
+    .solve_range = tqli_solve_range,
+    .eigenvalues_only = tqli_eigenvalues_only
+};
+
+const SolverBackend *const solver_backends[] = {
+    &tqli_backend,
+#ifdef HAVE_LAPACK
+    &lapack_backend,
+#endif
+    NULL
+};
 
-        wavefunctions[j][n].x = potential[n].x;
-        wavefunctions[j][n].y = 0.0;
+// Read once at the start of each solve, so it may change between solves on
+// other threads
+static _Atomic(const SolverBackend *) current_backend = &tqli_backend;
 
-        for(int i=1;i<n;i++)
+const SolverBackend *solver_backend()
+{
+    return atomic_load(&current_backend);
+}
+
+static _Atomic(SolvePlanner) current_planner = NULL;
+
+void solver_set_planner(SolvePlanner planner)
+{
+    atomic_store(&current_planner, planner);
+}
+
+// The partial path: every eigenvalue, but eigenvectors only for the k lowest
+static int solve_lowest(const SolvePlan *plan, EigenPackage *epkg, int m, int k, SolveControl *ctl,
+    PerfProfile *profile)
+{
+    const SolverBackend *backend = plan->backend;
+    double *d = epkg->diagonal;
+    double *vectors = epkg->vectors;
+    for(int i = 0; i < m; i++)
+        d[i] = epkg->evalues[i];
+
+    stage_begin(profile);
+    int done = backend->eigenvalues_only(d, epkg->subdiagonal, m, epkg->evalues, plan->threads, ctl, epkg->work);
+    stage_end(profile, STAGE_EIGENVALUES);
+    if (done)
+    {
+        if (ctl != NULL)
         {
-            wavefunctions[j][i].x = potential[i].x;
-            wavefunctions[j][i].y = epkg->z[i-1][j];
-            area += epkg->z[i-1][j] * epkg->z[i-1][j];
+            atomic_store_explicit(&ctl->total, k, memory_order_relaxed);
+            atomic_store_explicit(&ctl->progress, 0, memory_order_relaxed);
         }
-        area *= dl;
-        // normalize the wavefunction
-        for(int i=0;i<n+1;i++)
+        stage_begin(profile);
+        done = backend->solve_range(d, epkg->subdiagonal, m, 0, k-1, epkg->values, vectors, plan->threads, ctl,
+            epkg->work);
+        stage_end(profile, STAGE_VECTORS);
+    }
+    if (done)
+    {
+        for(int j = 0; j < k; j++)
+            for(int i = 0; i < m; i++)
+                epkg->z[i][j] = vectors[(size_t) j*m + i];
+    }
+    return done;
+}
+
+int solver_select_backend(const char *name)
+{
+    for(int i = 0; solver_backends[i] != NULL; i++)
+    {
+        if (strcmp(solver_backends[i]->name, name) == 0)
         {
-            wavefunctions[j][i].y /= sqrt(area);
+            atomic_store(&current_backend, solver_backends[i]);
+            return 1;
         }
+    }
+    return 0;
+}
+
+SolvePlan solver_plan(int n, int k)
+{
+    SolvePlan plan = { .backend=solver_backend(), .partial=0, .threads=0 };
+    SolvePlanner planner = atomic_load(&current_planner);
+    if (planner != NULL)
+        planner(n, k, &plan);
+    return plan;
+}
+
+int plan_prefers_update(const SolvePlan *plan, int m, int k, int r)
+{
+    if (plan->seconds > 0 && plan->update_seconds > 0)
+        return r * plan->update_seconds < plan->seconds;
+    return (!plan->partial || k >= m) && plan->backend == &tqli_backend && rank_update_pays(m, r);
+}
+
+int plan_keeps_vectors(const SolvePlan *plan, int m, int k, int r, int updates)
+{
+    if (!plan->partial || k >= m || plan->seconds <= 0 || plan->full_seconds <= 0 || plan->update_seconds <= 0)
+        return 0;
+    double saved = plan->seconds - r * plan->update_seconds;
+    return r > 0 && saved > 0 && plan->full_seconds - plan->seconds < updates * saved;
+}
+
+void *solve_spectrum(void *pkg)
+{
+    // All workspaces live in the EigenPackage. After the first solve at a given
+    // n (and k no larger than before) neither path allocates: the partial one
+    // takes its scratch from epkg->work, which keeps what the solves needed.
+    
+    struct SolverPkg *solverpkg = (struct SolverPkg*) (pkg);
+    Vector2 *potential = solverpkg->potential;
+    int n = solverpkg->n;
+    int k = solverpkg->num_eigenfunctions;
+    EigenPackage *epkg = solverpkg->epkg;
+    PerfProfile *profile = solverpkg->profile;
+    SolvePlan plan = solver_plan(n, k);
 
-        for(int i=0;i<n+1;i++)
+    reserve_eigenpackage(epkg, n, k);
+
+    stage_begin(profile);
+    plan.backend->assemble(potential, n, epkg->evalues, epkg->subdiagonal);
+    stage_end(profile, STAGE_ASSEMBLE);
+    epkg->z_columns = 0;
+
+    if (plan.partial && k < n-1 && !solverpkg->keep_vectors)
+    {
+        if (!solve_lowest(&plan, epkg, n-1, k, solverpkg->control, profile))
+            return NULL;
+        epkg->z_columns = k;
+    }
+    else
+    {
+        if (!plan.backend->solve_all(epkg, n-1, solverpkg->control, profile))
+            return NULL;
+        epkg->z_columns = n-1;
+    }
+    epkg->num_evalues = n-1;
+    epkg->first = 0;
+
+    stage_begin(profile);
+    extract_states(potential, n, k, epkg);
+    stage_end(profile, STAGE_OBSERVABLES);
+    epkg->num_efunctions = k;
+    epkg->displayable = 1;
+    return (void *) 1;
+}
+
+int solve_spectrum_update(struct SolverPkg *solverpkg, Vector2 *before, const EigenPackage *previous)
+{
+    Vector2 *potential = solverpkg->potential;
+    int n = solverpkg->n;
+    int m = n-1;
+    int k = solverpkg->num_eigenfunctions;
+    EigenPackage *epkg = solverpkg->epkg;
+    PerfProfile *profile = solverpkg->profile;
+    if (previous->n != n || previous->first != 0 || previous->num_evalues != m || previous->z_columns != m)
+        return -1;
+
+    // The update is exact for a change of the diagonal only
+    Arena *arena = workspace_arena(epkg->work, 0);
+    ArenaMark mark = arena_mark(arena);
+    double *d = arena_take(arena, sizeof(double)*m);
+    double *d_before = arena_take(arena, sizeof(double)*m);
+    double *e = arena_take(arena, sizeof(double)*m);
+    double *e_before = arena_take(arena, sizeof(double)*m);
+    tqli_backend.assemble(potential, n, d, e);
+    tqli_backend.assemble(before, n, d_before, e_before);
+    int lo = m, hi = -1;
+    int same_coupling = 1;
+    for(int i = 0; i < m; i++)
+    {
+        if (d[i] != d_before[i])
         {
-            wavefunctions[j][i].y = wavefunctions[j][i].y * wavefunctions[j][i].y;
+            lo = min(lo, i);
+            hi = i;
         }
+        same_coupling &= e[i] == e_before[i];
+    }
+    int rows = max(hi - lo + 1, 0);
+    SolvePlan plan = solver_plan(n, k);
+    if (!same_coupling || (rows > 0 && !plan_prefers_update(&plan, m, k, rows)))
+    {
+        arena_release(arena, mark);
+        return -1;
+    }
+
+    reserve_eigenpackage(epkg, n, k);
+    if (epkg != previous)
+    {
+        memcpy(epkg->evalues, previous->evalues, sizeof(double)*m);
+        for(int i = 0; i < m; i++)
+            memcpy(epkg->z[i], previous->z[i], sizeof(double)*m);
+    }
+    for(int i = 0; i < rows; i++)
+        d[i] = d[lo+i] - d_before[lo+i];
+
+    stage_begin(profile);
+    int done = rows == 0
+        || rank_update_diagonal(epkg->evalues, epkg->z, m, lo, rows, d, solverpkg->control, arena);
+    stage_end(profile, STAGE_UPDATE);
+    arena_release(arena, mark);
+    if (!done)
+    {
+        epkg->z_columns = 0;
+        return 0;
     }
+
+    epkg->z_columns = m;
+    epkg->num_evalues = m;
+    epkg->first = 0;
+    stage_begin(profile);
+    extract_states(potential, n, k, epkg);
+    stage_end(profile, STAGE_OBSERVABLES);
     epkg->num_efunctions = k;
-    epkg->efunctions = wavefunctions;
     epkg->displayable = 1;
-    return (void *) 1;
+    return 1;
+}
+
+int solve_spectrum_continued(Vector2 *potential, int n, int first, int k, const EigenPackage *previous,
+    EigenPackage *epkg, SolveControl *ctl)
+{
+    int m = n-1;
+    if (previous == epkg || previous->n != n || previous->first != first || previous->z_columns < k
+        || k <= 0 || first + k > m)
+        return -1;
+
+    reserve_eigenpackage(epkg, n, k);
+    double *d = epkg->diagonal;
+    double *vectors = epkg->vectors;
+    solver_backend()->assemble(potential, n, d, epkg->subdiagonal);
+    for(int i = 0; i < m; i++)
+        for(int j = 0; j < k; j++)
+            vectors[(size_t) j*m + i] = previous->z[i][j];
+    int done = continue_eigenpairs(d, epkg->subdiagonal, m, first, k, epkg->evalues, vectors, ctl,
+        workspace_arena(epkg->work, 0));
+    if (done != 1)
+    {
+        epkg->z_columns = 0;
+        return done;
+    }
+
+    for(int i = 0; i < m; i++)
+        for(int j = 0; j < k; j++)
+            epkg->z[i][j] = vectors[(size_t) j*m + i];
+    epkg->z_columns = k;
+    epkg->num_evalues = k;
+    epkg->first = first;
+    extract_states(potential, n, k, epkg);
+    epkg->num_efunctions = k;
+    epkg->displayable = 1;
+    return 1;
+}
+
+int spectrum_window(Vector2 *potential, int n, double emin, double emax, int *first)
+{
+    double *d = solver_malloc(sizeof(double)*(n-1));
+    double *e = solver_malloc(sizeof(double)*(n-1));
+    solver_backend()->assemble(potential, n, d, e);
+    int last;
+    int count = eigenvalue_window(d, e, n-1, emin, emax, first, &last);
+    free(e);
+    free(d);
+    return count;
+}
+
+int solve_spectrum_window(Vector2 *potential, int n, int first, int k, EigenPackage *epkg, SolveControl *ctl)
+{
+    int m = n-1;
+    if (first < 0 || k <= 0 || first + k > m)
+        return -1;
+    const SolverBackend *backend = solver_backend();
+    if (ctl != NULL)
+    {
+        atomic_store_explicit(&ctl->total, k, memory_order_relaxed);
+        atomic_store_explicit(&ctl->progress, 0, memory_order_relaxed);
+    }
+
+    // Solved into scratch, so that a cancelled solve leaves epkg as it was.
+    // The package's own serves once it is sized for n and k.
+    int fits = epkg->n == n && k <= epkg->capacity;
+    double *d = fits ? epkg->diagonal : solver_malloc(sizeof(double)*m);
+    double *e = fits ? epkg->subdiagonal : solver_malloc(sizeof(double)*m);
+    double *w = fits ? epkg->values : solver_malloc(sizeof(double)*k);
+    double *vectors = fits ? epkg->vectors : solver_malloc(sizeof(double)*m*k);
+    backend->assemble(potential, n, d, e);
+    int done = backend->solve_range(d, e, m, first, first+k-1, w, vectors, 0, ctl, epkg->work);
+    if (done)
+    {
+        reserve_eigenpackage(epkg, n, k);
+        if (!fits)
+            memcpy(epkg->subdiagonal, e, sizeof(double)*m);
+        memcpy(epkg->evalues, w, sizeof(double)*k);
+        for(int j = 0; j < k; j++)
+            for(int i = 0; i < m; i++)
+                epkg->z[i][j] = vectors[(size_t) j*m + i];
+    }
+    if (!fits)
+    {
+        free(vectors);
+        free(w);
+        free(e);
+        free(d);
+    }
+    if (!done)
+        return 0;
+
+    epkg->z_columns = k;
+    epkg->num_evalues = k;
+    epkg->first = first;
+    extract_states(potential, n, k, epkg);
+    epkg->num_efunctions = k;
+    epkg->displayable = 1;
+    return 1;
 }
@@ -0,0 +1,218 @@
+#include <stdlib.h>
+#include <string.h>
+#include "hashmap.h"
+#include "spectrumcache.h"
+
+// A cached spectrum. Also a node of the LRU list
+struct CacheEntry
+{
+    uint64_t key;
+    int n;
+    int k;
+    size_t bytes;
+    double *evalues; // n-1 sorted eigenvalues
+    Vector2 *efunctions; // k rows of n+1 displayable points
+    double *vectors; // k columns of z, stored one after the other
+    Observables *observables; // k entries
+    int num_observables;
+    double *dipoles; // min(num_observables, DIPOLE_STATES) squared, packed
+    struct CacheEntry *prev;
+    struct CacheEntry *next;
+};
+
+// Item stored in the hashmap
+struct cache_slot
+{
+    uint64_t key;
+    struct CacheEntry *entry;
+};
+
+static uint64_t slot_hash(const void *item, uint64_t seed0, uint64_t seed1)
+{
+    // keys are already hashes
+    return ((const struct cache_slot*) item)->key;
+}
+
+static int slot_compare(const void *a, const void *b, void *udata)
+{
+    uint64_t ka = ((const struct cache_slot*) a)->key;
+    uint64_t kb = ((const struct cache_slot*) b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+static void unlink_entry(SpectrumCache *cache, struct CacheEntry *entry)
+{
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        cache->head = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        cache->tail = entry->prev;
+    entry->prev = entry->next = NULL;
+}
+
+static void push_front(SpectrumCache *cache, struct CacheEntry *entry)
+{
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if (cache->head)
+        cache->head->prev = entry;
+    cache->head = entry;
+    if (cache->tail == NULL)
+        cache->tail = entry;
+}
+
+static void free_entry(struct CacheEntry *entry)
+{
+    free(entry->evalues);
+    free(entry->efunctions);
+    free(entry->vectors);
+    free(entry->observables);
+    free(entry->dipoles);
+    free(entry);
+}
+
+SpectrumCache *init_spectrumcache(size_t max_bytes)
+{
+    SpectrumCache *cache = malloc(sizeof(SpectrumCache));
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->map = hashmap_new(sizeof(struct cache_slot), 0, 0, 0,
+                            &slot_hash, &slot_compare, NULL, NULL);
+    cache->head = NULL;
+    cache->tail = NULL;
+    cache->bytes = 0;
+    cache->max_bytes = max_bytes;
+    atomic_init(&cache->hits, 0);
+    atomic_init(&cache->misses, 0);
+    return cache;
+}
+
+void free_spectrumcache(SpectrumCache *cache)
+{
+    struct CacheEntry *entry = cache->head;
+    while (entry)
+    {
+        struct CacheEntry *next = entry->next;
+        free_entry(entry);
+        entry = next;
+    }
+    hashmap_free(cache->map);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+uint64_t spectrum_key(Vector2 *potential, int n, int k)
+{
+    // The interleaved points cover both the grid and the potential samples
+    uint64_t h = hashmap_xxhash3(potential, sizeof(Vector2)*(n+1), 0, 0);
+    // Backends agree only to rounding, so a spectrum from one must not be
+    // served when another is selected
+    SolvePlan plan = solver_plan(n, k);
+    const char *name = plan.backend->name;
+    uint64_t backend = hashmap_xxhash3(name, strlen(name), 0, 0);
+    uint64_t settings[6] = { h, (uint64_t) n, (uint64_t) k, HAMILTONIAN_STENCIL, backend,
+        (uint64_t) plan.partial };
+    return hashmap_xxhash3(settings, sizeof(settings), 0, 0);
+}
+
+int spectrumcache_get(SpectrumCache *cache, uint64_t key, int n, int k, EigenPackage *out)
+{
+    pthread_mutex_lock(&cache->lock);
+    const struct cache_slot *slot = hashmap_get(cache->map, &(struct cache_slot) { .key=key });
+    if (slot == NULL || slot->entry->n != n || slot->entry->k != k)
+    {
+        pthread_mutex_unlock(&cache->lock);
+        atomic_fetch_add(&cache->misses, 1);
+        return 0;
+    }
+
+    struct CacheEntry *entry = slot->entry;
+    unlink_entry(cache, entry);
+    push_front(cache, entry);
+
+    reserve_eigenpackage(out, n, k);
+    memcpy(out->evalues, entry->evalues, sizeof(double)*(n-1));
+    for(int j = 0; j < k; j++)
+    {
+        memcpy(out->efunctions[j], entry->efunctions + j*(n+1), sizeof(Vector2)*(n+1));
+        for(int i = 0; i < n-1; i++)
+            out->z[i][j] = entry->vectors[j*(n-1) + i];
+    }
+    memcpy(out->observables, entry->observables, sizeof(Observables)*entry->num_observables);
+    int kd = min(entry->num_observables, DIPOLE_STATES);
+    for(int a = 0; a < kd; a++)
+        memcpy(out->dipoles + a*DIPOLE_STATES, entry->dipoles + a*kd, sizeof(double)*kd);
+    out->num_observables = entry->num_observables;
+    out->z_columns = k;
+    out->num_evalues = n-1;
+    out->first = 0;
+    out->num_efunctions = k;
+    out->displayable = 1;
+    pthread_mutex_unlock(&cache->lock);
+
+    atomic_fetch_add(&cache->hits, 1);
+    return 1;
+}
+
+void spectrumcache_put(SpectrumCache *cache, uint64_t key, EigenPackage *pkg)
+{
+    int n = pkg->n;
+    int k = pkg->num_efunctions;
+    size_t bytes = sizeof(struct CacheEntry)
+        + sizeof(double)*(n-1)
+        + sizeof(Vector2)*k*(n+1)
+        + sizeof(double)*k*(n-1)
+        + sizeof(Observables)*k
+        + sizeof(double)*min(k, DIPOLE_STATES)*min(k, DIPOLE_STATES);
+    if (bytes > cache->max_bytes)
+        return;
+
+    struct CacheEntry *entry = malloc(sizeof(struct CacheEntry));
+    entry->key = key;
+    entry->n = n;
+    entry->k = k;
+    entry->bytes = bytes;
+    entry->evalues = malloc(sizeof(double)*(n-1));
+    entry->efunctions = malloc(sizeof(Vector2)*k*(n+1));
+    entry->vectors = malloc(sizeof(double)*k*(n-1));
+    entry->observables = malloc(sizeof(Observables)*k);
+    entry->num_observables = min(pkg->num_observables, k);
+    int kd = min(entry->num_observables, DIPOLE_STATES);
+    entry->dipoles = malloc(sizeof(double)*kd*kd);
+    memcpy(entry->observables, pkg->observables, sizeof(Observables)*entry->num_observables);
+    for(int a = 0; a < kd; a++)
+        memcpy(entry->dipoles + a*kd, pkg->dipoles + a*DIPOLE_STATES, sizeof(double)*kd);
+    memcpy(entry->evalues, pkg->evalues, sizeof(double)*(n-1));
+    for(int j = 0; j < k; j++)
+    {
+        memcpy(entry->efunctions + j*(n+1), pkg->efunctions[j], sizeof(Vector2)*(n+1));
+        for(int i = 0; i < n-1; i++)
+            entry->vectors[j*(n-1) + i] = pkg->z[i][j];
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    const struct cache_slot *old = hashmap_get(cache->map, &(struct cache_slot) { .key=key });
+    if (old != NULL)
+    {
+        // same spectrum stored twice, e.g. by a racing solve. Keep the newer one
+        struct CacheEntry *stale = old->entry;
+        unlink_entry(cache, stale);
+        cache->bytes -= stale->bytes;
+        free_entry(stale);
+    }
+    hashmap_set(cache->map, &(struct cache_slot) { .key=key, .entry=entry });
+    push_front(cache, entry);
+    cache->bytes += bytes;
+
+    while (cache->bytes > cache->max_bytes)
+    {
+        struct CacheEntry *victim = cache->tail;
+        unlink_entry(cache, victim);
+        hashmap_delete(cache->map, &(struct cache_slot) { .key=victim->key });
+        cache->bytes -= victim->bytes;
+        free_entry(victim);
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
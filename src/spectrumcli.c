@@ -0,0 +1,609 @@
+/******************************************************************************
+ * Command line front end to the solver. Prints energies (and optionally
+ * probability densities) for a built-in, typed or plugin potential without
+ * opening a window.
+******************************************************************************/
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "solver.h"
+#include "tridiag.h"
+#include "slice.h"
+#include "potential.h"
+#include "expr.h"
+#include "spectrumcache.h"
+#include "spectrumstore.h"
+#include "plugin.h"
+#include "lanczos2d.h"
+#include "scatter.h"
+#include "eigenexport.h"
+#include "perfcounters.h"
+#include "autotune.h"
+
+typedef struct CliOptions
+{
+    int n;
+    int k;
+    const char *potential;
+    const char *expression; // overrides potential when set
+    const char *plugin; // path of a plugin; overrides both when set
+    const char *params[16]; // "name=value" overrides for the expression or plugin
+    int num_params;
+    int values_only;
+    int range_lo;
+    int range_hi; // -1 when no --range was given
+    double energy_lo;
+    double energy_hi; // --energies; the range is found from it per solve
+    int energies;
+    int densities;
+    int observables; // --observables
+    int use_store;
+    int watch;
+    int two_d;
+    double sweep_lo;
+    double sweep_hi; // --transmission
+    int sweep_points;
+    int transmission;
+    const char *export_path; // --export
+    int bench_runs; // --bench, 0 when not benchmarking
+    int backend_chosen; // --backend
+    int tune; // --tune
+} CliOptions;
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -n <points>        discretization (default 500)\n"
+        "  -k <count>         number of lowest states to print (default 10)\n"
+        "  -p <name>          constant, linear, quadratic, step, gaussian, sinusodial\n"
+        "  -e <expression>    potential V(x) as an expression, e.g. \"a*(x-0.5)^2; a=4\"\n"
+        "  --plugin <file.so> potential from a plugin shared object\n"
+        "  --param <name>=<v> set a parameter of the expression or plugin (repeatable)\n"
+        "  --watch            with --plugin, re-solve whenever the plugin is rebuilt\n"
+        "  --values-only      energies only, no eigenvectors (O(n^2))\n"
+        "  --range <lo>:<hi>  energies of states lo..hi by spectrum slicing\n"
+        "  --energies <a>:<b> the states with energies in [a, b), like --range\n"
+        "  --densities        also print |psi|^2 of the k lowest states, or of the\n"
+        "                     --range/--energies window by inverse iteration\n"
+        "  --observables      also print <x>, <x^2>, <p^2>, <V> and the uncertainties\n"
+        "                     of those states, and their dipoles <i|x|j>\n"
+        "  --no-store         do not read or write the on-disk spectrum store\n"
+        "  --2d               energies of V(x) + V(y) on an n x n grid, with -p only\n"
+        "  --transmission <a>:<b>\n"
+        "                     transmission and reflection of the potential with open\n"
+        "                     ends at energies across [a, b] instead of the spectrum\n"
+        "  --points <count>   energies in the --transmission sweep (default 1000)\n"
+        "  --export <file>    stream the eigenvectors of the k lowest states, or of the\n"
+        "                     --range/--energies window, to file one at a time.\n"
+        "                     Rerunning resumes an interrupted export\n"
+        "  --bench <runs>     time full and eigenvalues-only solves per stage, with\n"
+        "                     IPC and cache/branch misses where counters are available\n"
+        "  --backend <name>   eigensolver: tqli (default), or lapack in builds made\n"
+        "                     with LAPACK=1. Otherwise full solves follow the\n"
+        "                     machine's tuning profile, calibrated on first use\n"
+        "  --tune             recalibrate the tuning profile and print its predictions\n",
+        prog);
+}
+
+static int parse_args(int argc, char **argv, CliOptions *opts)
+{
+    opts->n = 500;
+    opts->k = 10;
+    opts->potential = "quadratic";
+    opts->expression = NULL;
+    opts->plugin = NULL;
+    opts->num_params = 0;
+    opts->values_only = 0;
+    opts->range_lo = 0;
+    opts->range_hi = -1;
+    opts->energies = 0;
+    opts->densities = 0;
+    opts->observables = 0;
+    opts->use_store = 1;
+    opts->watch = 0;
+    opts->two_d = 0;
+    opts->sweep_points = 1000;
+    opts->transmission = 0;
+    opts->export_path = NULL;
+    opts->bench_runs = 0;
+    opts->backend_chosen = 0;
+    opts->tune = 0;
+
+    for(int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *next = (i+1 < argc) ? argv[i+1] : NULL;
+
+        if (strcmp(arg, "-n") == 0 && next)
+        {
+            opts->n = atoi(next);
+            i++;
+        }
+        else if (strcmp(arg, "-k") == 0 && next)
+        {
+            opts->k = atoi(next);
+            i++;
+        }
+        else if (strcmp(arg, "-p") == 0 && next)
+        {
+            opts->potential = next;
+            i++;
+        }
+        else if (strcmp(arg, "-e") == 0 && next)
+        {
+            opts->expression = next;
+            i++;
+        }
+        else if (strcmp(arg, "--plugin") == 0 && next)
+        {
+            opts->plugin = next;
+            i++;
+        }
+        else if (strcmp(arg, "--watch") == 0)
+            opts->watch = 1;
+        else if (strcmp(arg, "--param") == 0 && next && opts->num_params < 16)
+        {
+            opts->params[opts->num_params++] = next;
+            i++;
+        }
+        else if (strcmp(arg, "--values-only") == 0)
+            opts->values_only = 1;
+        else if (strcmp(arg, "--range") == 0 && next)
+        {
+            if (sscanf(next, "%d:%d", &opts->range_lo, &opts->range_hi) != 2)
+                return 0;
+            i++;
+        }
+        else if (strcmp(arg, "--energies") == 0 && next)
+        {
+            if (sscanf(next, "%lf:%lf", &opts->energy_lo, &opts->energy_hi) != 2)
+                return 0;
+            opts->energies = 1;
+            i++;
+        }
+        else if (strcmp(arg, "--densities") == 0)
+            opts->densities = 1;
+        else if (strcmp(arg, "--observables") == 0)
+            opts->observables = 1;
+        else if (strcmp(arg, "--no-store") == 0)
+            opts->use_store = 0;
+        else if (strcmp(arg, "--tune") == 0)
+            opts->tune = 1;
+        else if (strcmp(arg, "--2d") == 0)
+            opts->two_d = 1;
+        else if (strcmp(arg, "--transmission") == 0 && next)
+        {
+            if (sscanf(next, "%lf:%lf", &opts->sweep_lo, &opts->sweep_hi) != 2)
+                return 0;
+            opts->transmission = 1;
+            i++;
+        }
+        else if (strcmp(arg, "--export") == 0 && next)
+        {
+            opts->export_path = next;
+            i++;
+        }
+        else if (strcmp(arg, "--bench") == 0 && next)
+        {
+            opts->bench_runs = atoi(next);
+            if (opts->bench_runs < 1)
+                return 0;
+            i++;
+        }
+        else if (strcmp(arg, "--backend") == 0 && next)
+        {
+            if (!solver_select_backend(next))
+            {
+                fprintf(stderr, "backend %s is not compiled in\n", next);
+                return 0;
+            }
+            opts->backend_chosen = 1;
+            i++;
+        }
+        else if (strcmp(arg, "--points") == 0 && next)
+        {
+            opts->sweep_points = atoi(next);
+            i++;
+        }
+        else
+            return 0;
+    }
+
+    if (opts->n < 3 || opts->k < 1 || (opts->watch && opts->plugin == NULL))
+        return 0;
+    if (opts->two_d && (opts->expression || opts->plugin || opts->values_only
+        || opts->range_hi >= 0 || opts->energies || opts->densities))
+        return 0;
+    if (opts->energies && opts->range_hi >= 0)
+        return 0;
+    if (opts->observables && (opts->two_d || opts->values_only || opts->transmission || opts->export_path))
+        return 0;
+    if (opts->bench_runs && (opts->two_d || opts->transmission || opts->export_path || opts->watch))
+        return 0;
+    if (opts->export_path && (opts->two_d || opts->transmission || opts->densities || opts->watch))
+        return 0;
+    if (opts->transmission && (opts->two_d || opts->sweep_points < 1 || opts->sweep_lo > opts->sweep_hi))
+        return 0;
+    opts->k = min(opts->k, opts->n-1);
+    if (opts->range_hi >= 0
+        && (opts->range_lo < 0 || opts->range_lo > opts->range_hi || opts->range_hi > opts->n-2))
+        return 0;
+    return 1;
+}
+
+static void print_densities(double *domain, int n, EigenPackage *epkg, int first)
+{
+    printf("\n# x |psi_%d|^2 ... |psi_%d|^2\n", first, first + epkg->num_efunctions-1);
+    for(int i = 0; i <= n; i++)
+    {
+        printf("%.6g", domain[i]);
+        for(int j = 0; j < epkg->num_efunctions; j++)
+            printf(" %.6g", epkg->efunctions[j][i].y);
+        printf("\n");
+    }
+}
+
+// With --observables: expectation values of the solved states, then the
+// dipole matrix of the first DIPOLE_STATES of them
+static void print_observables(EigenPackage *epkg, int first)
+{
+    printf("\n# index <x> <x^2> <p^2> <V> dx dp dx*dp\n");
+    for(int j = 0; j < epkg->num_observables; j++)
+    {
+        const Observables *o = &epkg->observables[j];
+        printf("%d %.10g %.10g %.10g %.10g %.10g %.10g %.10g\n",
+            first + j, o->x, o->x2, o->p2, o->v, o->dx, o->dp, o->dx * o->dp);
+    }
+
+    int kd = min(epkg->num_observables, DIPOLE_STATES);
+    printf("\n# <i|x|j> for i, j = %d..%d, one row per i\n", first, first + kd-1);
+    for(int a = 0; a < kd; a++)
+    {
+        for(int b = 0; b < kd; b++)
+            printf((b == 0) ? "%.6g" : " %.6g", epkg->dipoles[a*DIPOLE_STATES + b]);
+        printf("\n");
+    }
+}
+
+// With --transmission: T(E) and R(E) on an even grid of energies
+static void print_transmission(const CliOptions *opts, Vector2 *potential)
+{
+    int count = opts->sweep_points;
+    double *energies = calloc(count, sizeof(double));
+    double *transmission = malloc(sizeof(double)*count);
+    double *reflection = malloc(sizeof(double)*count);
+    for(int i = 0; i < count; i++)
+        energies[i] = (count > 1)
+            ? opts->sweep_lo + (opts->sweep_hi - opts->sweep_lo) * i / (count - 1)
+            : opts->sweep_lo;
+
+    transmission_sweep(potential, opts->n, energies, count, transmission, reflection, 0, NULL);
+    printf("# energy transmission reflection\n");
+    for(int i = 0; i < count; i++)
+        printf("%.10g %.10g %.10g\n", energies[i], transmission[i], reflection[i]);
+
+    free(reflection);
+    free(transmission);
+    free(energies);
+}
+
+// With --bench: full and eigenvalues-only solves under the performance
+// counters, reported per stage
+static void print_bench(const CliOptions *opts, double *domain, Vector2 *potential)
+{
+    int n = opts->n;
+    PerfProfile *profile = init_perfprofile();
+    EigenPackage *epkg = init_eigenpackage(opts->k, n, domain);
+    double *evalues = malloc(sizeof(double)*(n-1));
+    struct SolverPkg solverpkg = {
+        .potential=potential, .n=n, .num_eigenfunctions=opts->k, .epkg=epkg, .control=NULL, .profile=profile
+    };
+
+    for(int run = 0; run < opts->bench_runs; run++)
+    {
+        solve_spectrum(&solverpkg);
+        perf_begin(profile);
+        solve_eigenvalues(potential, n, evalues, NULL);
+        perf_end(profile, STAGE_EIGENVALUES);
+    }
+    printf("# %d runs, backend=%s, k=%d, per grid point = per row of the %d x %d matrix\n",
+        opts->bench_runs, solver_backend()->name, opts->k, n-1, n-1);
+    perf_report(profile, stdout, n-1);
+
+    free(evalues);
+    free_eigenpackage(epkg);
+    free_perfprofile(profile);
+}
+
+// Solves and prints the spectrum of one potential as the options ask
+static void print_spectrum(const CliOptions *opts, double *domain, Vector2 *potential)
+{
+    if (opts->transmission)
+    {
+        print_transmission(opts, potential);
+        return;
+    }
+    if (opts->bench_runs > 0)
+    {
+        print_bench(opts, domain, potential);
+        return;
+    }
+
+    int n = opts->n;
+    int range_lo = opts->range_lo;
+    int range_hi = opts->range_hi;
+    if (opts->energies)
+    {
+        int count = spectrum_window(potential, n, opts->energy_lo, opts->energy_hi, &range_lo);
+        if (count == 0)
+        {
+            printf("# no states in [%g, %g)\n", opts->energy_lo, opts->energy_hi);
+            return;
+        }
+        range_hi = range_lo + count - 1;
+    }
+
+    if (opts->export_path != NULL)
+    {
+        if (range_hi < 0)
+            range_hi = opts->k - 1;
+        int count = range_hi - range_lo + 1;
+        int done = export_eigenvectors(opts->export_path, potential, n, range_lo, count, NULL);
+        if (done < 0)
+            fprintf(stderr, "cannot export to %s: I/O error, or it holds an export of other states\n",
+                opts->export_path);
+        else
+            printf("# states %d..%d: %d of %d vectors in %s\n", range_lo, range_hi, done, count, opts->export_path);
+        return;
+    }
+    printf("# index energy\n");
+
+    if (range_hi >= 0 && (opts->densities || opts->observables))
+    {
+        // only the window's vectors, in time proportional to its size
+        int count = range_hi - range_lo + 1;
+        EigenPackage *epkg = init_eigenpackage(count, n, domain);
+        solve_spectrum_window(potential, n, range_lo, count, epkg, NULL);
+        for(int i = 0; i < count; i++)
+            printf("%d %.10g\n", range_lo + i, epkg->evalues[i]);
+        if (opts->densities)
+            print_densities(domain, n, epkg, range_lo);
+        if (opts->observables)
+            print_observables(epkg, range_lo);
+        free_eigenpackage(epkg);
+    }
+    else if (range_hi >= 0)
+    {
+        int count = range_hi - range_lo + 1;
+        double *d = malloc(sizeof(double)*(n-1));
+        double *e = malloc(sizeof(double)*(n-1));
+        double *evalues = malloc(sizeof(double)*count);
+
+        assemble_hamiltonian(potential, n, d, e);
+        slice_eigenvalues(d, e, n-1, range_lo, range_hi, evalues, 0, NULL, NULL);
+        for(int i = 0; i < count; i++)
+            printf("%d %.10g\n", range_lo + i, evalues[i]);
+
+        free(evalues);
+        free(e);
+        free(d);
+    }
+    else if (opts->values_only)
+    {
+        double *evalues = malloc(sizeof(double)*(n-1));
+        solve_eigenvalues(potential, n, evalues, NULL);
+        for(int i = 0; i < opts->k; i++)
+            printf("%d %.10g\n", i, evalues[i]);
+        free(evalues);
+    }
+    else
+    {
+        EigenPackage *epkg = init_eigenpackage(opts->k, n, domain);
+        struct SolverPkg solverpkg = {
+            .potential=potential, .n=n, .num_eigenfunctions=opts->k, .epkg=epkg, .control=NULL, .profile=NULL
+        };
+
+        // Spectra are shared with the GUI and other runs through the store
+        SpectrumStore *store = opts->use_store ? open_spectrumstore(NULL, SPECTRUM_STORE_BYTES) : NULL;
+        uint64_t key = spectrum_key(potential, n, opts->k);
+        if (store != NULL && spectrumstore_get(store, key, n, opts->k, epkg))
+            printf("# from store\n");
+        else
+        {
+            solve_spectrum(&solverpkg);
+            if (store != NULL)
+                spectrumstore_put(store, key, epkg);
+        }
+        if (store != NULL)
+            close_spectrumstore(store);
+
+        for(int i = 0; i < opts->k; i++)
+            printf("%d %.10g\n", i, epkg->evalues[i]);
+
+        if (opts->densities)
+            print_densities(domain, n, epkg, 0);
+        if (opts->observables)
+            print_observables(epkg, 0);
+        free_eigenpackage(epkg);
+    }
+}
+
+// With --2d: the lowest states of the separable potential V(x) + V(y)
+static int print_spectrum2d(const CliOptions *opts)
+{
+    PotentialBatchFn f = find_potential_batch(opts->potential);
+    if (f == NULL)
+    {
+        fprintf(stderr, "unknown potential: %s\n", opts->potential);
+        return 1;
+    }
+
+    int n = opts->n;
+    double *grid = malloc(sizeof(double)*(n+1)*(n+1));
+    fill_potential2d(n, f, NULL, grid);
+    Spectrum2D *spec = init_spectrum2d(n, opts->k);
+    solve_spectrum2d(grid, spec, NULL);
+
+    printf("# potential=%s(x)+%s(y) n=%dx%d\n# index energy\n", opts->potential, opts->potential, n, n);
+    for(int i = 0; i < opts->k; i++)
+        printf("%d %.10g\n", i, spec->evalues[i]);
+    printf("# %d stencil applications, %d restarts\n", spec->iterations, spec->restarts);
+
+    free_spectrum2d(spec);
+    free(grid);
+    return 0;
+}
+
+// Whether the options end in solve_spectrum(), which the tuning profile steers
+static int solves_spectrum(const CliOptions *opts)
+{
+    return !opts->two_d && !opts->transmission && !opts->export_path && !opts->bench_runs
+        && !opts->values_only && opts->range_hi < 0 && !opts->energies;
+}
+
+// Reads --param overrides as name=value. Returns 0 after printing an error
+static int parse_param(const char *arg, char *name, double *value)
+{
+    if (sscanf(arg, "%63[^=]=%lf", name, value) != 2)
+    {
+        fprintf(stderr, "bad parameter: %s\n", arg);
+        return 0;
+    }
+    return 1;
+}
+
+// With --watch: re-solves every time the plugin file changes, until killed
+static void watch_plugin(const CliOptions *opts, Plugin *plugin, double *domain, Vector2 *potential)
+{
+    char err[PLUGIN_ERROR_LEN];
+    while (1)
+    {
+        usleep(200000);
+        int status = reload_plugin_if_changed(plugin, err, sizeof(err));
+        if (status == -1)
+            fprintf(stderr, "reload failed: %s\n", err);
+        else if (status == 1)
+        {
+            plugin_fill(plugin, domain, opts->n, potential);
+            printf("\n# reloaded %s\n", opts->plugin);
+            print_spectrum(opts, domain, potential);
+            fflush(stdout);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    CliOptions opts;
+    if (!parse_args(argc, argv, &opts))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if (opts.tune)
+    {
+        TuneProfile *profile = autotune_startup(1, stdout);
+        autotune_report(profile, stdout);
+        free(profile);
+        return 0;
+    }
+    if (opts.two_d)
+        return print_spectrum2d(&opts);
+    // an explicit --backend is used as asked
+    TuneProfile *tuning = NULL;
+    if (!opts.backend_chosen && solves_spectrum(&opts))
+        tuning = autotune_startup(0, stderr);
+
+    int n = opts.n;
+    double *domain = create_domain(0, 1, n);
+    Vector2 *potential = malloc(sizeof(Vector2)*(n+1));
+    Plugin *plugin = NULL;
+
+    if (opts.plugin != NULL)
+    {
+        char err[PLUGIN_ERROR_LEN];
+        plugin = load_plugin(opts.plugin, err, sizeof(err));
+        if (plugin == NULL)
+        {
+            fprintf(stderr, "%s\n", err);
+            return 1;
+        }
+        for(int i = 0; i < opts.num_params; i++)
+        {
+            char name[64];
+            double value;
+            if (!parse_param(opts.params[i], name, &value))
+                return 1;
+            if (plugin_find_param(plugin, name) < 0)
+            {
+                fprintf(stderr, "plugin has no parameter %s\n", name);
+                return 1;
+            }
+            plugin_set_param(plugin, plugin_find_param(plugin, name), value);
+        }
+        plugin_fill(plugin, domain, n, potential);
+        printf("# plugin=\"%s\" (%s) n=%d\n", opts.plugin, plugin->desc->name, n);
+        for(int i = 0; i < plugin->desc->num_params; i++)
+            printf("# %s = %g\n", plugin->desc->params[i].name, plugin->params[i]);
+    }
+    else if (opts.expression != NULL)
+    {
+        char err[128];
+        Expr *expr = expr_compile(opts.expression, err, sizeof(err));
+        if (expr == NULL)
+        {
+            fprintf(stderr, "bad expression: %s\n", err);
+            return 1;
+        }
+        for(int i = 0; i < opts.num_params; i++)
+        {
+            char name[64];
+            double value;
+            if (!parse_param(opts.params[i], name, &value))
+                return 1;
+            if (expr_find_param(expr, name) < 0)
+            {
+                fprintf(stderr, "expression has no parameter %s\n", name);
+                return 1;
+            }
+            expr_set_param(expr, expr_find_param(expr, name), value);
+        }
+        expr_apply(expr, domain, potential, n);
+        expr_free(expr);
+        printf("# potential=\"%s\" n=%d\n", opts.expression, n);
+    }
+    else
+    {
+        PotentialBatchFn f = find_potential_batch(opts.potential);
+        if (f == NULL)
+        {
+            fprintf(stderr, "unknown potential: %s\n", opts.potential);
+            return 1;
+        }
+        fill_potential(domain, n, f, NULL, potential);
+        printf("# potential=%s n=%d\n", opts.potential, n);
+    }
+
+    print_spectrum(&opts, domain, potential);
+    if (opts.watch)
+    {
+        fflush(stdout);
+        watch_plugin(&opts, plugin, domain, potential);
+    }
+
+    if (plugin != NULL)
+        free_plugin(plugin);
+    if (tuning != NULL)
+    {
+        autotune_install(NULL);
+        free(tuning);
+    }
+    free(potential);
+    free(domain);
+    return 0;
+}
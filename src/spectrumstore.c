@@ -0,0 +1,493 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "spectrumstore.h"
+
+#define STORE_MAGIC "SSPEC02"
+
+// Start of every data file. The arrays follow it back to back: n-1 evalues,
+// k rows of n+1 Vector2, k columns of n-1 eigenvector entries, k Observables
+// and the min(k, DIPOLE_STATES) squared dipoles.
+struct store_header
+{
+    char magic[8];
+    uint64_t key;
+    int32_t n;
+    int32_t k;
+    int32_t stencil;
+    int32_t vector_size; // sizeof(Vector2) of the writer
+    double potential_scale;
+};
+
+// One line of the index
+struct index_entry
+{
+    uint64_t key;
+    uint64_t bytes;
+    uint64_t last_used; // ns since the epoch
+};
+
+static atomic_uint tmp_counter = 0;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static size_t file_bytes(int n, int k)
+{
+    return sizeof(struct store_header)
+        + sizeof(double)*(n-1)
+        + sizeof(Vector2)*k*(n+1)
+        + sizeof(double)*k*(n-1)
+        + sizeof(Observables)*k
+        + sizeof(double)*min(k, DIPOLE_STATES)*min(k, DIPOLE_STATES);
+}
+
+static char *store_path(SpectrumStore *store, const char *name)
+{
+    size_t len = strlen(store->dir) + strlen(name) + 2;
+    char *path = malloc(len);
+    snprintf(path, len, "%s/%s", store->dir, name);
+    return path;
+}
+
+static char *entry_path(SpectrumStore *store, uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.spec", (unsigned long long) key);
+    return store_path(store, name);
+}
+
+// mkdir -p
+static int make_dirs(const char *dir)
+{
+    char *path = strdup(dir);
+    for(char *p = path + 1; *p; p++)
+    {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        if (mkdir(path, 0755) != 0 && errno != EEXIST)
+        {
+            free(path);
+            return 0;
+        }
+        *p = '/';
+    }
+    int ok = mkdir(path, 0755) == 0 || errno == EEXIST;
+    free(path);
+    return ok;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len > 0)
+    {
+        ssize_t written = write(fd, p, len);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+        p += written;
+        len -= written;
+    }
+    return 1;
+}
+
+// Remembers a use of key until the next flush_pending(). Caller holds the mutex
+static void record_use(SpectrumStore *store, uint64_t key, uint64_t bytes)
+{
+    int i;
+    for(i = 0; i < store->num_pending; i++)
+        if (store->pending[i].key == key)
+            break;
+    if (i == store->num_pending)
+        store->num_pending++;
+    store->pending[i] = (struct index_entry) { .key=key, .bytes=bytes, .last_used=now_ns() };
+}
+
+// Appends the remembered uses to the index and returns its size afterwards,
+// or -1 if it can't be written. Caller holds the mutex and the exclusive lock
+static long flush_pending(SpectrumStore *store)
+{
+    char *path = store_path(store, "index");
+    FILE *index = fopen(path, "a");
+    free(path);
+    if (index == NULL)
+        return -1;
+    for(int i = 0; i < store->num_pending; i++)
+        fprintf(index, "%016llx %llu %llu\n", (unsigned long long) store->pending[i].key,
+            (unsigned long long) store->pending[i].bytes, (unsigned long long) store->pending[i].last_used);
+    store->num_pending = 0;
+    long size = ftell(index);
+    fclose(index);
+    return size;
+}
+
+// The estimate of the bytes in the store kept at the start of the lock file.
+// Returns 0 if there is none yet. Caller holds the lock
+static int read_total(SpectrumStore *store, uint64_t *total)
+{
+    return pread(store->lock_fd, total, sizeof(*total), 0) == sizeof(*total);
+}
+
+static void write_total(SpectrumStore *store, uint64_t total)
+{
+    // a short write leaves no estimate, which makes the next put compact
+    if (pwrite(store->lock_fd, &total, sizeof(total), 0) != sizeof(total))
+        ftruncate(store->lock_fd, 0);
+}
+
+static int compare_last_used(const void *a, const void *b)
+{
+    const struct index_entry *ea = a;
+    const struct index_entry *eb = b;
+    return (ea->last_used > eb->last_used) - (ea->last_used < eb->last_used);
+}
+
+// Collapses the index to one line per existing file, evicts the least
+// recently used files until the store is down to three quarters of its limit
+// and records the bytes left. Caller holds the exclusive lock
+static void compact_index(SpectrumStore *store)
+{
+    char *path = store_path(store, "index");
+    FILE *index = fopen(path, "r");
+    if (index == NULL)
+    {
+        free(path);
+        return;
+    }
+
+    int count = 0;
+    int capacity = 64;
+    struct index_entry *entries = malloc(sizeof(struct index_entry)*capacity);
+    unsigned long long key, bytes, last_used;
+    while (fscanf(index, "%llx %llu %llu", &key, &bytes, &last_used) == 3)
+    {
+        // the latest use of a key wins
+        int i;
+        for(i = 0; i < count; i++)
+            if (entries[i].key == key)
+                break;
+        if (i == count)
+        {
+            if (count == capacity)
+            {
+                capacity *= 2;
+                entries = realloc(entries, sizeof(struct index_entry)*capacity);
+            }
+            count++;
+        }
+        else if (entries[i].last_used > last_used)
+            continue;
+        entries[i] = (struct index_entry) { .key=key, .bytes=bytes, .last_used=last_used };
+    }
+    fclose(index);
+
+    // drop entries whose file is gone, e.g. removed by hand
+    uint64_t total = 0;
+    int live = 0;
+    for(int i = 0; i < count; i++)
+    {
+        char *file = entry_path(store, entries[i].key);
+        struct stat st;
+        if (stat(file, &st) == 0)
+        {
+            entries[i].bytes = st.st_size;
+            entries[live++] = entries[i];
+            total += st.st_size;
+        }
+        free(file);
+    }
+
+    qsort(entries, live, sizeof(struct index_entry), &compare_last_used);
+    // evicting below the limit leaves room for a few puts before the next compaction
+    int first = 0;
+    while (total > store->max_bytes / 4 * 3 && first < live)
+    {
+        char *file = entry_path(store, entries[first].key);
+        unlink(file);
+        free(file);
+        total -= entries[first].bytes;
+        first++;
+    }
+
+    char *tmp = store_path(store, "index.tmp");
+    FILE *out = fopen(tmp, "w");
+    if (out != NULL)
+    {
+        for(int i = first; i < live; i++)
+            fprintf(out, "%016llx %llu %llu\n", (unsigned long long) entries[i].key,
+                (unsigned long long) entries[i].bytes, (unsigned long long) entries[i].last_used);
+        fclose(out);
+        rename(tmp, path);
+    }
+    write_total(store, total);
+    free(tmp);
+    free(path);
+    free(entries);
+}
+
+// Removes temporary files that crashed writers left behind. Files younger
+// than STORE_TMP_AGE may still be in use. Caller holds the exclusive lock
+static void sweep_temporaries(SpectrumStore *store)
+{
+    DIR *dir = opendir(store->dir);
+    if (dir == NULL)
+        return;
+    time_t cutoff = time(NULL) - STORE_TMP_AGE;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strstr(entry->d_name, ".tmp") == NULL)
+            continue;
+        char *path = store_path(store, entry->d_name);
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && st.st_mtime < cutoff)
+            unlink(path);
+        free(path);
+    }
+    closedir(dir);
+}
+
+int spectrumstore_default_dir(char *dir, size_t size)
+{
+    if (getenv("SCHRODINGER_STORE") != NULL)
+        snprintf(dir, size, "%s", getenv("SCHRODINGER_STORE"));
+    else if (getenv("XDG_CACHE_HOME") != NULL)
+        snprintf(dir, size, "%s/schrodingersim", getenv("XDG_CACHE_HOME"));
+    else if (getenv("HOME") != NULL)
+        snprintf(dir, size, "%s/.cache/schrodingersim", getenv("HOME"));
+    else
+        return 0;
+    return make_dirs(dir);
+}
+
+SpectrumStore *open_spectrumstore(const char *dir, size_t max_bytes)
+{
+    char fallback[4096];
+    if (dir == NULL)
+    {
+        if (!spectrumstore_default_dir(fallback, sizeof(fallback)))
+            return NULL;
+        dir = fallback;
+    }
+    else if (!make_dirs(dir))
+        return NULL;
+
+    SpectrumStore *store = malloc(sizeof(SpectrumStore));
+    store->dir = strdup(dir);
+    store->max_bytes = max_bytes;
+    store->pending = malloc(sizeof(struct index_entry)*STORE_PENDING_HITS);
+    store->num_pending = 0;
+    pthread_mutex_init(&store->lock, NULL);
+    atomic_init(&store->hits, 0);
+    atomic_init(&store->misses, 0);
+
+    char *lock = store_path(store, "lock");
+    store->lock_fd = open(lock, O_RDWR | O_CREAT, 0644);
+    free(lock);
+    if (store->lock_fd < 0)
+    {
+        pthread_mutex_destroy(&store->lock);
+        free(store->pending);
+        free(store->dir);
+        free(store);
+        return NULL;
+    }
+
+    flock(store->lock_fd, LOCK_EX);
+    sweep_temporaries(store);
+    flock(store->lock_fd, LOCK_UN);
+    return store;
+}
+
+void close_spectrumstore(SpectrumStore *store)
+{
+    pthread_mutex_lock(&store->lock);
+    if (store->num_pending > 0)
+    {
+        flock(store->lock_fd, LOCK_EX);
+        flush_pending(store);
+        flock(store->lock_fd, LOCK_UN);
+    }
+    pthread_mutex_unlock(&store->lock);
+
+    close(store->lock_fd);
+    pthread_mutex_destroy(&store->lock);
+    free(store->pending);
+    free(store->dir);
+    free(store);
+}
+
+int spectrumstore_get(SpectrumStore *store, uint64_t key, int n, int k, EigenPackage *out)
+{
+    char *path = entry_path(store, key);
+    size_t bytes = file_bytes(n, k);
+    int hit = 0;
+
+    pthread_mutex_lock(&store->lock);
+    flock(store->lock_fd, LOCK_SH);
+    int fd = open(path, O_RDONLY);
+    free(path);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && (size_t) st.st_size == bytes)
+    {
+        void *map = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            const struct store_header *header = map;
+            if (memcmp(header->magic, STORE_MAGIC, 8) == 0 && header->key == key
+                && header->n == n && header->k == k
+                && header->stencil == HAMILTONIAN_STENCIL
+                && header->vector_size == (int32_t) sizeof(Vector2)
+                && header->potential_scale == POTENTIAL_SCALE)
+            {
+                const double *evalues = (const double*) (header + 1);
+                const Vector2 *efunctions = (const Vector2*) (evalues + (n-1));
+                const double *vectors = (const double*) (efunctions + k*(n+1));
+                const Observables *observables = (const Observables*) (vectors + k*(n-1));
+                const double *dipoles = (const double*) (observables + k);
+                int kd = min(k, DIPOLE_STATES);
+
+                reserve_eigenpackage(out, n, k);
+                memcpy(out->evalues, evalues, sizeof(double)*(n-1));
+                for(int j = 0; j < k; j++)
+                {
+                    memcpy(out->efunctions[j], efunctions + j*(n+1), sizeof(Vector2)*(n+1));
+                    for(int i = 0; i < n-1; i++)
+                        out->z[i][j] = vectors[j*(n-1) + i];
+                }
+                memcpy(out->observables, observables, sizeof(Observables)*k);
+                for(int a = 0; a < kd; a++)
+                    memcpy(out->dipoles + a*DIPOLE_STATES, dipoles + a*kd, sizeof(double)*kd);
+                out->num_observables = k;
+                out->z_columns = k;
+                out->num_evalues = n-1;
+                out->first = 0;
+                out->num_efunctions = k;
+                out->displayable = 1;
+                hit = 1;
+            }
+            munmap(map, bytes);
+        }
+    }
+    if (fd >= 0)
+        close(fd);
+    flock(store->lock_fd, LOCK_UN);
+
+    if (!hit)
+    {
+        pthread_mutex_unlock(&store->lock);
+        atomic_fetch_add(&store->misses, 1);
+        return 0;
+    }
+
+    record_use(store, key, bytes);
+    if (store->num_pending == STORE_PENDING_HITS)
+    {
+        flock(store->lock_fd, LOCK_EX);
+        if (flush_pending(store) > STORE_INDEX_BYTES)
+            compact_index(store);
+        flock(store->lock_fd, LOCK_UN);
+    }
+    pthread_mutex_unlock(&store->lock);
+    atomic_fetch_add(&store->hits, 1);
+    return 1;
+}
+
+int spectrumstore_put(SpectrumStore *store, uint64_t key, EigenPackage *pkg)
+{
+    int n = pkg->n;
+    int k = pkg->num_efunctions;
+    size_t bytes = file_bytes(n, k);
+    if (bytes > store->max_bytes || pkg->z_columns < k || pkg->num_observables < k)
+        return 0;
+
+    char name[64];
+    snprintf(name, sizeof(name), "%016llx.tmp.%ld.%u", (unsigned long long) key,
+        (long) getpid(), atomic_fetch_add(&tmp_counter, 1));
+    char *tmp = store_path(store, name);
+
+    // write under a private name so readers never see a partial file
+    int ok = 0;
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0)
+    {
+        struct store_header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, STORE_MAGIC, 8);
+        header.key = key;
+        header.n = n;
+        header.k = k;
+        header.stencil = HAMILTONIAN_STENCIL;
+        header.vector_size = sizeof(Vector2);
+        header.potential_scale = POTENTIAL_SCALE;
+
+        ok = write_all(fd, &header, sizeof(header))
+            && write_all(fd, pkg->evalues, sizeof(double)*(n-1));
+        for(int j = 0; ok && j < k; j++)
+            ok = write_all(fd, pkg->efunctions[j], sizeof(Vector2)*(n+1));
+
+        double *column = malloc(sizeof(double)*(n-1));
+        for(int j = 0; ok && j < k; j++)
+        {
+            for(int i = 0; i < n-1; i++)
+                column[i] = pkg->z[i][j];
+            ok = write_all(fd, column, sizeof(double)*(n-1));
+        }
+        free(column);
+        ok = ok && write_all(fd, pkg->observables, sizeof(Observables)*k);
+        for(int a = 0; ok && a < min(k, DIPOLE_STATES); a++)
+            ok = write_all(fd, pkg->dipoles + a*DIPOLE_STATES, sizeof(double)*min(k, DIPOLE_STATES));
+        ok = (close(fd) == 0) && ok;
+    }
+
+    if (!ok)
+    {
+        unlink(tmp);
+        free(tmp);
+        return 0;
+    }
+
+    char *path = entry_path(store, key);
+    pthread_mutex_lock(&store->lock);
+    flock(store->lock_fd, LOCK_EX);
+    ok = rename(tmp, path) == 0;
+    if (ok)
+    {
+        // the pending hits go in with the put so eviction sees them
+        record_use(store, key, bytes);
+        long index_bytes = flush_pending(store);
+        uint64_t total;
+        int known = read_total(store, &total);
+        total += bytes;
+        if (!known || total > store->max_bytes || index_bytes < 0 || index_bytes > STORE_INDEX_BYTES)
+            compact_index(store);
+        else
+            write_total(store, total);
+    }
+    else
+        unlink(tmp);
+    flock(store->lock_fd, LOCK_UN);
+    pthread_mutex_unlock(&store->lock);
+
+    free(path);
+    free(tmp);
+    return ok;
+}
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "telemetry.h"
+
+// Values below this many ns get a bucket each
+#define TELEMETRY_EXACT 256
+// Buckets per power of two above that
+#define TELEMETRY_STEPS 128
+// Durations are clamped below 2^44 ns, about 4.9 hours
+#define TELEMETRY_BITS 44
+#define TELEMETRY_BUCKETS (TELEMETRY_EXACT + (TELEMETRY_BITS - 8) * TELEMETRY_STEPS)
+
+typedef struct Histogram
+{
+    atomic_ullong counts[TELEMETRY_BUCKETS];
+    atomic_ullong total;
+    atomic_ullong sum_ns;
+    atomic_ullong max_ns;
+} Histogram;
+
+static Histogram histograms[METRIC_COUNT];
+
+static const struct
+{
+    const char *name;
+    const char *help;
+} metric_info[METRIC_COUNT] = {
+    {"frame_seconds", "Time between frames drawn back to back"},
+    {"queue_wait_seconds", "Time a 1D solve request waited for the solver thread"},
+    {"solve_seconds", "Solver thread time of published 1D solves"},
+    {"latency_seconds", "Request to publish of 1D solves"},
+    {"solve2d_seconds", "Solver thread time of published 2D solves"},
+};
+
+static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+static int bucket_of(uint64_t ns)
+{
+    if (ns < TELEMETRY_EXACT)
+        return (int) ns;
+    if (ns >> TELEMETRY_BITS)
+        ns = (UINT64_C(1) << TELEMETRY_BITS) - 1;
+    // shift brings the leading bit to 2^7, leaving 7 bits below it
+    int shift = 63 - __builtin_clzll(ns) - 7;
+    return TELEMETRY_EXACT + (shift - 1) * TELEMETRY_STEPS + (int) (ns >> shift) - TELEMETRY_STEPS;
+}
+
+// Middle of the durations a bucket holds, in ns
+static double bucket_value(int bucket)
+{
+    if (bucket < TELEMETRY_EXACT)
+        return bucket;
+    int shift = (bucket - TELEMETRY_EXACT) / TELEMETRY_STEPS + 1;
+    uint64_t lead = (bucket - TELEMETRY_EXACT) % TELEMETRY_STEPS + TELEMETRY_STEPS;
+    return (lead << shift) + 0.5 * ((UINT64_C(1) << shift) - 1);
+}
+
+void telemetry_record(Metric metric, double seconds)
+{
+    Histogram *h = &histograms[metric];
+    uint64_t ns = (seconds > 0) ? (uint64_t) (seconds * 1e9) : 0;
+    atomic_fetch_add_explicit(&h->counts[bucket_of(ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->total, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_ns, ns, memory_order_relaxed);
+
+    unsigned long long max = atomic_load_explicit(&h->max_ns, memory_order_relaxed);
+    while (ns > max
+        && !atomic_compare_exchange_weak_explicit(&h->max_ns, &max, ns, memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+long telemetry_count(Metric metric)
+{
+    return (long) atomic_load_explicit(&histograms[metric].total, memory_order_relaxed);
+}
+
+double telemetry_percentile(Metric metric, double p)
+{
+    Histogram *h = &histograms[metric];
+    unsigned long long total = atomic_load_explicit(&h->total, memory_order_relaxed);
+    if (total == 0)
+        return 0;
+
+    // rank of the wanted value, counting from 1
+    unsigned long long rank = (unsigned long long) (p * total + 0.5);
+    rank = (rank < 1) ? 1 : (rank > total) ? total : rank;
+    unsigned long long seen = 0;
+    for (int b = 0; b < TELEMETRY_BUCKETS; b++)
+    {
+        seen += atomic_load_explicit(&h->counts[b], memory_order_relaxed);
+        if (seen >= rank)
+            return bucket_value(b) * 1e-9;
+    }
+    // counts raced ahead of total
+    return atomic_load_explicit(&h->max_ns, memory_order_relaxed) * 1e-9;
+}
+
+void telemetry_reset()
+{
+    for (int m = 0; m < METRIC_COUNT; m++)
+    {
+        Histogram *h = &histograms[m];
+        for (int b = 0; b < TELEMETRY_BUCKETS; b++)
+            atomic_store_explicit(&h->counts[b], 0, memory_order_relaxed);
+        atomic_store_explicit(&h->total, 0, memory_order_relaxed);
+        atomic_store_explicit(&h->sum_ns, 0, memory_order_relaxed);
+        atomic_store_explicit(&h->max_ns, 0, memory_order_relaxed);
+    }
+}
+
+int telemetry_write_prometheus(const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if (out == NULL)
+        return 0;
+
+    for (int m = 0; m < METRIC_COUNT; m++)
+    {
+        Histogram *h = &histograms[m];
+        const char *name = metric_info[m].name;
+        fprintf(out, "# HELP schrodinger_%s %s\n", name, metric_info[m].help);
+        fprintf(out, "# TYPE schrodinger_%s summary\n", name);
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++)
+            fprintf(out, "schrodinger_%s{quantile=\"%g\"} %.9g\n", name, quantiles[q],
+                telemetry_percentile(m, quantiles[q]));
+        fprintf(out, "schrodinger_%s_sum %.9g\n", name, atomic_load(&h->sum_ns) * 1e-9);
+        fprintf(out, "schrodinger_%s_count %llu\n", name, atomic_load(&h->total));
+        fprintf(out, "# TYPE schrodinger_%s_max gauge\n", name);
+        fprintf(out, "schrodinger_%s_max %.9g\n", name, atomic_load(&h->max_ns) * 1e-9);
+    }
+    return fclose(out) == 0;
+}
+
+int telemetry_write_json(const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if (out == NULL)
+        return 0;
+
+    fprintf(out, "{\n");
+    for (int m = 0; m < METRIC_COUNT; m++)
+    {
+        Histogram *h = &histograms[m];
+        fprintf(out, "  \"%s\": {\"count\": %llu, \"sum\": %.9g, \"max\": %.9g", metric_info[m].name,
+            atomic_load(&h->total), atomic_load(&h->sum_ns) * 1e-9, atomic_load(&h->max_ns) * 1e-9);
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++)
+            fprintf(out, ", \"p%g\": %.9g", 100 * quantiles[q], telemetry_percentile(m, quantiles[q]));
+        fprintf(out, "}%s\n", (m < METRIC_COUNT - 1) ? "," : "");
+    }
+    fprintf(out, "}\n");
+    return fclose(out) == 0;
+}
+
+int telemetry_dump(const char *prefix)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s.prom", prefix);
+    int ok = telemetry_write_prometheus(path);
+    snprintf(path, sizeof(path), "%s.json", prefix);
+    return telemetry_write_json(path) && ok;
+}
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "thermal.h"
+#include "vecmath.h"
+
+// Points of a density row are summed in tiles of this many, with the rows
+// padded to match, so the accumulation has fixed trip counts and vectorizes
+#define THERMAL_TILE 4
+
+static void *thermal_malloc(size_t size)
+{
+    return solver_alloc(size, "thermal");
+}
+
+ThermalDensity *init_thermal(int n, double *domain)
+{
+    ThermalDensity *thermal = thermal_malloc(sizeof(ThermalDensity));
+    thermal->n = n;
+    thermal->stride = (n + THERMAL_TILE) / THERMAL_TILE * THERMAL_TILE;
+    thermal->potential = thermal_malloc(sizeof(Vector2)*(n+1));
+    thermal->have_potential = 0;
+    thermal->evalues = thermal_malloc(sizeof(double)*(n-1));
+    thermal->weights = thermal_malloc(sizeof(double)*(n-1));
+    thermal->densities = NULL;
+    thermal->solved = 0;
+    thermal->capacity = 0;
+    thermal->window = init_eigenpackage(1, n, domain);
+    thermal->sum = thermal_malloc(sizeof(double)*thermal->stride);
+    thermal->rho = thermal_malloc(sizeof(Vector2)*(n+1));
+    for(int i = 0; i <= n; i++)
+        thermal->rho[i] = (Vector2) { domain[i], 0.0 };
+    thermal->kT = -1;
+    thermal->tolerance = 0;
+    thermal->used = 0;
+    thermal->tail = 0;
+    return thermal;
+}
+
+void free_thermal(ThermalDensity *thermal)
+{
+    free(thermal->potential);
+    free(thermal->evalues);
+    free(thermal->weights);
+    free(thermal->densities);
+    free_eigenpackage(thermal->window);
+    free(thermal->sum);
+    free(thermal->rho);
+    free(thermal);
+}
+
+int thermal_states_needed(const double *evalues, int m, double kT, double tolerance, double *weights,
+    double *tail)
+{
+    if (kT <= 0)
+    {
+        weights[0] = 1;
+        for(int j = 1; j < m; j++)
+            weights[j] = 0;
+        if (tail != NULL)
+            *tail = 0;
+        return 1;
+    }
+
+    // exp() of anything below -700 is too small to matter next to the ground state
+    for(int j = 0; j < m; j++)
+        weights[j] = fmax(-(evalues[j] - evalues[0]) / kT, -700.0);
+    vexp(weights, weights, m);
+    double z = 0;
+    for(int j = 0; j < m; j++)
+        z += weights[j];
+
+    // drop states from the top while their weight stays within tolerance
+    int needed = m;
+    double left_out = 0;
+    while (needed > 1 && left_out + weights[needed-1] <= tolerance * z)
+        left_out += weights[--needed];
+    if (tail != NULL)
+        *tail = left_out / z;
+    return needed;
+}
+
+// Solves states thermal->solved..count-1 and appends their densities.
+// Returns 0 if cancelled, leaving the states held as they were.
+static int solve_states(ThermalDensity *thermal, Vector2 *potential, int count, SolveControl *ctl)
+{
+    int n = thermal->n;
+    int first = thermal->solved;
+    if (count > thermal->capacity)
+    {
+        double *grown = thermal_malloc(sizeof(double)*thermal->stride*count);
+        if (thermal->solved > 0)
+            memcpy(grown, thermal->densities, sizeof(double)*thermal->stride*thermal->solved);
+        free(thermal->densities);
+        thermal->densities = grown;
+        thermal->capacity = count;
+    }
+
+    EigenPackage *window = thermal->window;
+    if (solve_spectrum_window(potential, n, first, count - first, window, ctl) != 1)
+        return 0;
+    double dl = potential[1].x - potential[0].x;
+    for(int j = first; j < count; j++)
+    {
+        // unit eigenvectors, so |psi|^2 integrates to 1 once divided by dl
+        double *density = thermal->densities + (size_t) j*thermal->stride;
+        memset(density, 0, sizeof(double)*thermal->stride);
+        for(int i = 1; i < n; i++)
+        {
+            double psi = window->z[i-1][j-first];
+            density[i] = psi * psi / dl;
+        }
+    }
+    thermal->solved = count;
+    return 1;
+}
+
+static void add_density(const double *restrict density, double weight, int stride, double *restrict sum)
+{
+    for(int t = 0; t < stride; t += THERMAL_TILE)
+        for(int l = 0; l < THERMAL_TILE; l++)
+            sum[t+l] += weight * density[t+l];
+}
+
+int thermal_update(ThermalDensity *thermal, Vector2 *potential, double kT, double tolerance, SolveControl *ctl)
+{
+    int n = thermal->n;
+    if (!thermal->have_potential || memcmp(potential, thermal->potential, sizeof(Vector2)*(n+1)) != 0)
+    {
+        memcpy(thermal->potential, potential, sizeof(Vector2)*(n+1));
+        thermal->have_potential = 1;
+        thermal->solved = 0;
+        thermal->kT = -1;
+        if (!solve_eigenvalues(potential, n, thermal->evalues, ctl))
+        {
+            thermal->have_potential = 0;
+            return 0;
+        }
+    }
+    else if (kT == thermal->kT && tolerance == thermal->tolerance)
+        return thermal->used;
+
+    int needed = thermal_states_needed(thermal->evalues, n-1, kT, tolerance, thermal->weights, NULL);
+    needed = min(needed, THERMAL_MAX_STATES);
+    if (needed > thermal->solved)
+    {
+        // solve ahead while dragging towards higher temperatures
+        int count = max(needed, thermal->solved + thermal->solved / 2);
+        if (!solve_states(thermal, potential, min(count, min(THERMAL_MAX_STATES, n-1)), ctl))
+            return 0;
+    }
+
+    double kept = 0, left_out = 0;
+    for(int j = 0; j < n-1; j++)
+    {
+        if (j < needed)
+            kept += thermal->weights[j];
+        else
+            left_out += thermal->weights[j];
+    }
+    memset(thermal->sum, 0, sizeof(double)*thermal->stride);
+    for(int j = 0; j < needed; j++)
+        add_density(thermal->densities + (size_t) j*thermal->stride, thermal->weights[j] / kept,
+            thermal->stride, thermal->sum);
+    for(int i = 0; i <= n; i++)
+        thermal->rho[i].y = thermal->sum[i];
+
+    thermal->kT = kT;
+    thermal->tolerance = tolerance;
+    thermal->used = needed;
+    thermal->tail = left_out / (kept + left_out);
+    return needed;
+}
@@ -0,0 +1,267 @@
+#include <math.h>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "tridiag.h"
+#include "solver.h"
+
+// Smallest pivot allowed in the LDL^T recurrence before it is nudged away from 0
+#define PIVMIN (DBL_MIN / DBL_EPSILON)
+
+int sturm_count(const double *d, const double *e, int n, double x)
+{
+    // Counts negative pivots of T - xI = LDL^T
+    int count = 0;
+    double q = d[0] - x;
+    for(int i = 0; ; i++)
+    {
+        if (fabs(q) < PIVMIN)
+            q = -PIVMIN;
+        if (q < 0)
+            count++;
+        if (i == n-1)
+            break;
+        q = d[i+1] - x - e[i] * e[i] / q;
+    }
+    return count;
+}
+
+void gershgorin_bounds(const double *d, const double *e, int n, double *lo, double *hi)
+{
+    *lo = DBL_MAX;
+    *hi = -DBL_MAX;
+    for(int i = 0; i < n; i++)
+    {
+        double radius = 0;
+        if (i > 0)
+            radius += fabs(e[i-1]);
+        if (i < n-1)
+            radius += fabs(e[i]);
+        *lo = fmin(*lo, d[i] - radius);
+        *hi = fmax(*hi, d[i] + radius);
+    }
+    // keep the bounds strict so the counts at the ends are 0 and n
+    double pad = 2 * DBL_EPSILON * fmax(fabs(*lo), fabs(*hi)) + PIVMIN;
+    *lo -= pad;
+    *hi += pad;
+}
+
+void bisect_eigenvalues(const double *d, const double *e, int n, int il, int iu, double *out)
+{
+    double glo, ghi;
+    gershgorin_bounds(d, e, n, &glo, &ghi);
+
+    double lo = glo;
+    for(int j = il; j <= iu; j++)
+    {
+        // eigenvalue j lies in [lo, hi]. lo carries over from the previous
+        // eigenvalue since sturm_count(lo) <= j still holds
+        double hi = ghi;
+        while (hi - lo > 2 * DBL_EPSILON * fmax(fabs(lo), fabs(hi)) + PIVMIN)
+        {
+            double mid = 0.5 * (lo + hi);
+            if (mid <= lo || mid >= hi)
+                break;
+            if (sturm_count(d, e, n, mid) > j)
+                hi = mid;
+            else
+                lo = mid;
+        }
+        out[j - il] = 0.5 * (lo + hi);
+    }
+}
+
+int eigenvalue_window(const double *d, const double *e, int n, double lo, double hi, int *il, int *iu)
+{
+    *il = sturm_count(d, e, n, lo);
+    *iu = (hi > lo) ? sturm_count(d, e, n, hi) - 1 : *il - 1;
+    return *iu - *il + 1;
+}
+
+// P(T - shift I) = LU by Gaussian elimination with row interchanges. U has
+// two superdiagonals u1 and u2, L the multipliers l, and swap[i] records
+// whether rows i and i+1 were exchanged.
+typedef struct ShiftedLU
+{
+    double *u0;
+    double *u1;
+    double *u2;
+    double *l;
+    char *swap;
+} ShiftedLU;
+
+// Storage for f, from arena when there is one and else from the heap
+static void take_shifted(ShiftedLU *f, int n, Arena *arena, const char *who)
+{
+    size_t bytes = sizeof(double) * 4 * n + n;
+    double *work = (arena != NULL) ? arena_take(arena, bytes) : solver_alloc(bytes, who);
+    f->u0 = work;
+    f->u1 = work + n;
+    f->u2 = work + 2*n;
+    f->l = work + 3*n;
+    f->swap = (char*) (work + 4*n);
+}
+
+static void give_shifted(ShiftedLU *f, Arena *arena, ArenaMark mark)
+{
+    if (arena != NULL)
+        arena_release(arena, mark);
+    else
+        free(f->u0);
+}
+
+static void factor_shifted(const double *d, const double *e, int n, double shift, double tiny, ShiftedLU *f)
+{
+    // the row being eliminated only ever has entries in columns i and i+1
+    f->u0[0] = d[0] - shift;
+    f->u1[0] = (n > 1) ? e[0] : 0;
+    for(int i = 0; i < n-1; i++)
+    {
+        double sub = e[i];
+        double diag = d[i+1] - shift;
+        double super = (i < n-2) ? e[i+1] : 0;
+        if (fabs(f->u0[i]) >= fabs(sub))
+        {
+            f->swap[i] = 0;
+            f->l[i] = (f->u0[i] != 0) ? sub / f->u0[i] : 0;
+            f->u2[i] = 0;
+            f->u0[i+1] = diag - f->l[i] * f->u1[i];
+            f->u1[i+1] = super;
+        }
+        else
+        {
+            f->swap[i] = 1;
+            f->l[i] = f->u0[i] / sub;
+            double above = f->u1[i];
+            f->u0[i] = sub;
+            f->u1[i] = diag;
+            f->u2[i] = super;
+            f->u0[i+1] = above - f->l[i] * diag;
+            f->u1[i+1] = -f->l[i] * super;
+        }
+    }
+    f->u2[n-1] = 0;
+    if (n > 1)
+        f->u2[n-2] = 0;
+
+    // a shift at an eigenvalue makes U singular; a tiny pivot instead just
+    // makes the solution grow along the eigenvector, which is the point
+    for(int i = 0; i < n; i++)
+    {
+        if (fabs(f->u0[i]) < tiny)
+            f->u0[i] = (f->u0[i] < 0) ? -tiny : tiny;
+    }
+}
+
+static void solve_shifted(const ShiftedLU *f, int n, double *x)
+{
+    for(int i = 0; i < n-1; i++)
+    {
+        if (f->swap[i])
+        {
+            double t = x[i];
+            x[i] = x[i+1];
+            x[i+1] = t;
+        }
+        x[i+1] -= f->l[i] * x[i];
+    }
+    for(int i = n-1; i >= 0; i--)
+    {
+        double s = x[i];
+        if (i < n-1)
+            s -= f->u1[i] * x[i+1];
+        if (i < n-2)
+            s -= f->u2[i] * x[i+2];
+        x[i] = s / f->u0[i];
+    }
+}
+
+static double normalize(double *x, int n)
+{
+    double norm = 0;
+    for(int i = 0; i < n; i++)
+        norm += x[i] * x[i];
+    norm = sqrt(norm);
+    for(int i = 0; i < n; i++)
+        x[i] /= norm;
+    return norm;
+}
+
+void inverse_iteration_history(const double *d, const double *e, int n, const double *evalues, int j,
+    const double *history, int slots, double *x, Arena *arena)
+{
+    double glo, ghi;
+    gershgorin_bounds(d, e, n, &glo, &ghi);
+    double width = fmax(ghi - glo, PIVMIN);
+    double tiny = DBL_EPSILON * width;
+    // Vectors of eigenvalues closer than this are kept orthogonal explicitly
+    double cluster_gap = 1e-5 * width;
+
+    // Start of the cluster evalues[j] is in. Equal shifts would give equal
+    // vectors, so shifts within a cluster are kept at least 10 tiny apart.
+    int cluster = j;
+    while (cluster > 0 && evalues[cluster] - evalues[cluster-1] <= cluster_gap)
+        cluster--;
+    double shift = evalues[cluster];
+    for(int i = cluster+1; i <= j; i++)
+        shift = fmax(evalues[i], shift + 10 * tiny);
+
+    ShiftedLU f;
+    ArenaMark mark = (arena != NULL) ? arena_mark(arena) : (ArenaMark) { 0, 0, NULL };
+    take_shifted(&f, n, arena, "inverse_iteration");
+    factor_shifted(d, e, n, shift, tiny, &f);
+
+    uint64_t seed = 0x9e3779b97f4a7c15ull ^ (uint64_t) j;
+    for(int i = 0; i < n; i++)
+    {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        x[i] = (double) (seed >> 11) / 9007199254740992.0 - 0.5;
+    }
+    normalize(x, n);
+
+    // Each solve grows the wanted component by about 1/tiny relative to the
+    // rest. Once it has, one more solve cleans up what is left.
+    int oldest = (cluster > j - slots) ? cluster : j - slots;
+    int extra = -1;
+    for(int iter = 0; iter < 5 && extra != 0; iter++)
+    {
+        solve_shifted(&f, n, x);
+        for(int c = oldest; c < j; c++)
+        {
+            const double *v = history + (size_t) (c % slots) * n;
+            double dot = 0;
+            for(int i = 0; i < n; i++)
+                dot += v[i] * x[i];
+            for(int i = 0; i < n; i++)
+                x[i] -= dot * v[i];
+        }
+        double growth = normalize(x, n);
+        if (extra > 0)
+            extra--;
+        else if (extra < 0 && growth * tiny > 1e-3)
+            extra = 1;
+    }
+    give_shifted(&f, arena, mark);
+}
+
+void inverse_iteration(const double *d, const double *e, int n, const double *evalues, int j, double *vectors,
+    Arena *arena)
+{
+    int slots = (j > 0) ? j : 1;
+    inverse_iteration_history(d, e, n, evalues, j, vectors, slots, vectors + (size_t) j * n, arena);
+}
+
+void shifted_solve(const double *d, const double *e, int n, double shift, double *x, Arena *arena)
+{
+    double glo, ghi;
+    gershgorin_bounds(d, e, n, &glo, &ghi);
+    double tiny = DBL_EPSILON * fmax(ghi - glo, PIVMIN);
+
+    ShiftedLU f;
+    ArenaMark mark = (arena != NULL) ? arena_mark(arena) : (ArenaMark) { 0, 0, NULL };
+    take_shifted(&f, n, arena, "shifted_solve");
+    factor_shifted(d, e, n, shift, tiny, &f);
+    solve_shifted(&f, n, x);
+    give_shifted(&f, arena, mark);
+}
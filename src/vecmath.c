@@ -0,0 +1,150 @@
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "vecmath.h"
+
+// Lanes are processed in fixed-size blocks through local buffers. The fixed
+// trip count and the lack of aliasing let compilers vectorize without
+// runtime checks or scalar epilogues.
+#define VEC_BLOCK 256
+
+// Adding and subtracting 1.5 * 2^52 rounds a double to the nearest integer
+#define ROUND_SHIFT 6755399441055744.0
+
+#define LOG2E 1.44269504088896338700
+#define LN2_HI 6.93147180369123816490e-01
+#define LN2_LO 1.90821492927058770002e-10
+
+#define TWO_OVER_PI 6.36619772367581382433e-01
+// pi/2 split in three so k * PIO2_1 and k * PIO2_2 are exact for |k| < 2^20
+#define PIO2_1 1.57079632673412561417e+00
+#define PIO2_2 6.07710050630396597660e-11
+#define PIO2_3 2.02226624879595063154e-21
+
+static inline double round_nearest(double x)
+{
+    return (x + ROUND_SHIFT) - ROUND_SHIFT;
+}
+
+// 2^k for an integer-valued k in [-1022, 1023], built from the exponent bits
+static inline double pow2_exact(double k)
+{
+    // the low mantissa bits of t hold k + 2^51
+    double t = k + ROUND_SHIFT;
+    uint64_t bits;
+    memcpy(&bits, &t, sizeof(bits));
+    bits = (bits + 1023) << 52;
+    double scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return scale;
+}
+
+static void exp_block(const double *restrict in, double *restrict res)
+{
+    for (int i = 0; i < VEC_BLOCK; i++)
+    {
+        double v = in[i];
+        v = v < -1400.0 ? -1400.0 : v;
+        v = v > 1400.0 ? 1400.0 : v;
+
+        // e^v = 2^k * e^r with |r| <= ln2 / 2
+        double k = round_nearest(v * LOG2E);
+        double r = v - k * LN2_HI - k * LN2_LO;
+
+        double p = 1.0 / 6227020800.0;
+        p = p * r + 1.0 / 479001600.0;
+        p = p * r + 1.0 / 39916800.0;
+        p = p * r + 1.0 / 3628800.0;
+        p = p * r + 1.0 / 362880.0;
+        p = p * r + 1.0 / 40320.0;
+        p = p * r + 1.0 / 5040.0;
+        p = p * r + 1.0 / 720.0;
+        p = p * r + 1.0 / 120.0;
+        p = p * r + 1.0 / 24.0;
+        p = p * r + 1.0 / 6.0;
+        p = p * r + 0.5;
+        p = p * r + 1.0;
+        p = p * r + 1.0;
+
+        // Scaling in two halves lets results underflow to 0 and overflow to
+        // inf naturally instead of needing a branch
+        double k1 = round_nearest(k * 0.5);
+        res[i] = p * pow2_exact(k1) * pow2_exact(k - k1);
+    }
+}
+
+// sin(x + offset * pi/2) for offset 0 or 1
+static void sincos_block(const double *restrict in, double *restrict res, double offset)
+{
+    for (int i = 0; i < VEC_BLOCK; i++)
+    {
+        double v = in[i];
+
+        // v = k * pi/2 + r with |r| <= pi/4
+        double k = round_nearest(v * TWO_OVER_PI);
+        double r = v - k * PIO2_1 - k * PIO2_2 - k * PIO2_3;
+        double r2 = r * r;
+
+        double s = -1.0 / 1307674368000.0;
+        s = s * r2 + 1.0 / 6227020800.0;
+        s = s * r2 - 1.0 / 39916800.0;
+        s = s * r2 + 1.0 / 362880.0;
+        s = s * r2 - 1.0 / 5040.0;
+        s = s * r2 + 1.0 / 120.0;
+        s = s * r2 - 1.0 / 6.0;
+        s = s * r2 * r + r;
+
+        double c = 1.0 / 20922789888000.0;
+        c = c * r2 - 1.0 / 87178291200.0;
+        c = c * r2 + 1.0 / 479001600.0;
+        c = c * r2 - 1.0 / 3628800.0;
+        c = c * r2 + 1.0 / 40320.0;
+        c = c * r2 - 1.0 / 720.0;
+        c = c * r2 + 1.0 / 24.0;
+        c = c * r2 - 0.5;
+        c = c * r2 + 1.0;
+
+        // quadrant q = (k + offset) mod 4 in {0, 1, 2, 3}, all in doubles
+        double kk = k + offset;
+        double q = kk - 4.0 * round_nearest(kk * 0.25 - 0.375);
+        double high = round_nearest(q * 0.5 - 0.25); // 1 for q = 2, 3
+        double odd = q - 2.0 * high; // 1 for q = 1, 3
+
+        res[i] = (1.0 - 2.0 * high) * (s + odd * (c - s));
+    }
+}
+
+// Runs a block kernel over n values, padding the last block with zeros
+static void run_blocks(const double *x, double *out, size_t n, int which)
+{
+    double in[VEC_BLOCK];
+    double res[VEC_BLOCK];
+    for (size_t base = 0; base < n; base += VEC_BLOCK)
+    {
+        size_t m = (n - base < VEC_BLOCK) ? n - base : VEC_BLOCK;
+        memcpy(in, x + base, sizeof(double)*m);
+        for (size_t i = m; i < VEC_BLOCK; i++)
+            in[i] = 0.0;
+
+        if (which == 0)
+            exp_block(in, res);
+        else
+            sincos_block(in, res, which == 1 ? 0.0 : 1.0);
+        memcpy(out + base, res, sizeof(double)*m);
+    }
+}
+
+void vexp(const double *x, double *out, size_t n)
+{
+    run_blocks(x, out, n, 0);
+}
+
+void vsin(const double *x, double *out, size_t n)
+{
+    run_blocks(x, out, n, 1);
+}
+
+void vcos(const double *x, double *out, size_t n)
+{
+    run_blocks(x, out, n, 2);
+}
@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include "workspace.h"
+#include "solver.h"
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+// A block handed out from the heap because the buffer was full
+struct ArenaSpill
+{
+    struct ArenaSpill *next;
+    max_align_t data[];
+};
+
+Workspace *init_workspace()
+{
+    Workspace *work = solver_alloc(sizeof(Workspace), "init_workspace");
+    memset(work, 0, sizeof(Workspace));
+    pthread_mutex_init(&work->lock, NULL);
+    pthread_cond_init(&work->start, NULL);
+    pthread_cond_init(&work->done, NULL);
+    return work;
+}
+
+void free_workspace(Workspace *work)
+{
+    if (work == NULL)
+        return;
+    pthread_mutex_lock(&work->lock);
+    work->quit = 1;
+    pthread_cond_broadcast(&work->start);
+    pthread_mutex_unlock(&work->lock);
+    for(int t = 1; t <= work->num_threads; t++)
+        pthread_join(work->threads[t].thread, NULL);
+    pthread_mutex_destroy(&work->lock);
+    pthread_cond_destroy(&work->start);
+    pthread_cond_destroy(&work->done);
+
+    for(int t = 0; t < WORKSPACE_THREADS; t++)
+    {
+        arena_release(&work->arenas[t], (ArenaMark) { 0, 0, NULL });
+        free(work->arenas[t].block);
+    }
+    free(work);
+}
+
+Arena *workspace_arena(Workspace *work, int t)
+{
+    return &work->arenas[t];
+}
+
+ArenaMark arena_mark(const Arena *arena)
+{
+    return (ArenaMark) { arena->used, arena->spilled, arena->spills };
+}
+
+void *arena_take(Arena *arena, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+    void *p;
+    if (arena->size - arena->used >= size)
+    {
+        p = arena->block + arena->used;
+        arena->used += size;
+    }
+    else
+    {
+        struct ArenaSpill *spill = solver_alloc(sizeof(struct ArenaSpill) + size, "arena_take");
+        spill->next = arena->spills;
+        arena->spills = spill;
+        arena->spilled += size;
+        p = spill->data;
+    }
+    if (arena->used + arena->spilled > arena->peak)
+        arena->peak = arena->used + arena->spilled;
+    return p;
+}
+
+void arena_release(Arena *arena, ArenaMark mark)
+{
+    while (arena->spills != mark.spills)
+    {
+        struct ArenaSpill *spill = arena->spills;
+        arena->spills = spill->next;
+        free(spill);
+    }
+    arena->used = mark.used;
+    arena->spilled = mark.spilled;
+
+    if (arena->used == 0 && arena->spilled == 0)
+    {
+        // Nothing is out, so the buffer can move
+        if (arena->peak > arena->size)
+        {
+            free(arena->block);
+            arena->block = solver_alloc(arena->peak, "arena_release");
+            arena->size = arena->peak;
+        }
+        arena->peak = 0;
+    }
+}
+
+static void *workspace_thread(void *arg)
+{
+    WorkspaceThread *self = arg;
+    Workspace *work = self->work;
+    pthread_mutex_lock(&work->lock);
+    while (1)
+    {
+        while (!work->quit && work->job == self->seen)
+            pthread_cond_wait(&work->start, &work->lock);
+        if (work->quit)
+            break;
+        self->seen = work->job;
+        if (self->index >= work->count)
+            continue;
+
+        void *task = work->tasks + work->stride * self->index;
+        void *(*run)(void *) = work->run;
+        pthread_mutex_unlock(&work->lock);
+        run(task);
+        pthread_mutex_lock(&work->lock);
+        if (--work->remaining == 0)
+            pthread_cond_signal(&work->done);
+    }
+    pthread_mutex_unlock(&work->lock);
+    return NULL;
+}
+
+void workspace_run(Workspace *work, void *(*run)(void *), void *tasks, size_t stride, int count)
+{
+    pthread_mutex_lock(&work->lock);
+    while (work->num_threads < count-1)
+    {
+        WorkspaceThread *thread = &work->threads[work->num_threads + 1];
+        *thread = (WorkspaceThread) { .work = work, .index = work->num_threads + 1, .seen = work->job };
+        if (pthread_create(&thread->thread, NULL, workspace_thread, thread) != 0)
+        {
+            fprintf(stderr, "workspace_run: pthread_create failed\n");
+            exit(1);
+        }
+        work->num_threads++;
+    }
+    work->run = run;
+    work->tasks = tasks;
+    work->stride = stride;
+    work->count = count;
+    work->remaining = count-1;
+    work->job++;
+    pthread_cond_broadcast(&work->start);
+    pthread_mutex_unlock(&work->lock);
+
+    run(tasks);
+
+    pthread_mutex_lock(&work->lock);
+    while (work->remaining > 0)
+        pthread_cond_wait(&work->done, &work->lock);
+    pthread_mutex_unlock(&work->lock);
+}
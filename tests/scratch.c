@@ -1,4 +1,4 @@
-#include "../src/solver.h"
+#include "solver.h"
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -1,8 +1,38 @@
 // Tests are primarily for the eigenvector/eigenvalue solver
 // And the sorting function
-#include "../src/solver.h"
+#define _GNU_SOURCE
+#include "solver.h"
+#include "tridiag.h"
+#include "slice.h"
+#include "mrrr.h"
+#include "perturb.h"
+#include "thermal.h"
+#include "continuation.h"
+#include "spectrumcache.h"
+#include "spectrumstore.h"
+#include "expr.h"
+#include "potential.h"
+#include "lanczos2d.h"
+#include "scatter.h"
+#include "eigenexport.h"
+#include "telemetry.h"
+#include "perfcounters.h"
+#include "autotune.h"
+#include "livesolver.h"
+#include "livethermal.h"
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <utime.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
 #include <criterion/criterion.h>
 #include <math.h>
+#include <string.h>
 
 const double eps = 0.005;
 
@@ -11,6 +41,37 @@ int within(double a, double b, double EPS)
     return fabs(a - b) < EPS;
 }
 
+// Makes a fresh directory for a test that writes files, so that tests run
+// from anywhere and side by side, and writes its path to dir
+static void make_test_dir(char *dir, size_t size)
+{
+    const char *tmp = getenv("TMPDIR");
+    snprintf(dir, size, "%s/schrodinger-test-XXXXXX", (tmp != NULL && tmp[0] != '\0') ? tmp : "/tmp");
+    cr_assert(mkdtemp(dir) != NULL);
+}
+
+// Removes dir with everything in it
+static void remove_test_dir(const char *dir)
+{
+    DIR *listing = opendir(dir);
+    if (listing == NULL)
+        return;
+    for(struct dirent *entry; (entry = readdir(listing)) != NULL;)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        struct stat st;
+        if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode))
+            remove_test_dir(path);
+        else
+            unlink(path);
+    }
+    closedir(listing);
+    rmdir(dir);
+}
+
 Test(solver_tests, I_creation)
 {
     double **I = create_identity(5);
@@ -150,3 +211,1217 @@ Test(sort_test_eigs, sort_01)
 
     free_square_matrix(evectors, n);
 }
+
+double harmonic(double x)
+{
+    return 4*(x-0.5)*(x-0.5);
+}
+
+// Sends every solve down the partial path on two threads
+static void partial_planner(int n, int k, SolvePlan *plan)
+{
+    plan->partial = 1;
+    plan->threads = 2;
+}
+
+// Counts every malloc, mmap and new thread of the process while counting is
+// set, including the ones libc makes for the solver: qsort's buffer, thread
+// stacks. Elsewhere only solver_alloc() is counted.
+static atomic_int counting;
+static atomic_long process_allocs;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static void count_alloc()
+{
+    if (atomic_load_explicit(&counting, memory_order_relaxed))
+        atomic_fetch_add(&process_allocs, 1);
+}
+
+void *malloc(size_t size)
+{
+    count_alloc();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    count_alloc();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    count_alloc();
+    return __libc_realloc(ptr, size);
+}
+
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+    static void *(*next)(void *, size_t, int, int, int, off_t);
+    if (next == NULL)
+        next = (void *(*)(void *, size_t, int, int, int, off_t)) dlsym(RTLD_NEXT, "mmap");
+    count_alloc();
+    return next(addr, length, prot, flags, fd, offset);
+}
+
+// libc maps thread stacks without going through mmap()
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*run)(void *), void *arg)
+{
+    static int (*next)(pthread_t *, const pthread_attr_t *, void *(*)(void *), void *);
+    if (next == NULL)
+        next = (int (*)(pthread_t *, const pthread_attr_t *, void *(*)(void *), void *)) dlsym(RTLD_NEXT, "pthread_create");
+    count_alloc();
+    return next(thread, attr, run, arg);
+}
+#endif
+
+static void count_allocs(int on)
+{
+    atomic_store(&counting, on);
+}
+
+static long allocs_counted()
+{
+#ifdef __GLIBC__
+    return atomic_load(&process_allocs);
+#else
+    return solver_alloc_count();
+#endif
+}
+
+Test(solver_tests, steady_state_no_alloc)
+{
+    // big enough that glibc's qsort() would malloc its buffer
+    int n = 600;
+    double *domain = create_domain(0, 1, n);
+    Vector2 *potential = apply_potential(domain, n, &harmonic);
+    EigenPackage *epkg = init_eigenpackage(3, n, domain);
+    struct SolverPkg pkg = { .potential=potential, .n=n, .num_eigenfunctions=3, .epkg=epkg };
+
+    solve_spectrum(&pkg);
+    long allocs = allocs_counted();
+    count_allocs(1);
+    solve_spectrum(&pkg);
+    solve_spectrum(&pkg);
+    count_allocs(0);
+    cr_assert(allocs_counted() == allocs);
+
+    // asking for fewer eigenfunctions reuses the rows too
+    pkg.num_eigenfunctions = 2;
+    count_allocs(1);
+    solve_spectrum(&pkg);
+    count_allocs(0);
+    cr_assert(allocs_counted() == allocs);
+
+    for(int i = 1; i < n-1; i++)
+        cr_assert(epkg->evalues[i-1] <= epkg->evalues[i]);
+
+    double area = 0;
+    for(int i = 0; i <= n; i++)
+        area += epkg->efunctions[0][i].y;
+    cr_assert(within(area / n, 1.0, eps));
+
+    // so does the partial path, with slicing and MRRR split across threads
+    // that are started once
+    int big = 2000;
+    double *wide = create_domain(0, 1, big);
+    Vector2 *well = apply_potential(wide, big, &harmonic);
+    EigenPackage *partial = init_eigenpackage(40, big, wide);
+    struct SolverPkg partial_pkg = { .potential=well, .n=big, .num_eigenfunctions=40, .epkg=partial };
+    solver_set_planner(&partial_planner);
+    solve_spectrum(&partial_pkg);
+    allocs = allocs_counted();
+    count_allocs(1);
+    solve_spectrum(&partial_pkg);
+    solve_spectrum(&partial_pkg);
+    count_allocs(0);
+    long partial_allocs = allocs_counted() - allocs;
+    solver_set_planner(NULL);
+    cr_assert(partial_allocs == 0);
+    cr_assert(partial->z_columns == 40);
+
+    free_eigenpackage(partial);
+    free(well);
+    free(wide);
+    free_eigenpackage(epkg);
+    free(potential);
+    free(domain);
+}
+
+Test(solver_tests, cancelled_tqli)
+{
+    int n = 40;
+    double *d = malloc(sizeof(double)*n);
+    double *e = malloc(sizeof(double)*n);
+    double **z = create_identity(n);
+    for(int i = 0; i < n; i++) {
+        d[i] = 2.0 + i;
+        e[i] = -1.0;
+    }
+    SolveControl ctl;
+    init_solvecontrol(&ctl);
+    atomic_store(&ctl.cancel, 1);
+    cr_assert(tqli_ctl(d, e, z, n, &ctl) == 0);
+    cr_assert(atomic_load(&ctl.progress) == 0);
+
+    atomic_store(&ctl.cancel, 0);
+    cr_assert(tqli_ctl(d, e, z, n, &ctl) == 1);
+    cr_assert(atomic_load(&ctl.progress) == n);
+    cr_assert(atomic_load(&ctl.total) == n);
+
+    // a cancelled solve still closes its profiling stage
+    double *domain = create_domain(0, 1, n);
+    Vector2 *potential = apply_potential(domain, n, &harmonic);
+    EigenPackage *epkg = init_eigenpackage(2, n, domain);
+    PerfProfile *profile = init_perfprofile();
+    struct SolverPkg pkg = { .potential=potential, .n=n, .num_eigenfunctions=2, .epkg=epkg,
+        .control=&ctl, .profile=profile };
+    atomic_store(&ctl.cancel, 1);
+    cr_assert(solve_spectrum(&pkg) == NULL);
+    cr_assert(profile->runs[STAGE_TQLI] == 1);
+
+    free_perfprofile(profile);
+    free_eigenpackage(epkg);
+    free(potential);
+    free(domain);
+    free_square_matrix(z, n);
+    free(d);
+    free(e);
+}
+
+Test(solver_tests, values_only_matches_bisection)
+{
+    int n = 80;
+    double *domain = create_domain(0, 1, n);
+    Vector2 *potential = apply_potential(domain, n, &harmonic);
+    double *evalues = malloc(sizeof(double)*(n-1));
+    double *d = malloc(sizeof(double)*(n-1));
+    double *e = malloc(sizeof(double)*(n-1));
+    double window[5];
+
+    cr_assert(solve_eigenvalues(potential, n, evalues, NULL) == 1);
+    assemble_hamiltonian(potential, n, d, e);
+    bisect_eigenvalues(d, e, n-1, 10, 14, window);
+
+    for(int i = 0; i < 5; i++)
+        cr_assert(within(window[i], evalues[10+i], 1e-6 * fabs(evalues[10+i])));
+    cr_assert(sturm_count(d, e, n-1, 0.5 * (evalues[3] + evalues[4])) == 4);
+
+    free(e);
+    free(d);
+    free(evalues);
+    free(potential);
+    free(domain);
+}
+
+Test(solver_tests, window_matches_full_solve)
+{
+    int n = 120;
+    double *domain = create_domain(0, 1, n);
+    Vector2 *potential = apply_potential(domain, n, &harmonic);
+    EigenPackage *full = init_eigenpackage(50, n, domain);
+    EigenPackage *window = init_eigenpackage(6, n, domain);
+    struct SolverPkg pkg = { .potential=potential, .n=n, .num_eigenfunctions=50, .epkg=full };
+    cr_assert(solve_spectrum(&pkg) != NULL);
+
+    cr_assert(solve_spectrum_window(potential, n, 40, 6, window, NULL) == 1);
+    cr_assert(window->first == 40 && window->num_evalues == 6);
+    for(int j = 0; j < 6; j++)
+    {
+        cr_assert(within(window->evalues[j], full->evalues[40+j], 1e-8 * full->evalues[40+j]));
+        for(int i = 0; i <= n; i++)
+            cr_assert(within(window->efunctions[j][i].y, full->efunctions[40+j][i].y, 1e-4));
+    }
+
+    // the window of an energy interval comes from Sturm counts alone
+    int first;
+    double lo = 0.5 * (full->evalues[11] + full->evalues[12]);
+    double hi = 0.5 * (full->evalues[19] + full->evalues[20]);
+    cr_assert(spectrum_window(potential, n, lo, hi, &first) == 8);
+    cr_assert(first == 12);
+
+    // windows past the last state are refused, and a cancelled solve leaves
+    // the previous one in place
+    cr_assert(solve_spectrum_window(potential, n, n-4, 6, window, NULL) == -1);
+    cr_assert(solve_spectrum_window(potential, n, -1, 6, window, NULL) == -1);
+    SolveControl ctl;
+    init_solvecontrol(&ctl);
+    atomic_store(&ctl.cancel, 1);
+    double kept = window->evalues[0];
+    cr_assert(solve_spectrum_window(potential, n, 10, 6, window, &ctl) == 0);
+    cr_assert(window->evalues[0] == kept && window->first == 40 && window->z_columns == 6);
+
+    free_eigenpackage(window);
+    free_eigenpackage(full);
+    free(potential);
+    free(domain);
+}
+
+Test(solver_tests, rank_update_matches_full_solve)
+{
+    int n = 400;
+    int k = 10;
+    double *domain = create_domain(0, 1, n);
+    Vector2 *before = apply_potential(domain, n, &harmonic);
+    Vector2 *after = apply_potential(domain, n, &harmonic);
+    after[150].y += 0.05;
+    after[151].y -= 0.02;
+    EigenPackage *previous = init_eigenpackage(k, n, domain);
+    EigenPackage *updated = init_eigenpackage(k, n, domain);
+    EigenPackage *fresh = init_eigenpackage(k, n, domain);
+    struct SolverPkg pkg = { .potential=before, .n=n, .num_eigenfunctions=k, .epkg=previous };
+    cr_assert(solve_spectrum(&pkg) != NULL);
+    pkg.potential = after;
+    pkg.epkg = fresh;
+    cr_assert(solve_spectrum(&pkg) != NULL);
+
+    pkg.epkg = updated;
+    cr_assert(solve_spectrum_update(&pkg, before, previous) == 1);
+    cr_assert(updated->z_columns == n-1 && updated->num_efunctions == k);
+    double scale = fresh->evalues[n-2];
+    for(int j = 0; j < n-1; j++)
+        cr_assert(within(updated->evalues[j], fresh->evalues[j], 1e-12 * scale));
+    for(int j = 0; j < k; j++)
+        for(int i = 0; i <= n; i++)
+            cr_assert(within(updated->efunctions[j][i].y, fresh->efunctions[j][i].y, 1e-6));
+    for(int a = 0; a < n-1; a += 37)
+    {
+        for(int b = 0; b <= a; b++)
+        {
+            double dot = 0;
+            for(int i = 0; i < n-1; i++)
+                dot += updated->z[i][a] * updated->z[i][b];
+            cr_assert(within(dot, (a == b) ? 1.0 : 0.0, 1e-12));
+        }
+    }
+
+    // a wider change is left to a fresh solve
+    for(int i = 100; i < 140; i++)
+        after[i].y += 0.01;
+    cr_assert(solve_spectrum_update(&pkg, before, previous) == -1);
+
+    free_eigenpackage(fresh);
+    free_eigenpackage(updated);
+    free_eigenpackage(previous);
+    free(after);
+    free(before);
+    free(domain);
+}
+
+// Partial solves beat full ones, and a rank-one update beats both
+static void predicting_planner(int n, int k, SolvePlan *plan)
+{
+    plan->partial = 1;
+    plan->threads = 2;
+    plan->seconds = 1e-2;
+    plan->full_seconds = 2e-2;
+    plan->update_seconds = 1e-4;
+}
+
+static void wait_published(LiveSolver *live, unsigned long request)
+{
+    while (livesolver_published(live) < request)
+        usleep(1000);
+}
+
+Test(solver_tests, live_updates_under_partial_plan)
+{
+    int n = 400;
+    int k = 10;
+    double *domain = create_domain(0, 1, n);
+    Vector2 *potential = apply_potential(domain, n, &harmonic);
+    EigenPackage *fresh = init_eigenpackage(k, n, domain);
+    LiveSolver *live = init_livesolver(n, k, domain);
+    // spectra stored by earlier runs would be looked up instead
+    pthread_mutex_lock(&live->lock);
+    if (live->store != NULL)
+        close_spectrumstore(live->store);
+    live->store = NULL;
+    pthread_mutex_unlock(&live->lock);
+    solver_set_planner(&predicting_planner);
+
+    livesolver_request(live, potential, k);
+    wait_published(live, 1);
+    cr_assert(live->front->z_columns == k && live->front_updates == -1);
+
+    // the first stroke keeps every vector so that the next ones can update
+    potential[150].y += 0.05;
+    livesolver_request(live, potential, k);
+    wait_published(live, 2);
+    cr_assert(live->front->z_columns == n-1 && live->front_updates == 0);
+
+    potential[200].y -= 0.03;
+    potential[201].y += 0.02;
+    livesolver_request(live, potential, k);
+    wait_published(live, 3);
+    cr_assert(live->front_updates == 1);
+    struct SolverPkg pkg = { .potential=potential, .n=n, .num_eigenfunctions=k, .epkg=fresh };
+    cr_assert(solve_spectrum(&pkg) != NULL);
+    double scale = fresh->evalues[n-2];
+    for(int j = 0; j < k; j++)
+        cr_assert(within(live->front->evalues[j], fresh->evalues[j], 1e-12 * scale));
+    for(int j = 0; j < k; j++)
+        for(int i = 0; i <= n; i++)
+            cr_assert(within(live->front->efunctions[j][i].y, fresh->efunctions[j][i].y, 1e-6));
+
+    // without predictions a partial plan is followed as is
+    solver_set_planner(&partial_planner);
+    potential[250].y += 0.05;
+    livesolver_request(live, potential, k);
+    wait_published(live, 4);
+    cr_assert(live->front->z_columns == k && live->front_updates == -1);
+    solver_set_planner(NULL);
+
+    free_livesolver(live);
+    free_eigenpackage(fresh);
+    free(potential);
+    free(domain);
+}
+
+Test(solver_tests, perturbative_preview_is_first_order)
+{
+    int n = 300;
+    int k = 6;
+    double *domain = create_domain(0, 1, n);
+    Vector2 *before = apply_potential(domain, n, &harmonic);
+    Vector2 *after = apply_potential(domain, n, &harmonic);
+    for(int i = 100; i < 170; i++)
+        after[i].y += 0.002;
+    EigenPackage *previous = init_eigenpackage(k, n, domain);
+    EigenPackage *fresh = init_eigenpackage(k, n, domain);
+    EigenPackage *preview = init_eigenpackage(k, n, domain);
+    struct SolverPkg pkg = { .potential=before, .n=n, .num_eigenfunctions=k, .epkg=previous };
+    cr_assert(solve_spectrum(&pkg) != NULL);
+    pkg.potential = after;
+    pkg.epkg = fresh;
+    cr_assert(solve_spectrum(&pkg) != NULL);
+
+    cr_assert(perturb_preview(previous, before, after, n, preview) == 1);
+    cr_assert(preview->num_evalues == k && preview->num_efunctions == k && preview->z_columns == 0);
+    for(int j = 0; j < k; j++)
+    {
+        // second order errors are far below the first order shift
+        double shift = fresh->evalues[j] - previous->evalues[j];
+        cr_assert(fabs(shift) > 0.1);
+        cr_assert(fabs(preview->evalues[j] - fresh->evalues[j]) < 0.05 * fabs(shift));
+        double stale = 0, estimated = 0;
+        for(int i = 0; i <= n; i++)
+        {
+            stale = fmax(stale, fabs(previous->efunctions[j][i].y - fresh->efunctions[j][i].y));
+            estimated = fmax(estimated, fabs(preview->efunctions[j][i].y - fresh->efunctions[j][i].y));
+        }
+        cr_assert(estimated < 0.2 * stale);
+    }
+    // the next preview reuses the scratch of this one
+    long allocs = solver_alloc_count();
+    cr_assert(perturb_preview(previous, before, after, n, preview) == 1);
+    cr_assert(solver_alloc_count() == allocs);
+
+    // nothing to go on without eigenvectors
+    previous->z_columns = 0;
+    cr_assert(perturb_preview(previous, before, after, n, preview) == 0);
+
+    free_eigenpackage(preview);
+    free_eigenpackage(fresh);
+    free_eigenpackage(previous);
+    free(after);
+    free(before);
+    free(domain);
+}
+
+Test(solver_tests, observables_of_harmonic_states)
+{
+    int n = 400;
+    int k = 4;
+    double *domain = create_domain(0, 1, n);
+    Vector2 *potential = apply_potential(domain, n, &harmonic);
+    EigenPackage *epkg = init_eigenpackage(k, n, domain);
+    struct SolverPkg pkg = { .potential=potential, .n=n, .num_eigenfunctions=k, .epkg=epkg };
+    cr_assert(solve_spectrum(&pkg) != NULL);
+    cr_assert(epkg->num_observables == k);
+
+    // V = omega^2 (x - 1/2)^2 / 2 in the units of the Hamiltonian
+    double omega = sqrt(8 * POTENTIAL_SCALE);
+    for(int j = 0; j < k; j++)
+    {
+        const Observables *o = &epkg->observables[j];
+        cr_assert(within(o->p2 / 2 + o->v, epkg->evalues[j], 1e-9 * epkg->evalues[j]));
+        cr_assert(within(o->x, 0.5, 1e-6));
+        cr_assert(within(o->dx * o->dp, j + 0.5, 0.01 * (j + 0.5)));
+        cr_assert(within(o->dx, sqrt((j + 0.5) / omega), 0.01 * o->dx));
+
+        // dipoles against a sum down each pair of columns
+        for(int b = 0; b < k; b++)
+        {
+            double dot = 0, norm_j = 0, norm_b = 0;
+            for(int i = 0; i < n-1; i++)
+            {
+                dot += potential[i+1].x * epkg->z[i][j] * epkg->z[i][b];
+                norm_j += epkg->z[i][j] * epkg->z[i][j];
+                norm_b += epkg->z[i][b] * epkg->z[i][b];
+            }
+            cr_assert(within(epkg->dipoles[j*DIPOLE_STATES + b], dot / sqrt(norm_j * norm_b), 1e-12));
+        }
+    }
+    // parity selects neighbouring states, with <0|x|1> = 1/sqrt(2 omega)
+    cr_assert(within(fabs(epkg->dipoles[1]), 1 / sqrt(2 * omega), 0.01 / sqrt(2 * omega)));
+    cr_assert(fabs(epkg->dipoles[2]) < 1e-8);
+    cr_assert(within(epkg->dipoles[0], epkg->observables[0].x, 1e-12));
+
+    free_eigenpackage(epkg);
+    free(potential);
+    free(domain);
+}
+
+Test(thermal_tests, matches_sum_over_all_states)
+{
+    int n = 200;
+    int m = n-1;
+    double *domain = create_domain(0, 1, n);
+    Vector2 *potential = apply_potential(domain, n, &harmonic);
+    EigenPackage *epkg = init_eigenpackage(m, n, domain);
+    struct SolverPkg pkg = { .potential=potential, .n=n, .num_eigenfunctions=m, .epkg=epkg };
+    cr_assert(solve_spectrum(&pkg) != NULL);
+    ThermalDensity *thermal = init_thermal(n, domain);
+    double *weights = malloc(sizeof(double)*m);
+
+    double spacing = epkg->evalues[1] - epkg->evalues[0];
+    double temperatures[3] = { 3 * spacing, 0.5 * spacing, 0 };
+    for(int t = 0; t < 3; t++)
+    {
+        double kT = temperatures[t];
+        int used = thermal_update(thermal, potential, kT, THERMAL_TOLERANCE, NULL);
+        cr_assert(used == thermal->used && thermal->tail <= THERMAL_TOLERANCE);
+        // cooling down only reweights what the first temperature solved
+        if (t > 0)
+            cr_assert(used < thermal->solved);
+
+        double z = 0;
+        for(int j = 0; j < m; j++)
+        {
+            weights[j] = (kT > 0) ? exp(-(epkg->evalues[j] - epkg->evalues[0]) / kT) : (j == 0);
+            z += weights[j];
+        }
+        double peak = 0;
+        for(int i = 0; i <= n; i++)
+            peak = fmax(peak, epkg->efunctions[0][i].y);
+        for(int i = 0; i <= n; i++)
+        {
+            double rho = 0;
+            for(int j = 0; j < m; j++)
+                rho += weights[j] / z * epkg->efunctions[j][i].y;
+            cr_assert(within(thermal->rho[i].y, rho, 10 * THERMAL_TOLERANCE * peak));
+        }
+    }
+    int solved = thermal->solved;
+    cr_assert(thermal_update(thermal, potential, 0, THERMAL_TOLERANCE, NULL) == 1);
+    cr_assert(thermal->solved == solved);
+
+    free(weights);
+    free_thermal(thermal);
+    free_eigenpackage(epkg);
+    free(potential);
+    free(domain);
+}
+
+Test(thermal_tests, live_thermal_publishes_latest_request)
+{
+    int n = 200;
+    double *domain = create_domain(0, 1, n);
+    Vector2 *potential = apply_potential(domain, n, &harmonic);
+    double *evalues = malloc(sizeof(double)*(n-1));
+    cr_assert(solve_eigenvalues(potential, n, evalues, NULL) == 1);
+    double kT = 2 * (evalues[1] - evalues[0]);
+    ThermalDensity *expected = init_thermal(n, domain);
+
+    // a cancelled update leaves rho as it was and the next one starts over
+    SolveControl ctl;
+    init_solvecontrol(&ctl);
+    atomic_store(&ctl.cancel, 1);
+    cr_assert(thermal_update(expected, potential, kT, THERMAL_TOLERANCE, &ctl) == 0);
+    cr_assert(expected->kT == -1 && expected->rho[n/2].y == 0);
+
+    // the second request cancels or follows the first, and is what ends up in front
+    LiveThermal *live = init_livethermal(n, domain, THERMAL_TOLERANCE);
+    livethermal_request(live, potential, kT);
+    potential[n/3].y += 0.1;
+    livethermal_request(live, potential, kT);
+    livethermal_request(live, potential, kT);
+    while (livethermal_published(live) < 2)
+        usleep(1000);
+    cr_assert(live->requested == 2 && !livethermal_busy(live));
+    int used = thermal_update(expected, potential, kT, THERMAL_TOLERANCE, NULL);
+    cr_assert(live->used == used && live->kT == kT);
+    for(int i = 0; i <= n; i++)
+        cr_assert(live->front[i].y == expected->rho[i].y);
+
+    free_livethermal(live);
+    free_thermal(expected);
+    free(evalues);
+    free(potential);
+    free(domain);
+}
+
+// Double well with wells at 1/4 and 3/4, tilted so the right one is lower
+// for tilt < 0
+static void tilted_double_well(double *domain, int n, double tilt, Vector2 *potential)
+{
+    for(int i = 0; i <= n; i++)
+    {
+        double u = domain[i] - 0.5;
+        double well = 16 * u * u - 1;
+        potential[i] = (Vector2) { domain[i], well * well + tilt * u };
+    }
+}
+
+Test(continuation_tests, tracks_levels_through_a_crossing)
+{
+    int n = 400;
+    int k = 2;
+    double *domain = create_domain(0, 1, n);
+    Vector2 *potential = malloc(sizeof(Vector2)*(n+1));
+    EigenPackage *last = init_eigenpackage(k, n, domain);
+    EigenPackage *next = init_eigenpackage(k, n, domain);
+    EigenPackage *cold = init_eigenpackage(k, n, domain);
+    LevelTracker *tracker = init_tracker(n);
+
+    // The two lowest states sit one in each well, and swap order as the
+    // tilt goes through 0 between steps 10 and 11
+    int continued = 0;
+    for(int s = 0; s <= 21; s++)
+    {
+        double tilt = -0.105 + 0.01 * s;
+        tilted_double_well(domain, n, tilt, potential);
+        cr_assert(solve_spectrum_window(potential, n, 0, k, cold, NULL));
+        int status = (s > 0) ? solve_spectrum_continued(potential, n, 0, k, last, next, NULL) : -1;
+        if (status == 1)
+        {
+            continued++;
+            for(int j = 0; j < k; j++)
+            {
+                cr_assert(within(next->evalues[j], cold->evalues[j], 1e-8 * fabs(cold->evalues[j])));
+                for(int i = 0; i <= n; i++)
+                    cr_assert(within(next->efunctions[j][i].y, cold->efunctions[j][i].y, 1e-6 * n));
+            }
+        }
+        else
+        {
+            // only the crossing sends the predictors to each other's state
+            cr_assert(status == -1 && (s == 0 || s == 11));
+            solve_spectrum_window(potential, n, 0, k, next, NULL);
+        }
+        track_levels(tracker, next, tilt);
+        EigenPackage *tmp = last;
+        last = next;
+        next = tmp;
+    }
+    cr_assert(continued == 20);
+    cr_assert(tracker->steps == 22);
+
+    // The lower state now lies in the left well, and keeps the label the
+    // right one started out with
+    double left = 0;
+    for(int i = 0; i <= n / 2; i++)
+        left += last->efunctions[0][i].y / n;
+    cr_assert(left > 0.99);
+    cr_assert(tracker->labels[0] == 1 && tracker->labels[1] == 0);
+    int first = tracker_slot(tracker, 0);
+    cr_assert(tracker->history_labels[first*k] == 0 && tracker->history_labels[first*k + 1] == 1);
+    cr_assert(tracker->next_label == k);
+
+    free_tracker(tracker);
+    free_eigenpackage(cold);
+    free_eigenpackage(next);
+    free_eigenpackage(last);
+    free(potential);
+    free(domain);
+}
+
+Test(solver_tests, slicing_matches_bisection)
+{
+    int n = 400;
+    double *domain = create_domain(0, 1, n);
+    Vector2 *potential = apply_potential(domain, n, &harmonic);
+    double *d = malloc(sizeof(double)*(n-1));
+    double *e = malloc(sizeof(double)*(n-1));
+    double *expected = malloc(sizeof(double)*(n-1));
+    double *sliced = malloc(sizeof(double)*(n-1));
+    assemble_hamiltonian(potential, n, d, e);
+    bisect_eigenvalues(d, e, n-1, 0, n-2, expected);
+
+    // every thread count splits the range differently
+    for(int threads = 1; threads <= 4; threads++)
+    {
+        cr_assert(slice_eigenvalues(d, e, n-1, 0, n-2, sliced, threads, NULL, NULL) == 1);
+        for(int i = 0; i < n-1; i++)
+            cr_assert(within(sliced[i], expected[i], 1e-12 * fabs(expected[i])));
+    }
+    cr_assert(slice_eigenvalues(d, e, n-1, 150, 170, sliced, 0, NULL, NULL) == 1);
+    for(int i = 0; i <= 20; i++)
+        cr_assert(within(sliced[i], expected[150+i], 1e-12 * fabs(expected[150+i])));
+
+    free(sliced);
+    free(expected);
+    free(e);
+    free(d);
+    free(potential);
+    free(domain);
+}
+
+Test(solver_tests, mrrr_double_well)
+{
+    // tunnelling through a high barrier splits each level into a doublet
+    // far narrower than the gaps between levels
+    int n = 800;
+    int count = 12;
+    double *d = malloc(sizeof(double)*n);
+    double *e = malloc(sizeof(double)*n);
+    double *w = malloc(sizeof(double)*count);
+    double *expected = malloc(sizeof(double)*count);
+    double *vectors = malloc(sizeof(double)*n*count);
+    double dl = 1.0 / (n+1);
+    for(int i = 0; i < n; i++)
+    {
+        double x = (i+1) * dl;
+        d[i] = 1 / (dl*dl) + 2000 * ((fabs(x - 0.5) < 0.1) ? 50 : 0);
+        e[i] = -1 / (2*dl*dl);
+    }
+    bisect_eigenvalues(d, e, n, 0, count-1, expected);
+    cr_assert(expected[1] - expected[0] < 1e-8 * expected[0]);
+
+    for(int threads = 1; threads <= 2; threads++)
+    {
+        cr_assert(mrrr_eigenpairs(d, e, n, 0, count-1, w, vectors, threads, NULL, NULL) == 1);
+        for(int j = 0; j < count; j++)
+        {
+            double *x = vectors + j*n;
+            cr_assert(within(w[j], expected[j], 1e-10 * expected[j]));
+            double residual = 0;
+            for(int i = 0; i < n; i++)
+            {
+                double hx = d[i] * x[i] + ((i > 0) ? e[i-1] * x[i-1] : 0) + ((i < n-1) ? e[i] * x[i+1] : 0);
+                residual += (hx - w[j] * x[i]) * (hx - w[j] * x[i]);
+            }
+            cr_assert(sqrt(residual) < 1e-10 * (fabs(d[0]) + 2 * fabs(e[0])));
+            for(int k = 0; k <= j; k++)
+            {
+                double dot = 0;
+                for(int i = 0; i < n; i++)
+                    dot += x[i] * vectors[k*n + i];
+                cr_assert(within(dot, (k == j) ? 1.0 : 0.0, 1e-12));
+            }
+        }
+    }
+
+    free(vectors);
+    free(expected);
+    free(w);
+    free(e);
+    free(d);
+}
+
+Test(solver_tests, streamed_vectors)
+{
+    int n = 400;
+    int count = 40; // more than EXPORT_HISTORY, so old vectors get dropped
+    char dir[4096], path[4096 + 16];
+    make_test_dir(dir, sizeof(dir));
+    snprintf(path, sizeof(path), "%s/export.vec", dir);
+    double *domain = create_domain(0, 1, n);
+    Vector2 *potential = apply_potential(domain, n, &harmonic);
+    double *d = malloc(sizeof(double)*(n-1));
+    double *e = malloc(sizeof(double)*(n-1));
+    double *vectors = malloc(sizeof(double)*(n-1)*count);
+    double energy;
+    assemble_hamiltonian(potential, n, d, e);
+
+    cr_assert(export_eigenvectors(path, potential, n, 10, count, NULL) == count);
+    for(int j = 0; j < count; j++)
+    {
+        double *x = vectors + j*(n-1);
+        cr_assert(read_exported_vector(path, j, &energy, x) == 1);
+        double residual = 0;
+        for(int i = 0; i < n-1; i++)
+        {
+            double hx = d[i] * x[i] + ((i > 0) ? e[i-1] * x[i-1] : 0) + ((i < n-2) ? e[i] * x[i+1] : 0);
+            residual += (hx - energy * x[i]) * (hx - energy * x[i]);
+        }
+        cr_assert(sqrt(residual) < 1e-6 * energy);
+        for(int k = 0; k <= j; k++)
+        {
+            double dot = 0;
+            for(int i = 0; i < n-1; i++)
+                dot += x[i] * vectors[k*(n-1) + i];
+            cr_assert(within(dot, (k == j) ? 1.0 : 0.0, 1e-8));
+        }
+    }
+    cr_assert(read_exported_vector(path, count, &energy, vectors) == 0);
+
+    // a finished export is left alone, and one of other states refused
+    cr_assert(export_eigenvectors(path, potential, n, 10, count, NULL) == count);
+    cr_assert(export_eigenvectors(path, potential, n, 11, count, NULL) == -1);
+
+    // one that stopped before its header was written starts over
+    int fd = open(path, O_RDWR | O_TRUNC);
+    cr_assert(fd >= 0 && ftruncate(fd, 4096) == 0 && close(fd) == 0);
+    cr_assert(export_eigenvectors(path, potential, n, 10, count, NULL) == count);
+    cr_assert(read_exported_vector(path, 0, &energy, vectors) == 1 && energy > 0);
+
+    remove_test_dir(dir);
+    free(vectors);
+    free(e);
+    free(d);
+    free(potential);
+    free(domain);
+}
+
+Test(cache_tests, hit_and_eviction)
+{
+    int n = 30;
+    double *domain = create_domain(0, 1, n);
+    Vector2 *potential = apply_potential(domain, n, &harmonic);
+    EigenPackage *epkg = init_eigenpackage(2, n, domain);
+    EigenPackage *out = init_eigenpackage(2, n, domain);
+    struct SolverPkg pkg = { .potential=potential, .n=n, .num_eigenfunctions=2, .epkg=epkg };
+    solve_spectrum(&pkg);
+
+    // room for exactly one entry
+    SpectrumCache *cache = init_spectrumcache(2000);
+    uint64_t key = spectrum_key(potential, n, 2);
+    cr_assert(spectrumcache_get(cache, key, n, 2, out) == 0);
+    spectrumcache_put(cache, key, epkg);
+    cr_assert(spectrumcache_get(cache, key, n, 2, out) == 1);
+    cr_assert(out->evalues[0] == epkg->evalues[0]);
+    cr_assert(out->efunctions[1][n/2].y == epkg->efunctions[1][n/2].y);
+    cr_assert(out->num_observables == 2 && out->observables[1].p2 == epkg->observables[1].p2);
+
+    potential[5].y += 1.0;
+    uint64_t other = spectrum_key(potential, n, 2);
+    cr_assert(other != key);
+    spectrumcache_put(cache, other, epkg);
+    cr_assert(spectrumcache_get(cache, key, n, 2, out) == 0);
+    cr_assert(spectrumcache_get(cache, other, n, 2, out) == 1);
+    cr_assert(atomic_load(&cache->hits) == 2);
+    cr_assert(atomic_load(&cache->misses) == 2);
+
+    // a spectrum from another path is not served
+    solver_set_planner(&partial_planner);
+    cr_assert(spectrum_key(potential, n, 2) != other);
+    solver_set_planner(NULL);
+
+    free_spectrumcache(cache);
+    free_eigenpackage(out);
+    free_eigenpackage(epkg);
+    free(potential);
+    free(domain);
+}
+
+Test(store_tests, roundtrip_and_eviction)
+{
+    int n = 30;
+    double *domain = create_domain(0, 1, n);
+    Vector2 *potential = apply_potential(domain, n, &harmonic);
+    EigenPackage *epkg = init_eigenpackage(2, n, domain);
+    EigenPackage *out = init_eigenpackage(1, n, domain);
+    struct SolverPkg pkg = { .potential=potential, .n=n, .num_eigenfunctions=2, .epkg=epkg };
+    solve_spectrum(&pkg);
+
+    // room for exactly one file
+    char dir[4096], store_dir[4096 + 8], path[4096 + 64];
+    make_test_dir(dir, sizeof(dir));
+    snprintf(store_dir, sizeof(store_dir), "%s/store", dir);
+    SpectrumStore *store = open_spectrumstore(store_dir, 2000);
+    cr_assert(store != NULL);
+    uint64_t key = spectrum_key(potential, n, 2);
+    cr_assert(spectrumstore_put(store, key, epkg) == 1);
+    cr_assert(spectrumstore_get(store, key, n, 2, out) == 1);
+    cr_assert(out->num_efunctions == 2);
+    cr_assert(out->evalues[3] == epkg->evalues[3]);
+    cr_assert(out->z[4][1] == epkg->z[4][1]);
+
+    // a second entry pushes the first one out
+    potential[5].y += 1.0;
+    uint64_t other = spectrum_key(potential, n, 2);
+    cr_assert(spectrumstore_put(store, other, epkg) == 1);
+    cr_assert(spectrumstore_get(store, key, n, 2, out) == 0);
+    cr_assert(spectrumstore_get(store, other, n, 2, out) == 1);
+
+    // eviction compacted the index to the one file left, and the hit since
+    // is only remembered until the store is closed
+    snprintf(path, sizeof(path), "%s/index", store_dir);
+    FILE *index = fopen(path, "r");
+    int lines = 0;
+    for(int c; (c = fgetc(index)) != EOF;)
+        lines += c == '\n';
+    fclose(index);
+    cr_assert(lines == 1);
+    close_spectrumstore(store);
+
+    // temporaries of crashed writers are swept on open
+    snprintf(path, sizeof(path), "%s/0000000000000000.tmp.1.0", store_dir);
+    FILE *stale = fopen(path, "w");
+    fclose(stale);
+    time_t old = time(NULL) - 2*STORE_TMP_AGE;
+    utime(path, &(struct utimbuf) { old, old });
+    store = open_spectrumstore(store_dir, 2000);
+    cr_assert(access(path, F_OK) != 0);
+    close_spectrumstore(store);
+    remove_test_dir(dir);
+    free_eigenpackage(out);
+    free_eigenpackage(epkg);
+    free(potential);
+    free(domain);
+}
+
+Test(expr_tests, evaluate_and_params)
+{
+    char err[128];
+    Expr *expr = expr_compile("a*(x-0.5)^2 + if(x < 0.3, 0.5, 0) ; a = 4", err, sizeof(err));
+    cr_assert(expr != NULL);
+    cr_assert(expr_num_params(expr) == 1);
+    cr_assert(within(expr_get_param(expr, 0), 4.0, 1e-12));
+
+    double x[600];
+    double out[600];
+    for(int i = 0; i < 600; i++)
+        x[i] = i / 599.0;
+    expr_eval(expr, x, out, 600);
+    for(int i = 0; i < 600; i++)
+        cr_assert(within(out[i], 4*(x[i]-0.5)*(x[i]-0.5) + (x[i] < 0.3 ? 0.5 : 0), 1e-12));
+
+    expr_set_param(expr, expr_find_param(expr, "a"), 1.0);
+    expr_eval(expr, x, out, 600);
+    cr_assert(within(out[599], 0.25, 1e-12));
+    expr_free(expr);
+
+    expr = expr_compile("-2^2 + max(sin(pi/2), 0)", err, sizeof(err));
+    cr_assert(expr != NULL);
+    expr_eval(expr, x, out, 1);
+    cr_assert(within(out[0], -3.0, 1e-12));
+    expr_free(expr);
+
+    cr_assert(expr_compile("exp(x", err, sizeof(err)) == NULL);
+    cr_assert(expr_compile("foo(x)", err, sizeof(err)) == NULL);
+}
+
+Test(potential_tests, batch_matches_scalar)
+{
+    const char *names[] = {"constant", "linear", "quadratic", "step", "gaussian", "sinusodial"};
+    int n = 700;
+    double *domain = create_domain(0, 1, n);
+    for(int p = 0; p < 6; p++)
+    {
+        PotentialFn f = find_potential(names[p]);
+        Vector2 *points = apply_potential_batch(domain, n, find_potential_batch(names[p]), NULL);
+        for(int i = 0; i <= n; i++)
+        {
+            double expected = f(domain[i]);
+            cr_assert(points[i].x == (float) domain[i]);
+            // points are stored as floats
+            cr_assert(within(points[i].y, expected, 1e-6 * (1 + fabs(expected))));
+        }
+        free(points);
+    }
+    free(domain);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+Test(lanczos2d_tests, separable_and_warm_start)
+{
+    int n = 40, k = 6;
+    double *grid = malloc(sizeof(double)*(n+1)*(n+1));
+    fill_potential2d(n, &quadratic_batch, NULL, grid);
+
+    // States of V(x) + V(y) pair up states of V(x)
+    double *domain = create_domain(0, 1, n);
+    Vector2 *line = apply_potential_batch(domain, n, &quadratic_batch, NULL);
+    double *e1 = malloc(sizeof(double)*(n-1));
+    solve_eigenvalues(line, n, e1, NULL);
+    double sums[36];
+    for(int i = 0; i < k; i++)
+        for(int j = 0; j < k; j++)
+            sums[i*k + j] = e1[i] + e1[j];
+    qsort(sums, k*k, sizeof(double), compare_doubles);
+
+    Spectrum2D *spec = init_spectrum2d(n, k);
+    cr_assert(solve_spectrum2d(grid, spec, NULL));
+    for(int i = 0; i < k; i++)
+        cr_assert(within(spec->evalues[i], sums[i], 1e-6 * sums[i]));
+
+    // A warm start after an edit lands on the same states as a cold solve
+    for(int i = 0; i <= n; i++)
+        for(int j = 0; j <= n; j++)
+            grid[i*(n+1) + j] += 0.05 * exp(-(pow(j/(double) n - 0.6, 2) + pow(i/(double) n - 0.4, 2)) / 0.01);
+    cr_assert(solve_spectrum2d(grid, spec, NULL));
+    Spectrum2D *cold = init_spectrum2d(n, k);
+    cr_assert(solve_spectrum2d(grid, cold, NULL));
+    for(int i = 0; i < k; i++)
+        cr_assert(within(spec->evalues[i], cold->evalues[i], 1e-6 * cold->evalues[i]));
+
+    free_spectrum2d(cold);
+    free_spectrum2d(spec);
+    free(e1);
+    free(line);
+    free(domain);
+    free(grid);
+}
+
+Test(lanczos2d_tests, coarse_seeded)
+{
+    // Fine enough to be seeded from a coarser grid, and tall enough that the
+    // Weyl bound leaves no room for a filter until a pass tightens it
+    int n = 128, k = 6;
+    double *grid = malloc(sizeof(double)*(n+1)*(n+1));
+    fill_potential2d(n, &gaussian_batch, NULL, grid);
+
+    double *domain = create_domain(0, 1, n);
+    Vector2 *line = apply_potential_batch(domain, n, &gaussian_batch, NULL);
+    double *e1 = malloc(sizeof(double)*(n-1));
+    solve_eigenvalues(line, n, e1, NULL);
+    double sums[36];
+    for(int i = 0; i < k; i++)
+        for(int j = 0; j < k; j++)
+            sums[i*k + j] = e1[i] + e1[j];
+    qsort(sums, k*k, sizeof(double), compare_doubles);
+
+    Spectrum2D *spec = init_spectrum2d(n, k);
+    cr_assert(solve_spectrum2d(grid, spec, NULL));
+    for(int i = 0; i < k; i++)
+        cr_assert(within(spec->evalues[i], sums[i], 1e-6 * sums[i]));
+
+    free_spectrum2d(spec);
+    free(e1);
+    free(line);
+    free(domain);
+    free(grid);
+}
+
+Test(scatter_tests, free_particle_and_flux)
+{
+    int n = 500;
+    int count = 1000;
+    double *domain = create_domain(0, 1, n);
+    Vector2 *flat = apply_potential(domain, n, &constant);
+    Vector2 *barrier = apply_potential(domain, n, &gaussian);
+    double *energies = malloc(sizeof(double)*count);
+    double *t = malloc(sizeof(double)*count);
+    double *r = malloc(sizeof(double)*count);
+    double *threaded = malloc(sizeof(double)*count);
+    for(int i = 0; i < count; i++)
+        energies[i] = 400.0 * (i + 1);
+
+    // nothing to scatter off
+    transmission_sweep(flat, n, energies, count, t, r, 1, NULL);
+    for(int i = 0; i < count; i++)
+        cr_assert(within(t[i], 1.0, 1e-12) && r[i] < 1e-12);
+
+    // current is conserved, tunneling is tiny and the barrier (peak 200000)
+    // is transparent well above it
+    transmission_sweep(barrier, n, energies, count, t, r, 1, NULL);
+    for(int i = 0; i < count; i++)
+        cr_assert(within(t[i] + r[i], 1.0, 1e-10));
+    cr_assert(t[9] < 1e-35);
+    cr_assert(t[count-1] > 0.999);
+
+    transmission_sweep(barrier, n, energies, count, threaded, NULL, 3, NULL);
+    for(int i = 0; i < count; i++)
+        cr_assert(threaded[i] == t[i]);
+
+    free(threaded);
+    free(r);
+    free(t);
+    free(energies);
+    free(barrier);
+    free(flat);
+    free(domain);
+}
+
+Test(telemetry_tests, percentiles_and_export)
+{
+    telemetry_reset();
+    cr_assert(telemetry_percentile(METRIC_LATENCY, 0.5) == 0);
+
+    // 1 us .. 10 ms in steps of 1 us
+    for(int i = 1; i <= 10000; i++)
+        telemetry_record(METRIC_LATENCY, i * 1e-6);
+    cr_assert(telemetry_count(METRIC_LATENCY) == 10000);
+    cr_assert(within(telemetry_percentile(METRIC_LATENCY, 0.5), 5e-3, 0.01 * 5e-3));
+    cr_assert(within(telemetry_percentile(METRIC_LATENCY, 0.99), 9.9e-3, 0.01 * 9.9e-3));
+    cr_assert(within(telemetry_percentile(METRIC_LATENCY, 1.0), 1e-2, 0.01 * 1e-2));
+    // exact at the bottom of the range
+    telemetry_record(METRIC_FRAME, 100e-9);
+    cr_assert(within(telemetry_percentile(METRIC_FRAME, 0.5), 100e-9, 1e-12));
+
+    char dir[4096], path[4096 + 32];
+    make_test_dir(dir, sizeof(dir));
+    snprintf(path, sizeof(path), "%s/telemetry", dir);
+    cr_assert(telemetry_dump(path) == 1);
+    strcat(path, ".prom");
+    FILE *prom = fopen(path, "r");
+    cr_assert(prom != NULL);
+    char line[256];
+    int found = 0;
+    while (fgets(line, sizeof(line), prom) != NULL)
+        found += strcmp(line, "schrodinger_latency_seconds_count 10000\n") == 0;
+    fclose(prom);
+    remove_test_dir(dir);
+    cr_assert(found == 1);
+
+    telemetry_reset();
+    cr_assert(telemetry_count(METRIC_LATENCY) == 0);
+}
+
+Test(perf_tests, stages_with_or_without_counters)
+{
+    int n = 60;
+    double *domain = create_domain(0, 1, n);
+    Vector2 *potential = apply_potential(domain, n, &harmonic);
+    EigenPackage *epkg = init_eigenpackage(3, n, domain);
+    PerfProfile *profile = init_perfprofile();
+    struct SolverPkg pkg = { .potential=potential, .n=n, .num_eigenfunctions=3, .epkg=epkg, .profile=profile };
+
+    solve_spectrum(&pkg);
+    solve_spectrum(&pkg);
+    for(int s = STAGE_ASSEMBLE; s <= STAGE_OBSERVABLES; s++)
+    {
+        cr_assert(profile->runs[s] == 2);
+        cr_assert(profile->seconds[s] >= 0);
+    }
+    cr_assert(profile->runs[STAGE_EIGENVALUES] == 0);
+    cr_assert(profile->seconds[STAGE_TQLI] > 0);
+    // the QL iterations retire instructions whenever they can be counted
+    if (perf_available(profile, PERF_INSTRUCTIONS))
+        cr_assert(profile->counts[STAGE_TQLI][PERF_INSTRUCTIONS] > 0);
+
+    // profiling doesn't change the result
+    double ground = epkg->evalues[0];
+    pkg.profile = NULL;
+    solve_spectrum(&pkg);
+    cr_assert(epkg->evalues[0] == ground);
+
+    free_perfprofile(profile);
+    free_eigenpackage(epkg);
+    free(potential);
+    free(domain);
+}
+
+Test(solver_tests, backends_agree)
+{
+    int n = 200;
+    double *domain = create_domain(0, 1, n);
+    Vector2 *potential = apply_potential(domain, n, &harmonic);
+    EigenPackage *reference = init_eigenpackage(4, n, domain);
+    struct SolverPkg pkg = { .potential=potential, .n=n, .num_eigenfunctions=4, .epkg=reference };
+    cr_assert(solver_backend() == &tqli_backend);
+    solve_spectrum(&pkg);
+    cr_assert(solver_select_backend("no such backend") == 0);
+
+    EigenPackage *epkg = init_eigenpackage(4, n, domain);
+    double *evalues = malloc(sizeof(double)*(n-1));
+    for(int b = 0; solver_backends[b] != NULL; b++)
+    {
+        cr_assert(solver_select_backend(solver_backends[b]->name) == 1);
+        pkg.epkg = epkg;
+        cr_assert(solve_spectrum(&pkg) != NULL);
+        cr_assert(solve_eigenvalues(potential, n, evalues, NULL) == 1);
+        for(int i = 0; i < n-1; i++)
+        {
+            double tol = 1e-9 * fabs(reference->evalues[i]);
+            cr_assert(within(epkg->evalues[i], reference->evalues[i], tol));
+            cr_assert(within(evalues[i], reference->evalues[i], tol));
+        }
+        // densities don't depend on the sign of the vectors
+        for(int j = 0; j < 4; j++)
+            for(int i = 0; i <= n; i++)
+                cr_assert(within(epkg->efunctions[j][i].y, reference->efunctions[j][i].y, 1e-6));
+
+        cr_assert(solve_spectrum_window(potential, n, 10, 3, epkg, NULL) == 1);
+        for(int j = 0; j < 3; j++)
+            cr_assert(within(epkg->evalues[j], reference->evalues[10+j], 1e-9 * reference->evalues[10+j]));
+    }
+    solver_select_backend("tqli");
+
+    free(evalues);
+    free_eigenpackage(epkg);
+    free_eigenpackage(reference);
+    free(potential);
+    free(domain);
+}
+
+Test(autotune_tests, predictions_and_profile_file)
+{
+    // a full solve going as n^3 and a partial one as n^2 plus n per vector
+    // and every other backend slower, so that the file covers them all
+    TuneProfile profile = { .cpus = (int) sysconf(_SC_NPROCESSORS_ONLN), .num_full = 0, .num_partial = 1 };
+    profile.partial[0].backend = &tqli_backend;
+    profile.partial[0].threads = 1;
+    for(int b = 0; solver_backends[b] != NULL; b++)
+    {
+        profile.full[b].backend = solver_backends[b];
+        for(int s = 0; s < TUNE_SIZES; s++)
+            profile.full[b].seconds[s] = (b+1) * 1e-10 * pow(tune_sizes[s], 3);
+        profile.num_full++;
+    }
+    for(int s = 0; s < TUNE_SIZES; s++)
+    {
+        double n = tune_sizes[s];
+        profile.partial[0].values[s] = 1e-8 * n*n;
+        profile.partial[0].vector[s] = 1e-8 * n;
+        profile.update[s] = 1e-11 * n*n*n;
+    }
+
+    SolvePlan plan;
+    double t = autotune_predict(&profile, 10000, 10, &plan);
+    cr_assert(plan.partial == 1 && plan.threads == 1);
+    cr_assert(within(t, 1e-8 * (1e8 + 1e5), 1e-3 * t));
+    cr_assert(plan.seconds == t && within(plan.full_seconds, 1e-10 * 1e12, 1e-3 * plan.full_seconds));
+    cr_assert(within(plan.update_seconds, 1e-11 * 1e12, 1e-3 * plan.update_seconds));
+    // nearly every vector is cheaper in one go
+    autotune_predict(&profile, 100, 98, &plan);
+    cr_assert(plan.partial == 0 && plan.backend == &tqli_backend);
+
+    char dir[4096], path[4096 + 16];
+    make_test_dir(dir, sizeof(dir));
+    snprintf(path, sizeof(path), "%s/autotune", dir);
+    cr_assert(autotune_save(&profile, path) == 1);
+    TuneProfile *loaded = autotune_load(path);
+    remove_test_dir(dir);
+    cr_assert(loaded != NULL);
+    cr_assert(loaded->num_partial == 1 && loaded->partial[0].threads == 1);
+    cr_assert(within(loaded->full[0].seconds[TUNE_SIZES-1], profile.full[0].seconds[TUNE_SIZES-1], 1e-6));
+    cr_assert(within(loaded->update[0], profile.update[0], 1e-6 * profile.update[0]));
+
+    // solves follow the installed profile and still give every eigenvalue
+    int n = 120;
+    double *domain = create_domain(0, 1, n);
+    Vector2 *potential = apply_potential(domain, n, &harmonic);
+    EigenPackage *full = init_eigenpackage(3, n, domain);
+    EigenPackage *partial = init_eigenpackage(3, n, domain);
+    struct SolverPkg pkg = { .potential=potential, .n=n, .num_eigenfunctions=3, .epkg=full };
+    solve_spectrum(&pkg);
+    autotune_install(loaded);
+    pkg.epkg = partial;
+    solve_spectrum(&pkg);
+    autotune_install(NULL);
+    cr_assert(partial->z_columns == 3 && full->z_columns == n-1);
+    for(int i = 0; i < n-1; i++)
+        cr_assert(within(partial->evalues[i], full->evalues[i], 1e-9 * full->evalues[i]));
+    for(int j = 0; j < 3; j++)
+        for(int i = 0; i <= n; i++)
+            cr_assert(within(partial->efunctions[j][i].y, full->efunctions[j][i].y, 1e-6));
+
+    free_eigenpackage(partial);
+    free_eigenpackage(full);
+    free(potential);
+    free(domain);
+    free(loaded);
+}